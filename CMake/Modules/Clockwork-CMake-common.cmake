@@ -110,6 +110,7 @@ if (CMAKE_PROJECT_NAME STREQUAL Clockwork)
     option (CLOCKWORK_DATABASE_SQLITE "Enable Database support with SQLite embedded" FALSE)
     cmake_dependent_option (CLOCKWORK_MINIDUMPS "Enable minidumps on crash (VS only)" TRUE "MSVC" FALSE)
     option (CLOCKWORK_FILEWATCHER "Enable filewatcher support" TRUE)
+    cmake_dependent_option (CLOCKWORK_IO_URING "Enable io_uring backend for asynchronous file reads (Linux only)" TRUE "CMAKE_SYSTEM_NAME STREQUAL Linux AND NOT ANDROID AND NOT RPI" FALSE)
     if (CPACK_SYSTEM_NAME STREQUAL Linux)
         cmake_dependent_option (CLOCKWORK_USE_LIB64_RPM "Enable 64-bit RPM CPack generator using /usr/lib64 and disable all other generators (Debian-based host only)" FALSE "CLOCKWORK_64BIT AND NOT HAS_LIB64" FALSE)
         cmake_dependent_option (CLOCKWORK_USE_LIB_DEB "Enable 64-bit DEB CPack generator using /usr/lib and disable all other generators (Redhat-based host only)" FALSE "CLOCKWORK_64BIT AND HAS_LIB64" FALSE)
@@ -285,6 +286,17 @@ if (CLOCKWORK_FILEWATCHER)
     add_definitions (-DCLOCKWORK_FILEWATCHER)
 endif ()
 
+# Enable io_uring backend for asynchronous file reads when the kernel headers provide it, otherwise fall back to I/O threads only.
+if (CLOCKWORK_IO_URING)
+    include (CheckIncludeFiles)
+    check_include_files (linux/io_uring.h HAVE_LINUX_IO_URING_H)
+    if (HAVE_LINUX_IO_URING_H)
+        add_definitions (-DCLOCKWORK_IO_URING)
+    else ()
+        message (STATUS "linux/io_uring.h not found, asynchronous file reads will use I/O threads")
+    endif ()
+endif ()
+
 # Enable profiling by default. If disabled, autoprofileblocks become no-ops and the Profiler subsystem is not instantiated.
 if (CLOCKWORK_PROFILING)
     add_definitions (-DCLOCKWORK_PROFILING)
@@ -67,6 +67,7 @@ class AnimatedModel
 AnimationState AddAnimationState(Animation);
 void ApplyAttributes();
 void ApplyMaterialList(const String& = String ( ));
+Node CreateBoneNode(const String&);
 void DrawDebugGeometry(DebugRenderer, bool);
 AnimationState GetAnimationState(Animation) const;
 AnimationState GetAnimationState(uint) const;
@@ -114,6 +115,8 @@ Array<AttributeInfo> attributeInfos;
 Array<Variant> attributes;
 /* readonly */
 StringHash baseType;
+float boneLodDistance;
+bool boneNodesEnabled;
 /* readonly */
 BoundingBox boundingBox;
 bool castShadows;
@@ -150,6 +153,7 @@ uint numMorphs;
 ObjectAnimation objectAnimation;
 bool occludee;
 bool occluder;
+bool poseSharing;
 /* readonly */
 int refs;
 float shadowDistance;
@@ -272,6 +276,8 @@ class Animation
 {
 // Methods:
 void AddTrigger(float, bool, const Variant&);
+bool Compress(float = 0.0005f, float = 0.0005f, float = 0.0005f);
+void Decompress();
 bool Load(File);
 bool Load(VectorBuffer&);
 void RemoveAllTriggers();
@@ -288,6 +294,8 @@ StringHash baseType;
 /* readonly */
 String category;
 /* readonly */
+bool compressed;
+/* readonly */
 float length;
 /* readonly */
 uint memoryUse;
@@ -662,6 +670,7 @@ bool relative;
 bool scaled;
 float shadowDistance;
 uint shadowMask;
+float sortThreshold;
 bool sorted;
 bool temporary;
 /* readonly */
@@ -3699,6 +3708,7 @@ bool Load(File, bool = false);
 bool Load(VectorBuffer&, bool = false);
 bool LoadXML(const XMLElement&, bool = false);
 void MarkNetworkUpdate() const;
+bool QueueDecal(Drawable, const Vector3&, const Quaternion&, float, float, float, const Vector2&, const Vector2&, float = 0.0, float = 0.1, uint = 0xffffffff);
 void Remove();
 void RemoveAllDecals();
 void RemoveDecals(uint);
@@ -3751,6 +3761,8 @@ uint numDecals;
 /* readonly */
 uint numIndices;
 /* readonly */
+uint numQueuedDecals;
+/* readonly */
 uint numVertices;
 ObjectAnimation objectAnimation;
 bool occludee;
@@ -4882,7 +4894,6 @@ String name;
 uint numCompressedLevels;
 /* readonly */
 int refs;
-/* readonly */
 bool sRGB;
 /* readonly */
 StringHash type;
@@ -4896,6 +4907,40 @@ int weakRefs;
 int width;
 };
 
+class Impostor
+{
+// Methods:
+Geometry GetFrameGeometry(const Vector3&) const;
+bool Load(File);
+bool Load(VectorBuffer&);
+bool Save(File) const;
+bool Save(VectorBuffer&) const;
+void SendEvent(const String&, VariantMap& = VariantMap ( ));
+
+// Properties:
+/* readonly */
+StringHash baseType;
+/* readonly */
+String category;
+Vector3 center;
+Material material;
+/* readonly */
+uint memoryUse;
+String name;
+uint numFrames;
+/* readonly */
+int refs;
+float size;
+/* readonly */
+StringHash type;
+/* readonly */
+String typeName;
+/* readonly */
+uint useTimer;
+/* readonly */
+int weakRefs;
+};
+
 class IndexBuffer
 {
 // Methods:
@@ -7150,6 +7195,7 @@ bool scaled;
 bool serializeParticles;
 float shadowDistance;
 uint shadowMask;
+float sortThreshold;
 bool sorted;
 bool temporary;
 /* readonly */
@@ -7726,6 +7772,7 @@ void SendEvent(const String&, VariantMap& = VariantMap ( ));
 void SetDefaultRenderPath(XMLFile);
 
 // Properties:
+float animationBudget;
 /* readonly */
 StringHash baseType;
 /* readonly */
@@ -7756,6 +7803,8 @@ Array<uint> numGeometries;
 /* readonly */
 Array<uint> numLights;
 /* readonly */
+Array<uint> numOccludedDrawables;
+/* readonly */
 Array<uint> numOccluders;
 /* readonly */
 uint numPrimitives;
@@ -7772,6 +7821,7 @@ bool reuseShadowMaps;
 int shadowMapSize;
 int shadowQuality;
 bool specularLighting;
+bool temporalOcclusion;
 int textureAnisotropy;
 TextureFilterMode textureFilterMode;
 int textureQuality;
@@ -7842,6 +7892,7 @@ void RemoveResourceDir(const String&);
 String SanitateResourceDirName(const String&) const;
 String SanitateResourceName(const String&) const;
 void SendEvent(const String&, VariantMap& = VariantMap ( ));
+void SetMaxResidentMip(Resource, uint);
 
 // Properties:
 bool autoReloadResources;
@@ -7849,6 +7900,7 @@ bool autoReloadResources;
 StringHash baseType;
 /* readonly */
 String category;
+String cookedResourceDir;
 int finishBackgroundResourcesMs;
 Array<uint> memoryBudget;
 /* readonly */
@@ -7856,6 +7908,8 @@ Array<uint> memoryUse;
 /* readonly */
 uint numBackgroundLoadResources;
 /* readonly */
+uint numStreamingResources;
+/* readonly */
 Array<PackageFile> packageFiles;
 /* readonly */
 int refs;
@@ -7866,6 +7920,7 @@ bool returnFailedResources;
 bool seachPackagesFirst;
 /* writeonly */
 bool searchPackagesFirst;
+uint streamingBudget;
 /* readonly */
 uint totalMemoryUse;
 /* readonly */
@@ -9886,6 +9941,10 @@ bool enabled;
 bool enabledEffective;
 /* readonly */
 uint id;
+Impostor impostor;
+/* readonly */
+bool impostorActive;
+float impostorDistance;
 /* readonly */
 bool inView;
 uint lightMask;
@@ -9969,6 +10028,7 @@ BoundingBox boundingBox;
 bool castShadows;
 /* readonly */
 String category;
+float clusterSize;
 float drawDistance;
 bool enabled;
 /* readonly */
@@ -9991,6 +10051,8 @@ Node node;
 /* readonly */
 uint numAttributes;
 /* readonly */
+uint numClusters;
+/* readonly */
 uint numGeometries;
 /* readonly */
 uint numInstanceNodes;
@@ -10290,8 +10352,14 @@ Node node;
 /* readonly */
 uint numAttributes;
 /* readonly */
+uint numLoadedTiles;
+/* readonly */
 IntVector2 numPatches;
 /* readonly */
+IntVector2 numTiles;
+/* readonly */
+uint numTreeLevels;
+/* readonly */
 IntVector2 numVertices;
 ObjectAnimation objectAnimation;
 bool occludee;
@@ -10300,14 +10368,22 @@ uint occlusionLodLevel;
 int patchSize;
 /* readonly */
 Array<TerrainPatch> patches;
+bool quadtree;
 /* readonly */
 int refs;
 float shadowDistance;
 uint shadowMask;
 bool smoothing;
 Vector3 spacing;
+uint streamingBudget;
+float streamingDistance;
+/* readonly */
+uint streamingMemoryUse;
 bool temporary;
 /* readonly */
+int tileSize;
+XMLFile tiledHeightMap;
+/* readonly */
 StringHash type;
 /* readonly */
 String typeName;
@@ -11081,7 +11157,6 @@ bool GetInterceptNetworkUpdate(const String&) const;
 TileMapObject2D GetObject(uint) const;
 Node GetObjectNode(uint) const;
 Tile2D GetTile(int, int) const;
-Node GetTileNode(int, int) const;
 bool HasProperty(const String&) const;
 bool Load(File, bool = false);
 bool Load(VectorBuffer&, bool = false);
@@ -11099,6 +11174,7 @@ void SetAttributeAnimation(const String&, ValueAnimation, WrapMode = WM_LOOP, fl
 void SetAttributeAnimationSpeed(const String&, float);
 void SetAttributeAnimationWrapMode(const String&, WrapMode);
 void SetInterceptNetworkUpdate(const String&, bool);
+void SetTile(int, int, Tile2D);
 const String& GetProperty(const String&) const;
 
 // Properties:
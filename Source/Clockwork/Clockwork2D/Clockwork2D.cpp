@@ -49,6 +49,7 @@
 #include "../Clockwork2D/Sprite2D.h"
 #include "../Clockwork2D/SpriteSheet2D.h"
 #include "../Clockwork2D/TileMap2D.h"
+#include "../Clockwork2D/TileMapChunk2D.h"
 #include "../Clockwork2D/TileMapLayer2D.h"
 #include "../Clockwork2D/TmxFile2D.h"
 
@@ -79,6 +80,7 @@ void RegisterClockwork2DLibrary(Context* context)
     TmxFile2D::RegisterObject(context);
     TileMap2D::RegisterObject(context);
     TileMapLayer2D::RegisterObject(context);
+    TileMapChunk2D::RegisterObject(context);
 
     PhysicsWorld2D::RegisterObject(context);
     RigidBody2D::RegisterObject(context);
@@ -37,6 +37,9 @@ namespace Clockwork
 
 const float PIXEL_SIZE = 0.01f;
 
+/// Next source batch vertex version. Shared by all drawables, so that a new drawable can not repeat an old one's version.
+static unsigned nextSourceBatchesVersion = 1;
+
 SourceBatch2D::SourceBatch2D() :
     drawOrder_(0)
 {
@@ -46,6 +49,7 @@ Drawable2D::Drawable2D(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY2D),
     layer_(0),
     orderInLayer_(0),
+    sourceBatchesVersion_(0),
     sourceBatchesDirty_(true)
 {
 }
@@ -98,7 +102,10 @@ void Drawable2D::SetOrderInLayer(int orderInLayer)
 const Vector<SourceBatch2D>& Drawable2D::GetSourceBatches()
 {
     if (sourceBatchesDirty_)
+    {
         UpdateSourceBatches();
+        sourceBatchesVersion_ = nextSourceBatchesVersion++;
+    }
 
     return sourceBatches_;
 }
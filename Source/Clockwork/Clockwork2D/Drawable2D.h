@@ -89,6 +89,8 @@ public:
 
     /// Return all source batches (called by Renderer2D).
     const Vector<SourceBatch2D>& GetSourceBatches();
+    /// Return source batch vertex version. Changes whenever the source batches have been updated (called by Renderer2D).
+    unsigned GetSourceBatchesVersion() const { return sourceBatchesVersion_; }
 
 protected:
     /// Handle scene being assigned.
@@ -109,6 +111,8 @@ protected:
     int orderInLayer_;
     /// Source batches.
     Vector<SourceBatch2D> sourceBatches_;
+    /// Source batch vertex version.
+    unsigned sourceBatchesVersion_;
     /// Source batches dirty flag.
     bool sourceBatchesDirty_;
     /// Renderer2D.
@@ -23,6 +23,7 @@
 #include "../Precompiled.h"
 
 #include "../Core/Context.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/Camera.h"
 #include "../Graphics/Material.h"
 #include "../Resource/ResourceCache.h"
@@ -33,6 +34,10 @@
 #include "../Clockwork2D/Renderer2D.h"
 #include "../Clockwork2D/Sprite2D.h"
 
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 namespace Clockwork
@@ -41,16 +46,141 @@ namespace Clockwork
 extern const char* CLOCKWORK2D_CATEGORY;
 extern const char* blendModeNames[];
 
+/// Minimum number of particles per work item when updating a large emitter in worker threads.
+static const unsigned PARTICLES_PER_WORK_ITEM = 16384;
+
+/// 2D particle attribute streams.
+enum Particle2DStream
+{
+    P2D_TIME_TO_LIVE = 0,
+    P2D_TIME_STEP,
+    P2D_POSITION_X,
+    P2D_POSITION_Y,
+    P2D_SIZE,
+    P2D_SIZE_DELTA,
+    P2D_ROTATION,
+    P2D_ROTATION_DELTA,
+    P2D_COLOR_R,
+    P2D_COLOR_G,
+    P2D_COLOR_B,
+    P2D_COLOR_A,
+    P2D_COLOR_DELTA_R,
+    P2D_COLOR_DELTA_G,
+    P2D_COLOR_DELTA_B,
+    P2D_COLOR_DELTA_A,
+    P2D_START_POS_X,
+    P2D_START_POS_Y,
+    P2D_VELOCITY_X,
+    P2D_VELOCITY_Y,
+    P2D_RADIAL_ACCELERATION,
+    P2D_TANGENTIAL_ACCELERATION,
+    P2D_EMIT_RADIUS,
+    P2D_EMIT_RADIUS_DELTA,
+    P2D_EMIT_ROTATION,
+    P2D_EMIT_ROTATION_DELTA,
+    NUM_PARTICLE2D_STREAMS
+};
+
+/// Particle range updated by a work item.
+struct ParticleRange2D
+{
+    /// Emitter.
+    ParticleEmitter2D* emitter_;
+    /// Start index.
+    unsigned start_;
+    /// End index.
+    unsigned end_;
+    /// World scale.
+    float worldScale_;
+    /// Bounding rectangle min point.
+    Vector2 boundsMin_;
+    /// Bounding rectangle max point.
+    Vector2 boundsMax_;
+};
+
+void UpdateParticles2DWork(const WorkItem* item, unsigned threadIndex)
+{
+    ParticleRange2D* range = reinterpret_cast<ParticleRange2D*>(item->start_);
+    range->emitter_->UpdateParticles(range->start_, range->end_, range->worldScale_, range->boundsMin_, range->boundsMax_);
+}
+
+/// Accelerate gravity emitter particles towards or around their start positions and move them.
+static void UpdateGravityParticles(float* positionX, float* positionY, float* velocityX, float* velocityY, const float* startX,
+    const float* startY, const float* radialAcceleration, const float* tangentialAcceleration, const float* timeSteps,
+    float gravityX, float gravityY, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    __m128 minDistance = _mm_set1_ps(0.0001f);
+    __m128 gX = _mm_set1_ps(gravityX);
+    __m128 gY = _mm_set1_ps(gravityY);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 posX = _mm_loadu_ps(&positionX[i]);
+        __m128 posY = _mm_loadu_ps(&positionY[i]);
+        __m128 velX = _mm_loadu_ps(&velocityX[i]);
+        __m128 velY = _mm_loadu_ps(&velocityY[i]);
+        __m128 timeStep = _mm_loadu_ps(&timeSteps[i]);
+        __m128 radial = _mm_loadu_ps(&radialAcceleration[i]);
+        __m128 tangential = _mm_loadu_ps(&tangentialAcceleration[i]);
+
+        __m128 distanceX = _mm_sub_ps(posX, _mm_loadu_ps(&startX[i]));
+        __m128 distanceY = _mm_sub_ps(posY, _mm_loadu_ps(&startY[i]));
+        __m128 distance = _mm_max_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(distanceX, distanceX), _mm_mul_ps(distanceY,
+            distanceY))), minDistance);
+        __m128 dirX = _mm_div_ps(distanceX, distance);
+        __m128 dirY = _mm_div_ps(distanceY, distance);
+
+        __m128 tangentialX = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(dirY, tangential));
+        __m128 tangentialY = _mm_mul_ps(dirX, tangential);
+        __m128 radialX = _mm_mul_ps(dirX, radial);
+        __m128 radialY = _mm_mul_ps(dirY, radial);
+
+        velX = _mm_add_ps(velX, _mm_mul_ps(_mm_sub_ps(_mm_add_ps(gX, radialX), tangentialX), timeStep));
+        velY = _mm_sub_ps(velY, _mm_mul_ps(_mm_add_ps(_mm_sub_ps(gY, radialY), tangentialY), timeStep));
+        _mm_storeu_ps(&velocityX[i], velX);
+        _mm_storeu_ps(&velocityY[i], velY);
+        _mm_storeu_ps(&positionX[i], _mm_add_ps(posX, _mm_mul_ps(velX, timeStep)));
+        _mm_storeu_ps(&positionY[i], _mm_add_ps(posY, _mm_mul_ps(velY, timeStep)));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float distanceX = positionX[i] - startX[i];
+        float distanceY = positionY[i] - startY[i];
+
+        float distanceScalar = Vector2(distanceX, distanceY).Length();
+        if (distanceScalar < 0.0001f)
+            distanceScalar = 0.0001f;
+
+        float radialX = distanceX / distanceScalar;
+        float radialY = distanceY / distanceScalar;
+
+        float tangentialX = -radialY * tangentialAcceleration[i];
+        float tangentialY = radialX * tangentialAcceleration[i];
+
+        radialX *= radialAcceleration[i];
+        radialY *= radialAcceleration[i];
+
+        velocityX[i] += (gravityX + radialX - tangentialX) * timeSteps[i];
+        velocityY[i] -= (gravityY - radialY + tangentialY) * timeSteps[i];
+        positionX[i] += velocityX[i] * timeSteps[i];
+        positionY[i] += velocityY[i] * timeSteps[i];
+    }
+}
+
 ParticleEmitter2D::ParticleEmitter2D(Context* context) :
     Drawable2D(context),
     blendMode_(BLEND_ADDALPHA),
-    numParticles_(0),
     emissionTime_(0.0f),
     emitParticleTime_(0.0f),
     boundingBoxMinPoint_(Vector3::ZERO),
     boundingBoxMaxPoint_(Vector3::ZERO)
 {
     sourceBatches_.Resize(1);
+    particles_.Define(NUM_PARTICLE2D_STREAMS, 0);
 }
 
 ParticleEmitter2D::~ParticleEmitter2D()
@@ -129,10 +259,8 @@ void ParticleEmitter2D::SetMaxParticles(unsigned maxParticles)
 {
     maxParticles = (unsigned)Max(maxParticles, 1);
 
-    particles_.Resize(maxParticles);
+    particles_.Define(NUM_PARTICLE2D_STREAMS, maxParticles);
     sourceBatches_[0].vertices_.Reserve(maxParticles * 4);
-
-    numParticles_ = Min(maxParticles, numParticles_);
 }
 
 ParticleEffect2D* ParticleEmitter2D::GetEffect() const
@@ -227,22 +355,30 @@ void ParticleEmitter2D::UpdateSourceBatches()
     vertex2.uv_ = textureRect.max_;
     vertex3.uv_ = Vector2(textureRect.max_.x_, textureRect.min_.y_);
 
-    for (int i = 0; i < numParticles_; ++i)
+    const float* positionX = particles_.GetStream(P2D_POSITION_X);
+    const float* positionY = particles_.GetStream(P2D_POSITION_Y);
+    const float* size = particles_.GetStream(P2D_SIZE);
+    const float* rotation = particles_.GetStream(P2D_ROTATION);
+    const float* colorR = particles_.GetStream(P2D_COLOR_R);
+    const float* colorG = particles_.GetStream(P2D_COLOR_G);
+    const float* colorB = particles_.GetStream(P2D_COLOR_B);
+    const float* colorA = particles_.GetStream(P2D_COLOR_A);
+
+    unsigned numParticles = particles_.GetNumParticles();
+    for (unsigned i = 0; i < numParticles; ++i)
     {
-        Particle2D& p = particles_[i];
-
-        float rotation = -p.rotation_;
-        float c = Cos(rotation);
-        float s = Sin(rotation);
-        float add = (c + s) * p.size_ * 0.5f;
-        float sub = (c - s) * p.size_ * 0.5f;
+        float c = Cos(-rotation[i]);
+        float s = Sin(-rotation[i]);
+        float add = (c + s) * size[i] * 0.5f;
+        float sub = (c - s) * size[i] * 0.5f;
 
-        vertex0.position_ = Vector3(p.position_.x_ - sub, p.position_.y_ - add, 0.0f);
-        vertex1.position_ = Vector3(p.position_.x_ - add, p.position_.y_ + sub, 0.0f);
-        vertex2.position_ = Vector3(p.position_.x_ + sub, p.position_.y_ + add, 0.0f);
-        vertex3.position_ = Vector3(p.position_.x_ + add, p.position_.y_ - sub, 0.0f);
+        vertex0.position_ = Vector3(positionX[i] - sub, positionY[i] - add, 0.0f);
+        vertex1.position_ = Vector3(positionX[i] - add, positionY[i] + sub, 0.0f);
+        vertex2.position_ = Vector3(positionX[i] + sub, positionY[i] + add, 0.0f);
+        vertex3.position_ = Vector3(positionX[i] + add, positionY[i] - sub, 0.0f);
 
-        vertex0.color_ = vertex1.color_ = vertex2.color_ = vertex3.color_ = p.color_.ToUInt();
+        vertex0.color_ = vertex1.color_ = vertex2.color_ = vertex3.color_ =
+            Color(colorR[i], colorG[i], colorB[i], colorA[i]).ToUInt();
 
         vertices.Push(vertex0);
         vertices.Push(vertex1);
@@ -276,37 +412,28 @@ void ParticleEmitter2D::Update(float timeStep)
     Vector3 worldPosition = GetNode()->GetWorldPosition();
     float worldScale = GetNode()->GetWorldScale().x_ * PIXEL_SIZE;
 
-    boundingBoxMinPoint_ = Vector3(M_INFINITY, M_INFINITY, 0.0f);
-    boundingBoxMaxPoint_ = Vector3(-M_INFINITY, -M_INFINITY, 0.0f);
-
-    int particleIndex = 0;
-    while (particleIndex < numParticles_)
-    {
-        Particle2D& particle = particles_[particleIndex];
-        if (particle.timeToLive_ > 0.0f)
-        {
-            UpdateParticle(particle, timeStep, worldPosition, worldScale);
-            ++particleIndex;
-        }
-        else
-        {
-            if (particleIndex != numParticles_ - 1)
-                particles_[particleIndex] = particles_[numParticles_ - 1];
-            --numParticles_;
-        }
-    }
+    // Remove particles that ran out of time on the previous update, then clamp the timestep of the rest to their remaining
+    // time to live
+    particles_.RemoveExpired(P2D_TIME_TO_LIVE);
+    float* timeSteps = particles_.GetStream(P2D_TIME_STEP);
+    float* timeToLive = particles_.GetStream(P2D_TIME_TO_LIVE);
+    ParticleConsumeLife(timeSteps, timeToLive, timeStep, particles_.GetNumParticles());
 
+    // New particles are advanced by the remaining emission time instead
     if (emissionTime_ >= 0.0f)
     {
         float worldAngle = GetNode()->GetWorldRotation().RollAngle();
 
-        float timeBetweenParticles = effect_->GetParticleLifeSpan() / particles_.Size();
+        float timeBetweenParticles = effect_->GetParticleLifeSpan() / particles_.GetMaxParticles();
         emitParticleTime_ += timeStep;
 
         while (emitParticleTime_ > 0.0f)
         {
             if (EmitParticle(worldPosition, worldAngle, worldScale))
-                UpdateParticle(particles_[numParticles_ - 1], emitParticleTime_, worldPosition, worldScale);
+            {
+                unsigned index = particles_.GetNumParticles() - 1;
+                ParticleConsumeLife(&timeSteps[index], &timeToLive[index], emitParticleTime_, 1);
+            }
 
             emitParticleTime_ -= timeBetweenParticles;
         }
@@ -315,6 +442,53 @@ void ParticleEmitter2D::Update(float timeStep)
             emissionTime_ = Max(0.0f, emissionTime_ - timeStep);
     }
 
+    Vector2 boundsMin(M_INFINITY, M_INFINITY);
+    Vector2 boundsMax(-M_INFINITY, -M_INFINITY);
+
+    // Split large emitters to worker threads. The particles are independent of each other
+    unsigned numParticles = particles_.GetNumParticles();
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = queue ? Min((int)queue->GetNumThreads() + 1, (int)(numParticles / PARTICLES_PER_WORK_ITEM)) : 0;
+
+    if (numWorkItems > 1)
+    {
+        PODVector<ParticleRange2D> ranges(numWorkItems);
+        unsigned particlesPerItem = numParticles / numWorkItems;
+
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            ParticleRange2D& range = ranges[i];
+            range.emitter_ = this;
+            range.start_ = i * particlesPerItem;
+            range.end_ = i < numWorkItems - 1 ? range.start_ + particlesPerItem : numParticles;
+            range.worldScale_ = worldScale;
+            range.boundsMin_ = boundsMin;
+            range.boundsMax_ = boundsMax;
+
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = UpdateParticles2DWork;
+            item->aux_ = this;
+            item->start_ = &range;
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            boundsMin.x_ = Min(boundsMin.x_, ranges[i].boundsMin_.x_);
+            boundsMin.y_ = Min(boundsMin.y_, ranges[i].boundsMin_.y_);
+            boundsMax.x_ = Max(boundsMax.x_, ranges[i].boundsMax_.x_);
+            boundsMax.y_ = Max(boundsMax.y_, ranges[i].boundsMax_.y_);
+        }
+    }
+    else
+        UpdateParticles(0, numParticles, worldScale, boundsMin, boundsMax);
+
+    boundingBoxMinPoint_ = Vector3(boundsMin.x_, boundsMin.y_, 0.0f);
+    boundingBoxMaxPoint_ = Vector3(boundsMax.x_, boundsMax.y_, 0.0f);
+
     sourceBatchesDirty_ = true;
 
     OnMarkedDirty(node_);
@@ -322,7 +496,7 @@ void ParticleEmitter2D::Update(float timeStep)
 
 bool ParticleEmitter2D::EmitParticle(const Vector3& worldPosition, float worldAngle, float worldScale)
 {
-    if (numParticles_ >= effect_->GetMaxParticles())
+    if (particles_.IsFull() || (int)particles_.GetNumParticles() >= effect_->GetMaxParticles())
         return false;
 
     float lifespan = effect_->GetParticleLifeSpan() + effect_->GetParticleLifespanVariance() * Random(-1.0f, 1.0f);
@@ -331,100 +505,103 @@ bool ParticleEmitter2D::EmitParticle(const Vector3& worldPosition, float worldAn
 
     float invLifespan = 1.0f / lifespan;
 
-    Particle2D& particle = particles_[numParticles_++];
-    particle.timeToLive_ = lifespan;
+    unsigned index = particles_.AddParticle();
+    particles_.GetStream(P2D_TIME_TO_LIVE)[index] = lifespan;
 
-    particle.position_.x_ = worldPosition.x_ + worldScale * effect_->GetSourcePositionVariance().x_ * Random(-1.0f, 1.0f);
-    particle.position_.y_ = worldPosition.y_ + worldScale * effect_->GetSourcePositionVariance().y_ * Random(-1.0f, 1.0f);
-    particle.startPos_.x_ = worldPosition.x_;
-    particle.startPos_.y_ = worldPosition.y_;
+    particles_.GetStream(P2D_POSITION_X)[index] =
+        worldPosition.x_ + worldScale * effect_->GetSourcePositionVariance().x_ * Random(-1.0f, 1.0f);
+    particles_.GetStream(P2D_POSITION_Y)[index] =
+        worldPosition.y_ + worldScale * effect_->GetSourcePositionVariance().y_ * Random(-1.0f, 1.0f);
+    particles_.GetStream(P2D_START_POS_X)[index] = worldPosition.x_;
+    particles_.GetStream(P2D_START_POS_Y)[index] = worldPosition.y_;
 
     float angle = worldAngle + effect_->GetAngle() + effect_->GetAngleVariance() * Random(-1.0f, 1.0f);
     float speed = worldScale * (effect_->GetSpeed() + effect_->GetSpeedVariance() * Random(-1.0f, 1.0f));
-    particle.velocity_.x_ = speed * Cos(angle);
-    particle.velocity_.y_ = speed * Sin(angle);
+    particles_.GetStream(P2D_VELOCITY_X)[index] = speed * Cos(angle);
+    particles_.GetStream(P2D_VELOCITY_Y)[index] = speed * Sin(angle);
 
     float maxRadius = Max(0.0f, worldScale * (effect_->GetMaxRadius() + effect_->GetMaxRadiusVariance() * Random(-1.0f, 1.0f)));
     float minRadius = Max(0.0f, worldScale * (effect_->GetMinRadius() + effect_->GetMinRadiusVariance() * Random(-1.0f, 1.0f)));
-    particle.emitRadius_ = maxRadius;
-    particle.emitRadiusDelta_ = (minRadius - maxRadius) * invLifespan;
-    particle.emitRotation_ = worldAngle + effect_->GetAngle() + effect_->GetAngleVariance() * Random(-1.0f, 1.0f);
-    particle.emitRotationDelta_ = effect_->GetRotatePerSecond() + effect_->GetRotatePerSecondVariance() * Random(-1.0f, 1.0f);
-    particle.radialAcceleration_ =
+    particles_.GetStream(P2D_EMIT_RADIUS)[index] = maxRadius;
+    particles_.GetStream(P2D_EMIT_RADIUS_DELTA)[index] = (minRadius - maxRadius) * invLifespan;
+    particles_.GetStream(P2D_EMIT_ROTATION)[index] =
+        worldAngle + effect_->GetAngle() + effect_->GetAngleVariance() * Random(-1.0f, 1.0f);
+    particles_.GetStream(P2D_EMIT_ROTATION_DELTA)[index] =
+        effect_->GetRotatePerSecond() + effect_->GetRotatePerSecondVariance() * Random(-1.0f, 1.0f);
+    particles_.GetStream(P2D_RADIAL_ACCELERATION)[index] =
         worldScale * (effect_->GetRadialAcceleration() + effect_->GetRadialAccelVariance() * Random(-1.0f, 1.0f));
-    particle.tangentialAcceleration_ =
+    particles_.GetStream(P2D_TANGENTIAL_ACCELERATION)[index] =
         worldScale * (effect_->GetTangentialAcceleration() + effect_->GetTangentialAccelVariance() * Random(-1.0f, 1.0f));
 
     float startSize =
         worldScale * Max(0.1f, effect_->GetStartParticleSize() + effect_->GetStartParticleSizeVariance() * Random(-1.0f, 1.0f));
     float finishSize =
         worldScale * Max(0.1f, effect_->GetFinishParticleSize() + effect_->GetFinishParticleSizeVariance() * Random(-1.0f, 1.0f));
-    particle.size_ = startSize;
-    particle.sizeDelta_ = (finishSize - startSize) * invLifespan;
+    particles_.GetStream(P2D_SIZE)[index] = startSize;
+    particles_.GetStream(P2D_SIZE_DELTA)[index] = (finishSize - startSize) * invLifespan;
 
-    particle.color_ = effect_->GetStartColor() + effect_->GetStartColorVariance() * Random(-1.0f, 1.0f);
+    Color startColor = effect_->GetStartColor() + effect_->GetStartColorVariance() * Random(-1.0f, 1.0f);
     Color endColor = effect_->GetFinishColor() + effect_->GetFinishColorVariance() * Random(-1.0f, 1.0f);
-    particle.colorDelta_ = (endColor - particle.color_) * invLifespan;
+    Color colorDelta = (endColor - startColor) * invLifespan;
+    const float* startColorData = startColor.Data();
+    const float* colorDeltaData = colorDelta.Data();
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        particles_.GetStream(P2D_COLOR_R + i)[index] = startColorData[i];
+        particles_.GetStream(P2D_COLOR_DELTA_R + i)[index] = colorDeltaData[i];
+    }
 
-    particle.rotation_ = worldAngle + effect_->GetRotationStart() + effect_->GetRotationStartVariance() * Random(-1.0f, 1.0f);
+    float startRotation =
+        worldAngle + effect_->GetRotationStart() + effect_->GetRotationStartVariance() * Random(-1.0f, 1.0f);
     float endRotation = worldAngle + effect_->GetRotationEnd() + effect_->GetRotationEndVariance() * Random(-1.0f, 1.0f);
-    particle.rotationDelta_ = (endRotation - particle.rotation_) * invLifespan;
+    particles_.GetStream(P2D_ROTATION)[index] = startRotation;
+    particles_.GetStream(P2D_ROTATION_DELTA)[index] = (endRotation - startRotation) * invLifespan;
 
     return true;
 }
 
-void ParticleEmitter2D::UpdateParticle(Particle2D& particle, float timeStep, const Vector3& worldPosition, float worldScale)
+void ParticleEmitter2D::UpdateParticles(unsigned start, unsigned end, float worldScale, Vector2& boundsMin, Vector2& boundsMax)
 {
-    if (timeStep > particle.timeToLive_)
-        timeStep = particle.timeToLive_;
-
-    particle.timeToLive_ -= timeStep;
+    unsigned count = end - start;
+    const float* timeSteps = particles_.GetStream(P2D_TIME_STEP) + start;
+    float* positionX = particles_.GetStream(P2D_POSITION_X) + start;
+    float* positionY = particles_.GetStream(P2D_POSITION_Y) + start;
+    float* size = particles_.GetStream(P2D_SIZE) + start;
+    const float* startX = particles_.GetStream(P2D_START_POS_X) + start;
+    const float* startY = particles_.GetStream(P2D_START_POS_Y) + start;
 
     if (effect_->GetEmitterType() == EMITTER_TYPE_RADIAL)
     {
-        particle.emitRotation_ += particle.emitRotationDelta_ * timeStep;
-        particle.emitRadius_ += particle.emitRadiusDelta_ * timeStep;
+        float* emitRotation = particles_.GetStream(P2D_EMIT_ROTATION) + start;
+        float* emitRadius = particles_.GetStream(P2D_EMIT_RADIUS) + start;
+        ParticleMultiplyAdd(emitRotation, particles_.GetStream(P2D_EMIT_ROTATION_DELTA) + start, timeSteps, count);
+        ParticleMultiplyAdd(emitRadius, particles_.GetStream(P2D_EMIT_RADIUS_DELTA) + start, timeSteps, count);
 
-        particle.position_.x_ = particle.startPos_.x_ - Cos(particle.emitRotation_) * particle.emitRadius_;
-        particle.position_.y_ = particle.startPos_.y_ + Sin(particle.emitRotation_) * particle.emitRadius_;
+        for (unsigned i = 0; i < count; ++i)
+        {
+            positionX[i] = startX[i] - Cos(emitRotation[i]) * emitRadius[i];
+            positionY[i] = startY[i] + Sin(emitRotation[i]) * emitRadius[i];
+        }
     }
     else
     {
-        float distanceX = particle.position_.x_ - particle.startPos_.x_;
-        float distanceY = particle.position_.y_ - particle.startPos_.y_;
-
-        float distanceScalar = Vector2(distanceX, distanceY).Length();
-        if (distanceScalar < 0.0001f)
-            distanceScalar = 0.0001f;
-
-        float radialX = distanceX / distanceScalar;
-        float radialY = distanceY / distanceScalar;
-
-        float tangentialX = radialX;
-        float tangentialY = radialY;
-
-        radialX *= particle.radialAcceleration_;
-        radialY *= particle.radialAcceleration_;
-
-        float newY = tangentialX;
-        tangentialX = -tangentialY * particle.tangentialAcceleration_;
-        tangentialY = newY * particle.tangentialAcceleration_;
-
-        particle.velocity_.x_ += (effect_->GetGravity().x_ * worldScale + radialX - tangentialX) * timeStep;
-        particle.velocity_.y_ -= (effect_->GetGravity().y_ * worldScale - radialY + tangentialY) * timeStep;
-        particle.position_.x_ += particle.velocity_.x_ * timeStep;
-        particle.position_.y_ += particle.velocity_.y_ * timeStep;
+        UpdateGravityParticles(positionX, positionY, particles_.GetStream(P2D_VELOCITY_X) + start,
+            particles_.GetStream(P2D_VELOCITY_Y) + start, startX, startY, particles_.GetStream(P2D_RADIAL_ACCELERATION) + start,
+            particles_.GetStream(P2D_TANGENTIAL_ACCELERATION) + start, timeSteps, effect_->GetGravity().x_ * worldScale,
+            effect_->GetGravity().y_ * worldScale, count);
     }
 
-    particle.size_ += particle.sizeDelta_ * timeStep;
-    particle.rotation_ += particle.rotationDelta_ * timeStep;
-    particle.color_ += particle.colorDelta_ * timeStep;
+    ParticleMultiplyAdd(size, particles_.GetStream(P2D_SIZE_DELTA) + start, timeSteps, count);
+    ParticleMultiplyAdd(particles_.GetStream(P2D_ROTATION) + start, particles_.GetStream(P2D_ROTATION_DELTA) + start, timeSteps,
+        count);
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        ParticleMultiplyAdd(particles_.GetStream(P2D_COLOR_R + i) + start, particles_.GetStream(P2D_COLOR_DELTA_R + i) + start,
+            timeSteps, count);
+    }
 
-    float halfSize = particle.size_ * 0.5f;
-    boundingBoxMinPoint_.x_ = Min(boundingBoxMinPoint_.x_, particle.position_.x_ - halfSize);
-    boundingBoxMinPoint_.y_ = Min(boundingBoxMinPoint_.y_, particle.position_.y_ - halfSize);
-    boundingBoxMaxPoint_.x_ = Max(boundingBoxMaxPoint_.x_, particle.position_.x_ + halfSize);
-    boundingBoxMaxPoint_.y_ = Max(boundingBoxMaxPoint_.y_, particle.position_.y_ + halfSize);
+    ParticleRange(positionX, size, 0.5f, count, boundsMin.x_, boundsMax.x_);
+    ParticleRange(positionY, size, 0.5f, count, boundsMin.y_, boundsMax.y_);
 }
 
 }
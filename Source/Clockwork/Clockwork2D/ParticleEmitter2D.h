@@ -23,60 +23,22 @@
 #pragma once
 
 #include "../Clockwork2D/Drawable2D.h"
+#include "../Graphics/ParticleBuffer.h"
 
 namespace Clockwork
 {
 
 class ParticleEffect2D;
 class Sprite2D;
-
-/// 2D particle.
-struct Particle2D
-{
-    /// Time to live.
-    float timeToLive_;
-
-    /// Position.
-    Vector2 position_;
-    /// Size.
-    float size_;
-    /// Size delta.
-    float sizeDelta_;
-    /// Rotation.
-    float rotation_;
-    /// Rotation delta.
-    float rotationDelta_;
-    /// Color.
-    Color color_;
-    /// Color delta.
-    Color colorDelta_;
-
-    // EMITTER_TYPE_GRAVITY parameters
-    /// Start position.
-    Vector2 startPos_;
-    /// Velocity.
-    Vector2 velocity_;
-    /// Radial acceleration.
-    float radialAcceleration_;
-    /// Tangential acceleration.
-    float tangentialAcceleration_;
-
-    // EMITTER_TYPE_RADIAL parameters
-    /// Emit radius.
-    float emitRadius_;
-    /// Emit radius delta.
-    float emitRadiusDelta_;
-    /// Emit rotation.
-    float emitRotation_;
-    /// Emit rotation delta.
-    float emitRotationDelta_;
-};
+struct WorkItem;
 
 /// 2D particle emitter component.
 class CLOCKWORK_API ParticleEmitter2D : public Drawable2D
 {
     OBJECT(ParticleEmitter2D);
 
+    friend void UpdateParticles2DWork(const WorkItem* item, unsigned threadIndex);
+
 public:
     /// Construct.
     ParticleEmitter2D(Context* context);
@@ -106,7 +68,7 @@ public:
     BlendMode GetBlendMode() const { return blendMode_; }
 
     /// Return max particles.
-    unsigned GetMaxParticles() const { return particles_.Size(); }
+    unsigned GetMaxParticles() const { return particles_.GetMaxParticles(); }
 
     /// Set particle model attr.
     void SetParticleEffectAttr(const ResourceRef& value);
@@ -134,8 +96,8 @@ private:
     void Update(float timeStep);
     /// Emit particle.
     bool EmitParticle(const Vector3& worldPosition, float worldAngle, float worldScale);
-    /// Update particle.
-    void UpdateParticle(Particle2D& particle, float timeStep, const Vector3& worldPosition, float worldScale);
+    /// Integrate a range of particles using their clamped timesteps and extend the bounding rectangle to cover them. Can be called from a worker thread.
+    void UpdateParticles(unsigned start, unsigned end, float worldScale, Vector2& boundsMin, Vector2& boundsMax);
 
     /// Particle effect.
     SharedPtr<ParticleEffect2D> effect_;
@@ -143,14 +105,12 @@ private:
     SharedPtr<Sprite2D> sprite_;
     /// Blend mode.
     BlendMode blendMode_;
-    /// Num particles.
-    int numParticles_;
     /// Emission time.
     float emissionTime_;
     /// Emit particle time
     float emitParticleTime_;
-    /// Particles.
-    Vector<Particle2D> particles_;
+    /// Particles in structure-of-arrays form.
+    ParticleBuffer particles_;
     /// Bounding box min point.
     Vector3 boundingBoxMinPoint_;
     /// Bounding box max point.
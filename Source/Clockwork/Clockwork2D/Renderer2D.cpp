@@ -55,6 +55,8 @@ ViewBatchInfo2D::ViewBatchInfo2D() :
     indexCount_(0),
     vertexCount_(0),
     batchUpdatedFrameNumber_(0),
+    dirtyVertexCount_(0),
+    verticesDirty_(true),
     batchCount_(0)
 {
 }
@@ -196,27 +198,82 @@ void Renderer2D::UpdateGeometry(const FrameInfo& frame)
         unsigned vertexCount = viewBatchInfo.vertexCount_;
         VertexBuffer* vertexBuffer = viewBatchInfo.vertexBuffer_;
         if (vertexBuffer->GetVertexCount() < vertexCount)
+        {
             vertexBuffer->SetSize(vertexCount, MASK_VERTEX2D, true);
+            viewBatchInfo.verticesDirty_ = true;
+        }
+        if (vertexBuffer->IsDataLost())
+        {
+            viewBatchInfo.verticesDirty_ = true;
+            vertexBuffer->ClearDataLost();
+        }
+
+        const PODVector<ViewSourceBatch2D*>& sourceBatches = viewBatchInfo.sortedSourceBatches_;
+
+        // If only a few source batches have changed, rewrite just their vertex ranges and keep the rest resident
+        if (viewBatchInfo.dirtyVertexCount_ * 2 > vertexCount)
+            viewBatchInfo.verticesDirty_ = true;
 
-        if (vertexCount)
+        if (vertexCount && viewBatchInfo.verticesDirty_)
         {
             Vertex2D* dest = reinterpret_cast<Vertex2D*>(vertexBuffer->Lock(0, vertexCount, true));
             if (dest)
             {
-                const PODVector<const SourceBatch2D*>& sourceBatches = viewBatchInfo.sourceBatches_;
                 for (unsigned b = 0; b < sourceBatches.Size(); ++b)
                 {
-                    const Vector<Vertex2D>& vertices = sourceBatches[b]->vertices_;
+                    const Vector<Vertex2D>& vertices = sourceBatches[b]->batch_->vertices_;
                     for (unsigned i = 0; i < vertices.Size(); ++i)
                         dest[i] = vertices[i];
                     dest += vertices.Size();
+                    sourceBatches[b]->dirty_ = false;
                 }
 
                 vertexBuffer->Unlock();
+                viewBatchInfo.verticesDirty_ = false;
+                viewBatchInfo.dirtyVertexCount_ = 0;
             }
             else
                 LOGERROR("Failed to lock vertex buffer");
         }
+        else if (viewBatchInfo.dirtyVertexCount_)
+        {
+            for (unsigned b = 0; b < sourceBatches.Size();)
+            {
+                if (!sourceBatches[b]->dirty_)
+                {
+                    ++b;
+                    continue;
+                }
+
+                // Lock a run of consecutive changed source batches at once
+                unsigned end = b + 1;
+                while (end < sourceBatches.Size() && sourceBatches[end]->dirty_)
+                    ++end;
+                unsigned start = sourceBatches[b]->vertexStart_;
+                unsigned count = sourceBatches[end - 1]->vertexStart_ + sourceBatches[end - 1]->vertexCount_ - start;
+
+                Vertex2D* dest = reinterpret_cast<Vertex2D*>(vertexBuffer->Lock(start, count));
+                if (!dest)
+                {
+                    LOGERROR("Failed to lock vertex buffer");
+                    viewBatchInfo.verticesDirty_ = true;
+                    break;
+                }
+
+                for (; b < end; ++b)
+                {
+                    const Vector<Vertex2D>& vertices = sourceBatches[b]->batch_->vertices_;
+                    for (unsigned i = 0; i < vertices.Size(); ++i)
+                        dest[i] = vertices[i];
+                    dest += vertices.Size();
+                    sourceBatches[b]->dirty_ = false;
+                }
+
+                vertexBuffer->Unlock();
+            }
+
+            viewBatchInfo.dirtyVertexCount_ = 0;
+        }
 
         viewBatchInfo.vertexBufferUpdateFrameNumber_ = frame_.frameNumber_;
     }
@@ -413,7 +470,7 @@ void Renderer2D::GetDrawables(PODVector<Drawable2D*>& dest, Node* node)
         GetDrawables(dest, i->Get());
 }
 
-static inline bool CompareSourceBatch2Ds(const SourceBatch2D* lhs, const SourceBatch2D* rhs)
+static inline bool CompareSourceBatch2Ds(const ViewSourceBatch2D* lhs, const ViewSourceBatch2D* rhs)
 {
     if (lhs->drawOrder_ != rhs->drawOrder_)
         return lhs->drawOrder_ < rhs->drawOrder_;
@@ -421,7 +478,7 @@ static inline bool CompareSourceBatch2Ds(const SourceBatch2D* lhs, const SourceB
     if (lhs->material_ != rhs->material_)
         return lhs->material_->GetNameHash() < rhs->material_->GetNameHash();
 
-    return lhs < rhs;
+    return lhs->batch_ < rhs->batch_;
 }
 
 void Renderer2D::UpdateViewBatchInfo(ViewBatchInfo2D& viewBatchInfo, Camera* camera)
@@ -430,22 +487,73 @@ void Renderer2D::UpdateViewBatchInfo(ViewBatchInfo2D& viewBatchInfo, Camera* cam
     if (viewBatchInfo.batchUpdatedFrameNumber_ == frame_.frameNumber_)
         return;
 
-    PODVector<const SourceBatch2D*>& soruceBatches = viewBatchInfo.sourceBatches_;
-    soruceBatches.Clear();
+    PODVector<ViewSourceBatch2D>& newSourceBatches = viewBatchInfo.newSourceBatches_;
+    newSourceBatches.Clear();
     for (unsigned d = 0; d < drawables_.Size(); ++d)
     {
         if (!drawables_[d]->IsInView(camera))
             continue;
 
         const Vector<SourceBatch2D>& batches = drawables_[d]->GetSourceBatches();
+        unsigned version = drawables_[d]->GetSourceBatchesVersion();
         for (unsigned b = 0; b < batches.Size(); ++b)
         {
             if (batches[b].material_ && !batches[b].vertices_.Empty())
-                soruceBatches.Push(&batches[b]);
+            {
+                ViewSourceBatch2D batch;
+                batch.batch_ = &batches[b];
+                batch.material_ = batches[b].material_;
+                batch.drawOrder_ = batches[b].drawOrder_;
+                batch.vertexCount_ = batches[b].vertices_.Size();
+                batch.version_ = version;
+                batch.vertexStart_ = 0;
+                batch.dirty_ = false;
+                newSourceBatches.Push(batch);
+            }
         }
     }
 
-    Sort(soruceBatches.Begin(), soruceBatches.End(), CompareSourceBatch2Ds);
+    viewBatchInfo.batchUpdatedFrameNumber_ = frame_.frameNumber_;
+
+    // If the same source batches are visible with the same sort keys and vertex counts as before, the view batches and the
+    // vertices in the vertex buffer remain valid. Only the source batches whose vertices have changed need to be rewritten
+    PODVector<ViewSourceBatch2D>& sourceBatches = viewBatchInfo.sourceBatches_;
+    bool layoutChanged = newSourceBatches.Size() != sourceBatches.Size();
+    for (unsigned b = 0; b < sourceBatches.Size() && !layoutChanged; ++b)
+    {
+        const ViewSourceBatch2D& batch = sourceBatches[b];
+        const ViewSourceBatch2D& newBatch = newSourceBatches[b];
+        layoutChanged = newBatch.batch_ != batch.batch_ || newBatch.material_ != batch.material_ ||
+            newBatch.drawOrder_ != batch.drawOrder_ || newBatch.vertexCount_ != batch.vertexCount_;
+    }
+
+    if (!layoutChanged)
+    {
+        for (unsigned b = 0; b < sourceBatches.Size(); ++b)
+        {
+            ViewSourceBatch2D& batch = sourceBatches[b];
+            if (batch.version_ != newSourceBatches[b].version_)
+            {
+                batch.version_ = newSourceBatches[b].version_;
+                if (!batch.dirty_)
+                {
+                    batch.dirty_ = true;
+                    viewBatchInfo.dirtyVertexCount_ += batch.vertexCount_;
+                }
+            }
+        }
+
+        return;
+    }
+
+    sourceBatches.Swap(newSourceBatches);
+
+    PODVector<ViewSourceBatch2D*>& sortedSourceBatches = viewBatchInfo.sortedSourceBatches_;
+    sortedSourceBatches.Resize(sourceBatches.Size());
+    for (unsigned b = 0; b < sourceBatches.Size(); ++b)
+        sortedSourceBatches[b] = &sourceBatches[b];
+
+    Sort(sortedSourceBatches.Begin(), sortedSourceBatches.End(), CompareSourceBatch2Ds);
 
     viewBatchInfo.batchCount_ = 0;
     Material* currMaterial = 0;
@@ -454,10 +562,10 @@ void Renderer2D::UpdateViewBatchInfo(ViewBatchInfo2D& viewBatchInfo, Camera* cam
     unsigned vStart = 0;
     unsigned vCount = 0;
 
-    for (unsigned b = 0; b < soruceBatches.Size(); ++b)
+    for (unsigned b = 0; b < sortedSourceBatches.Size(); ++b)
     {
-        Material* material = soruceBatches[b]->material_;
-        const Vector<Vertex2D>& vertices = soruceBatches[b]->vertices_;
+        ViewSourceBatch2D* batch = sortedSourceBatches[b];
+        Material* material = batch->material_;
 
         // When new material encountered, finish the current batch and start new
         if (currMaterial != material)
@@ -474,8 +582,9 @@ void Renderer2D::UpdateViewBatchInfo(ViewBatchInfo2D& viewBatchInfo, Camera* cam
             currMaterial = material;
         }
 
-        iCount += vertices.Size() * 6 / 4;
-        vCount += vertices.Size();
+        batch->vertexStart_ = vStart + vCount;
+        iCount += batch->vertexCount_ * 6 / 4;
+        vCount += batch->vertexCount_;
     }
 
     // Add the final batch if necessary
@@ -484,7 +593,8 @@ void Renderer2D::UpdateViewBatchInfo(ViewBatchInfo2D& viewBatchInfo, Camera* cam
 
     viewBatchInfo.indexCount_ = iStart + iCount;
     viewBatchInfo.vertexCount_ = vStart + vCount;
-    viewBatchInfo.batchUpdatedFrameNumber_ = frame_.frameNumber_;
+    viewBatchInfo.dirtyVertexCount_ = 0;
+    viewBatchInfo.verticesDirty_ = true;
 }
 
 void Renderer2D::AddViewBatch(ViewBatchInfo2D& viewBatchInfo, Material* material, unsigned indexStart, unsigned indexCount,
@@ -35,6 +35,25 @@ class VertexBuffer;
 struct FrameInfo;
 struct SourceBatch2D;
 
+/// Visible source batch, along with the state it had when the view batches were built.
+struct ViewSourceBatch2D
+{
+    /// Source batch.
+    const SourceBatch2D* batch_;
+    /// Material.
+    Material* material_;
+    /// Draw order.
+    int drawOrder_;
+    /// Vertex count.
+    unsigned vertexCount_;
+    /// Source batch vertex version of the drawable.
+    unsigned version_;
+    /// Start position in the vertex buffer.
+    unsigned vertexStart_;
+    /// Vertices changed since written to the vertex buffer flag.
+    bool dirty_;
+};
+
 /// 2D view batch info.
 struct ViewBatchInfo2D
 {
@@ -51,8 +70,16 @@ struct ViewBatchInfo2D
     SharedPtr<VertexBuffer> vertexBuffer_;
     /// Batch updated frame number.
     unsigned batchUpdatedFrameNumber_;
-    /// Source batches.
-    PODVector<const SourceBatch2D*> sourceBatches_;
+    /// Visible source batches in drawable order, as the view batches were built from them.
+    PODVector<ViewSourceBatch2D> sourceBatches_;
+    /// Visible source batches of the current frame, for comparing against the previous ones.
+    PODVector<ViewSourceBatch2D> newSourceBatches_;
+    /// Visible source batches in draw order.
+    PODVector<ViewSourceBatch2D*> sortedSourceBatches_;
+    /// Number of vertices that have changed since written to the vertex buffer.
+    unsigned dirtyVertexCount_;
+    /// Whole vertex buffer needs to be rewritten flag.
+    bool verticesDirty_;
     /// Batch count;
     unsigned batchCount_;
     /// Materials.
@@ -0,0 +1,218 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Core/Context.h"
+#include "../Graphics/Material.h"
+#include "../Graphics/Texture2D.h"
+#include "../Scene/Node.h"
+#include "../Clockwork2D/Renderer2D.h"
+#include "../Clockwork2D/Sprite2D.h"
+#include "../Clockwork2D/TileMap2D.h"
+#include "../Clockwork2D/TileMapChunk2D.h"
+#include "../Clockwork2D/TileMapLayer2D.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+/// Maximum number of material changes within a chunk that still get their own draw order.
+static const unsigned MAX_CHUNK_DRAW_ORDERS = 1024;
+
+TileMapChunk2D::TileMapChunk2D(Context* context) :
+    Drawable2D(context)
+{
+}
+
+TileMapChunk2D::~TileMapChunk2D()
+{
+}
+
+void TileMapChunk2D::RegisterObject(Context* context)
+{
+    context->RegisterFactory<TileMapChunk2D>();
+}
+
+void TileMapChunk2D::SetTiles(TileMapLayer2D* layer, const IntRect& tiles)
+{
+    layer_ = layer;
+    tiles_ = tiles;
+
+    MarkTilesDirty();
+}
+
+void TileMapChunk2D::MarkTilesDirty()
+{
+    if (node_)
+        OnMarkedDirty(node_);
+}
+
+TileMapLayer2D* TileMapChunk2D::GetTileMapLayer() const
+{
+    return layer_;
+}
+
+void TileMapChunk2D::OnWorldBoundingBoxUpdate()
+{
+    boundingBox_.Clear();
+
+    TileMap2D* tileMap = layer_ ? layer_->GetTileMap() : 0;
+    if (tileMap)
+    {
+        const TileMapInfo2D& info = tileMap->GetInfo();
+        Rect drawRect;
+
+        for (int y = tiles_.top_; y < tiles_.bottom_; ++y)
+        {
+            for (int x = tiles_.left_; x < tiles_.right_; ++x)
+            {
+                Tile2D* tile = layer_->GetTile(x, y);
+                Sprite2D* sprite = tile ? tile->GetSprite() : 0;
+                if (!sprite || !sprite->GetDrawRectangle(drawRect))
+                    continue;
+
+                Vector2 position = info.TileIndexToPosition(x, y);
+                boundingBox_.Merge(Vector3(position + drawRect.min_, 0.0f));
+                boundingBox_.Merge(Vector3(position + drawRect.max_, 0.0f));
+            }
+        }
+    }
+
+    worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+}
+
+void TileMapChunk2D::OnDrawOrderChanged()
+{
+    // Each run of tiles with the same material is ordered after the previous ones
+    for (unsigned i = 0; i < sourceBatches_.Size(); ++i)
+        sourceBatches_[i].drawOrder_ = GetDrawOrder() + Min((int)i, (int)MAX_CHUNK_DRAW_ORDERS - 1);
+}
+
+void TileMapChunk2D::UpdateSourceBatches()
+{
+    if (!sourceBatchesDirty_)
+        return;
+
+    sourceBatches_.Clear();
+    sourceBatchesDirty_ = false;
+
+    TileMap2D* tileMap = layer_ ? layer_->GetTileMap() : 0;
+    if (!tileMap || !renderer_)
+        return;
+
+    // Tiles are drawn in the same order as the layer, row by row. First find the runs of tiles with the same material, so
+    // that the source batches are allocated only once
+    PODVector<Material*> tileMaterials((unsigned)(tiles_.Width() * tiles_.Height()));
+    PODVector<unsigned> runLengths;
+    Material* currMaterial = 0;
+    Rect drawRect;
+    Rect textureRect;
+
+    for (int y = tiles_.top_; y < tiles_.bottom_; ++y)
+    {
+        for (int x = tiles_.left_; x < tiles_.right_; ++x)
+        {
+            Material*& material = tileMaterials[(y - tiles_.top_) * tiles_.Width() + x - tiles_.left_];
+            material = 0;
+
+            Tile2D* tile = layer_->GetTile(x, y);
+            Sprite2D* sprite = tile ? tile->GetSprite() : 0;
+            if (!sprite || !sprite->GetDrawRectangle(drawRect) || !sprite->GetTextureRectangle(textureRect))
+                continue;
+
+            material = renderer_->GetMaterial(sprite->GetTexture(), BLEND_ALPHA);
+            if (material != currMaterial || runLengths.Empty())
+            {
+                runLengths.Push(0);
+                currMaterial = material;
+            }
+            ++runLengths.Back();
+        }
+    }
+
+    sourceBatches_.Resize(runLengths.Size());
+    for (unsigned i = 0; i < runLengths.Size(); ++i)
+        sourceBatches_[i].vertices_.Reserve(runLengths[i] * 4);
+
+    const TileMapInfo2D& info = tileMap->GetInfo();
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    unsigned color = Color::WHITE.ToUInt();
+    SourceBatch2D* batch = 0;
+
+    for (int y = tiles_.top_; y < tiles_.bottom_; ++y)
+    {
+        for (int x = tiles_.left_; x < tiles_.right_; ++x)
+        {
+            Material* material = tileMaterials[(y - tiles_.top_) * tiles_.Width() + x - tiles_.left_];
+            if (!material)
+                continue;
+
+            if (!batch || material != batch->material_)
+            {
+                batch = batch ? batch + 1 : &sourceBatches_[0];
+                batch->material_ = material;
+            }
+
+            Sprite2D* sprite = layer_->GetTile(x, y)->GetSprite();
+            sprite->GetDrawRectangle(drawRect);
+            sprite->GetTextureRectangle(textureRect);
+
+            /*
+            V1---------V2
+            |         / |
+            |       /   |
+            |     /     |
+            |   /       |
+            | /         |
+            V0---------V3
+            */
+            Vector2 position = info.TileIndexToPosition(x, y);
+            Vertex2D vertex0;
+            Vertex2D vertex1;
+            Vertex2D vertex2;
+            Vertex2D vertex3;
+
+            vertex0.position_ = worldTransform * Vector3(position.x_ + drawRect.min_.x_, position.y_ + drawRect.min_.y_, 0.0f);
+            vertex1.position_ = worldTransform * Vector3(position.x_ + drawRect.min_.x_, position.y_ + drawRect.max_.y_, 0.0f);
+            vertex2.position_ = worldTransform * Vector3(position.x_ + drawRect.max_.x_, position.y_ + drawRect.max_.y_, 0.0f);
+            vertex3.position_ = worldTransform * Vector3(position.x_ + drawRect.max_.x_, position.y_ + drawRect.min_.y_, 0.0f);
+
+            vertex0.uv_ = textureRect.min_;
+            vertex1.uv_ = Vector2(textureRect.min_.x_, textureRect.max_.y_);
+            vertex2.uv_ = textureRect.max_;
+            vertex3.uv_ = Vector2(textureRect.max_.x_, textureRect.min_.y_);
+
+            vertex0.color_ = vertex1.color_ = vertex2.color_ = vertex3.color_ = color;
+
+            batch->vertices_.Push(vertex0);
+            batch->vertices_.Push(vertex1);
+            batch->vertices_.Push(vertex2);
+            batch->vertices_.Push(vertex3);
+        }
+    }
+
+    OnDrawOrderChanged();
+}
+
+}
@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "../Clockwork2D/Drawable2D.h"
+
+namespace Clockwork
+{
+
+class TileMapLayer2D;
+
+/// Renders a rectangular block of a tile map layer's tiles as one drawable. Created by TileMapLayer2D.
+class CLOCKWORK_API TileMapChunk2D : public Drawable2D
+{
+    OBJECT(TileMapChunk2D);
+
+public:
+    /// Construct.
+    TileMapChunk2D(Context* context);
+    /// Destruct.
+    ~TileMapChunk2D();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Set tile layer and the range of tiles to render.
+    void SetTiles(TileMapLayer2D* layer, const IntRect& tiles);
+    /// Mark the tiles changed, so that vertices and bounding box are rebuilt.
+    void MarkTilesDirty();
+
+    /// Return tile layer.
+    TileMapLayer2D* GetTileMapLayer() const;
+
+    /// Return the range of tiles rendered.
+    const IntRect& GetTiles() const { return tiles_; }
+
+protected:
+    /// Recalculate the world-space bounding box.
+    virtual void OnWorldBoundingBoxUpdate();
+    /// Handle draw order changed.
+    virtual void OnDrawOrderChanged();
+    /// Update source batches.
+    virtual void UpdateSourceBatches();
+
+private:
+    /// Tile layer.
+    WeakPtr<TileMapLayer2D> layer_;
+    /// Range of tiles rendered, right and bottom exclusive.
+    IntRect tiles_;
+};
+
+}
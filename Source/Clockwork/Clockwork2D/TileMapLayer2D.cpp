@@ -28,6 +28,7 @@
 #include "../Scene/Node.h"
 #include "../Clockwork2D/StaticSprite2D.h"
 #include "../Clockwork2D/TileMap2D.h"
+#include "../Clockwork2D/TileMapChunk2D.h"
 #include "../Clockwork2D/TileMapLayer2D.h"
 #include "../Clockwork2D/TmxFile2D.h"
 
@@ -36,9 +37,15 @@
 namespace Clockwork
 {
 
+/// Width and height of a tile chunk in tiles.
+static const int TILE_CHUNK_SIZE = 32;
+
 TileMapLayer2D::TileMapLayer2D(Context* context) :
     Component(context),
     tmxLayer_(0),
+    tileLayer_(0),
+    objectGroup_(0),
+    imageLayer_(0),
     drawOrder_(0),
     visible_(true)
 {
@@ -125,7 +132,12 @@ void TileMapLayer2D::Initialize(TileMap2D* tileMap, const TmxLayer2D* tmxLayer)
                 nodes_[i]->Remove();
         }
 
+        for (unsigned i = 0; i < chunks_.Size(); ++i)
+            chunks_[i]->Remove();
+
         nodes_.Clear();
+        tiles_.Clear();
+        chunks_.Clear();
     }
 
     tileLayer_ = 0;
@@ -175,6 +187,9 @@ void TileMapLayer2D::SetDrawOrder(int drawOrder)
         if (staticSprite)
             staticSprite->SetLayer(drawOrder_);
     }
+
+    for (unsigned i = 0; i < chunks_.Size(); ++i)
+        chunks_[i]->SetLayer(drawOrder_);
 }
 
 void TileMapLayer2D::SetVisible(bool visible)
@@ -189,6 +204,9 @@ void TileMapLayer2D::SetVisible(bool visible)
         if (nodes_[i])
             nodes_[i]->SetEnabled(visible_);
     }
+
+    for (unsigned i = 0; i < chunks_.Size(); ++i)
+        chunks_[i]->SetEnabled(visible_);
 }
 
 TileMap2D* TileMapLayer2D::GetTileMap() const
@@ -226,23 +244,27 @@ int TileMapLayer2D::GetHeight() const
     return tmxLayer_ ? tmxLayer_->GetHeight() : 0;
 }
 
-Tile2D* TileMapLayer2D::GetTile(int x, int y) const
+void TileMapLayer2D::SetTile(int x, int y, Tile2D* tile)
 {
-    if (!tileLayer_)
-        return 0;
+    if (!tileLayer_ || x < 0 || x >= tileLayer_->GetWidth() || y < 0 || y >= tileLayer_->GetHeight())
+        return;
+
+    SharedPtr<Tile2D>& dest = tiles_[y * tileLayer_->GetWidth() + x];
+    if (dest == tile)
+        return;
+
+    dest = tile;
 
-    return tileLayer_->GetTile(x, y);
+    int chunksX = (tileLayer_->GetWidth() + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    chunks_[(y / TILE_CHUNK_SIZE) * chunksX + x / TILE_CHUNK_SIZE]->MarkTilesDirty();
 }
 
-Node* TileMapLayer2D::GetTileNode(int x, int y) const
+Tile2D* TileMapLayer2D::GetTile(int x, int y) const
 {
-    if (!tileLayer_)
-        return 0;
-
-    if (x < 0 || x >= tileLayer_->GetWidth() || y < 0 || y >= tileLayer_->GetHeight())
+    if (!tileLayer_ || x < 0 || x >= tileLayer_->GetWidth() || y < 0 || y >= tileLayer_->GetHeight())
         return 0;
 
-    return nodes_[y * tileLayer_->GetWidth() + x];
+    return tiles_[y * tileLayer_->GetWidth() + x];
 }
 
 unsigned TileMapLayer2D::GetNumObjects() const
@@ -289,27 +311,32 @@ void TileMapLayer2D::SetTileLayer(const TmxTileLayer2D* tileLayer)
 
     int width = tileLayer->GetWidth();
     int height = tileLayer->GetHeight();
-    nodes_.Resize((unsigned)(width * height));
+    tiles_.Resize((unsigned)(width * height));
 
-    const TileMapInfo2D& info = tileMap_->GetInfo();
     for (int y = 0; y < height; ++y)
     {
         for (int x = 0; x < width; ++x)
-        {
-            const Tile2D* tile = tileLayer->GetTile(x, y);
-            if (!tile)
-                continue;
-
-            SharedPtr<Node> tileNode(GetNode()->CreateChild("Tile"));
-            tileNode->SetTemporary(true);
-            tileNode->SetPosition(info.TileIndexToPosition(x, y));
+            tiles_[y * width + x] = tileLayer->GetTile(x, y);
+    }
 
-            StaticSprite2D* staticSprite = tileNode->CreateComponent<StaticSprite2D>();
-            staticSprite->SetSprite(tile->GetSprite());
-            staticSprite->SetLayer(drawOrder_);
-            staticSprite->SetOrderInLayer(y * width + x);
+    // Render the tiles in chunks instead of a sprite node per tile. The chunks are components of the layer node, ordered
+    // row by row like the tiles
+    int chunksX = (width + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    int chunksY = (height + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+    chunks_.Resize((unsigned)(chunksX * chunksY));
 
-            nodes_[y * width + x] = tileNode;
+    for (int y = 0; y < chunksY; ++y)
+    {
+        for (int x = 0; x < chunksX; ++x)
+        {
+            SharedPtr<TileMapChunk2D> chunk(GetNode()->CreateComponent<TileMapChunk2D>(LOCAL));
+            chunk->SetTemporary(true);
+            chunk->SetLayer(drawOrder_);
+            chunk->SetOrderInLayer(y * chunksX + x);
+            chunk->SetTiles(this, IntRect(x * TILE_CHUNK_SIZE, y * TILE_CHUNK_SIZE, Min((x + 1) * TILE_CHUNK_SIZE, width),
+                Min((y + 1) * TILE_CHUNK_SIZE, height)));
+
+            chunks_[y * chunksX + x] = chunk;
         }
     }
 }
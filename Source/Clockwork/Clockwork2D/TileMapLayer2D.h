@@ -31,6 +31,7 @@ namespace Clockwork
 class DebugRenderer;
 class Node;
 class TileMap2D;
+class TileMapChunk2D;
 class TmxImageLayer2D;
 class TmxLayer2D;
 class TmxObjectGroup2D;
@@ -82,8 +83,8 @@ public:
     int GetWidth() const;
     /// Return height (for tile layer only).
     int GetHeight() const;
-    /// Return tile node (for tile layer only).
-    Node* GetTileNode(int x, int y) const;
+    /// Set tile (for tile layer only). Only the chunk of tiles containing it is rebuilt.
+    void SetTile(int x, int y, Tile2D* tile);
     /// Return tile (for tile layer only).
     Tile2D* GetTile(int x, int y) const;
 
@@ -119,8 +120,12 @@ private:
     int drawOrder_;
     /// Visible.
     bool visible_;
-    /// Tile node or image nodes.
+    /// Object nodes or image node.
     Vector<SharedPtr<Node> > nodes_;
+    /// Tiles (for tile layer only). Copied from the tmx layer so that they can be changed.
+    Vector<SharedPtr<Tile2D> > tiles_;
+    /// Tile chunk drawables (for tile layer only).
+    Vector<SharedPtr<TileMapChunk2D> > chunks_;
 };
 
 }
@@ -0,0 +1,98 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Container/Sort.h"
+
+#include <cstring>
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const unsigned RADIX_SORT_THRESHOLD = 32;
+static const unsigned RADIX_DIGITS = 8;
+static const unsigned RADIX_BUCKETS = 256;
+
+void RadixSort(RadixSortItem* items, RadixSortItem* temp, unsigned count)
+{
+    // Small arrays are faster to sort with a stable insertion sort
+    if (count < RADIX_SORT_THRESHOLD)
+    {
+        for (unsigned i = 1; i < count; ++i)
+        {
+            RadixSortItem item = items[i];
+            unsigned j = i;
+            while (j > 0 && item.key_ < items[j - 1].key_)
+            {
+                items[j] = items[j - 1];
+                --j;
+            }
+            items[j] = item;
+        }
+        return;
+    }
+
+    // Build the histograms of all 8-bit digits in one pass
+    unsigned histograms[RADIX_DIGITS][RADIX_BUCKETS];
+    memset(histograms, 0, sizeof histograms);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        unsigned long long key = items[i].key_;
+        for (unsigned d = 0; d < RADIX_DIGITS; ++d)
+            ++histograms[d][(key >> (d * 8)) & 0xff];
+    }
+
+    RadixSortItem* src = items;
+    RadixSortItem* dest = temp;
+
+    for (unsigned d = 0; d < RADIX_DIGITS; ++d)
+    {
+        unsigned* histogram = histograms[d];
+        unsigned shift = d * 8;
+
+        // Skip the pass if all keys have the same digit, which is common for the high bits
+        if (histogram[(src[0].key_ >> shift) & 0xff] == count)
+            continue;
+
+        unsigned offset = 0;
+        for (unsigned b = 0; b < RADIX_BUCKETS; ++b)
+        {
+            unsigned num = histogram[b];
+            histogram[b] = offset;
+            offset += num;
+        }
+
+        for (unsigned i = 0; i < count; ++i)
+            dest[histogram[(src[i].key_ >> shift) & 0xff]++] = src[i];
+
+        Swap(src, dest);
+    }
+
+    if (src != items)
+        memcpy(items, src, count * sizeof(RadixSortItem));
+}
+
+}
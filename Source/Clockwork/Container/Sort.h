@@ -22,6 +22,12 @@
 
 #pragma once
 
+#ifdef CLOCKWORK_IS_BUILDING
+#include "Clockwork.h"
+#else
+#include <Clockwork/Clockwork.h>
+#endif
+
 #include "../Container/Swap.h"
 #include "../Container/VectorBase.h"
 
@@ -141,4 +147,24 @@ template <class T, class U> void Sort(RandomAccessIterator<T> begin, RandomAcces
     InsertionSort(begin, end, compare);
 }
 
+/// Key and value index pair for radix sorting.
+struct RadixSortItem
+{
+    /// Sort key.
+    unsigned long long key_;
+    /// Index of the sorted element.
+    unsigned index_;
+};
+
+/// Return an unsigned integer that sorts in the same order as a float.
+inline unsigned FloatToRadixKey(float value)
+{
+    unsigned bits = *((unsigned*)&value);
+    // Flip all bits of negative values and only the sign bit of positive values
+    return bits ^ ((unsigned)((int)bits >> 31) | 0x80000000);
+}
+
+/// Stable sort of key and index pairs in ascending key order using a least significant digit radix sort. The temporary buffer must hold at least as many items as are sorted. The result is always stored in the items array.
+CLOCKWORK_API void RadixSort(RadixSortItem* items, RadixSortItem* temp, unsigned count);
+
 }
@@ -51,6 +51,8 @@ private:
 #ifndef WIN32
     /// Mutex for the event, necessary for pthreads-based implementation.
     void* mutex_;
+    /// Set flag, so that a Set() before Wait() is not lost like with the Windows event.
+    bool set_;
 #endif
     /// Operating system specific event.
     void* event_;
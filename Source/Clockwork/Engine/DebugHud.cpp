@@ -123,13 +123,14 @@ void DebugHud::Update()
         }
 
         String stats;
-        stats.AppendWithFormat("Triangles %u\nBatches %u\nViews %u\nLights %u\nShadowmaps %u\nOccluders %u",
+        stats.AppendWithFormat("Triangles %u\nBatches %u\nViews %u\nLights %u\nShadowmaps %u\nOccluders %u\nOccluded %u",
             primitives,
             batches,
             renderer->GetNumViews(),
             renderer->GetNumLights(true),
             renderer->GetNumShadowMaps(true),
-            renderer->GetNumOccluders(true));
+            renderer->GetNumOccluders(true),
+            renderer->GetNumOccludedDrawables(true));
 
         if (!appStats_.Empty())
         {
@@ -33,6 +33,7 @@
 #include "../Engine/Engine.h"
 #include "../Graphics/Graphics.h"
 #include "../Graphics/Renderer.h"
+#include "../IO/AsyncFileIO.h"
 #include "../IO/FileSystem.h"
 #include "../Input/Input.h"
 #include "../IO/Log.h"
@@ -119,6 +120,7 @@ Engine::Engine(Context* context) :
     context_->RegisterSubsystem(new Profiler(context_));
 #endif
     context_->RegisterSubsystem(new FileSystem(context_));
+    context_->RegisterSubsystem(new AsyncFileIO(context_));
 #ifdef CLOCKWORK_LOGGING
     context_->RegisterSubsystem(new Log(context_));
 #endif
@@ -325,6 +327,15 @@ bool Engine::Initialize(const VariantMap& parameters)
                 autoLoadPaths[i].CString());
     }
 
+    // Set the cooked resource directory if specified
+    String cookedResourceDir = GetParameter(parameters, "CookedResourceDir", String::EMPTY).GetString();
+    if (!cookedResourceDir.Empty())
+    {
+        if (!IsAbsolutePath(cookedResourceDir))
+            cookedResourceDir = resourcePrefixPath + cookedResourceDir;
+        cache->SetCookedResourceDir(cookedResourceDir);
+    }
+
     // Initialize graphics & audio output
     if (!headless_)
     {
@@ -63,28 +63,49 @@ AnimatedModel::AnimatedModel(Context* context) :
     animationLodBias_(1.0f),
     animationLodTimer_(-1.0f),
     animationLodDistance_(0.0f),
+    boneLodDistance_(0.0f),
+    poseLodBones_(0),
     updateInvisible_(false),
     animationDirty_(false),
     animationOrderDirty_(false),
     morphsDirty_(false),
+    morphsUploadPending_(false),
     skinningDirty_(true),
     boneBoundingBoxDirty_(true),
     isMaster_(true),
     loading_(false),
     assignBonesPending_(false),
-    forceAnimationUpdate_(false)
+    forceAnimationUpdate_(false),
+    boneNodesEnabled_(true),
+    poseSharing_(false)
 {
 }
 
 AnimatedModel::~AnimatedModel()
 {
     // When being destroyed, remove the bone hierarchy if appropriate (last AnimatedModel in the node)
-    Bone* rootBone = skeleton_.GetRootBone();
-    if (rootBone && rootBone->node_)
+    if (boneNodesEnabled_)
     {
-        Node* parent = rootBone->node_->GetParent();
-        if (parent && !parent->GetComponent<AnimatedModel>())
-            RemoveRootBone();
+        Bone* rootBone = skeleton_.GetRootBone();
+        if (rootBone && rootBone->node_)
+        {
+            Node* parent = rootBone->node_->GetParent();
+            if (parent && !parent->GetComponent<AnimatedModel>())
+                RemoveRootBone();
+        }
+    }
+    else
+    {
+        // Without bone nodes, remove the nodes created for individual bones in the same case
+        Vector<Bone>& bones = skeleton_.GetModifiableBones();
+        for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
+        {
+            if (!i->node_)
+                continue;
+            Node* parent = i->node_->GetParent();
+            if (parent && !parent->GetComponent<AnimatedModel>())
+                i->node_->Remove();
+        }
     }
 }
 
@@ -111,6 +132,9 @@ void AnimatedModel::RegisterObject(Context* context)
         Variant::emptyVariantVector, AM_FILE);
     ACCESSOR_ATTRIBUTE("Morphs", GetMorphsAttr, SetMorphsAttr, PODVector<unsigned char>, Variant::emptyBuffer,
         AM_DEFAULT | AM_NOEDIT);
+    ACCESSOR_ATTRIBUTE("Bone Nodes", GetBoneNodesEnabled, SetBoneNodesEnabled, bool, true, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Pose Sharing", GetPoseSharing, SetPoseSharing, bool, false, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Bone LOD Distance", GetBoneLodDistance, SetBoneLodDistance, float, 0.0f, AM_DEFAULT);
 }
 
 bool AnimatedModel::Load(Deserializer& source, bool setInstanceDefault)
@@ -152,12 +176,24 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
         return;
 
     const Vector<Bone>& bones = skeleton_.GetBones();
+    AnimatedModel* poseMaster = GetPoseMaster();
+    const PODVector<unsigned>* poseMapping = poseMaster && poseMaster != this ? &GetPoseMapping(poseMaster) : 0;
     Sphere boneSphere;
 
     for (unsigned i = 0; i < bones.Size(); ++i)
     {
         const Bone& bone = bones[i];
-        if (!bone.node_)
+        Matrix3x4 transform;
+        if (poseMaster)
+        {
+            unsigned poseIndex = poseMapping ? poseMapping->At(i) : i;
+            if (poseIndex >= poseMaster->poseTransforms_.Size())
+                continue;
+            transform = node_->GetWorldTransform() * poseMaster->poseTransforms_[poseIndex];
+        }
+        else if (bone.node_)
+            transform = bone.node_->GetWorldTransform();
+        else
             continue;
 
         float distance;
@@ -167,7 +203,6 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
         {
             // Do an initial crude test using the bone's AABB
             const BoundingBox& box = bone.boundingBox_;
-            const Matrix3x4& transform = bone.node_->GetWorldTransform();
             distance = query.ray_.HitDistance(box.Transformed(transform));
             if (distance >= query.maxDistance_)
                 continue;
@@ -183,7 +218,7 @@ void AnimatedModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQu
         }
         else if (bone.collisionMask_ & BONECOLLISION_SPHERE)
         {
-            boneSphere.center_ = bone.node_->GetWorldPosition();
+            boneSphere.center_ = transform.Translation();
             boneSphere.radius_ = bone.radius_;
             distance = query.ray_.HitDistance(boneSphere);
             if (distance >= query.maxDistance_)
@@ -233,6 +268,17 @@ void AnimatedModel::Update(const FrameInfo& frame)
         UpdateAnimation(frame);
     else if (boneBoundingBoxDirty_)
         UpdateBoneBoundingBox();
+
+    // When in view, do the CPU side of the geometry update already here in the threaded drawable update: apply vertex morphs
+    // to this model's own vertex data, and calculate the skin matrices of the master model. Non-master models read the
+    // master's pose, so they calculate skinning in the view's geometry update once all animations have been applied
+    if (frame.camera_ && abs((int)frame.frameNumber_ - (int)viewFrameNumber_) <= 1)
+    {
+        if (morphsDirty_)
+            UpdateMorphs();
+        if (isMaster_ && skinningDirty_)
+            UpdateSkinning();
+    }
 }
 
 void AnimatedModel::UpdateBatches(const FrameInfo& frame)
@@ -285,13 +331,16 @@ void AnimatedModel::UpdateGeometry(const FrameInfo& frame)
     if (morphsDirty_)
         UpdateMorphs();
 
+    if (morphsUploadPending_)
+        UploadMorphs();
+
     if (skinningDirty_)
         UpdateSkinning();
 }
 
 UpdateGeometryType AnimatedModel::GetUpdateGeometryType()
 {
-    if (morphsDirty_ || forceAnimationUpdate_)
+    if (morphsDirty_ || morphsUploadPending_ || forceAnimationUpdate_)
         return UPDATE_MAIN_THREAD;
     else if (skinningDirty_)
         return UPDATE_WORKER_THREAD;
@@ -304,7 +353,41 @@ void AnimatedModel::DrawDebugGeometry(DebugRenderer* debug, bool depthTest)
     if (debug && IsEnabledEffective())
     {
         debug->AddBoundingBox(GetWorldBoundingBox(), Color::GREEN, depthTest);
-        debug->AddSkeleton(skeleton_, Color(0.75f, 0.75f, 0.75f), depthTest);
+
+        AnimatedModel* poseMaster = GetPoseMaster();
+        if (!poseMaster)
+            debug->AddSkeleton(skeleton_, Color(0.75f, 0.75f, 0.75f), depthTest);
+        else
+        {
+            // Draw the skeleton from the master model's pose, skipping bones that do not skin any geometry like
+            // DebugRenderer::AddSkeleton()
+            const Vector<Bone>& bones = skeleton_.GetBones();
+            const PODVector<Matrix3x4>& poseTransforms = poseMaster->poseTransforms_;
+            const PODVector<unsigned>* poseMapping = poseMaster != this ? &GetPoseMapping(poseMaster) : 0;
+            const Matrix3x4& worldTransform = node_->GetWorldTransform();
+            Color color(0.75f, 0.75f, 0.75f);
+            for (unsigned i = 0; i < bones.Size(); ++i)
+            {
+                if (bones[i].radius_ < M_EPSILON && bones[i].boundingBox_.Size().LengthSquared() < M_EPSILON)
+                    continue;
+                unsigned poseIndex = poseMapping ? poseMapping->At(i) : i;
+                if (poseIndex >= poseTransforms.Size())
+                    continue;
+
+                Vector3 start = worldTransform * poseTransforms[poseIndex].Translation();
+                Vector3 end = start;
+                unsigned j = bones[i].parentIndex_;
+                if (j != i && j < bones.Size() && (bones[j].radius_ >= M_EPSILON ||
+                    bones[j].boundingBox_.Size().LengthSquared() >= M_EPSILON))
+                {
+                    unsigned parentPoseIndex = poseMapping ? poseMapping->At(j) : j;
+                    if (parentPoseIndex < poseTransforms.Size())
+                        end = worldTransform * poseTransforms[parentPoseIndex].Translation();
+                }
+
+                debug->AddLine(start, end, color, depthTest);
+            }
+        }
     }
 }
 
@@ -396,7 +479,7 @@ void AnimatedModel::SetModel(Model* model, bool createBones)
     }
     else
     {
-        RemoveRootBone(); // Remove existing root bone if any
+        RemoveBoneNodes(); // Remove existing bone nodes if any
         SetNumGeometries(0);
         geometryBoneMappings_.Clear();
         morphVertexBuffers_.Clear();
@@ -511,6 +594,76 @@ void AnimatedModel::SetAnimationLodBias(float bias)
     MarkNetworkUpdate();
 }
 
+void AnimatedModel::SetBoneNodesEnabled(bool enable)
+{
+    if (enable == boneNodesEnabled_)
+        return;
+
+    boneNodesEnabled_ = enable;
+
+    // When loading, the bone nodes are assigned later in ApplyAttributes()
+    if (isMaster_ && node_ && !loading_ && !assignBonesPending_ && skeleton_.GetNumBones())
+    {
+        RemoveBoneNodes();
+        if (enable)
+            CreateBoneNodes();
+        InitializePose();
+
+        // Reassign the animation tracks to the bone nodes or the pose
+        for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+        {
+            AnimationState* state = *i;
+            state->SetStartBone(state->GetStartBone());
+        }
+
+        MarkAnimationDirty();
+        // Non-master models skin from the bone nodes or the pose, so make them update too
+        node_->MarkDirty();
+    }
+
+    MarkNetworkUpdate();
+}
+
+void AnimatedModel::SetPoseSharing(bool enable)
+{
+    poseSharing_ = enable;
+    MarkNetworkUpdate();
+}
+
+void AnimatedModel::SetBoneLodDistance(float distance)
+{
+    boneLodDistance_ = Max(distance, 0.0f);
+    MarkAnimationDirty();
+    MarkNetworkUpdate();
+}
+
+Node* AnimatedModel::CreateBoneNode(const String& boneName)
+{
+    Bone* bone = skeleton_.GetBone(boneName);
+    if (!bone)
+        return 0;
+    if (bone->node_ || boneNodesEnabled_)
+        return bone->node_;
+
+    if (!isMaster_ || !node_)
+    {
+        LOGERROR("Can not create bone node for non-master or detached model");
+        return 0;
+    }
+
+    // Create as local like the full bone hierarchy
+    unsigned index = (unsigned)(bone - &skeleton_.GetModifiableBones()[0]);
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scale;
+    poseTransforms_[index].Decompose(position, rotation, scale);
+
+    Node* boneNode = node_->CreateChild(bone->name_, LOCAL);
+    boneNode->SetTransform(position, rotation, scale);
+    bone->node_ = boneNode;
+    return boneNode;
+}
+
 void AnimatedModel::SetUpdateInvisible(bool enable)
 {
     updateInvisible_ = enable;
@@ -681,8 +834,8 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
 
             for (unsigned i = 0; i < destBones.Size(); ++i)
             {
-                if (destBones[i].node_ && destBones[i].name_ == srcBones[i].name_ && destBones[i].parentIndex_ ==
-                                                                                     srcBones[i].parentIndex_)
+                if ((destBones[i].node_ || !boneNodesEnabled_) && destBones[i].name_ == srcBones[i].name_ &&
+                    destBones[i].parentIndex_ == srcBones[i].parentIndex_)
                 {
                     // If compatible, just copy the values and retain the old node and animated status
                     Node* boneNode = destBones[i].node_;
@@ -698,14 +851,17 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
                 }
             }
             if (compatible)
+            {
+                InitializePose();
                 return;
+            }
         }
 
         RemoveAllAnimationStates();
 
-        // Detach the rootbone of the previous model if any
+        // Detach the bone nodes of the previous model if any
         if (createBones)
-            RemoveRootBone();
+            RemoveBoneNodes();
 
         skeleton_.Define(skeleton);
 
@@ -721,24 +877,8 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
         }
 
         // Create scene nodes for the bones
-        if (createBones)
-        {
-            for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
-            {
-                // Create bones as local, as they are never to be directly synchronized over the network
-                Node* boneNode = node_->CreateChild(i->name_, LOCAL);
-                boneNode->AddListener(this);
-                boneNode->SetTransform(i->initialPosition_, i->initialRotation_, i->initialScale_);
-                i->node_ = boneNode;
-            }
-
-            for (unsigned i = 0; i < bones.Size(); ++i)
-            {
-                unsigned parentIndex = bones[i].parentIndex_;
-                if (parentIndex != i && parentIndex < bones.Size())
-                    bones[parentIndex].node_->AddChild(bones[i].node_);
-            }
-        }
+        if (createBones && boneNodesEnabled_)
+            CreateBoneNodes();
 
         using namespace BoneHierarchyCreated;
 
@@ -767,6 +907,7 @@ void AnimatedModel::SetSkeleton(const Skeleton& skeleton, bool createBones)
     // Reserve space for skinning matrices
     skinMatrices_.Resize(skeleton_.GetNumBones());
     SetGeometryBoneMappings();
+    InitializePose();
 
     assignBonesPending_ = !createBones;
 }
@@ -928,8 +1069,24 @@ void AnimatedModel::AssignBoneNodes()
     if (!node_)
         return;
 
-    // Find the bone nodes from the node hierarchy and add listeners
     Vector<Bone>& bones = skeleton_.GetModifiableBones();
+
+    if (!boneNodesEnabled_)
+    {
+        // Without bone nodes, only nodes created for individual bones exist, as direct children. They follow the pose,
+        // so no listeners are needed
+        for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
+            i->node_ = isMaster_ ? node_->GetChild(i->name_, false) : (Node*)0;
+
+        for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+        {
+            AnimationState* state = *i;
+            state->SetStartBone(state->GetStartBone());
+        }
+        return;
+    }
+
+    // Find the bone nodes from the node hierarchy and add listeners
     bool boneFound = false;
     for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
     {
@@ -962,6 +1119,257 @@ void AnimatedModel::RemoveRootBone()
         rootBone->node_->Remove();
 }
 
+void AnimatedModel::CreateBoneNodes()
+{
+    Vector<Bone>& bones = skeleton_.GetModifiableBones();
+    for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
+    {
+        // Create bones as local, as they are never to be directly synchronized over the network
+        Node* boneNode = node_->CreateChild(i->name_, LOCAL);
+        boneNode->AddListener(this);
+        boneNode->SetTransform(i->initialPosition_, i->initialRotation_, i->initialScale_);
+        i->node_ = boneNode;
+    }
+
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        unsigned parentIndex = bones[i].parentIndex_;
+        if (parentIndex != i && parentIndex < bones.Size())
+            bones[parentIndex].node_->AddChild(bones[i].node_);
+    }
+}
+
+void AnimatedModel::RemoveBoneNodes()
+{
+    RemoveRootBone();
+
+    // Without bone nodes, nodes created for individual bones are not under the root bone
+    Vector<Bone>& bones = skeleton_.GetModifiableBones();
+    for (Vector<Bone>::Iterator i = bones.Begin(); i != bones.End(); ++i)
+    {
+        if (i->node_)
+            i->node_->Remove();
+        i->node_.Reset();
+    }
+}
+
+void AnimatedModel::InitializePose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned numBones = bones.Size();
+
+    posePositions_.Resize(numBones);
+    poseRotations_.Resize(numBones);
+    poseScales_.Resize(numBones);
+    poseTransforms_.Resize(numBones);
+    poseMapping_.Clear();
+
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        posePositions_[i] = bones[i].initialPosition_;
+        poseRotations_[i] = bones[i].initialRotation_;
+        poseScales_[i] = bones[i].initialScale_;
+    }
+
+    // Order the bones so that parents are evaluated before their children. Usually they already are
+    poseOrder_.Clear();
+    poseOrder_.Reserve(numBones);
+    PODVector<bool> ordered(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+        ordered[i] = false;
+
+    bool progress = true;
+    while (poseOrder_.Size() < numBones && progress)
+    {
+        progress = false;
+        for (unsigned i = 0; i < numBones; ++i)
+        {
+            if (ordered[i])
+                continue;
+            unsigned parentIndex = bones[i].parentIndex_;
+            if (parentIndex == i || parentIndex >= numBones || ordered[parentIndex])
+            {
+                poseOrder_.Push(i);
+                ordered[i] = true;
+                progress = true;
+            }
+        }
+    }
+
+    // Bones in a parent cycle can not be ordered; evaluate them as roots
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        if (!ordered[i])
+            poseOrder_.Push(i);
+    }
+
+    // Rank the bones for the bone LOD by the size of their subtree, then by depth. A parent's subtree is always larger than
+    // its child's, so the bones dropped at any LOD are whole leaf subtrees
+    PODVector<unsigned> depths(numBones);
+    PODVector<unsigned> subtreeSizes(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+    {
+        unsigned index = poseOrder_[i];
+        unsigned parentIndex = bones[index].parentIndex_;
+        depths[index] = parentIndex != index && parentIndex < numBones && ordered[index] ? depths[parentIndex] + 1 : 0;
+        subtreeSizes[index] = 1;
+    }
+    for (int i = (int)numBones - 1; i >= 0; --i)
+    {
+        unsigned index = poseOrder_[i];
+        unsigned parentIndex = bones[index].parentIndex_;
+        if (parentIndex != index && parentIndex < numBones && ordered[index])
+            subtreeSizes[parentIndex] += subtreeSizes[index];
+    }
+
+    PODVector<unsigned long long> rankKeys(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+        rankKeys[i] = (unsigned long long)(numBones - subtreeSizes[i]) << 40 | (unsigned long long)depths[i] << 20 | i;
+    Sort(rankKeys.Begin(), rankKeys.End());
+
+    poseRanks_.Resize(numBones);
+    for (unsigned i = 0; i < numBones; ++i)
+        poseRanks_[(unsigned)(rankKeys[i] & 0xfffff)] = i;
+    poseLodBones_ = numBones;
+
+    ResetPose();
+    UpdatePoseTransforms();
+}
+
+void AnimatedModel::ResetPose()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        const Bone& bone = bones[i];
+        if (bone.animated_)
+        {
+            posePositions_[i] = bone.initialPosition_;
+            poseRotations_[i] = bone.initialRotation_;
+            poseScales_[i] = bone.initialScale_;
+        }
+    }
+}
+
+void AnimatedModel::UpdatePoseTransforms()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    unsigned numBones = bones.Size();
+
+    for (unsigned i = 0; i < poseOrder_.Size(); ++i)
+    {
+        unsigned index = poseOrder_[i];
+        unsigned parentIndex = bones[index].parentIndex_;
+        Matrix3x4 localTransform(posePositions_[index], poseRotations_[index], poseScales_[index]);
+        if (parentIndex != index && parentIndex < numBones)
+            poseTransforms_[index] = poseTransforms_[parentIndex] * localTransform;
+        else
+            poseTransforms_[index] = localTransform;
+    }
+
+    UpdatePoseBoneNodes();
+}
+
+void AnimatedModel::UpdatePoseBoneNodes()
+{
+    if (boneNodesEnabled_)
+        return;
+
+    // Move the nodes created for individual bones. They are children of the model's node, so use the model-space transform.
+    // Nodes are marked dirty afterward along with the model's node
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        Node* boneNode = bones[i].node_;
+        if (boneNode)
+        {
+            Vector3 position;
+            Quaternion rotation;
+            Vector3 scale;
+            poseTransforms_[i].Decompose(position, rotation, scale);
+            boneNode->SetTransformSilent(position, rotation, scale);
+        }
+    }
+}
+
+bool AnimatedModel::BuildPoseKey()
+{
+    // Bones under manual control make the pose specific to this instance
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    for (Vector<Bone>::ConstIterator i = bones.Begin(); i != bones.End(); ++i)
+    {
+        if (!i->animated_)
+            return false;
+    }
+
+    poseKey_.model_ = model_;
+    poseKey_.numBones_ = poseLodBones_;
+    poseKey_.states_.Clear();
+
+    for (Vector<SharedPtr<AnimationState> >::ConstIterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+    {
+        AnimationState* state = *i;
+        if (!state->IsEnabled())
+            continue;
+        // So do per-bone blending weights
+        if (state->HasBoneWeights())
+            return false;
+
+        Bone* startBone = state->GetStartBone();
+        PoseKeyState keyState;
+        keyState.animation_ = state->GetAnimation();
+        keyState.startBone_ = startBone ? (unsigned)(startBone - &bones[0]) : M_MAX_UNSIGNED;
+        keyState.time_ = (int)floorf(state->GetTime() / POSE_CACHE_TIME_STEP);
+        keyState.weight_ = (unsigned)(state->GetWeight() * 255.0f + 0.5f);
+        keyState.looped_ = state->IsLooped();
+        poseKey_.states_.Push(keyState);
+    }
+
+    return true;
+}
+
+AnimatedModel* AnimatedModel::GetPoseMaster() const
+{
+    if (isMaster_)
+        return boneNodesEnabled_ ? 0 : const_cast<AnimatedModel*>(this);
+
+    AnimatedModel* master = node_ ? node_->GetComponent<AnimatedModel>() : 0;
+    return master && master != this && !master->boneNodesEnabled_ ? master : 0;
+}
+
+const PODVector<unsigned>& AnimatedModel::GetPoseMapping(AnimatedModel* master)
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    const Vector<Bone>& masterBones = master->skeleton_.GetBones();
+
+    bool valid = poseMapping_.Size() == bones.Size();
+    for (unsigned i = 0; i < poseMapping_.Size() && valid; ++i)
+    {
+        unsigned index = poseMapping_[i];
+        if (index < masterBones.Size() && masterBones[index].nameHash_ != bones[i].nameHash_)
+            valid = false;
+    }
+
+    if (!valid)
+    {
+        poseMapping_.Resize(bones.Size());
+        for (unsigned i = 0; i < bones.Size(); ++i)
+        {
+            poseMapping_[i] = M_MAX_UNSIGNED;
+            for (unsigned j = 0; j < masterBones.Size(); ++j)
+            {
+                if (masterBones[j].nameHash_ == bones[i].nameHash_)
+                {
+                    poseMapping_[i] = j;
+                    break;
+                }
+            }
+        }
+    }
+
+    return poseMapping_;
+}
+
 void AnimatedModel::MarkAnimationDirty()
 {
     if (isMaster_)
@@ -983,6 +1391,24 @@ void AnimatedModel::MarkAnimationOrderDirty()
 void AnimatedModel::MarkMorphsDirty()
 {
     morphsDirty_ = true;
+    MarkForUpdate();
+}
+
+void AnimatedModel::MarkPoseDirty()
+{
+    const Vector<Bone>& bones = skeleton_.GetBones();
+    for (unsigned i = 0; i < bones.Size(); ++i)
+    {
+        if (bones[i].node_)
+            bones[i].node_->MarkDirty();
+    }
+
+    const Vector<SharedPtr<Component> >& components = node_->GetComponents();
+    for (unsigned i = 0; i < components.Size(); ++i)
+    {
+        if (components[i]->GetType() == AnimatedModel::GetTypeStatic())
+            static_cast<AnimatedModel*>(components[i].Get())->OnMarkedDirty(node_);
+    }
 }
 
 void AnimatedModel::CloneGeometries()
@@ -1140,12 +1566,17 @@ void AnimatedModel::UpdateAnimation(const FrameInfo& frame)
     // If using animation LOD, accumulate time and see if it is time to update
     if (animationLodBias_ > 0.0f && animationLodDistance_ > 0.0f)
     {
+        // When the scene exceeds the renderer's animation budget, the octree scales up the LOD distances
+        float lodDistance = animationLodDistance_;
+        if (octant_)
+            lodDistance *= octant_->GetRoot()->GetAnimationLodScale();
+
         // Perform the first update always regardless of LOD timer
         if (animationLodTimer_ >= 0.0f)
         {
             animationLodTimer_ += animationLodBias_ * frame.timeStep_ * ANIMATION_LOD_BASESCALE;
-            if (animationLodTimer_ >= animationLodDistance_)
-                animationLodTimer_ = fmodf(animationLodTimer_, animationLodDistance_);
+            if (animationLodTimer_ >= lodDistance)
+                animationLodTimer_ = fmodf(animationLodTimer_, lodDistance);
             else
                 return;
         }
@@ -1164,15 +1595,49 @@ void AnimatedModel::UpdateAnimation(const FrameInfo& frame)
     // (first AnimatedModel in a node)
     if (isMaster_)
     {
-        skeleton_.ResetSilent();
-        for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
-            (*i)->Apply();
+        if (boneNodesEnabled_)
+        {
+            skeleton_.ResetSilent();
+            for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+                (*i)->Apply();
 
-        // Skeleton reset and animations apply the node transforms "silently" to avoid repeated marking dirty. Mark dirty now
-        node_->MarkDirty();
+            // Skeleton reset and animations apply the node transforms "silently" to avoid repeated marking dirty. Mark dirty now
+            node_->MarkDirty();
 
-        // Calculate new bone bounding box
-        UpdateBoneBoundingBox();
+            // Calculate new bone bounding box
+            UpdateBoneBoundingBox();
+        }
+        else
+        {
+            // Beyond the bone LOD distance, animate only the most important bones
+            unsigned numBones = poseOrder_.Size();
+            poseLodBones_ = numBones;
+            if (boneLodDistance_ > 0.0f && animationLodDistance_ > boneLodDistance_)
+                poseLodBones_ = (unsigned)Max((int)(numBones * boneLodDistance_ / animationLodDistance_), 1);
+
+            // Reuse the pose of an identical instance evaluated earlier this frame, including its bounding box
+            PoseCache* poseCache = poseSharing_ && octant_ && BuildPoseKey() ? &octant_->GetRoot()->GetPoseCache() : 0;
+            if (poseCache && poseCache->GetPose(poseKey_, poseTransforms_, boneBoundingBox_))
+            {
+                UpdatePoseBoneNodes();
+                boneBoundingBoxDirty_ = false;
+                worldBoundingBoxDirty_ = true;
+            }
+            else
+            {
+                ResetPose();
+                for (Vector<SharedPtr<AnimationState> >::Iterator i = animationStates_.Begin(); i != animationStates_.End(); ++i)
+                    (*i)->Apply();
+                UpdatePoseTransforms();
+                UpdateBoneBoundingBox();
+
+                if (poseCache)
+                    poseCache->StorePose(poseKey_, poseTransforms_, boneBoundingBox_);
+            }
+
+            // The scene node itself does not move, so it is enough to notify the pose's users
+            MarkPoseDirty();
+        }
     }
 
     animationDirty_ = false;
@@ -1187,6 +1652,24 @@ void AnimatedModel::UpdateBoneBoundingBox()
         Matrix3x4 inverseNodeTransform = node_->GetWorldTransform().Inverse();
 
         const Vector<Bone>& bones = skeleton_.GetBones();
+
+        // The pose is already in model space
+        if (!boneNodesEnabled_)
+        {
+            for (unsigned i = 0; i < bones.Size(); ++i)
+            {
+                const Bone& bone = bones[i];
+                if (bone.collisionMask_ & BONECOLLISION_BOX)
+                    boneBoundingBox_.Merge(bone.boundingBox_.Transformed(poseTransforms_[i]));
+                else if (bone.collisionMask_ & BONECOLLISION_SPHERE)
+                    boneBoundingBox_.Merge(Sphere(poseTransforms_[i].Translation(), bone.radius_ * 0.5f));
+            }
+
+            boneBoundingBoxDirty_ = false;
+            worldBoundingBoxDirty_ = true;
+            return;
+        }
+
         for (Vector<Bone>::ConstIterator i = bones.Begin(); i != bones.End(); ++i)
         {
             Node* boneNode = i->node_;
@@ -1213,6 +1696,32 @@ void AnimatedModel::UpdateSkinning()
     // Use model's world transform in case a bone is missing
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
 
+    // Without bone nodes, skin from the master model's model-space pose
+    AnimatedModel* poseMaster = GetPoseMaster();
+    if (poseMaster)
+    {
+        const PODVector<Matrix3x4>& poseTransforms = poseMaster->poseTransforms_;
+        const PODVector<unsigned>* poseMapping = poseMaster != this ? &GetPoseMapping(poseMaster) : 0;
+
+        for (unsigned i = 0; i < bones.Size(); ++i)
+        {
+            unsigned poseIndex = poseMapping ? poseMapping->At(i) : i;
+            if (poseIndex < poseTransforms.Size())
+                skinMatrices_[i] = worldTransform * (poseTransforms[poseIndex] * bones[i].offsetMatrix_);
+            else
+                skinMatrices_[i] = worldTransform;
+
+            if (geometrySkinMatrices_.Size())
+            {
+                for (unsigned j = 0; j < geometrySkinMatrixPtrs_[i].Size(); ++j)
+                    *geometrySkinMatrixPtrs_[i][j] = skinMatrices_[i];
+            }
+        }
+
+        skinningDirty_ = false;
+        return;
+    }
+
     // Skinning with global matrices only
     if (!geometrySkinMatrices_.Size())
     {
@@ -1253,42 +1762,56 @@ void AnimatedModel::UpdateMorphs()
 
     if (morphs_.Size())
     {
-        // Reset the morph data range from all morphable vertex buffers, then apply morphs
+        // Reset the morph data range from all morphable vertex buffers, then apply morphs. The morph vertex buffers are
+        // this model's own shadowed clones, so the data can be written without locking the GPU buffer
         for (unsigned i = 0; i < morphVertexBuffers_.Size(); ++i)
         {
             VertexBuffer* buffer = morphVertexBuffers_[i];
-            if (buffer)
+            if (buffer && buffer->GetShadowData())
             {
                 VertexBuffer* originalBuffer = model_->GetVertexBuffers()[i];
                 unsigned morphStart = model_->GetMorphRangeStart(i);
                 unsigned morphCount = model_->GetMorphRangeCount(i);
+                void* dest = buffer->GetShadowData() + morphStart * buffer->GetVertexSize();
 
-                void* dest = buffer->Lock(morphStart, morphCount);
-                if (dest)
-                {
-                    // Reset morph range by copying data from the original vertex buffer
-                    CopyMorphVertices(dest, originalBuffer->GetShadowData() + morphStart * originalBuffer->GetVertexSize(),
-                        morphCount, buffer, originalBuffer);
+                // Reset morph range by copying data from the original vertex buffer
+                CopyMorphVertices(dest, originalBuffer->GetShadowData() + morphStart * originalBuffer->GetVertexSize(),
+                    morphCount, buffer, originalBuffer);
 
-                    for (unsigned j = 0; j < morphs_.Size(); ++j)
+                for (unsigned j = 0; j < morphs_.Size(); ++j)
+                {
+                    if (morphs_[j].weight_ > 0.0f)
                     {
-                        if (morphs_[j].weight_ > 0.0f)
-                        {
-                            HashMap<unsigned, VertexBufferMorph>::Iterator k = morphs_[j].buffers_.Find(i);
-                            if (k != morphs_[j].buffers_.End())
-                                ApplyMorph(buffer, dest, morphStart, k->second_, morphs_[j].weight_);
-                        }
+                        HashMap<unsigned, VertexBufferMorph>::Iterator k = morphs_[j].buffers_.Find(i);
+                        if (k != morphs_[j].buffers_.End())
+                            ApplyMorph(buffer, dest, morphStart, k->second_, morphs_[j].weight_);
                     }
-
-                    buffer->Unlock();
                 }
             }
         }
+
+        morphsUploadPending_ = true;
     }
 
     morphsDirty_ = false;
 }
 
+void AnimatedModel::UploadMorphs()
+{
+    for (unsigned i = 0; i < morphVertexBuffers_.Size(); ++i)
+    {
+        VertexBuffer* buffer = morphVertexBuffers_[i];
+        if (buffer && buffer->GetShadowData())
+        {
+            unsigned morphStart = model_->GetMorphRangeStart(i);
+            unsigned morphCount = model_->GetMorphRangeCount(i);
+            buffer->SetDataRange(buffer->GetShadowData() + morphStart * buffer->GetVertexSize(), morphStart, morphCount);
+        }
+    }
+
+    morphsUploadPending_ = false;
+}
+
 void AnimatedModel::ApplyMorph(VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph,
     float weight)
 {
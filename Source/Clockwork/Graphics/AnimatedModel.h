@@ -23,6 +23,7 @@
 #pragma once
 
 #include "../Graphics/Model.h"
+#include "../Graphics/PoseCache.h"
 #include "../Graphics/Skeleton.h"
 #include "../Graphics/StaticModel.h"
 
@@ -94,6 +95,14 @@ public:
     void SetMorphWeight(StringHash nameHash, float weight);
     /// Reset all vertex morphs to zero.
     void ResetMorphWeights();
+    /// Set whether to create a scene node for every bone (default true). When disabled, animation is evaluated into flat pose transform arrays instead, and scene nodes are only created for bones requested with CreateBoneNode(). Changing the mode on a loaded model removes the existing bone nodes and any nodes attached to them.
+    void SetBoneNodesEnabled(bool enable);
+    /// Set whether the pose may be shared with identical instances (same model and animation states at nearly the same time positions) through the scene's pose cache. Only used when bone nodes are disabled, and skipped while bones are under manual control or per-bone blending weights are used. Default false.
+    void SetPoseSharing(bool enable);
+    /// Set animation LOD distance beyond which only the most important bones are animated when bone nodes are disabled. The number of animated bones falls in proportion to the distance, dropping leaf bones first. 0 (default) disables.
+    void SetBoneLodDistance(float distance);
+    /// Return scene node of a bone, creating it if bone nodes are disabled. The node is parented directly to the model's node and follows the bone's model-space pose. Return null if bone not found.
+    Node* CreateBoneNode(const String& boneName);
 
     /// Return skeleton.
     Skeleton& GetSkeleton() { return skeleton_; }
@@ -119,6 +128,18 @@ public:
     /// Return whether to update animation when not visible.
     bool GetUpdateInvisible() const { return updateInvisible_; }
 
+    /// Return whether a scene node is created for every bone.
+    bool GetBoneNodesEnabled() const { return boneNodesEnabled_; }
+
+    /// Return whether the pose may be shared with identical instances.
+    bool GetPoseSharing() const { return poseSharing_; }
+
+    /// Return bone LOD distance.
+    float GetBoneLodDistance() const { return boneLodDistance_; }
+
+    /// Return model-space bone transforms, indexed like the skeleton's bones. Only updated when bone nodes are disabled.
+    const PODVector<Matrix3x4>& GetPoseTransforms() const { return poseTransforms_; }
+
     /// Return all vertex morphs.
     const Vector<ModelMorph>& GetMorphs() const { return morphs_; }
 
@@ -174,6 +195,26 @@ private:
     void AssignBoneNodes();
     /// Remove (old) skeleton root bone.
     void RemoveRootBone();
+    /// Create scene nodes for all bones.
+    void CreateBoneNodes();
+    /// Remove scene nodes of all bones, including nodes created for individual bones.
+    void RemoveBoneNodes();
+    /// Reset the pose and define the bone evaluation order. Called when the skeleton is set.
+    void InitializePose();
+    /// Reset animated bones of the pose to their initial transforms.
+    void ResetPose();
+    /// Concatenate the local pose into model-space transforms and move the nodes created for individual bones.
+    void UpdatePoseTransforms();
+    /// Move the nodes created for individual bones to follow the model-space pose.
+    void UpdatePoseBoneNodes();
+    /// Fill the pose cache key from the current animation states. Return false if the pose can not be shared.
+    bool BuildPoseKey();
+    /// Return the master model whose pose drives this model's skinning, or null if bone nodes are used.
+    AnimatedModel* GetPoseMaster() const;
+    /// Return the master model's bone index for each bone of this model. Rebuilt when the skeletons no longer match.
+    const PODVector<unsigned>& GetPoseMapping(AnimatedModel* master);
+    /// Notify the models sharing the pose and the nodes created for individual bones that the pose has changed. Used instead of marking the scene node dirty when bone nodes are not used.
+    void MarkPoseDirty();
     /// Mark animation and skinning to require an update.
     void MarkAnimationDirty();
     /// Mark animation and skinning to require a forced update (blending order changed.)
@@ -194,8 +235,10 @@ private:
     void UpdateBoneBoundingBox();
     /// Recalculate skinning.
     void UpdateSkinning();
-    /// Reapply all vertex morphs.
+    /// Reapply all vertex morphs to the shadow data of the morph vertex buffers. Does not access the GPU, so can be called from a worker thread.
     void UpdateMorphs();
+    /// Upload morphed vertex data to the GPU. Must be called from the main thread.
+    void UploadMorphs();
     /// Apply a vertex morph.
     void ApplyMorph
         (VertexBuffer* buffer, void* destVertexData, unsigned morphRangeStart, const VertexBufferMorph& morph, float weight);
@@ -212,6 +255,22 @@ private:
     Vector<SharedPtr<AnimationState> > animationStates_;
     /// Skinning matrices.
     PODVector<Matrix3x4> skinMatrices_;
+    /// Local-space bone positions of the pose.
+    PODVector<Vector3> posePositions_;
+    /// Local-space bone rotations of the pose.
+    PODVector<Quaternion> poseRotations_;
+    /// Local-space bone scales of the pose.
+    PODVector<Vector3> poseScales_;
+    /// Model-space bone transforms of the pose.
+    PODVector<Matrix3x4> poseTransforms_;
+    /// Bone indices in evaluation order, parents before children.
+    PODVector<unsigned> poseOrder_;
+    /// Bone importance ranks for the bone LOD, 0 being the most important. Parents always rank before their children.
+    PODVector<unsigned> poseRanks_;
+    /// Pose cache key of the current animation states.
+    PoseKey poseKey_;
+    /// Mapping of bone indices to the master model's pose for non-master models.
+    PODVector<unsigned> poseMapping_;
     /// Mapping of subgeometry bone indices, used if more bones than skinning shader can manage.
     Vector<PODVector<unsigned> > geometryBoneMappings_;
     /// Subgeometry skinning matrices, used if more bones than skinning shader can manage.
@@ -232,6 +291,10 @@ private:
     float animationLodTimer_;
     /// Animation LOD distance, the minimum of all LOD view distances last frame.
     float animationLodDistance_;
+    /// Bone LOD distance.
+    float boneLodDistance_;
+    /// Number of bones animated at the current bone LOD.
+    unsigned poseLodBones_;
     /// Update animation when invisible flag.
     bool updateInvisible_;
     /// Animation dirty flag.
@@ -240,6 +303,8 @@ private:
     bool animationOrderDirty_;
     /// Vertex morphs dirty flag.
     bool morphsDirty_;
+    /// Morphed vertex data waiting to be uploaded flag.
+    bool morphsUploadPending_;
     /// Skinning dirty flag.
     bool skinningDirty_;
     /// Bone bounding box dirty flag.
@@ -252,6 +317,10 @@ private:
     bool assignBonesPending_;
     /// Force animation update after becoming visible flag.
     bool forceAnimationUpdate_;
+    /// Create scene nodes for all bones flag.
+    bool boneNodesEnabled_;
+    /// Share the pose with identical instances flag.
+    bool poseSharing_;
 };
 
 }
@@ -79,7 +79,9 @@ bool Animation::BeginLoad(Deserializer& source)
     unsigned memoryUse = sizeof(Animation);
 
     // Check ID
-    if (source.ReadFileID() != "UANI")
+    String fileID = source.ReadFileID();
+    bool compressed = fileID == "UACL";
+    if (fileID != "UANI" && !compressed)
     {
         LOGERROR(source.GetName() + " is not a valid animation file");
         return false;
@@ -90,6 +92,7 @@ bool Animation::BeginLoad(Deserializer& source)
     animationNameHash_ = animationName_;
     length_ = source.ReadFloat();
     tracks_.Clear();
+    compressed_.Clear();
 
     unsigned tracks = source.ReadUInt();
     tracks_.Resize(tracks);
@@ -103,6 +106,10 @@ bool Animation::BeginLoad(Deserializer& source)
         newTrack.nameHash_ = newTrack.name_;
         newTrack.channelMask_ = source.ReadUByte();
 
+        // Compressed animations store only the track names and channel masks here, followed by the channels of all tracks
+        if (compressed)
+            continue;
+
         unsigned keyFrames = source.ReadUInt();
         newTrack.keyFrames_.Resize(keyFrames);
         memoryUse += keyFrames * sizeof(AnimationKeyFrame);
@@ -121,6 +128,16 @@ bool Animation::BeginLoad(Deserializer& source)
         }
     }
 
+    if (compressed)
+    {
+        if (!compressed_.Load(source, tracks, length_))
+        {
+            LOGERROR(source.GetName() + " has invalid compressed animation data");
+            return false;
+        }
+        memoryUse += compressed_.GetMemoryUse();
+    }
+
     // Optionally read triggers from an XML file
     ResourceCache* cache = GetSubsystem<ResourceCache>();
     String xmlName = ReplaceExtension(GetName(), ".xml");
@@ -149,8 +166,10 @@ bool Animation::BeginLoad(Deserializer& source)
 
 bool Animation::Save(Serializer& dest) const
 {
+    bool compressed = IsCompressed();
+
     // Write ID, name and length
-    dest.WriteFileID("UANI");
+    dest.WriteFileID(compressed ? "UACL" : "UANI");
     dest.WriteString(animationName_);
     dest.WriteFloat(length_);
 
@@ -161,6 +180,9 @@ bool Animation::Save(Serializer& dest) const
         const AnimationTrack& track = tracks_[i];
         dest.WriteString(track.name_);
         dest.WriteUByte(track.channelMask_);
+        if (compressed)
+            continue;
+
         dest.WriteUInt(track.keyFrames_.Size());
 
         // Write keyframes of the track
@@ -177,6 +199,9 @@ bool Animation::Save(Serializer& dest) const
         }
     }
 
+    if (compressed)
+        compressed_.Save(dest);
+
     // If triggers have been defined, write an XML file for them
     if (triggers_.Size())
     {
@@ -219,6 +244,7 @@ void Animation::SetLength(float length)
 void Animation::SetTracks(const Vector<AnimationTrack>& tracks)
 {
     tracks_ = tracks;
+    compressed_.Clear();
 }
 
 void Animation::AddTrigger(float time, bool timeIsNormalized, const Variant& data)
@@ -247,6 +273,46 @@ void Animation::SetNumTriggers(unsigned num)
     triggers_.Resize(num);
 }
 
+bool Animation::Compress(float positionTolerance, float rotationTolerance, float scaleTolerance)
+{
+    if (IsCompressed())
+        return true;
+
+    compressed_.Compress(tracks_, length_, positionTolerance, rotationTolerance, scaleTolerance);
+    if (compressed_.IsEmpty())
+    {
+        LOGERROR("Animation " + GetName() + " has no keyframes to compress");
+        return false;
+    }
+
+    unsigned memoryUse = sizeof(Animation) + tracks_.Size() * sizeof(AnimationTrack) + compressed_.GetMemoryUse() +
+        triggers_.Size() * sizeof(AnimationTriggerPoint);
+    for (unsigned i = 0; i < tracks_.Size(); ++i)
+    {
+        tracks_[i].keyFrames_.Clear();
+        tracks_[i].keyFrames_.Compact();
+    }
+
+    SetMemoryUse(memoryUse);
+    return true;
+}
+
+void Animation::Decompress()
+{
+    if (!IsCompressed())
+        return;
+
+    compressed_.Decompress(tracks_);
+    compressed_.Clear();
+
+    unsigned memoryUse = sizeof(Animation) + tracks_.Size() * sizeof(AnimationTrack) + triggers_.Size() *
+        sizeof(AnimationTriggerPoint);
+    for (unsigned i = 0; i < tracks_.Size(); ++i)
+        memoryUse += tracks_[i].keyFrames_.Size() * sizeof(AnimationKeyFrame);
+
+    SetMemoryUse(memoryUse);
+}
+
 const AnimationTrack* Animation::GetTrack(unsigned index) const
 {
     return index < tracks_.Size() ? &tracks_[index] : 0;
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "../Container/Ptr.h"
+#include "../Graphics/CompressedAnimation.h"
 #include "../Math/Quaternion.h"
 #include "../Math/Vector3.h"
 #include "../Resource/Resource.h"
@@ -110,6 +111,11 @@ public:
     void RemoveAllTriggers();
     /// Resize trigger point vector.
     void SetNumTriggers(unsigned num);
+    /// Convert the keyframe tracks to the compressed representation, which is also used when saving. The tracks' keyframes are freed. Return true if successful.
+    bool Compress(float positionTolerance = DEFAULT_POSITION_TOLERANCE, float rotationTolerance = DEFAULT_ROTATION_TOLERANCE,
+        float scaleTolerance = DEFAULT_SCALE_TOLERANCE);
+    /// Convert the compressed representation back to keyframe tracks.
+    void Decompress();
 
     /// Return animation name.
     const String& GetAnimationName() const { return animationName_; }
@@ -120,7 +126,7 @@ public:
     /// Return animation length.
     float GetLength() const { return length_; }
 
-    /// Return all animation tracks.
+    /// Return all animation tracks. When compressed, the tracks have no keyframes.
     const Vector<AnimationTrack>& GetTracks() const { return tracks_; }
 
     /// Return number of animation tracks.
@@ -139,6 +145,12 @@ public:
     /// Return number of animation trigger points.
     unsigned GetNumTriggers() const { return triggers_.Size(); }
 
+    /// Return whether the tracks are stored in compressed form.
+    bool IsCompressed() const { return !compressed_.IsEmpty(); }
+
+    /// Return the compressed tracks.
+    const CompressedAnimation& GetCompressedData() const { return compressed_; }
+
 private:
     /// Animation name.
     String animationName_;
@@ -150,6 +162,8 @@ private:
     Vector<AnimationTrack> tracks_;
     /// Animation trigger points.
     Vector<AnimationTriggerPoint> triggers_;
+    /// Compressed tracks.
+    CompressedAnimation compressed_;
 };
 
 }
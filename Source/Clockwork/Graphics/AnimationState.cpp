@@ -33,9 +33,56 @@
 namespace Clockwork
 {
 
+/// Sample an animation track at a time position, interpolating between key frames. Update the last key frame index.
+static void SampleKeyFrames(const AnimationTrack* track, unsigned& frame, float time, float length, bool looped, Vector3& position,
+    Quaternion& rotation, Vector3& scale)
+{
+    track->GetKeyFrameIndex(time, frame);
+
+    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
+    unsigned nextFrame = frame + 1;
+    bool interpolate = true;
+    if (nextFrame >= track->keyFrames_.Size())
+    {
+        if (!looped)
+        {
+            nextFrame = frame;
+            interpolate = false;
+        }
+        else
+            nextFrame = 0;
+    }
+
+    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
+    unsigned char channelMask = track->channelMask_;
+
+    if (!interpolate)
+    {
+        position = keyFrame->position_;
+        rotation = keyFrame->rotation_;
+        scale = keyFrame->scale_;
+    }
+    else
+    {
+        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
+        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
+        if (timeInterval < 0.0f)
+            timeInterval += length;
+        float t = timeInterval > 0.0f ? (time - keyFrame->time_) / timeInterval : 1.0f;
+
+        if (channelMask & CHANNEL_POSITION)
+            position = keyFrame->position_.Lerp(nextKeyFrame->position_, t);
+        if (channelMask & CHANNEL_ROTATION)
+            rotation = keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t);
+        if (channelMask & CHANNEL_SCALE)
+            scale = keyFrame->scale_.Lerp(nextKeyFrame->scale_, t);
+    }
+}
+
 AnimationStateTrack::AnimationStateTrack() :
     track_(0),
     bone_(0),
+    boneIndex_(M_MAX_UNSIGNED),
     weight_(1.0f),
     keyFrame_(0)
 {
@@ -52,7 +99,8 @@ AnimationState::AnimationState(AnimatedModel* model, Animation* animation) :
     looped_(false),
     weight_(0.0f),
     time_(0.0f),
-    layer_(0)
+    layer_(0),
+    poseTracks_(false)
 {
     // Set default start bone (use all tracks.)
     SetStartBone(0);
@@ -65,7 +113,8 @@ AnimationState::AnimationState(Node* node, Animation* animation) :
     looped_(false),
     weight_(1.0f),
     time_(0.0f),
-    layer_(0)
+    layer_(0),
+    poseTracks_(false)
 {
     if (animation_)
     {
@@ -118,18 +167,25 @@ void AnimationState::SetStartBone(Bone* startBone)
         startBone = rootBone;
     }
 
+    // Without bone nodes, the tracks are matched against the skeleton's bone hierarchy and applied to the model's pose
+    bool poseTracks = !model_->GetBoneNodesEnabled();
+
     // Do not reassign if the start bone did not actually change, and we already have valid bone nodes
-    if (startBone == startBone_ && !stateTracks_.Empty())
+    if (startBone == startBone_ && !stateTracks_.Empty() && poseTracks == poseTracks_)
         return;
 
     startBone_ = startBone;
+    poseTracks_ = poseTracks;
 
     const Vector<AnimationTrack>& tracks = animation_->GetTracks();
     stateTracks_.Clear();
 
-    if (!startBone->node_)
+    if (!startBone->node_ && !poseTracks)
         return;
 
+    const Vector<Bone>& bones = skeleton.GetBones();
+    unsigned startBoneIndex = (unsigned)(startBone - &bones[0]);
+
     for (unsigned i = 0; i < tracks.Size(); ++i)
     {
         AnimationStateTrack stateTrack;
@@ -141,6 +197,27 @@ void AnimationState::SetStartBone(Bone* startBone)
 
         if (nameHash == startBone->nameHash_)
             trackBone = startBone;
+        else if (poseTracks)
+        {
+            Bone* bone = skeleton.GetBone(nameHash);
+            if (bone)
+            {
+                // Walk up the parent chain, at most the number of bones in case of a malformed hierarchy
+                unsigned index = (unsigned)(bone - &bones[0]);
+                for (unsigned j = 0; j < bones.Size(); ++j)
+                {
+                    unsigned parentIndex = bones[index].parentIndex_;
+                    if (parentIndex == index || parentIndex >= bones.Size())
+                        break;
+                    if (parentIndex == startBoneIndex)
+                    {
+                        trackBone = bone;
+                        break;
+                    }
+                    index = parentIndex;
+                }
+            }
+        }
         else
         {
             Node* trackBoneNode = startBone->node_->GetChild(nameHash, true);
@@ -148,10 +225,12 @@ void AnimationState::SetStartBone(Bone* startBone)
                 trackBone = skeleton.GetBone(nameHash);
         }
 
-        if (trackBone && trackBone->node_)
+        if (trackBone && (trackBone->node_ || poseTracks))
         {
             stateTrack.bone_ = trackBone;
-            stateTrack.node_ = trackBone->node_;
+            stateTrack.boneIndex_ = (unsigned)(trackBone - &bones[0]);
+            if (!poseTracks)
+                stateTrack.node_ = trackBone->node_;
             stateTracks_.Push(stateTrack);
         }
     }
@@ -209,7 +288,18 @@ void AnimationState::SetBoneWeight(unsigned index, float weight, bool recursive)
     if (recursive)
     {
         Node* boneNode = stateTracks_[index].node_;
-        if (boneNode)
+        if (poseTracks_)
+        {
+            // Recurse to the tracks of the child bones
+            unsigned boneIndex = stateTracks_[index].boneIndex_;
+            for (unsigned i = 0; i < stateTracks_.Size(); ++i)
+            {
+                const Bone* bone = stateTracks_[i].bone_;
+                if (i != index && bone && bone->parentIndex_ == boneIndex)
+                    SetBoneWeight(i, weight, true);
+            }
+        }
+        else if (boneNode)
         {
             const Vector<SharedPtr<Node> >& children = boneNode->GetChildren();
             for (unsigned i = 0; i < children.Size(); ++i)
@@ -349,12 +439,23 @@ float AnimationState::GetBoneWeight(StringHash nameHash) const
     return GetBoneWeight(GetTrackIndex(nameHash));
 }
 
+bool AnimationState::HasBoneWeights() const
+{
+    for (Vector<AnimationStateTrack>::ConstIterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
+    {
+        if (i->weight_ != 1.0f)
+            return true;
+    }
+
+    return false;
+}
+
 unsigned AnimationState::GetTrackIndex(const String& name) const
 {
     for (unsigned i = 0; i < stateTracks_.Size(); ++i)
     {
         Node* node = stateTracks_[i].node_;
-        if (node && node->GetName() == name)
+        if (node ? node->GetName() == name : (poseTracks_ && stateTracks_[i].bone_->name_ == name))
             return i;
     }
 
@@ -377,7 +478,7 @@ unsigned AnimationState::GetTrackIndex(StringHash nameHash) const
     for (unsigned i = 0; i < stateTracks_.Size(); ++i)
     {
         Node* node = stateTracks_[i].node_;
-        if (node && node->GetNameHash() == nameHash)
+        if (node ? node->GetNameHash() == nameHash : (poseTracks_ && stateTracks_[i].bone_->nameHash_ == nameHash))
             return i;
     }
 
@@ -394,8 +495,30 @@ void AnimationState::Apply()
     if (!animation_ || !IsEnabled())
         return;
 
+    // Decode all tracks of a compressed animation in one pass
+    if (animation_->IsCompressed())
+    {
+        unsigned numTracks = animation_->GetNumTracks();
+        if (samplePositions_.Size() != numTracks)
+        {
+            samplePositions_.Resize(numTracks);
+            sampleRotations_.Resize(numTracks);
+            sampleScales_.Resize(numTracks);
+        }
+        if (numTracks)
+        {
+            animation_->GetCompressedData().Sample(time_, looped_, &samplePositions_[0], &sampleRotations_[0],
+                &sampleScales_[0]);
+        }
+    }
+
     if (model_)
-        ApplyToModel();
+    {
+        if (poseTracks_)
+            ApplyToPose();
+        else
+            ApplyToModel();
+    }
     else
         ApplyToNodes();
 }
@@ -418,188 +541,144 @@ void AnimationState::ApplyToModel()
     }
 }
 
-void AnimationState::ApplyToNodes()
-{
-    // When applying to a node hierarchy, can only use full weight (nothing to blend to)
-    for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
-        ApplyTrackFullWeight(*i);
-}
-
-void AnimationState::ApplyTrackFullWeight(AnimationStateTrack& stateTrack)
+void AnimationState::ApplyToPose()
 {
-    const AnimationTrack* track = stateTrack.track_;
-    Node* node = stateTrack.node_;
-
-    if (track->keyFrames_.Empty() || !node)
+    unsigned numBones = model_->poseTransforms_.Size();
+    if (!numBones)
         return;
 
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
+    Vector3* positions = &model_->posePositions_[0];
+    Quaternion* rotations = &model_->poseRotations_[0];
+    Vector3* scales = &model_->poseScales_[0];
+    const unsigned* ranks = &model_->poseRanks_[0];
+    unsigned lodBones = model_->poseLodBones_;
 
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
+    for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
     {
-        if (!looped_)
+        AnimationStateTrack& stateTrack = *i;
+        const AnimationTrack* track = stateTrack.track_;
+        unsigned index = stateTrack.boneIndex_;
+        float finalWeight = weight_ * stateTrack.weight_;
+
+        // Do not apply if zero effective weight, the bone has animation disabled, or is dropped by the bone LOD
+        if (Equals(finalWeight, 0.0f) || !stateTrack.bone_->animated_ || index >= numBones || ranks[index] >= lodBones)
+            continue;
+
+        Vector3 position;
+        Quaternion rotation;
+        Vector3 scale;
+        if (!SampleTrack(stateTrack, position, rotation, scale))
+            continue;
+        unsigned char channelMask = track->channelMask_;
+
+        if (Equals(finalWeight, 1.0f))
         {
-            nextFrame = frame;
-            interpolate = false;
+            if (channelMask & CHANNEL_POSITION)
+                positions[index] = position;
+            if (channelMask & CHANNEL_ROTATION)
+                rotations[index] = rotation;
+            if (channelMask & CHANNEL_SCALE)
+                scales[index] = scale;
         }
         else
-            nextFrame = 0;
+        {
+            if (channelMask & CHANNEL_POSITION)
+                positions[index] = positions[index].Lerp(position, finalWeight);
+            if (channelMask & CHANNEL_ROTATION)
+                rotations[index] = rotations[index].Slerp(rotation, finalWeight);
+            if (channelMask & CHANNEL_SCALE)
+                scales[index] = scales[index].Lerp(scale, finalWeight);
+        }
     }
+}
 
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
-    unsigned char channelMask = track->channelMask_;
+void AnimationState::ApplyToNodes()
+{
+    // When applying to a node hierarchy, can only use full weight (nothing to blend to)
+    for (Vector<AnimationStateTrack>::Iterator i = stateTracks_.Begin(); i != stateTracks_.End(); ++i)
+        ApplyTrackFullWeight(*i);
+}
 
-    if (!interpolate)
+bool AnimationState::SampleTrack(AnimationStateTrack& stateTrack, Vector3& position, Quaternion& rotation, Vector3& scale)
+{
+    const AnimationTrack* track = stateTrack.track_;
+
+    // Compressed animations have been sampled for all tracks at once
+    if (animation_->IsCompressed())
     {
-        // No interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPosition(keyFrame->position_);
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotation(keyFrame->rotation_);
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScale(keyFrame->scale_);
+        unsigned index = (unsigned)(track - &animation_->GetTracks()[0]);
+        if (index >= samplePositions_.Size())
+            return false;
+
+        position = samplePositions_[index];
+        rotation = sampleRotations_[index];
+        scale = sampleScales_[index];
+        return true;
     }
-    else
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
 
-        // Interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPosition(keyFrame->position_.Lerp(nextKeyFrame->position_, t));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotation(keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScale(keyFrame->scale_.Lerp(nextKeyFrame->scale_, t));
-    }
+    if (track->keyFrames_.Empty())
+        return false;
+
+    SampleKeyFrames(track, stateTrack.keyFrame_, time_, animation_->GetLength(), looped_, position, rotation, scale);
+    return true;
 }
 
-void AnimationState::ApplyTrackFullWeightSilent(AnimationStateTrack& stateTrack)
+void AnimationState::ApplyTrackFullWeight(AnimationStateTrack& stateTrack)
 {
-    const AnimationTrack* track = stateTrack.track_;
     Node* node = stateTrack.node_;
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scale;
 
-    if (track->keyFrames_.Empty() || !node)
+    if (!node || !SampleTrack(stateTrack, position, rotation, scale))
         return;
 
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
-
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
-    }
+    unsigned char channelMask = stateTrack.track_->channelMask_;
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPosition(position);
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotation(rotation);
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScale(scale);
+}
 
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
-    unsigned char channelMask = track->channelMask_;
+void AnimationState::ApplyTrackFullWeightSilent(AnimationStateTrack& stateTrack)
+{
+    Node* node = stateTrack.node_;
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scale;
 
-    if (!interpolate)
-    {
-        // No interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(keyFrame->position_);
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(keyFrame->rotation_);
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(keyFrame->scale_);
-    }
-    else
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
+    if (!node || !SampleTrack(stateTrack, position, rotation, scale))
+        return;
 
-        // Interpolation, full weight
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(keyFrame->position_.Lerp(nextKeyFrame->position_, t));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(keyFrame->scale_.Lerp(nextKeyFrame->scale_, t));
-    }
+    unsigned char channelMask = stateTrack.track_->channelMask_;
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPositionSilent(position);
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotationSilent(rotation);
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScaleSilent(scale);
 }
 
 void AnimationState::ApplyTrackBlendedSilent(AnimationStateTrack& stateTrack, float weight)
 {
-    const AnimationTrack* track = stateTrack.track_;
     Node* node = stateTrack.node_;
+    Vector3 position;
+    Quaternion rotation;
+    Vector3 scale;
 
-    if (track->keyFrames_.Empty() || !node)
+    if (!node || !SampleTrack(stateTrack, position, rotation, scale))
         return;
 
-    unsigned& frame = stateTrack.keyFrame_;
-    track->GetKeyFrameIndex(time_, frame);
-
-    // Check if next frame to interpolate to is valid, or if wrapping is needed (looping animation only)
-    unsigned nextFrame = frame + 1;
-    bool interpolate = true;
-    if (nextFrame >= track->keyFrames_.Size())
-    {
-        if (!looped_)
-        {
-            nextFrame = frame;
-            interpolate = false;
-        }
-        else
-            nextFrame = 0;
-    }
-
-    const AnimationKeyFrame* keyFrame = &track->keyFrames_[frame];
-    unsigned char channelMask = track->channelMask_;
-
-    if (!interpolate)
-    {
-        // No interpolation, blend between old transform & animation
-        if (channelMask & CHANNEL_POSITION)
-            node->SetPositionSilent(node->GetPosition().Lerp(keyFrame->position_, weight));
-        if (channelMask & CHANNEL_ROTATION)
-            node->SetRotationSilent(node->GetRotation().Slerp(keyFrame->rotation_, weight));
-        if (channelMask & CHANNEL_SCALE)
-            node->SetScaleSilent(node->GetScale().Lerp(keyFrame->scale_, weight));
-    }
-    else
-    {
-        const AnimationKeyFrame* nextKeyFrame = &track->keyFrames_[nextFrame];
-        float timeInterval = nextKeyFrame->time_ - keyFrame->time_;
-        if (timeInterval < 0.0f)
-            timeInterval += animation_->GetLength();
-        float t = timeInterval > 0.0f ? (time_ - keyFrame->time_) / timeInterval : 1.0f;
-
-        // Interpolation, blend between old transform & animation
-        if (channelMask & CHANNEL_POSITION)
-        {
-            node->SetPositionSilent(node->GetPosition().Lerp(
-                keyFrame->position_.Lerp(nextKeyFrame->position_, t), weight));
-        }
-        if (channelMask & CHANNEL_ROTATION)
-        {
-            node->SetRotationSilent(node->GetRotation().Slerp(
-                keyFrame->rotation_.Slerp(nextKeyFrame->rotation_, t), weight));
-        }
-        if (channelMask & CHANNEL_SCALE)
-        {
-            node->SetScaleSilent(node->GetScale().Lerp(
-                keyFrame->scale_.Lerp(nextKeyFrame->scale_, t), weight));
-        }
-    }
+    // Blend between old transform & animation
+    unsigned char channelMask = stateTrack.track_->channelMask_;
+    if (channelMask & CHANNEL_POSITION)
+        node->SetPositionSilent(node->GetPosition().Lerp(position, weight));
+    if (channelMask & CHANNEL_ROTATION)
+        node->SetRotationSilent(node->GetRotation().Slerp(rotation, weight));
+    if (channelMask & CHANNEL_SCALE)
+        node->SetScaleSilent(node->GetScale().Lerp(scale, weight));
 }
 
 }
@@ -24,6 +24,8 @@
 
 #include "../Container/HashMap.h"
 #include "../Container/Ptr.h"
+#include "../Math/Quaternion.h"
+#include "../Math/Vector3.h"
 
 namespace Clockwork
 {
@@ -48,6 +50,8 @@ struct AnimationStateTrack
     const AnimationTrack* track_;
     /// Bone pointer.
     Bone* bone_;
+    /// Bone index in the skeleton (model mode.)
+    unsigned boneIndex_;
     /// Scene node pointer.
     WeakPtr<Node> node_;
     /// Blending weight.
@@ -103,6 +107,8 @@ public:
     float GetBoneWeight(const String& name) const;
     /// Return per-bone blending weight by name.
     float GetBoneWeight(StringHash nameHash) const;
+    /// Return whether any track has a per-bone blending weight other than 1.0.
+    bool HasBoneWeights() const;
     /// Return track index with matching bone node, or M_MAX_UNSIGNED if not found.
     unsigned GetTrackIndex(Node* node) const;
     /// Return track index by bone name, or M_MAX_UNSIGNED if not found.
@@ -134,6 +140,8 @@ public:
 private:
     /// Apply animation to a skeleton. Transform changes are applied silently, so the model needs to dirty its root model afterward.
     void ApplyToModel();
+    /// Apply animation to the model's pose arrays when it does not use bone nodes.
+    void ApplyToPose();
     /// Apply animation to a scene node hierarchy.
     void ApplyToNodes();
     /// Apply animation track to a scene node, full weight.
@@ -142,6 +150,8 @@ private:
     void ApplyTrackFullWeightSilent(AnimationStateTrack& stateTrack);
     /// Apply animation track to a scene node, blended with current node transform. Apply transform changes silently without marking the node dirty.
     void ApplyTrackBlendedSilent(AnimationStateTrack& stateTrack, float weight);
+    /// Sample an animation track at the current time position. Return false if the track has no data.
+    bool SampleTrack(AnimationStateTrack& stateTrack, Vector3& position, Quaternion& rotation, Vector3& scale);
 
     /// Animated model (model mode.)
     WeakPtr<AnimatedModel> model_;
@@ -161,6 +171,14 @@ private:
     float time_;
     /// Blending layer.
     unsigned char layer_;
+    /// Tracks are assigned to the model's pose instead of bone nodes flag.
+    bool poseTracks_;
+    /// Sampled track positions of a compressed animation.
+    PODVector<Vector3> samplePositions_;
+    /// Sampled track rotations of a compressed animation.
+    PODVector<Quaternion> sampleRotations_;
+    /// Sampled track scales of a compressed animation.
+    PODVector<Vector3> sampleScales_;
 };
 
 }
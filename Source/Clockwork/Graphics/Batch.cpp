@@ -40,41 +40,6 @@
 namespace Clockwork
 {
 
-inline bool CompareBatchesState(Batch* lhs, Batch* rhs)
-{
-    if (lhs->renderOrder_ != rhs->renderOrder_)
-        return lhs->renderOrder_ < rhs->renderOrder_;
-    else if (lhs->sortKey_ != rhs->sortKey_)
-        return lhs->sortKey_ < rhs->sortKey_;
-    else
-        return lhs->distance_ < rhs->distance_;
-}
-
-inline bool CompareBatchesFrontToBack(Batch* lhs, Batch* rhs)
-{
-    if (lhs->renderOrder_ != rhs->renderOrder_)
-        return lhs->renderOrder_ < rhs->renderOrder_;
-    else if (lhs->distance_ != rhs->distance_)
-        return lhs->distance_ < rhs->distance_;
-    else
-        return lhs->sortKey_ < rhs->sortKey_;
-}
-
-inline bool CompareBatchesBackToFront(Batch* lhs, Batch* rhs)
-{
-    if (lhs->renderOrder_ != rhs->renderOrder_)
-        return lhs->renderOrder_ < rhs->renderOrder_;
-    else if (lhs->distance_ != rhs->distance_)
-        return lhs->distance_ > rhs->distance_;
-    else
-        return lhs->sortKey_ < rhs->sortKey_;
-}
-
-inline bool CompareInstancesFrontToBack(const InstanceData& lhs, const InstanceData& rhs)
-{
-    return lhs.distance_ < rhs.distance_;
-}
-
 inline bool CompareBatchGroupOrder(BatchGroup* lhs, BatchGroup* rhs)
 {
     return lhs->renderOrder_ < rhs->renderOrder_;
@@ -688,127 +653,200 @@ void BatchQueue::Clear(int maxSortedInstances)
     batches_.Clear();
     sortedBatches_.Clear();
     batchGroups_.Clear();
+    instancedBatches_.Clear();
     maxSortedInstances_ = (unsigned)maxSortedInstances;
 }
 
 void BatchQueue::SortBackToFront()
 {
-    sortedBatches_.Resize(batches_.Size());
+    unsigned numBatches = batches_.Size();
+    PODVector<RadixSortItem>& items = batchSortBuffer_.items_;
+    items.Resize(numBatches);
+    batchSortBuffer_.temp_.Resize(numBatches);
 
-    for (unsigned i = 0; i < batches_.Size(); ++i)
-        sortedBatches_[i] = &batches_[i];
+    // Render order has priority, then descending distance, then the shader part of the state
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        const Batch& batch = batches_[i];
+        items[i].key_ = (((unsigned long long)batch.renderOrder_) << 56) |
+                        (((unsigned long long)~FloatToRadixKey(batch.distance_)) << 24) | (batch.sortKey_ >> 40);
+        items[i].index_ = i;
+    }
+
+    RadixSort(items.Begin().ptr_, batchSortBuffer_.temp_.Begin().ptr_, numBatches);
 
-    Sort(sortedBatches_.Begin(), sortedBatches_.End(), CompareBatchesBackToFront);
+    sortedBatches_.Resize(numBatches);
+    for (unsigned i = 0; i < numBatches; ++i)
+        sortedBatches_[i] = &batches_[items[i].index_];
 
     sortedBatchGroups_.Resize(batchGroups_.Size());
     
-    unsigned index = 0;
-    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
-        sortedBatchGroups_[index++] = &i->second_;
+    for (unsigned i = 0; i < batchGroups_.Size(); ++i)
+        sortedBatchGroups_[i] = &batchGroups_[i];
     
     Sort(sortedBatchGroups_.Begin(), sortedBatchGroups_.End(), CompareBatchGroupOrder);
 }
 
 void BatchQueue::SortFrontToBack()
 {
-    sortedBatches_.Clear();
+    SortBatchesFrontToBack();
+    SortGroupsFrontToBack();
+}
+
+void BatchQueue::SortBatchesFrontToBack()
+{
+    sortedBatches_.Resize(batches_.Size());
 
     for (unsigned i = 0; i < batches_.Size(); ++i)
-        sortedBatches_.Push(&batches_[i]);
+        sortedBatches_[i] = &batches_[i];
 
-    SortFrontToBack2Pass(sortedBatches_);
+    SortFrontToBack2Pass(sortedBatches_, batchSortBuffer_);
+}
+
+void BatchQueue::SortGroupsFrontToBack()
+{
+    PODVector<RadixSortItem>& items = groupSortBuffer_.items_;
+    PODVector<InstanceData>& instances = groupSortBuffer_.instances_;
 
     // Sort each group front to back
-    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
+    for (Vector<BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
     {
-        if (i->second_.instances_.Size() <= maxSortedInstances_)
+        unsigned numInstances = i->instances_.Size();
+        if (numInstances > 1 && numInstances <= maxSortedInstances_)
         {
-            Sort(i->second_.instances_.Begin(), i->second_.instances_.End(), CompareInstancesFrontToBack);
-            if (i->second_.instances_.Size())
-                i->second_.distance_ = i->second_.instances_[0].distance_;
+            items.Resize(numInstances);
+            groupSortBuffer_.temp_.Resize(numInstances);
+            instances = i->instances_;
+
+            for (unsigned j = 0; j < numInstances; ++j)
+            {
+                items[j].key_ = FloatToRadixKey(instances[j].distance_);
+                items[j].index_ = j;
+            }
+
+            RadixSort(items.Begin().ptr_, groupSortBuffer_.temp_.Begin().ptr_, numInstances);
+
+            for (unsigned j = 0; j < numInstances; ++j)
+                i->instances_[j] = instances[items[j].index_];
+            i->distance_ = i->instances_[0].distance_;
         }
         else
         {
             float minDistance = M_INFINITY;
-            for (PODVector<InstanceData>::ConstIterator j = i->second_.instances_.Begin(); j != i->second_.instances_.End(); ++j)
+            for (PODVector<InstanceData>::ConstIterator j = i->instances_.Begin(); j != i->instances_.End(); ++j)
                 minDistance = Min(minDistance, j->distance_);
-            i->second_.distance_ = minDistance;
+            i->distance_ = minDistance;
         }
     }
 
     sortedBatchGroups_.Resize(batchGroups_.Size());
 
-    unsigned index = 0;
-    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
-        sortedBatchGroups_[index++] = &i->second_;
+    for (unsigned i = 0; i < batchGroups_.Size(); ++i)
+        sortedBatchGroups_[i] = &batchGroups_[i];
 
-    SortFrontToBack2Pass(reinterpret_cast<PODVector<Batch*>& >(sortedBatchGroups_));
+    SortFrontToBack2Pass(reinterpret_cast<PODVector<Batch*>& >(sortedBatchGroups_), groupSortBuffer_);
 }
 
-void BatchQueue::SortFrontToBack2Pass(PODVector<Batch*>& batches)
+void BatchQueue::SortFrontToBack2Pass(PODVector<Batch*>& batches, BatchSortBuffer& buffer)
 {
+    unsigned numBatches = batches.Size();
+    PODVector<RadixSortItem>& items = buffer.items_;
+    items.Resize(numBatches);
+    buffer.temp_.Resize(numBatches);
+    // Sort keys refer to the batches by index, so keep the original order for the final reordering
+    buffer.batches_ = batches;
+
     // Mobile devices likely use a tiled deferred approach, with which front-to-back sorting is irrelevant. The 2-pass
-    // method is also time consuming, so just sort with state having priority
+    // method is also time consuming, so just sort with state having priority. As the radix sort is stable, sort by the least
+    // significant key first
 #ifdef GL_ES_VERSION_2_0
-    Sort(batches.Begin(), batches.End(), CompareBatchesState);
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        items[i].key_ = FloatToRadixKey(batches[i]->distance_);
+        items[i].index_ = i;
+    }
+    RadixSort(items.Begin().ptr_, buffer.temp_.Begin().ptr_, numBatches);
+
+    for (unsigned i = 0; i < numBatches; ++i)
+        items[i].key_ = batches[items[i].index_]->sortKey_;
+    RadixSort(items.Begin().ptr_, buffer.temp_.Begin().ptr_, numBatches);
+
+    for (unsigned i = 0; i < numBatches; ++i)
+        items[i].key_ = batches[items[i].index_]->renderOrder_;
+    RadixSort(items.Begin().ptr_, buffer.temp_.Begin().ptr_, numBatches);
 #else
     // For desktop, first sort by distance and remap shader/material/geometry IDs in the sort key
-    Sort(batches.Begin(), batches.End(), CompareBatchesFrontToBack);
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        const Batch* batch = batches[i];
+        items[i].key_ = (((unsigned long long)batch->renderOrder_) << 56) |
+                        (((unsigned long long)FloatToRadixKey(batch->distance_)) << 24) | (batch->sortKey_ >> 40);
+        items[i].index_ = i;
+    }
+    RadixSort(items.Begin().ptr_, buffer.temp_.Begin().ptr_, numBatches);
 
     unsigned freeShaderID = 0;
     unsigned short freeMaterialID = 0;
     unsigned short freeGeometryID = 0;
 
-    for (PODVector<Batch*>::Iterator i = batches.Begin(); i != batches.End(); ++i)
+    for (unsigned i = 0; i < numBatches; ++i)
     {
-        Batch* batch = *i;
+        Batch* batch = batches[items[i].index_];
 
         unsigned shaderID = (unsigned)(batch->sortKey_ >> 32);
-        HashMap<unsigned, unsigned>::ConstIterator j = shaderRemapping_.Find(shaderID);
-        if (j != shaderRemapping_.End())
+        HashMap<unsigned, unsigned>::ConstIterator j = buffer.shaderRemapping_.Find(shaderID);
+        if (j != buffer.shaderRemapping_.End())
             shaderID = j->second_;
         else
         {
-            shaderID = shaderRemapping_[shaderID] = freeShaderID | (shaderID & 0xc0000000);
+            shaderID = buffer.shaderRemapping_[shaderID] = freeShaderID | (shaderID & 0xc0000000);
             ++freeShaderID;
         }
 
-        unsigned short materialID = (unsigned short)(batch->sortKey_ & 0xffff0000);
-        HashMap<unsigned short, unsigned short>::ConstIterator k = materialRemapping_.Find(materialID);
-        if (k != materialRemapping_.End())
+        unsigned short materialID = (unsigned short)((batch->sortKey_ >> 16) & 0xffff);
+        HashMap<unsigned short, unsigned short>::ConstIterator k = buffer.materialRemapping_.Find(materialID);
+        if (k != buffer.materialRemapping_.End())
             materialID = k->second_;
         else
         {
-            materialID = materialRemapping_[materialID] = freeMaterialID;
+            materialID = buffer.materialRemapping_[materialID] = freeMaterialID;
             ++freeMaterialID;
         }
 
         unsigned short geometryID = (unsigned short)(batch->sortKey_ & 0xffff);
-        HashMap<unsigned short, unsigned short>::ConstIterator l = geometryRemapping_.Find(geometryID);
-        if (l != geometryRemapping_.End())
+        HashMap<unsigned short, unsigned short>::ConstIterator l = buffer.geometryRemapping_.Find(geometryID);
+        if (l != buffer.geometryRemapping_.End())
             geometryID = l->second_;
         else
         {
-            geometryID = geometryRemapping_[geometryID] = freeGeometryID;
+            geometryID = buffer.geometryRemapping_[geometryID] = freeGeometryID;
             ++freeGeometryID;
         }
 
         batch->sortKey_ = (((unsigned long long)shaderID) << 32) | (((unsigned long long)materialID) << 16) | geometryID;
+
+        // The remapped shader IDs fit in 22 bits, which leaves room for the render order in the same key. The items are
+        // already in distance order, which the stable sort keeps for batches with equal state
+        items[i].key_ = (((unsigned long long)batch->renderOrder_) << 56) | (((unsigned long long)(shaderID >> 30)) << 54) |
+                        (((unsigned long long)(shaderID & 0x3fffff)) << 32) | (batch->sortKey_ & 0xffffffff);
     }
 
-    shaderRemapping_.Clear();
-    materialRemapping_.Clear();
-    geometryRemapping_.Clear();
+    buffer.shaderRemapping_.Clear();
+    buffer.materialRemapping_.Clear();
+    buffer.geometryRemapping_.Clear();
 
     // Finally sort again with the rewritten ID's
-    Sort(batches.Begin(), batches.End(), CompareBatchesState);
+    RadixSort(items.Begin().ptr_, buffer.temp_.Begin().ptr_, numBatches);
 #endif
+
+    for (unsigned i = 0; i < numBatches; ++i)
+        batches[i] = buffer.batches_[items[i].index_];
 }
 
 void BatchQueue::SetTransforms(void* lockedData, unsigned& freeIndex)
 {
-    for (HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
-        i->second_.SetTransforms(lockedData, freeIndex);
+    for (Vector<BatchGroup>::Iterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
+        i->SetTransforms(lockedData, freeIndex);
 }
 
 void BatchQueue::Draw(View* view, bool markToStencil, bool usingLightOptimization, bool allowDepthWrite) const
@@ -858,10 +896,10 @@ unsigned BatchQueue::GetNumInstances() const
 {
     unsigned total = 0;
 
-    for (HashMap<BatchGroupKey, BatchGroup>::ConstIterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
+    for (Vector<BatchGroup>::ConstIterator i = batchGroups_.Begin(); i != batchGroups_.End(); ++i)
     {
-        if (i->second_.geometryType_ == GEOM_INSTANCED)
-            total += i->second_.instances_.Size();
+        if (i->geometryType_ == GEOM_INSTANCED)
+            total += i->instances_.Size();
     }
 
     return total;
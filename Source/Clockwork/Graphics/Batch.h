@@ -23,6 +23,7 @@
 #pragma once
 
 #include "../Container/Ptr.h"
+#include "../Container/Sort.h"
 #include "../Graphics/Drawable.h"
 #include "../Graphics/Material.h"
 #include "../Math/MathDefs.h"
@@ -40,6 +41,7 @@ class Material;
 class Matrix3x4;
 class Pass;
 class ShaderVariation;
+class Technique;
 class Texture2D;
 class VertexBuffer;
 class View;
@@ -226,6 +228,36 @@ struct BatchGroupKey
     unsigned ToHash() const;
 };
 
+/// Instanced draw call waiting to be assigned to a batch group.
+struct InstancedBatch
+{
+    /// Draw call.
+    Batch batch_;
+    /// Technique, used when assigning the batch group shaders.
+    Technique* technique_;
+    /// Shadows allowed flag, used when assigning the batch group shaders.
+    bool allowShadows_;
+};
+
+/// Scratch buffers for radix sorting batches, kept between frames to avoid allocation.
+struct BatchSortBuffer
+{
+    /// Sort keys and indices.
+    PODVector<RadixSortItem> items_;
+    /// Temporary buffer for the radix sort.
+    PODVector<RadixSortItem> temp_;
+    /// Batches in their original order.
+    PODVector<Batch*> batches_;
+    /// Instances in their original order.
+    PODVector<InstanceData> instances_;
+    /// Shader remapping table for 2-pass state and distance sort.
+    HashMap<unsigned, unsigned> shaderRemapping_;
+    /// Material remapping table for 2-pass state and distance sort.
+    HashMap<unsigned short, unsigned short> materialRemapping_;
+    /// Geometry remapping table for 2-pass state and distance sort.
+    HashMap<unsigned short, unsigned short> geometryRemapping_;
+};
+
 /// Queue that contains both instanced and non-instanced draw calls.
 struct BatchQueue
 {
@@ -236,8 +268,12 @@ public:
     void SortBackToFront();
     /// Sort instanced and non-instanced draw calls front to back.
     void SortFrontToBack();
+    /// Sort non-instanced draw calls front to back. Can be run in parallel with SortGroupsFrontToBack().
+    void SortBatchesFrontToBack();
+    /// Sort instanced draw calls front to back. Can be run in parallel with SortBatchesFrontToBack().
+    void SortGroupsFrontToBack();
     /// Sort batches front to back while also maintaining state sorting.
-    void SortFrontToBack2Pass(PODVector<Batch*>& batches);
+    void SortFrontToBack2Pass(PODVector<Batch*>& batches, BatchSortBuffer& buffer);
     /// Pre-set instance transforms of all groups. The vertex buffer must be big enough to hold all transforms.
     void SetTransforms(void* lockedData, unsigned& freeIndex);
     /// Draw.
@@ -246,16 +282,16 @@ public:
     unsigned GetNumInstances() const;
 
     /// Return whether the batch group is empty.
-    bool IsEmpty() const { return batches_.Empty() && batchGroups_.Empty(); }
+    bool IsEmpty() const { return batches_.Empty() && batchGroups_.Empty() && instancedBatches_.Empty(); }
 
     /// Instanced draw calls.
-    HashMap<BatchGroupKey, BatchGroup> batchGroups_;
-    /// Shader remapping table for 2-pass state and distance sort.
-    HashMap<unsigned, unsigned> shaderRemapping_;
-    /// Material remapping table for 2-pass state and distance sort.
-    HashMap<unsigned short, unsigned short> materialRemapping_;
-    /// Geometry remapping table for 2-pass state and distance sort.
-    HashMap<unsigned short, unsigned short> geometryRemapping_;
+    Vector<BatchGroup> batchGroups_;
+    /// Instanced draw calls waiting to be grouped.
+    PODVector<InstancedBatch> instancedBatches_;
+    /// Sort buffers for non-instanced draw calls.
+    BatchSortBuffer batchSortBuffer_;
+    /// Sort buffers for instanced draw calls.
+    BatchSortBuffer groupSortBuffer_;
 
     /// Unsorted non-instanced draw calls.
     PODVector<Batch> batches_;
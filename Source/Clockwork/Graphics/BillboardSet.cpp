@@ -24,6 +24,7 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/BillboardSet.h"
 #include "../Graphics/Camera.h"
@@ -45,6 +46,8 @@ namespace Clockwork
 extern const char* GEOMETRY_CATEGORY;
 
 static const float INV_SQRT_TWO = 1.0f / sqrtf(2.0f);
+/// Minimum number of billboards per work item when splitting a vertex buffer update to worker threads.
+static const unsigned BILLBOARDS_PER_WORK_ITEM = 1024;
 
 const char* faceCameraModeNames[] =
 {
@@ -56,9 +59,129 @@ const char* faceCameraModeNames[] =
     0
 };
 
-inline bool CompareBillboards(Billboard* lhs, Billboard* rhs)
+/// Billboard vertex buffer update parameters shared by the work items.
+struct BillboardUpdateParams
 {
-    return lhs->sortDistance_ > rhs->sortDistance_;
+    /// Enabled billboard pointers.
+    Billboard** billboards_;
+    /// Locked vertex data.
+    float* vertexData_;
+    /// Camera for sort distances.
+    Camera* camera_;
+    /// Billboard position transform.
+    Matrix3x4 billboardTransform_;
+    /// Billboard size scale.
+    Vector3 billboardScale_;
+};
+
+static void CalculateBillboardDistances(const BillboardUpdateParams& params, Billboard** start, Billboard** end)
+{
+    for (Billboard** i = start; i != end; ++i)
+        (*i)->sortDistance_ = params.camera_->GetDistanceSquared(params.billboardTransform_ * (*i)->position_);
+}
+
+static void WriteBillboardVertices(const BillboardUpdateParams& params, Billboard** start, Billboard** end)
+{
+    float* dest = params.vertexData_ + (start - params.billboards_) * 32;
+    const Vector3& billboardScale = params.billboardScale_;
+
+    for (Billboard** i = start; i != end; ++i)
+    {
+        Billboard& billboard = **i;
+
+        Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
+        unsigned color = billboard.color_.ToUInt();
+
+        float rotationMatrix[2][2];
+        rotationMatrix[0][0] = Cos(billboard.rotation_);
+        rotationMatrix[0][1] = Sin(billboard.rotation_);
+        rotationMatrix[1][0] = -rotationMatrix[0][1];
+        rotationMatrix[1][1] = rotationMatrix[0][0];
+
+        dest[0] = billboard.position_.x_;
+        dest[1] = billboard.position_.y_;
+        dest[2] = billboard.position_.z_;
+        ((unsigned&)dest[3]) = color;
+        dest[4] = billboard.uv_.min_.x_;
+        dest[5] = billboard.uv_.min_.y_;
+        dest[6] = -size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
+        dest[7] = -size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
+
+        dest[8] = billboard.position_.x_;
+        dest[9] = billboard.position_.y_;
+        dest[10] = billboard.position_.z_;
+        ((unsigned&)dest[11]) = color;
+        dest[12] = billboard.uv_.max_.x_;
+        dest[13] = billboard.uv_.min_.y_;
+        dest[14] = size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
+        dest[15] = size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
+
+        dest[16] = billboard.position_.x_;
+        dest[17] = billboard.position_.y_;
+        dest[18] = billboard.position_.z_;
+        ((unsigned&)dest[19]) = color;
+        dest[20] = billboard.uv_.max_.x_;
+        dest[21] = billboard.uv_.max_.y_;
+        dest[22] = size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
+        dest[23] = size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
+
+        dest[24] = billboard.position_.x_;
+        dest[25] = billboard.position_.y_;
+        dest[26] = billboard.position_.z_;
+        ((unsigned&)dest[27]) = color;
+        dest[28] = billboard.uv_.min_.x_;
+        dest[29] = billboard.uv_.max_.y_;
+        dest[30] = -size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
+        dest[31] = -size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
+
+        dest += 32;
+    }
+}
+
+static void CalculateBillboardDistancesWork(const WorkItem* item, unsigned threadIndex)
+{
+    CalculateBillboardDistances(*reinterpret_cast<BillboardUpdateParams*>(item->aux_), reinterpret_cast<Billboard**>(item->start_),
+        reinterpret_cast<Billboard**>(item->end_));
+}
+
+static void WriteBillboardVerticesWork(const WorkItem* item, unsigned threadIndex)
+{
+    WriteBillboardVertices(*reinterpret_cast<BillboardUpdateParams*>(item->aux_), reinterpret_cast<Billboard**>(item->start_),
+        reinterpret_cast<Billboard**>(item->end_));
+}
+
+/// Process the enabled billboards in work items if there are enough of them and the work queue can be used, otherwise directly.
+static void ProcessBillboards(WorkQueue* queue, void (*workFunction)(const WorkItem*, unsigned),
+    void (*function)(const BillboardUpdateParams&, Billboard**, Billboard**), BillboardUpdateParams& params, unsigned count)
+{
+    int numWorkItems = 0;
+    if (queue && Thread::IsMainThread())
+        numWorkItems = Min((int)queue->GetNumThreads() + 1, (int)(count / BILLBOARDS_PER_WORK_ITEM));
+
+    if (numWorkItems <= 1)
+    {
+        function(params, params.billboards_, params.billboards_ + count);
+        return;
+    }
+
+    unsigned billboardsPerItem = count / numWorkItems;
+    Billboard** start = params.billboards_;
+    for (int i = 0; i < numWorkItems; ++i)
+    {
+        Billboard** end = i < numWorkItems - 1 ? start + billboardsPerItem : params.billboards_ + count;
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = workFunction;
+        item->aux_ = &params;
+        item->start_ = start;
+        item->end_ = end;
+        queue->AddWorkItem(item);
+
+        start = end;
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
 }
 
 BillboardSet::BillboardSet(Context* context) :
@@ -68,6 +191,7 @@ BillboardSet::BillboardSet(Context* context) :
     relative_(true),
     scaled_(true),
     sorted_(false),
+    sortThreshold_(0.0f),
     faceCameraMode_(FC_ROTATE_XYZ),
     geometry_(new Geometry(context)),
     vertexBuffer_(new VertexBuffer(context_)),
@@ -102,6 +226,7 @@ void BillboardSet::RegisterObject(Context* context)
     ACCESSOR_ATTRIBUTE("Relative Position", IsRelative, SetRelative, bool, true, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Relative Scale", IsScaled, SetScaled, bool, true, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Sort By Distance", IsSorted, SetSorted, bool, false, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Sort Threshold", GetSortThreshold, SetSortThreshold, float, 0.0f, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Can Be Occluded", IsOccludee, SetOccludee, bool, true, AM_DEFAULT);
     ATTRIBUTE("Cast Shadows", bool, castShadows_, false, AM_DEFAULT);
     ENUM_ATTRIBUTE("Face Camera Mode", faceCameraMode_, faceCameraModeNames, FC_ROTATE_XYZ, AM_DEFAULT);
@@ -169,8 +294,8 @@ void BillboardSet::UpdateBatches(const FrameInfo& frame)
 
     Vector3 worldPos = node_->GetWorldPosition();
     Vector3 offset = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
-    // Sort if position relative to camera has changed
-    if (offset != previousOffset_ & sorted_)
+    // Sort if position relative to camera has changed more than the threshold
+    if (sorted_ && (offset - previousOffset_).LengthSquared() > sortThreshold_ * sortThreshold_)
         sortThisFrame_ = true;
 
     distance_ = frame.camera_->GetDistance(GetWorldBoundingBox().Center());
@@ -270,6 +395,12 @@ void BillboardSet::SetSorted(bool enable)
     Commit();
 }
 
+void BillboardSet::SetSortThreshold(float threshold)
+{
+    sortThreshold_ = Max(threshold, 0.0f);
+    MarkNetworkUpdate();
+}
+
 void BillboardSet::SetFaceCameraMode(FaceCameraMode mode)
 {
     faceCameraMode_ = mode;
@@ -470,8 +601,6 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     unsigned numBillboards = billboards_.Size();
     unsigned enabledBillboards = 0;
     const Matrix3x4& worldTransform = node_->GetWorldTransform();
-    Matrix3x4 billboardTransform = relative_ ? worldTransform : Matrix3x4::IDENTITY;
-    Vector3 billboardScale = scaled_ ? worldTransform.Scale() : Vector3::ONE;
 
     // First check number of enabled billboards
     for (unsigned i = 0; i < numBillboards; ++i)
@@ -483,16 +612,11 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     sortedBillboards_.Resize(enabledBillboards);
     unsigned index = 0;
 
-    // Then set initial sort order and distances
+    // Then set initial sort order
     for (unsigned i = 0; i < numBillboards; ++i)
     {
-        Billboard& billboard = billboards_[i];
-        if (billboard.enabled_)
-        {
-            sortedBillboards_[index++] = &billboard;
-            if (sorted_)
-                billboard.sortDistance_ = frame.camera_->GetDistanceSquared(billboardTransform * billboards_[i].position_);
-        }
+        if (billboards_[i].enabled_)
+            sortedBillboards_[index++] = &billboards_[i];
     }
 
     batches_[0].geometry_->SetDrawRange(TRIANGLE_LIST, 0, enabledBillboards * 6, false);
@@ -502,69 +626,42 @@ void BillboardSet::UpdateVertexBuffer(const FrameInfo& frame)
     if (!enabledBillboards)
         return;
 
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    BillboardUpdateParams params;
+    params.billboards_ = &sortedBillboards_[0];
+    params.vertexData_ = 0;
+    params.camera_ = frame.camera_;
+    params.billboardTransform_ = relative_ ? worldTransform : Matrix3x4::IDENTITY;
+    params.billboardScale_ = scaled_ ? worldTransform.Scale() : Vector3::ONE;
+
     if (sorted_)
     {
-        Sort(sortedBillboards_.Begin(), sortedBillboards_.End(), CompareBillboards);
+        ProcessBillboards(queue, CalculateBillboardDistancesWork, CalculateBillboardDistances, params, enabledBillboards);
+
+        // Radix sort from back to front. Invert the exact distance keys so that the farthest billboard sorts first
+        sortItems_.Resize(enabledBillboards);
+        sortTemp_.Resize(enabledBillboards);
+        for (unsigned i = 0; i < enabledBillboards; ++i)
+        {
+            Billboard* billboard = sortedBillboards_[i];
+            sortItems_[i].key_ = ~FloatToRadixKey(billboard->sortDistance_);
+            sortItems_[i].index_ = (unsigned)(billboard - &billboards_[0]);
+        }
+
+        RadixSort(&sortItems_[0], &sortTemp_[0], enabledBillboards);
+        for (unsigned i = 0; i < enabledBillboards; ++i)
+            sortedBillboards_[i] = &billboards_[sortItems_[i].index_];
+
         Vector3 worldPos = node_->GetWorldPosition();
         // Store the "last sorted position" now
         previousOffset_ = (worldPos - frame.camera_->GetNode()->GetWorldPosition());
     }
 
-    float* dest = (float*)vertexBuffer_->Lock(0, enabledBillboards * 4, true);
-    if (!dest)
+    params.vertexData_ = (float*)vertexBuffer_->Lock(0, enabledBillboards * 4, true);
+    if (!params.vertexData_)
         return;
 
-    for (unsigned i = 0; i < enabledBillboards; ++i)
-    {
-        Billboard& billboard = *sortedBillboards_[i];
-
-        Vector2 size(billboard.size_.x_ * billboardScale.x_, billboard.size_.y_ * billboardScale.y_);
-        unsigned color = billboard.color_.ToUInt();
-
-        float rotationMatrix[2][2];
-        rotationMatrix[0][0] = Cos(billboard.rotation_);
-        rotationMatrix[0][1] = Sin(billboard.rotation_);
-        rotationMatrix[1][0] = -rotationMatrix[0][1];
-        rotationMatrix[1][1] = rotationMatrix[0][0];
-
-        dest[0] = billboard.position_.x_;
-        dest[1] = billboard.position_.y_;
-        dest[2] = billboard.position_.z_;
-        ((unsigned&)dest[3]) = color;
-        dest[4] = billboard.uv_.min_.x_;
-        dest[5] = billboard.uv_.min_.y_;
-        dest[6] = -size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
-        dest[7] = -size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
-
-        dest[8] = billboard.position_.x_;
-        dest[9] = billboard.position_.y_;
-        dest[10] = billboard.position_.z_;
-        ((unsigned&)dest[11]) = color;
-        dest[12] = billboard.uv_.max_.x_;
-        dest[13] = billboard.uv_.min_.y_;
-        dest[14] = size.x_ * rotationMatrix[0][0] + size.y_ * rotationMatrix[0][1];
-        dest[15] = size.x_ * rotationMatrix[1][0] + size.y_ * rotationMatrix[1][1];
-
-        dest[16] = billboard.position_.x_;
-        dest[17] = billboard.position_.y_;
-        dest[18] = billboard.position_.z_;
-        ((unsigned&)dest[19]) = color;
-        dest[20] = billboard.uv_.max_.x_;
-        dest[21] = billboard.uv_.max_.y_;
-        dest[22] = size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
-        dest[23] = size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
-
-        dest[24] = billboard.position_.x_;
-        dest[25] = billboard.position_.y_;
-        dest[26] = billboard.position_.z_;
-        ((unsigned&)dest[27]) = color;
-        dest[28] = billboard.uv_.min_.x_;
-        dest[29] = billboard.uv_.max_.y_;
-        dest[30] = -size.x_ * rotationMatrix[0][0] - size.y_ * rotationMatrix[0][1];
-        dest[31] = -size.x_ * rotationMatrix[1][0] - size.y_ * rotationMatrix[1][1];
-
-        dest += 32;
-    }
+    ProcessBillboards(queue, WriteBillboardVerticesWork, WriteBillboardVertices, params, enabledBillboards);
 
     vertexBuffer_->Unlock();
     vertexBuffer_->ClearDataLost();
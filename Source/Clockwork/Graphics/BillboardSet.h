@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "../Container/Sort.h"
 #include "../Graphics/Drawable.h"
 #include "../IO/VectorBuffer.h"
 #include "../Math/Color.h"
@@ -87,6 +88,8 @@ public:
     void SetScaled(bool enable);
     /// Set whether billboards are sorted by distance. Default false.
     void SetSorted(bool enable);
+    /// Set how far the camera has to move relative to the billboard set before unchanged billboards are sorted again. Default 0 (any movement.)
+    void SetSortThreshold(float threshold);
     /// Set how the billboards should rotate in relation to the camera. Default is to follow camera rotation on all axes (FC_ROTATE_XYZ.)
     void SetFaceCameraMode(FaceCameraMode mode);
     /// Set animation LOD bias.
@@ -115,6 +118,9 @@ public:
     /// Return whether billboards are sorted.
     bool IsSorted() const { return sorted_; }
 
+    /// Return camera movement needed to sort unchanged billboards again.
+    float GetSortThreshold() const { return sortThreshold_; }
+
     /// Return how the billboards rotate in relation to the camera.
     FaceCameraMode GetFaceCameraMode() const { return faceCameraMode_; }
 
@@ -154,6 +160,8 @@ protected:
     bool scaled_;
     /// Billboards sorted flag.
     bool sorted_;
+    /// Camera movement needed to sort unchanged billboards again.
+    float sortThreshold_;
     /// Billboard rotation mode in relation to the camera.
     FaceCameraMode faceCameraMode_;
 
@@ -183,8 +191,12 @@ private:
     unsigned sortFrameNumber_;
     /// Previous offset to camera for determining whether sorting is necessary.
     Vector3 previousOffset_;
-    /// Billboard pointers for sorting.
-    Vector<Billboard*> sortedBillboards_;
+    /// Enabled billboard pointers in sorted order.
+    PODVector<Billboard*> sortedBillboards_;
+    /// Sort keys of the enabled billboards.
+    PODVector<RadixSortItem> sortItems_;
+    /// Temporary buffer for radix sorting.
+    PODVector<RadixSortItem> sortTemp_;
     /// Attribute buffer for network replication.
     mutable VectorBuffer attrBuffer_;
 };
@@ -0,0 +1,563 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Container/Sort.h"
+#include "../Graphics/Animation.h"
+#include "../Graphics/CompressedAnimation.h"
+#include "../IO/Deserializer.h"
+#include "../IO/Serializer.h"
+
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+/// Key time quantization range.
+static const float TIME_QUANTIZATION = 65535.0f;
+/// Key value quantization range, symmetric around zero.
+static const float VALUE_QUANTIZATION = 32767.0f;
+
+/// Normalize a 4-component value in place.
+static void NormalizeValue(float* value)
+{
+    float lenSquared = value[0] * value[0] + value[1] * value[1] + value[2] * value[2] + value[3] * value[3];
+    if (lenSquared > 0.0f)
+    {
+        float invLen = 1.0f / sqrtf(lenSquared);
+        for (unsigned i = 0; i < 4; ++i)
+            value[i] *= invLen;
+    }
+}
+
+/// Read the value of one channel of a keyframe as 4 components.
+static void GetKeyFrameValue(const AnimationKeyFrame& keyFrame, unsigned char type, float* dest)
+{
+    if (type == CHANNEL_ROTATION)
+    {
+        dest[0] = keyFrame.rotation_.w_;
+        dest[1] = keyFrame.rotation_.x_;
+        dest[2] = keyFrame.rotation_.y_;
+        dest[3] = keyFrame.rotation_.z_;
+        NormalizeValue(dest);
+    }
+    else
+    {
+        const Vector3& value = type == CHANNEL_POSITION ? keyFrame.position_ : keyFrame.scale_;
+        dest[0] = value.x_;
+        dest[1] = value.y_;
+        dest[2] = value.z_;
+        dest[3] = 0.0f;
+    }
+}
+
+/// Interpolate between two channel values. Rotations are normalized after interpolation.
+static void InterpolateValue(const float* start, const float* end, float t, unsigned char type, float* dest)
+{
+    for (unsigned i = 0; i < 4; ++i)
+        dest[i] = start[i] + (end[i] - start[i]) * t;
+    if (type == CHANNEL_ROTATION)
+        NormalizeValue(dest);
+}
+
+/// Return whether all components of two channel values are within a tolerance.
+static bool IsWithinTolerance(const float* lhs, const float* rhs, float tolerance)
+{
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        if (Abs(lhs[i] - rhs[i]) > tolerance)
+            return false;
+    }
+
+    return true;
+}
+
+/// Find the keys to interpolate between at a quantized time position, and the interpolation factor.
+static void FindKeys(const unsigned short* times, unsigned numKeys, float time, bool looped, unsigned& index, unsigned& nextIndex,
+    float& t)
+{
+    if (time < times[0])
+    {
+        // Before the first key: wrap from the last key if looping, otherwise hold the first key
+        if (looped && numKeys > 1)
+        {
+            index = numKeys - 1;
+            nextIndex = 0;
+            float interval = TIME_QUANTIZATION - times[index] + times[0];
+            t = interval > 0.0f ? (time + TIME_QUANTIZATION - times[index]) / interval : 0.0f;
+        }
+        else
+        {
+            index = nextIndex = 0;
+            t = 0.0f;
+        }
+        return;
+    }
+
+    // Binary search for the last key at or before the time position
+    unsigned low = 0;
+    unsigned high = numKeys;
+    while (high - low > 1)
+    {
+        unsigned mid = (low + high) >> 1;
+        if (times[mid] <= time)
+            low = mid;
+        else
+            high = mid;
+    }
+
+    index = low;
+    if (index + 1 < numKeys)
+    {
+        nextIndex = index + 1;
+        float interval = (float)(times[nextIndex] - times[index]);
+        t = interval > 0.0f ? (time - times[index]) / interval : 0.0f;
+    }
+    else if (looped && numKeys > 1)
+    {
+        nextIndex = 0;
+        float interval = TIME_QUANTIZATION - times[index] + times[0];
+        t = interval > 0.0f ? (time - times[index]) / interval : 0.0f;
+    }
+    else
+    {
+        nextIndex = index;
+        t = 0.0f;
+    }
+}
+
+/// Evaluate a channel at a quantized time position without SIMD.
+static void EvaluateChannel(const CompressedAnimationChannel& channel, const unsigned short* keyTimes, const short* keyValues,
+    float time, bool looped, float* dest)
+{
+    if (!channel.numKeys_)
+    {
+        for (unsigned i = 0; i < 4; ++i)
+            dest[i] = channel.offset_[i];
+        return;
+    }
+
+    unsigned index, nextIndex;
+    float t;
+    FindKeys(keyTimes + channel.keyStart_, channel.numKeys_, time, looped, index, nextIndex, t);
+
+    const short* start = keyValues + (channel.keyStart_ + index) * 4;
+    const short* end = keyValues + (channel.keyStart_ + nextIndex) * 4;
+
+    // Quaternions wrapping from the last key to the first may be in opposite hemispheres. Consecutive keys were already
+    // aligned when compressing
+    float sign = 1.0f;
+    if (channel.type_ == CHANNEL_ROTATION && nextIndex < index)
+    {
+        float dot = (float)start[0] * end[0] + (float)start[1] * end[1] + (float)start[2] * end[2] + (float)start[3] * end[3];
+        if (dot < 0.0f)
+            sign = -1.0f;
+    }
+
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        float value = (float)start[i] + ((float)end[i] * sign - (float)start[i]) * t;
+        dest[i] = channel.offset_[i] + value * channel.scale_[i];
+    }
+
+    if (channel.type_ == CHANNEL_ROTATION)
+        NormalizeValue(dest);
+}
+
+CompressedAnimation::CompressedAnimation() :
+    length_(0.0f)
+{
+}
+
+void CompressedAnimation::Compress(const Vector<AnimationTrack>& tracks, float length, float positionTolerance,
+    float rotationTolerance, float scaleTolerance)
+{
+    static const unsigned char channelTypes[] = { CHANNEL_POSITION, CHANNEL_ROTATION, CHANNEL_SCALE };
+
+    Clear();
+    length_ = Max(length, 0.0f);
+    float timeScale = length_ > 0.0f ? TIME_QUANTIZATION / length_ : 0.0f;
+
+    PODVector<float> values;
+    PODVector<unsigned> keptKeys;
+
+    for (unsigned i = 0; i < tracks.Size(); ++i)
+    {
+        const AnimationTrack& track = tracks[i];
+        const Vector<AnimationKeyFrame>& keyFrames = track.keyFrames_;
+        unsigned numKeyFrames = keyFrames.Size();
+        if (!numKeyFrames)
+            continue;
+
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned char type = channelTypes[j];
+            if (!(track.channelMask_ & type))
+                continue;
+
+            float tolerance = Max(type == CHANNEL_POSITION ? positionTolerance : (type == CHANNEL_ROTATION ? rotationTolerance :
+                scaleTolerance), 0.0f);
+
+            // Gather the channel values. Keep consecutive rotations in the same hemisphere so that they interpolate the short way
+            values.Resize(numKeyFrames * 4);
+            for (unsigned k = 0; k < numKeyFrames; ++k)
+            {
+                float* value = &values[k * 4];
+                GetKeyFrameValue(keyFrames[k], type, value);
+                if (type == CHANNEL_ROTATION && k > 0)
+                {
+                    const float* previous = value - 4;
+                    if (value[0] * previous[0] + value[1] * previous[1] + value[2] * previous[2] + value[3] * previous[3] < 0.0f)
+                    {
+                        for (unsigned c = 0; c < 4; ++c)
+                            value[c] = -value[c];
+                    }
+                }
+            }
+
+            CompressedAnimationChannel channel;
+            channel.track_ = i;
+            channel.type_ = type;
+            channel.keyStart_ = keyTimes_.Size();
+            channel.numKeys_ = 0;
+
+            float minValue[4];
+            float maxValue[4];
+            for (unsigned c = 0; c < 4; ++c)
+                minValue[c] = maxValue[c] = values[c];
+            for (unsigned k = 1; k < numKeyFrames; ++k)
+            {
+                for (unsigned c = 0; c < 4; ++c)
+                {
+                    minValue[c] = Min(minValue[c], values[k * 4 + c]);
+                    maxValue[c] = Max(maxValue[c], values[k * 4 + c]);
+                }
+            }
+
+            bool constant = true;
+            for (unsigned c = 0; c < 4; ++c)
+            {
+                if (maxValue[c] - minValue[c] > tolerance)
+                    constant = false;
+            }
+
+            // A constant channel stores only the middle of its value range
+            if (constant)
+            {
+                for (unsigned c = 0; c < 4; ++c)
+                {
+                    channel.offset_[c] = (minValue[c] + maxValue[c]) * 0.5f;
+                    channel.scale_[c] = 0.0f;
+                }
+                if (type == CHANNEL_ROTATION)
+                    NormalizeValue(channel.offset_);
+                channels_.Push(channel);
+                continue;
+            }
+
+            // Quantize positions and scales to their value range, rotations to the unit range
+            for (unsigned c = 0; c < 4; ++c)
+            {
+                if (type == CHANNEL_ROTATION)
+                {
+                    channel.offset_[c] = 0.0f;
+                    channel.scale_[c] = 1.0f / VALUE_QUANTIZATION;
+                }
+                else
+                {
+                    channel.offset_[c] = (minValue[c] + maxValue[c]) * 0.5f;
+                    channel.scale_[c] = (maxValue[c] - minValue[c]) * 0.5f / VALUE_QUANTIZATION;
+                }
+            }
+
+            // Remove keys that can be reconstructed by interpolating between the kept neighbours. Extend the segment starting
+            // from the last kept key for as long as all keys inside it stay within the tolerance
+            keptKeys.Clear();
+            keptKeys.Push(0);
+            unsigned anchor = 0;
+            for (unsigned k = 2; k < numKeyFrames; ++k)
+            {
+                float interval = keyFrames[k].time_ - keyFrames[anchor].time_;
+                bool fits = true;
+                for (unsigned m = anchor + 1; m < k && fits; ++m)
+                {
+                    float t = interval > 0.0f ? (keyFrames[m].time_ - keyFrames[anchor].time_) / interval : 0.0f;
+                    float interpolated[4];
+                    InterpolateValue(&values[anchor * 4], &values[k * 4], t, type, interpolated);
+                    fits = IsWithinTolerance(interpolated, &values[m * 4], tolerance);
+                }
+
+                if (!fits)
+                {
+                    anchor = k - 1;
+                    keptKeys.Push(anchor);
+                }
+            }
+            if (numKeyFrames > 1)
+                keptKeys.Push(numKeyFrames - 1);
+
+            for (unsigned k = 0; k < keptKeys.Size(); ++k)
+            {
+                unsigned keyIndex = keptKeys[k];
+                unsigned short time = (unsigned short)Clamp((int)(keyFrames[keyIndex].time_ * timeScale + 0.5f), 0,
+                    (int)TIME_QUANTIZATION);
+
+                // If keys are closer than the time resolution, keep the later one
+                if (channel.numKeys_ && time <= keyTimes_.Back())
+                {
+                    keyTimes_.Pop();
+                    keyValues_.Resize(keyValues_.Size() - 4);
+                    --channel.numKeys_;
+                }
+
+                keyTimes_.Push(time);
+                const float* value = &values[keyIndex * 4];
+                for (unsigned c = 0; c < 4; ++c)
+                {
+                    int quantized = channel.scale_[c] > 0.0f ? (int)floorf((value[c] - channel.offset_[c]) / channel.scale_[c] +
+                        0.5f) : 0;
+                    keyValues_.Push((short)Clamp(quantized, -(int)VALUE_QUANTIZATION, (int)VALUE_QUANTIZATION));
+                }
+                ++channel.numKeys_;
+            }
+
+            channels_.Push(channel);
+        }
+    }
+}
+
+void CompressedAnimation::Decompress(Vector<AnimationTrack>& tracks) const
+{
+    const unsigned short* keyTimes = keyTimes_.Empty() ? 0 : &keyTimes_[0];
+    const short* keyValues = keyValues_.Empty() ? 0 : &keyValues_[0];
+    PODVector<unsigned short> trackTimes;
+
+    for (unsigned i = 0; i < tracks.Size(); ++i)
+    {
+        AnimationTrack& track = tracks[i];
+        track.keyFrames_.Clear();
+
+        // Collect the key times of all channels of the track. A track with only constant channels gets a single keyframe
+        trackTimes.Clear();
+        bool hasChannels = false;
+        for (unsigned j = 0; j < channels_.Size(); ++j)
+        {
+            const CompressedAnimationChannel& channel = channels_[j];
+            if (channel.track_ != i)
+                continue;
+
+            hasChannels = true;
+            for (unsigned k = 0; k < channel.numKeys_; ++k)
+            {
+                unsigned short time = keyTimes[channel.keyStart_ + k];
+                if (!trackTimes.Contains(time))
+                    trackTimes.Push(time);
+            }
+        }
+        if (!hasChannels)
+            continue;
+        if (trackTimes.Empty())
+            trackTimes.Push(0);
+        Sort(trackTimes.Begin(), trackTimes.End());
+
+        track.keyFrames_.Resize(trackTimes.Size());
+        for (unsigned k = 0; k < trackTimes.Size(); ++k)
+        {
+            AnimationKeyFrame& keyFrame = track.keyFrames_[k];
+            keyFrame.time_ = trackTimes[k] * length_ / TIME_QUANTIZATION;
+            keyFrame.position_ = Vector3::ZERO;
+            keyFrame.rotation_ = Quaternion::IDENTITY;
+            keyFrame.scale_ = Vector3::ONE;
+
+            for (unsigned j = 0; j < channels_.Size(); ++j)
+            {
+                const CompressedAnimationChannel& channel = channels_[j];
+                if (channel.track_ != i)
+                    continue;
+
+                float value[4];
+                EvaluateChannel(channel, keyTimes, keyValues, trackTimes[k], false, value);
+                if (channel.type_ == CHANNEL_POSITION)
+                    keyFrame.position_ = Vector3(value[0], value[1], value[2]);
+                else if (channel.type_ == CHANNEL_ROTATION)
+                    keyFrame.rotation_ = Quaternion(value[0], value[1], value[2], value[3]);
+                else
+                    keyFrame.scale_ = Vector3(value[0], value[1], value[2]);
+            }
+        }
+    }
+}
+
+bool CompressedAnimation::Load(Deserializer& source, unsigned numTracks, float length)
+{
+    Clear();
+    length_ = Max(length, 0.0f);
+
+    unsigned numChannels = source.ReadUInt();
+    channels_.Resize(numChannels);
+
+    for (unsigned i = 0; i < numChannels; ++i)
+    {
+        CompressedAnimationChannel& channel = channels_[i];
+        channel.track_ = source.ReadUInt();
+        channel.type_ = source.ReadUByte();
+        channel.keyStart_ = keyTimes_.Size();
+        channel.numKeys_ = source.ReadUInt();
+        source.Read(channel.offset_, sizeof channel.offset_);
+        source.Read(channel.scale_, sizeof channel.scale_);
+
+        if (channel.track_ >= numTracks || (channel.type_ != CHANNEL_POSITION && channel.type_ != CHANNEL_ROTATION &&
+            channel.type_ != CHANNEL_SCALE) || channel.numKeys_ > source.GetSize())
+        {
+            Clear();
+            return false;
+        }
+
+        if (channel.numKeys_)
+        {
+            keyTimes_.Resize(channel.keyStart_ + channel.numKeys_);
+            keyValues_.Resize(keyTimes_.Size() * 4);
+            unsigned timesSize = channel.numKeys_ * sizeof(unsigned short);
+            unsigned valuesSize = channel.numKeys_ * 4 * sizeof(short);
+            if (source.Read(&keyTimes_[channel.keyStart_], timesSize) != timesSize ||
+                source.Read(&keyValues_[channel.keyStart_ * 4], valuesSize) != valuesSize)
+            {
+                Clear();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool CompressedAnimation::Save(Serializer& dest) const
+{
+    if (!dest.WriteUInt(channels_.Size()))
+        return false;
+
+    for (unsigned i = 0; i < channels_.Size(); ++i)
+    {
+        const CompressedAnimationChannel& channel = channels_[i];
+        dest.WriteUInt(channel.track_);
+        dest.WriteUByte(channel.type_);
+        dest.WriteUInt(channel.numKeys_);
+        dest.Write(channel.offset_, sizeof channel.offset_);
+        dest.Write(channel.scale_, sizeof channel.scale_);
+        if (channel.numKeys_)
+        {
+            dest.Write(&keyTimes_[channel.keyStart_], channel.numKeys_ * sizeof(unsigned short));
+            dest.Write(&keyValues_[channel.keyStart_ * 4], channel.numKeys_ * 4 * sizeof(short));
+        }
+    }
+
+    return true;
+}
+
+void CompressedAnimation::Clear()
+{
+    channels_.Clear();
+    keyTimes_.Clear();
+    keyValues_.Clear();
+}
+
+void CompressedAnimation::Sample(float time, bool looped, Vector3* positions, Quaternion* rotations, Vector3* scales) const
+{
+    float scaledTime = length_ > 0.0f ? Clamp(time, 0.0f, length_) * (TIME_QUANTIZATION / length_) : 0.0f;
+    const unsigned short* keyTimes = keyTimes_.Empty() ? 0 : &keyTimes_[0];
+    const short* keyValues = keyValues_.Empty() ? 0 : &keyValues_[0];
+
+    for (PODVector<CompressedAnimationChannel>::ConstIterator i = channels_.Begin(); i != channels_.End(); ++i)
+    {
+        const CompressedAnimationChannel& channel = *i;
+        float* dest;
+        if (channel.type_ == CHANNEL_ROTATION)
+            dest = &rotations[channel.track_].w_;
+        else
+            dest = channel.type_ == CHANNEL_POSITION ? &positions[channel.track_].x_ : &scales[channel.track_].x_;
+
+#ifdef CLOCKWORK_SSE2
+        if (channel.numKeys_)
+        {
+            unsigned index, nextIndex;
+            float t;
+            FindKeys(keyTimes + channel.keyStart_, channel.numKeys_, scaledTime, looped, index, nextIndex, t);
+
+            // Sign-extend the four 16-bit components of both keys to floats
+            __m128i start16 = _mm_loadl_epi64((const __m128i*)(keyValues + (channel.keyStart_ + index) * 4));
+            __m128i end16 = _mm_loadl_epi64((const __m128i*)(keyValues + (channel.keyStart_ + nextIndex) * 4));
+            __m128 start = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(start16, start16), 16));
+            __m128 end = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(end16, end16), 16));
+
+            if (channel.type_ == CHANNEL_ROTATION && nextIndex < index)
+            {
+                float dot[4];
+                _mm_storeu_ps(dot, _mm_mul_ps(start, end));
+                if (dot[0] + dot[1] + dot[2] + dot[3] < 0.0f)
+                    end = _mm_sub_ps(_mm_setzero_ps(), end);
+            }
+
+            __m128 value = _mm_add_ps(start, _mm_mul_ps(_mm_sub_ps(end, start), _mm_set1_ps(t)));
+            value = _mm_add_ps(_mm_loadu_ps(channel.offset_), _mm_mul_ps(value, _mm_loadu_ps(channel.scale_)));
+
+            if (channel.type_ == CHANNEL_ROTATION)
+            {
+                __m128 lenSquared = _mm_mul_ps(value, value);
+                lenSquared = _mm_add_ps(lenSquared, _mm_shuffle_ps(lenSquared, lenSquared, _MM_SHUFFLE(2, 3, 0, 1)));
+                lenSquared = _mm_add_ps(lenSquared, _mm_shuffle_ps(lenSquared, lenSquared, _MM_SHUFFLE(1, 0, 3, 2)));
+                _mm_storeu_ps(dest, _mm_div_ps(value, _mm_sqrt_ps(lenSquared)));
+            }
+            else
+            {
+                float result[4];
+                _mm_storeu_ps(result, value);
+                dest[0] = result[0];
+                dest[1] = result[1];
+                dest[2] = result[2];
+            }
+            continue;
+        }
+#endif
+
+        float value[4];
+        EvaluateChannel(channel, keyTimes, keyValues, scaledTime, looped, value);
+        dest[0] = value[0];
+        dest[1] = value[1];
+        dest[2] = value[2];
+        if (channel.type_ == CHANNEL_ROTATION)
+            dest[3] = value[3];
+    }
+}
+
+unsigned CompressedAnimation::GetMemoryUse() const
+{
+    return channels_.Size() * sizeof(CompressedAnimationChannel) + keyTimes_.Size() * sizeof(unsigned short) +
+        keyValues_.Size() * sizeof(short);
+}
+
+}
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/Vector.h"
+#include "../Math/Quaternion.h"
+#include "../Math/Vector3.h"
+
+namespace Clockwork
+{
+
+class Deserializer;
+class Serializer;
+struct AnimationTrack;
+
+/// Default maximum position error allowed when removing redundant keyframes.
+static const float DEFAULT_POSITION_TOLERANCE = 0.0005f;
+/// Default maximum rotation quaternion component error allowed when removing redundant keyframes.
+static const float DEFAULT_ROTATION_TOLERANCE = 0.0005f;
+/// Default maximum scale error allowed when removing redundant keyframes.
+static const float DEFAULT_SCALE_TOLERANCE = 0.0005f;
+
+/// Compressed animation channel: one of position, rotation or scale of a track.
+struct CompressedAnimationChannel
+{
+    /// Track index.
+    unsigned track_;
+    /// Channel type: CHANNEL_POSITION, CHANNEL_ROTATION or CHANNEL_SCALE.
+    unsigned char type_;
+    /// Index of the first key in the shared key arrays.
+    unsigned keyStart_;
+    /// Number of keys. Zero for a constant channel, which uses the offset as its value.
+    unsigned numKeys_;
+    /// Dequantization offset. Components are XYZ for positions and scales, WXYZ for rotations.
+    float offset_[4];
+    /// Dequantization scale.
+    float scale_[4];
+};
+
+/// Compressed representation of all tracks of an animation. Channel values are quantized to 16 bits, constant channels store only a single value, and keyframes that can be reconstructed by interpolation within error tolerances are removed. The keys of all channels are stored in shared arrays so that the whole animation is sampled at once.
+class CLOCKWORK_API CompressedAnimation
+{
+public:
+    /// Construct empty.
+    CompressedAnimation();
+
+    /// Compress from keyframe tracks.
+    void Compress(const Vector<AnimationTrack>& tracks, float length, float positionTolerance = DEFAULT_POSITION_TOLERANCE,
+        float rotationTolerance = DEFAULT_ROTATION_TOLERANCE, float scaleTolerance = DEFAULT_SCALE_TOLERANCE);
+    /// Decompress to keyframe tracks. The tracks must already exist with their names and channel masks.
+    void Decompress(Vector<AnimationTrack>& tracks) const;
+    /// Load channels and keys from a stream. Return true if successful.
+    bool Load(Deserializer& source, unsigned numTracks, float length);
+    /// Save channels and keys to a stream. Return true if successful.
+    bool Save(Serializer& dest) const;
+    /// Remove all channels and keys.
+    void Clear();
+    /// Sample all tracks at a time position. The output arrays must have room for all tracks; only the channels included in each track are written.
+    void Sample(float time, bool looped, Vector3* positions, Quaternion* rotations, Vector3* scales) const;
+
+    /// Return whether has no channels.
+    bool IsEmpty() const { return channels_.Empty(); }
+
+    /// Return number of channels.
+    unsigned GetNumChannels() const { return channels_.Size(); }
+
+    /// Return total number of keys.
+    unsigned GetNumKeys() const { return keyTimes_.Size(); }
+
+    /// Return memory use in bytes.
+    unsigned GetMemoryUse() const;
+
+private:
+    /// Animation length.
+    float length_;
+    /// Channels.
+    PODVector<CompressedAnimationChannel> channels_;
+    /// Key times quantized to the animation length.
+    PODVector<unsigned short> keyTimes_;
+    /// Quantized key values, 4 per key.
+    PODVector<short> keyValues_;
+};
+
+}
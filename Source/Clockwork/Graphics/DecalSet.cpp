@@ -24,6 +24,8 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/Timer.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/AnimatedModel.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/Camera.h"
@@ -59,6 +61,8 @@ static const unsigned DEFAULT_MAX_INDICES = 1024;
 static const unsigned STATIC_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT;
 static const unsigned SKINNED_ELEMENT_MASK = MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT | MASK_BLENDWEIGHTS |
                                              MASK_BLENDINDICES;
+/// Maximum triangles in a leaf node of a decal target geometry hierarchy.
+static const unsigned BVH_LEAF_TRIANGLES = 8;
 
 static DecalVertex ClipEdge(const DecalVertex& v0, const DecalVertex& v1, float d0, float d1, bool skinned)
 {
@@ -128,6 +132,284 @@ static void ClipPolygon(PODVector<DecalVertex>& dest, const PODVector<DecalVerte
         dest.Push(ClipEdge(src[last], src[0], lastDistance, distance, skinned));
 }
 
+static void AddCacheTriangle(PODVector<DecalVertex>& vertices, unsigned i0, unsigned i1, unsigned i2,
+    const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData, unsigned positionStride,
+    unsigned normalStride, unsigned skinningStride)
+{
+    const Vector3& v0 = *((const Vector3*)(&positionData[i0 * positionStride]));
+    const Vector3& v1 = *((const Vector3*)(&positionData[i1 * positionStride]));
+    const Vector3& v2 = *((const Vector3*)(&positionData[i2 * positionStride]));
+
+    // Calculate unsmoothed face normals if no normal data
+    Vector3 faceNormal = Vector3::ZERO;
+    if (!normalData)
+    {
+        Vector3 dist1 = v1 - v0;
+        Vector3 dist2 = v2 - v0;
+        faceNormal = (dist1.CrossProduct(dist2)).Normalized();
+    }
+
+    const Vector3& n0 = normalData ? *((const Vector3*)(&normalData[i0 * normalStride])) : faceNormal;
+    const Vector3& n1 = normalData ? *((const Vector3*)(&normalData[i1 * normalStride])) : faceNormal;
+    const Vector3& n2 = normalData ? *((const Vector3*)(&normalData[i2 * normalStride])) : faceNormal;
+
+    if (!skinningData)
+    {
+        vertices.Push(DecalVertex(v0, n0));
+        vertices.Push(DecalVertex(v1, n1));
+        vertices.Push(DecalVertex(v2, n2));
+    }
+    else
+    {
+        const unsigned char* s0 = &skinningData[i0 * skinningStride];
+        const unsigned char* s1 = &skinningData[i1 * skinningStride];
+        const unsigned char* s2 = &skinningData[i2 * skinningStride];
+
+        vertices.Push(DecalVertex(v0, n0, (const float*)s0, s0 + sizeof(float) * 4));
+        vertices.Push(DecalVertex(v1, n1, (const float*)s1, s1 + sizeof(float) * 4));
+        vertices.Push(DecalVertex(v2, n2, (const float*)s2, s2 + sizeof(float) * 4));
+    }
+}
+
+template <class T> static void AddCacheTriangles(PODVector<DecalVertex>& vertices, const T* indices, unsigned indexCount,
+    const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData, unsigned positionStride,
+    unsigned normalStride, unsigned skinningStride)
+{
+    const T* indicesEnd = indices + indexCount;
+
+    while (indices + 2 < indicesEnd)
+    {
+        AddCacheTriangle(vertices, indices[0], indices[1], indices[2], positionData, normalData, skinningData, positionStride,
+            normalStride, skinningStride);
+        indices += 3;
+    }
+}
+
+/// Build a decal target geometry hierarchy node and its children recursively. Return the node index.
+static unsigned BuildDecalBVH(PODVector<DecalBVHNode>& nodes, PODVector<unsigned>& triangles, const PODVector<DecalVertex>& vertices,
+    unsigned start, unsigned count)
+{
+    unsigned index = nodes.Size();
+    nodes.Resize(index + 1);
+
+    BoundingBox box;
+    BoundingBox centerBox;
+    for (unsigned i = start; i < start + count; ++i)
+    {
+        const DecalVertex* triangle = &vertices[triangles[i] * 3];
+        box.Merge(triangle[0].position_);
+        box.Merge(triangle[1].position_);
+        box.Merge(triangle[2].position_);
+        centerBox.Merge((triangle[0].position_ + triangle[1].position_ + triangle[2].position_) / 3.0f);
+    }
+
+    nodes[index].boundingBox_ = box;
+
+    if (count <= BVH_LEAF_TRIANGLES)
+    {
+        nodes[index].start_ = start;
+        nodes[index].count_ = count;
+        return index;
+    }
+
+    // Split the triangle centers at the middle of their longest axis
+    Vector3 size = centerBox.Size();
+    unsigned axis = (size.x_ >= size.y_ && size.x_ >= size.z_) ? 0 : (size.y_ >= size.z_ ? 1 : 2);
+    float split = centerBox.Center().Data()[axis];
+    unsigned i = start;
+    unsigned j = start + count;
+
+    while (i < j)
+    {
+        const DecalVertex* triangle = &vertices[triangles[i] * 3];
+        float center = (triangle[0].position_ + triangle[1].position_ + triangle[2].position_).Data()[axis] / 3.0f;
+        if (center < split)
+            ++i;
+        else
+            Swap(triangles[i], triangles[--j]);
+    }
+
+    // If all triangles fell on one side, split them in half
+    unsigned leftCount = i - start;
+    if (!leftCount || leftCount == count)
+        leftCount = count / 2;
+
+    // The first child follows its parent, the second child's index is stored in the parent
+    nodes[index].count_ = 0;
+    BuildDecalBVH(nodes, triangles, vertices, start, leftCount);
+    unsigned right = BuildDecalBVH(nodes, triangles, vertices, start + leftCount, count - leftCount);
+    nodes[index].start_ = right;
+    return index;
+}
+
+static void GetFace(Vector<PODVector<DecalVertex> >& faces, const DecalVertex* triangle, const DecalRequest& request,
+    const PODVector<unsigned>& boneMapping)
+{
+    // Check if face is too much away from the decal normal
+    if (request.decalNormal_.DotProduct((triangle[0].normal_ + triangle[1].normal_ + triangle[2].normal_) / 3.0f) <
+        request.normalCutoff_)
+        return;
+
+    // Check if face is culled completely by any of the planes
+    for (unsigned i = PLANE_FAR; i < NUM_FRUSTUM_PLANES; --i)
+    {
+        const Plane& plane = request.frustum_.planes_[i];
+        if (plane.Distance(triangle[0].position_) < 0.0f && plane.Distance(triangle[1].position_) < 0.0f &&
+            plane.Distance(triangle[2].position_) < 0.0f)
+            return;
+    }
+
+    DecalVertex vertices[3];
+
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        vertices[i] = triangle[i];
+        if (!request.skinned_)
+            continue;
+
+        // Convert the blend indices to skeleton bone indices. The decal set remaps them to its own bones when adding the decal
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            if (vertices[i].blendWeights_[j] > 0.0f)
+            {
+                unsigned boneIndex = vertices[i].blendIndices_[j];
+                if (!boneMapping.Empty())
+                {
+                    if (boneIndex >= boneMapping.Size())
+                        return;
+                    boneIndex = boneMapping[boneIndex];
+                }
+                if (boneIndex > 255)
+                    return;
+
+                vertices[i].blendIndices_[j] = (unsigned char)boneIndex;
+            }
+            else
+                vertices[i].blendIndices_[j] = 0;
+        }
+    }
+
+    faces.Resize(faces.Size() + 1);
+    PODVector<DecalVertex>& face = faces.Back();
+    face.Reserve(3);
+    face.Push(vertices[0]);
+    face.Push(vertices[1]);
+    face.Push(vertices[2]);
+}
+
+static void CalculateUVs(Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV,
+    const Vector2& bottomRightUV)
+{
+    Matrix4 viewProj = projection * view;
+
+    for (PODVector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    {
+        Vector3 projected = viewProj * i->position_;
+        i->texCoord_ = Vector2(
+            Lerp(topLeftUV.x_, bottomRightUV.x_, projected.x_ * 0.5f + 0.5f),
+            Lerp(bottomRightUV.y_, topLeftUV.y_, projected.y_ * 0.5f + 0.5f)
+        );
+    }
+}
+
+static void TransformVertices(Decal& decal, const Matrix3x4& transform)
+{
+    for (PODVector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    {
+        i->position_ = transform * i->position_;
+        i->normal_ = (transform * i->normal_).Normalized();
+    }
+}
+
+/// Project and clip a decal against its target geometries. Only accesses the request, so may be called from a worker thread.
+static void ProcessDecal(DecalRequest& request)
+{
+    Decal& newDecal = request.decal_;
+    Vector<PODVector<DecalVertex> > faces;
+    PODVector<DecalVertex> tempFace;
+    PODVector<unsigned> stack;
+
+    // Collect the faces from the hierarchy nodes intersecting the decal frustum
+    for (unsigned i = 0; i < request.geometries_.Size(); ++i)
+    {
+        const DecalGeometryCache& cache = *request.geometries_[i];
+        if (cache.nodes_.Empty() || (request.skinned_ && !cache.skinned_))
+            continue;
+
+        stack.Push(0);
+
+        while (stack.Size())
+        {
+            unsigned nodeIndex = stack.Back();
+            stack.Pop();
+
+            const DecalBVHNode& node = cache.nodes_[nodeIndex];
+            if (request.frustum_.IsInsideFast(node.boundingBox_) == OUTSIDE)
+                continue;
+
+            if (node.count_)
+            {
+                for (unsigned j = node.start_; j < node.start_ + node.count_; ++j)
+                    GetFace(faces, &cache.vertices_[j * 3], request, request.boneMappings_[i]);
+            }
+            else
+            {
+                stack.Push(node.start_);
+                stack.Push(nodeIndex + 1);
+            }
+        }
+    }
+
+    // Clip the acquired faces against all frustum planes
+    for (unsigned i = 0; i < NUM_FRUSTUM_PLANES; ++i)
+    {
+        for (unsigned j = 0; j < faces.Size(); ++j)
+        {
+            PODVector<DecalVertex>& face = faces[j];
+            if (face.Empty())
+                continue;
+
+            ClipPolygon(tempFace, face, request.frustum_.planes_[i], request.skinned_);
+            face = tempFace;
+        }
+    }
+
+    // Now triangulate the resulting faces into decal vertices
+    for (unsigned i = 0; i < faces.Size(); ++i)
+    {
+        PODVector<DecalVertex>& face = faces[i];
+        if (face.Size() < 3)
+            continue;
+
+        for (unsigned j = 2; j < face.Size(); ++j)
+        {
+            newDecal.AddVertex(face[0]);
+            newDecal.AddVertex(face[j - 1]);
+            newDecal.AddVertex(face[j]);
+        }
+    }
+
+    // Leave empty or too large decals for the decal set to reject
+    if (newDecal.vertices_.Empty() || newDecal.vertices_.Size() > request.maxVertices_ ||
+        newDecal.indices_.Size() > request.maxIndices_)
+        return;
+
+    CalculateUVs(newDecal, request.frustumTransform_.Inverse(), request.projection_, request.topLeftUV_, request.bottomRightUV_);
+
+    // Transform vertices to the decal set's local space and generate tangents
+    TransformVertices(newDecal, request.vertexTransform_);
+    GenerateTangents(&newDecal.vertices_[0], sizeof(DecalVertex), &newDecal.indices_[0], sizeof(unsigned short), 0,
+        newDecal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
+        tangent_));
+
+    newDecal.CalculateBoundingBox();
+}
+
+static void ProcessDecalWork(const WorkItem* item, unsigned threadIndex)
+{
+    ProcessDecal(*reinterpret_cast<DecalRequest*>(item->aux_));
+}
+
 void Decal::AddVertex(const DecalVertex& vertex)
 {
     for (unsigned i = 0; i < vertices_.Size(); ++i)
@@ -151,6 +433,161 @@ void Decal::CalculateBoundingBox()
         boundingBox_.Merge(vertices_[i].position_);
 }
 
+bool DecalGeometryCache::Build(Geometry* geometry)
+{
+    geometry_ = geometry;
+    vertices_.Clear();
+    nodes_.Clear();
+    vertexVersions_.Clear();
+    skinned_ = false;
+
+    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+        return false;
+
+    indexStart_ = geometry->GetIndexStart();
+    indexCount_ = geometry->GetIndexCount();
+    vertexStart_ = geometry->GetVertexStart();
+    vertexCount_ = geometry->GetVertexCount();
+
+    const unsigned char* positionData = 0;
+    const unsigned char* normalData = 0;
+    const unsigned char* skinningData = 0;
+    const unsigned char* indexData = 0;
+    unsigned positionStride = 0;
+    unsigned normalStride = 0;
+    unsigned skinningStride = 0;
+    unsigned indexStride = 0;
+
+    IndexBuffer* ib = geometry->GetIndexBuffer();
+    if (ib)
+    {
+        indexData = ib->GetShadowData();
+        indexStride = ib->GetIndexSize();
+    }
+
+    // For morphed models positions, normals and skinning may be in different buffers
+    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
+    {
+        VertexBuffer* vb = geometry->GetVertexBuffer(i);
+        if (!vb)
+            continue;
+
+        vertexVersions_.Push(MakePair(vb, vb->GetDataVersion()));
+        unsigned elementMask = geometry->GetVertexElementMask(i);
+        unsigned char* data = vb->GetShadowData();
+        if (!data)
+            continue;
+
+        if (elementMask & MASK_POSITION)
+        {
+            positionData = data;
+            positionStride = vb->GetVertexSize();
+        }
+        if (elementMask & MASK_NORMAL)
+        {
+            normalData = data + vb->GetElementOffset(ELEMENT_NORMAL);
+            normalStride = vb->GetVertexSize();
+        }
+        if (elementMask & MASK_BLENDWEIGHTS)
+        {
+            skinningData = data + vb->GetElementOffset(ELEMENT_BLENDWEIGHTS);
+            skinningStride = vb->GetVertexSize();
+        }
+    }
+
+    // Positions and indices are needed
+    if (!positionData)
+    {
+        // As a fallback, try to get the geometry's raw vertex/index data
+        unsigned elementMask;
+        geometry->GetRawData(positionData, positionStride, indexData, indexStride, elementMask);
+        if (!positionData)
+        {
+            LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
+            return false;
+        }
+    }
+
+    skinned_ = skinningData != 0;
+
+    PODVector<DecalVertex> triangleVertices;
+
+    if (indexData)
+    {
+        // 16-bit indices
+        if (indexStride == sizeof(unsigned short))
+        {
+            AddCacheTriangles(triangleVertices, ((const unsigned short*)indexData) + indexStart_, indexCount_, positionData,
+                normalData, skinningData, positionStride, normalStride, skinningStride);
+        }
+        else
+        // 32-bit indices
+        {
+            AddCacheTriangles(triangleVertices, ((const unsigned*)indexData) + indexStart_, indexCount_, positionData, normalData,
+                skinningData, positionStride, normalStride, skinningStride);
+        }
+    }
+    else
+    {
+        // Non-indexed geometry
+        unsigned indices = vertexStart_;
+        unsigned indicesEnd = indices + vertexCount_;
+
+        while (indices + 2 < indicesEnd)
+        {
+            AddCacheTriangle(triangleVertices, indices, indices + 1, indices + 2, positionData, normalData, skinningData,
+                positionStride, normalStride, skinningStride);
+            indices += 3;
+        }
+    }
+
+    unsigned numTriangles = triangleVertices.Size() / 3;
+    if (!numTriangles)
+        return true;
+
+    PODVector<unsigned> triangles(numTriangles);
+    for (unsigned i = 0; i < numTriangles; ++i)
+        triangles[i] = i;
+
+    BuildDecalBVH(nodes_, triangles, triangleVertices, 0, numTriangles);
+
+    // Store the triangles in hierarchy order so that each leaf node refers to a contiguous range
+    vertices_.Resize(numTriangles * 3);
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        const DecalVertex* src = &triangleVertices[triangles[i] * 3];
+        vertices_[i * 3] = src[0];
+        vertices_[i * 3 + 1] = src[1];
+        vertices_[i * 3 + 2] = src[2];
+    }
+
+    return true;
+}
+
+bool DecalGeometryCache::IsValid(Geometry* geometry) const
+{
+    if (!geometry || geometry_.Get() != geometry || indexStart_ != geometry->GetIndexStart() ||
+        indexCount_ != geometry->GetIndexCount() || vertexStart_ != geometry->GetVertexStart() ||
+        vertexCount_ != geometry->GetVertexCount())
+        return false;
+
+    // CustomGeometry and morphing rewrite the vertex data without changing the geometry or its draw range
+    unsigned index = 0;
+    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
+    {
+        VertexBuffer* vb = geometry->GetVertexBuffer(i);
+        if (!vb)
+            continue;
+
+        if (index >= vertexVersions_.Size() || vertexVersions_[index].first_ != vb ||
+            vertexVersions_[index].second_ != vb->GetDataVersion())
+            return false;
+        ++index;
+    }
+
+    return index == vertexVersions_.Size();
+}
+
 DecalSet::DecalSet(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY),
     geometry_(new Geometry(context)),
@@ -160,14 +597,24 @@ DecalSet::DecalSet(Context* context) :
     numIndices_(0),
     maxVertices_(DEFAULT_MAX_VERTICES),
     maxIndices_(DEFAULT_MAX_INDICES),
+    vertexHead_(0),
+    indexHead_(0),
+    dirtyVertexStart_(M_MAX_UNSIGNED),
+    dirtyVertexEnd_(0),
+    dirtyIndexStart_(M_MAX_UNSIGNED),
+    dirtyIndexEnd_(0),
     skinned_(false),
     bufferSizeDirty_(true),
     bufferDirty_(true),
+    bufferRangeDirty_(false),
     boundingBoxDirty_(true),
     skinningDirty_(false),
     assignBonesPending_(false),
     subscribed_(false)
 {
+    // Keep CPU copies of the buffers so that only the changed ranges of the ring need to be written
+    vertexBuffer_->SetShadowed(true);
+    indexBuffer_->SetShadowed(true);
     geometry_->SetIndexBuffer(indexBuffer_);
 
     batches_.Resize(1);
@@ -177,6 +624,7 @@ DecalSet::DecalSet(Context* context) :
 
 DecalSet::~DecalSet()
 {
+    CancelRequests();
 }
 
 void DecalSet::RegisterObject(Context* context)
@@ -234,6 +682,8 @@ void DecalSet::UpdateGeometry(const FrameInfo& frame)
 
     if (bufferDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
         UpdateBuffers();
+    else if (bufferRangeDirty_)
+        UpdateBufferRanges();
 
     if (skinningDirty_)
         UpdateSkinning();
@@ -241,7 +691,7 @@ void DecalSet::UpdateGeometry(const FrameInfo& frame)
 
 UpdateGeometryType DecalSet::GetUpdateGeometryType()
 {
-    if (bufferDirty_ || bufferSizeDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
+    if (bufferDirty_ || bufferSizeDirty_ || bufferRangeDirty_ || vertexBuffer_->IsDataLost() || indexBuffer_->IsDataLost())
         return UPDATE_MAIN_THREAD;
     else if (skinningDirty_)
         return UPDATE_WORKER_THREAD;
@@ -295,181 +745,55 @@ bool DecalSet::AddDecal(Drawable* target, const Vector3& worldPosition, const Qu
 {
     PROFILE(AddDecal);
 
-    // Do not add decals in headless mode
-    if (!node_ || !GetSubsystem<Graphics>())
+    DecalRequest request;
+    if (!PrepareDecal(request, target, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive,
+        normalCutoff, subGeometry))
         return false;
 
-    if (!target || !target->GetNode())
-    {
-        LOGERROR("Null target drawable for decal");
-        return false;
-    }
+    ProcessDecal(request);
+    return CommitDecal(request);
+}
 
-    // Check for animated target and switch into skinned/static mode if necessary
-    AnimatedModel* animatedModel = dynamic_cast<AnimatedModel*>(target);
-    if ((animatedModel && !skinned_) || (!animatedModel && skinned_))
-    {
-        RemoveAllDecals();
-        skinned_ = animatedModel != 0;
-        bufferSizeDirty_ = true;
-    }
+bool DecalSet::QueueDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size,
+    float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive, float normalCutoff,
+    unsigned subGeometry)
+{
+    // Queued decals are added on scene post-update, so without a scene add immediately
+    if (!GetScene())
+        return AddDecal(target, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive,
+            normalCutoff, subGeometry);
 
-    // Center the decal frustum on the world position
-    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
-    /// \todo target transform is not right if adding a decal to StaticModelGroup
-    Matrix3x4 targetTransform = target->GetNode()->GetWorldTransform().Inverse();
+    PROFILE(QueueDecal);
 
-    // For an animated model, adjust the decal position back to the bind pose
-    // To do this, need to find the bone the decal is colliding with
-    if (animatedModel)
+    requests_.Resize(requests_.Size() + 1);
+    DecalRequest& request = requests_.Back();
+    if (!PrepareDecal(request, target, worldPosition, worldRotation, size, aspectRatio, depth, topLeftUV, bottomRightUV, timeToLive,
+        normalCutoff, subGeometry))
     {
-        Skeleton& skeleton = animatedModel->GetSkeleton();
-        unsigned numBones = skeleton.GetNumBones();
-        Bone* bestBone = 0;
-        float bestSize = 0.0f;
-
-        for (unsigned i = 0; i < numBones; ++i)
-        {
-            Bone* bone = skeleton.GetBone(i);
-            if (!bone->node_ || !bone->collisionMask_)
-                continue;
-
-            // Represent the decal as a sphere, try to find the biggest colliding bone
-            Sphere decalSphere
-                (bone->node_->GetWorldTransform().Inverse() * worldPosition, 0.5f * size / bone->node_->GetWorldScale().Length());
-
-            if (bone->collisionMask_ & BONECOLLISION_BOX)
-            {
-                float size = bone->boundingBox_.HalfSize().Length();
-                if (bone->boundingBox_.IsInside(decalSphere) && size > bestSize)
-                {
-                    bestBone = bone;
-                    bestSize = size;
-                }
-            }
-            else if (bone->collisionMask_ & BONECOLLISION_SPHERE)
-            {
-                Sphere boneSphere(Vector3::ZERO, bone->radius_);
-                float size = bone->radius_;
-                if (boneSphere.IsInside(decalSphere) && size > bestSize)
-                {
-                    bestBone = bone;
-                    bestSize = size;
-                }
-            }
-        }
-
-        if (bestBone)
-            targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
+        requests_.Pop();
+        return false;
     }
 
-    // Build the decal frustum
-    Frustum decalFrustum;
-    Matrix3x4 frustumTransform = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
-    decalFrustum.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, frustumTransform);
-
-    Vector3 decalNormal = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
-
-    decals_.Resize(decals_.Size() + 1);
-    Decal& newDecal = decals_.Back();
-    newDecal.timeToLive_ = timeToLive;
-
-    Vector<PODVector<DecalVertex> > faces;
-    PODVector<DecalVertex> tempFace;
-
-    unsigned numBatches = target->GetBatches().Size();
-
-    // Use either a specified subgeometry in the target, or all
-    if (subGeometry < numBatches)
-        GetFaces(faces, target, subGeometry, decalFrustum, decalNormal, normalCutoff);
+    // Use a low priority so that the frame's rendering work is not delayed
+    request.item_ = new WorkItem();
+    request.item_->workFunction_ = ProcessDecalWork;
+    request.item_->start_ = 0;
+    request.item_->end_ = 0;
+    request.item_->aux_ = &request;
+    request.item_->priority_ = 0;
+
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    if (queue)
+        queue->AddWorkItem(request.item_);
     else
     {
-        for (unsigned i = 0; i < numBatches; ++i)
-            GetFaces(faces, target, i, decalFrustum, decalNormal, normalCutoff);
-    }
-
-    // Clip the acquired faces against all frustum planes
-    for (unsigned i = 0; i < NUM_FRUSTUM_PLANES; ++i)
-    {
-        for (unsigned j = 0; j < faces.Size(); ++j)
-        {
-            PODVector<DecalVertex>& face = faces[j];
-            if (face.Empty())
-                continue;
-
-            ClipPolygon(tempFace, face, decalFrustum.planes_[i], skinned_);
-            face = tempFace;
-        }
-    }
-
-    // Now triangulate the resulting faces into decal vertices
-    for (unsigned i = 0; i < faces.Size(); ++i)
-    {
-        PODVector<DecalVertex>& face = faces[i];
-        if (face.Size() < 3)
-            continue;
-
-        for (unsigned j = 2; j < face.Size(); ++j)
-        {
-            newDecal.AddVertex(face[0]);
-            newDecal.AddVertex(face[j - 1]);
-            newDecal.AddVertex(face[j]);
-        }
-    }
-
-    // Check if resulted in no triangles
-    if (newDecal.vertices_.Empty())
-    {
-        decals_.Pop();
-        return true;
-    }
-
-    if (newDecal.vertices_.Size() > maxVertices_)
-    {
-        LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
-                   String(maxVertices_));
-        decals_.Pop();
-        return false;
-    }
-    if (newDecal.indices_.Size() > maxIndices_)
-    {
-        LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
-                   String(maxIndices_));
-        decals_.Pop();
-        return false;
+        ProcessDecalWork(request.item_, 0);
+        request.item_->completed_ = true;
     }
 
-    // Calculate UVs
-    Matrix4 projection(Matrix4::ZERO);
-    projection.m11_ = (1.0f / (size * 0.5f));
-    projection.m00_ = projection.m11_ / aspectRatio;
-    projection.m22_ = 1.0f / depth;
-    projection.m33_ = 1.0f;
-
-    CalculateUVs(newDecal, frustumTransform.Inverse(), projection, topLeftUV, bottomRightUV);
-
-    // Transform vertices to this node's local space and generate tangents
-    Matrix3x4 decalTransform = node_->GetWorldTransform().Inverse() * target->GetNode()->GetWorldTransform();
-    TransformVertices(newDecal, skinned_ ? Matrix3x4::IDENTITY : decalTransform);
-    GenerateTangents(&newDecal.vertices_[0], sizeof(DecalVertex), &newDecal.indices_[0], sizeof(unsigned short), 0,
-        newDecal.indices_.Size(), offsetof(DecalVertex, normal_), offsetof(DecalVertex, texCoord_), offsetof(DecalVertex,
-        tangent_));
-
-    newDecal.CalculateBoundingBox();
-    numVertices_ += newDecal.vertices_.Size();
-    numIndices_ += newDecal.indices_.Size();
-
-    // Remove oldest decals if total vertices exceeded
-    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
-        RemoveDecals(1);
-
-    LOGDEBUG("Added decal with " + String(newDecal.vertices_.Size()) + " vertices");
-
-    // If new decal is time limited, subscribe to scene post-update
-    if (newDecal.timeToLive_ > 0.0f && !subscribed_)
+    if (!subscribed_)
         UpdateEventSubscription(false);
 
-    MarkDecalsDirty();
     return true;
 }
 
@@ -486,6 +810,7 @@ void DecalSet::RemoveAllDecals()
         decals_.Clear();
         numVertices_ = 0;
         numIndices_ = 0;
+        bufferDirty_ = true;
         MarkDecalsDirty();
     }
 
@@ -583,6 +908,7 @@ void DecalSet::SetDecalsAttr(const PODVector<unsigned char>& value)
     UpdateEventSubscription(true);
     UpdateBatch();
     MarkDecalsDirty();
+    bufferDirty_ = true;
     bufferSizeDirty_ = true;
 }
 
@@ -640,260 +966,286 @@ PODVector<unsigned char> DecalSet::GetDecalsAttr() const
         }
     }
 
-    return ret.GetBuffer();
-}
-
-void DecalSet::OnMarkedDirty(Node* node)
-{
-    Drawable::OnMarkedDirty(node);
+    return ret.GetBuffer();
+}
+
+void DecalSet::OnMarkedDirty(Node* node)
+{
+    Drawable::OnMarkedDirty(node);
+
+    if (skinned_)
+    {
+        // If the scene node or any of the bone nodes move, mark skinning dirty
+        skinningDirty_ = true;
+    }
+}
+
+void DecalSet::OnWorldBoundingBoxUpdate()
+{
+    if (!skinned_)
+    {
+        if (boundingBoxDirty_)
+            CalculateBoundingBox();
+
+        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
+    }
+    else
+    {
+        // When using skinning, update world bounding box based on the bones
+        BoundingBox worldBox;
+
+        for (Vector<Bone>::ConstIterator i = bones_.Begin(); i != bones_.End(); ++i)
+        {
+            Node* boneNode = i->node_;
+            if (!boneNode)
+                continue;
+
+            // Use hitbox if available. If not, use only half of the sphere radius
+            /// \todo The sphere radius should be multiplied with bone scale
+            if (i->collisionMask_ & BONECOLLISION_BOX)
+                worldBox.Merge(i->boundingBox_.Transformed(boneNode->GetWorldTransform()));
+            else if (i->collisionMask_ & BONECOLLISION_SPHERE)
+                worldBox.Merge(Sphere(boneNode->GetWorldPosition(), i->radius_ * 0.5f));
+        }
+
+        worldBoundingBox_ = worldBox;
+    }
+}
+
+bool DecalSet::PrepareDecal(DecalRequest& request, Drawable* target, const Vector3& worldPosition,
+    const Quaternion& worldRotation, float size, float aspectRatio, float depth, const Vector2& topLeftUV,
+    const Vector2& bottomRightUV, float timeToLive, float normalCutoff, unsigned subGeometry)
+{
+    // Do not add decals in headless mode
+    if (!node_ || !GetSubsystem<Graphics>())
+        return false;
+
+    if (!target || !target->GetNode())
+    {
+        LOGERROR("Null target drawable for decal");
+        return false;
+    }
+
+    // Check for animated target. The decal set switches into skinned/static mode when the decal is added
+    AnimatedModel* animatedModel = dynamic_cast<AnimatedModel*>(target);
+
+    // Center the decal frustum on the world position
+    Vector3 adjustedWorldPosition = worldPosition - 0.5f * depth * (worldRotation * Vector3::FORWARD);
+    /// \todo target transform is not right if adding a decal to StaticModelGroup
+    Matrix3x4 targetTransform = target->GetNode()->GetWorldTransform().Inverse();
+
+    // For an animated model, adjust the decal position back to the bind pose
+    // To do this, need to find the bone the decal is colliding with
+    if (animatedModel)
+    {
+        Skeleton& skeleton = animatedModel->GetSkeleton();
+        unsigned numBones = skeleton.GetNumBones();
+        Bone* bestBone = 0;
+        float bestSize = 0.0f;
+
+        for (unsigned i = 0; i < numBones; ++i)
+        {
+            Bone* bone = skeleton.GetBone(i);
+            if (!bone->node_ || !bone->collisionMask_)
+                continue;
+
+            // Represent the decal as a sphere, try to find the biggest colliding bone
+            Sphere decalSphere
+                (bone->node_->GetWorldTransform().Inverse() * worldPosition, 0.5f * size / bone->node_->GetWorldScale().Length());
+
+            if (bone->collisionMask_ & BONECOLLISION_BOX)
+            {
+                float size = bone->boundingBox_.HalfSize().Length();
+                if (bone->boundingBox_.IsInside(decalSphere) && size > bestSize)
+                {
+                    bestBone = bone;
+                    bestSize = size;
+                }
+            }
+            else if (bone->collisionMask_ & BONECOLLISION_SPHERE)
+            {
+                Sphere boneSphere(Vector3::ZERO, bone->radius_);
+                float size = bone->radius_;
+                if (boneSphere.IsInside(decalSphere) && size > bestSize)
+                {
+                    bestBone = bone;
+                    bestSize = size;
+                }
+            }
+        }
+
+        if (bestBone)
+            targetTransform = (bestBone->node_->GetWorldTransform() * bestBone->offsetMatrix_).Inverse();
+    }
+
+    // Build the decal frustum
+    request.frustumTransform_ = targetTransform * Matrix3x4(adjustedWorldPosition, worldRotation, 1.0f);
+    request.frustum_.DefineOrtho(size, aspectRatio, 1.0, 0.0f, depth, request.frustumTransform_);
+    request.decalNormal_ = (targetTransform * Vector4(worldRotation * Vector3::BACK, 0.0f)).Normalized();
+
+    request.projection_ = Matrix4::ZERO;
+    request.projection_.m11_ = (1.0f / (size * 0.5f));
+    request.projection_.m00_ = request.projection_.m11_ / aspectRatio;
+    request.projection_.m22_ = 1.0f / depth;
+    request.projection_.m33_ = 1.0f;
+
+    // Skinned decals stay in the target's bind pose, static decals are transformed to this node's local space
+    request.vertexTransform_ = animatedModel ? Matrix3x4::IDENTITY : node_->GetWorldTransform().Inverse() *
+        target->GetNode()->GetWorldTransform();
+
+    request.target_ = target;
+    request.topLeftUV_ = topLeftUV;
+    request.bottomRightUV_ = bottomRightUV;
+    request.normalCutoff_ = normalCutoff;
+    request.maxVertices_ = maxVertices_;
+    request.maxIndices_ = maxIndices_;
+    request.skinned_ = animatedModel != 0;
+    request.decal_.timeToLive_ = timeToLive;
 
-    if (skinned_)
-    {
-        // If the scene node or any of the bone nodes move, mark skinning dirty
-        skinningDirty_ = true;
-    }
-}
+    // Use either a specified subgeometry in the target, or all
+    unsigned numBatches = target->GetBatches().Size();
+    unsigned batchStart = subGeometry < numBatches ? subGeometry : 0;
+    unsigned batchEnd = subGeometry < numBatches ? subGeometry + 1 : numBatches;
 
-void DecalSet::OnWorldBoundingBoxUpdate()
-{
-    if (!skinned_)
+    for (unsigned i = batchStart; i < batchEnd; ++i)
     {
-        if (boundingBoxDirty_)
-            CalculateBoundingBox();
+        // Try to use the most accurate LOD level if possible
+        DecalGeometryCache* cache = GetGeometryCache(target->GetLodGeometry(i, 0));
+        if (!cache)
+            continue;
 
-        worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
-    }
-    else
-    {
-        // When using skinning, update world bounding box based on the bones
-        BoundingBox worldBox;
+        request.geometries_.Push(SharedPtr<DecalGeometryCache>(cache));
+        request.boneMappings_.Resize(request.boneMappings_.Size() + 1);
 
-        for (Vector<Bone>::ConstIterator i = bones_.Begin(); i != bones_.End(); ++i)
+        // Check whether target is using global or per-geometry skinning
+        if (animatedModel && !animatedModel->GetGeometrySkinMatrices().Empty())
         {
-            Node* boneNode = i->node_;
-            if (!boneNode)
-                continue;
-
-            // Use hitbox if available. If not, use only half of the sphere radius
-            /// \todo The sphere radius should be multiplied with bone scale
-            if (i->collisionMask_ & BONECOLLISION_BOX)
-                worldBox.Merge(i->boundingBox_.Transformed(boneNode->GetWorldTransform()));
-            else if (i->collisionMask_ & BONECOLLISION_SPHERE)
-                worldBox.Merge(Sphere(boneNode->GetWorldPosition(), i->radius_ * 0.5f));
+            const Vector<PODVector<unsigned> >& geometryBoneMappings = animatedModel->GetGeometryBoneMappings();
+            if (i < geometryBoneMappings.Size())
+                request.boneMappings_.Back() = geometryBoneMappings[i];
         }
-
-        worldBoundingBox_ = worldBox;
     }
+
+    return true;
 }
 
-void DecalSet::GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, const Frustum& frustum,
-    const Vector3& decalNormal, float normalCutoff)
+bool DecalSet::CommitDecal(DecalRequest& request)
 {
-    // Try to use the most accurate LOD level if possible
-    Geometry* geometry = target->GetLodGeometry(batchIndex, 0);
-    if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
-        return;
-
-    const unsigned char* positionData = 0;
-    const unsigned char* normalData = 0;
-    const unsigned char* skinningData = 0;
-    const unsigned char* indexData = 0;
-    unsigned positionStride = 0;
-    unsigned normalStride = 0;
-    unsigned skinningStride = 0;
-    unsigned indexStride = 0;
-
-    IndexBuffer* ib = geometry->GetIndexBuffer();
-    if (ib)
+    // Switch into skinned/static mode if necessary
+    if (request.skinned_ != skinned_)
     {
-        indexData = ib->GetShadowData();
-        indexStride = ib->GetIndexSize();
+        RemoveAllDecals();
+        skinned_ = request.skinned_;
+        bufferSizeDirty_ = true;
     }
 
-    // For morphed models positions, normals and skinning may be in different buffers
-    for (unsigned i = 0; i < geometry->GetNumVertexBuffers(); ++i)
-    {
-        VertexBuffer* vb = geometry->GetVertexBuffer(i);
-        if (!vb)
-            continue;
+    Decal& newDecal = request.decal_;
 
-        unsigned elementMask = geometry->GetVertexElementMask(i);
-        unsigned char* data = vb->GetShadowData();
-        if (!data)
-            continue;
+    // Check if resulted in no triangles
+    if (newDecal.vertices_.Empty())
+        return true;
 
-        if (elementMask & MASK_POSITION)
-        {
-            positionData = data;
-            positionStride = vb->GetVertexSize();
-        }
-        if (elementMask & MASK_NORMAL)
-        {
-            normalData = data + vb->GetElementOffset(ELEMENT_NORMAL);
-            normalStride = vb->GetVertexSize();
-        }
-        if (elementMask & MASK_BLENDWEIGHTS)
-        {
-            skinningData = data + vb->GetElementOffset(ELEMENT_BLENDWEIGHTS);
-            skinningStride = vb->GetVertexSize();
-        }
+    if (newDecal.vertices_.Size() > maxVertices_)
+    {
+        LOGWARNING("Can not add decal, vertex count " + String(newDecal.vertices_.Size()) + " exceeds maximum " +
+                   String(maxVertices_));
+        return false;
     }
-
-    // Positions and indices are needed
-    if (!positionData)
+    if (newDecal.indices_.Size() > maxIndices_)
     {
-        // As a fallback, try to get the geometry's raw vertex/index data
-        unsigned elementMask;
-        geometry->GetRawData(positionData, positionStride, indexData, indexStride, elementMask);
-        if (!positionData)
-        {
-            LOGWARNING("Can not add decal, target drawable has no CPU-side geometry data");
-            return;
-        }
+        LOGWARNING("Can not add decal, index count " + String(newDecal.indices_.Size()) + " exceeds maximum " +
+                   String(maxIndices_));
+        return false;
     }
 
-    if (indexData)
+    if (skinned_)
     {
-        unsigned indexStart = geometry->GetIndexStart();
-        unsigned indexCount = geometry->GetIndexCount();
+        AnimatedModel* animatedModel = static_cast<AnimatedModel*>(request.target_.Get());
+        if (!animatedModel)
+            return false;
 
-        // 16-bit indices
-        if (indexStride == sizeof(unsigned short))
+        // Remap the skeleton bone indices to the decal bones. Drop triangles that can not be skinned
+        PODVector<bool> skinnable(newDecal.vertices_.Size());
+        for (unsigned i = 0; i < newDecal.vertices_.Size(); ++i)
         {
-            const unsigned short* indices = ((const unsigned short*)indexData) + indexStart;
-            const unsigned short* indicesEnd = indices + indexCount;
-
-            while (indices < indicesEnd)
-            {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-                indices += 3;
-            }
+            DecalVertex& vertex = newDecal.vertices_[i];
+            skinnable[i] = GetBones(animatedModel, vertex.blendWeights_, vertex.blendIndices_);
         }
-        else
-        // 32-bit indices
-        {
-            const unsigned* indices = ((const unsigned*)indexData) + indexStart;
-            const unsigned* indicesEnd = indices + indexCount;
 
-            while (indices < indicesEnd)
+        unsigned numIndices = 0;
+        for (unsigned i = 0; i + 2 < newDecal.indices_.Size(); i += 3)
+        {
+            const unsigned short* triangle = &newDecal.indices_[i];
+            if (skinnable[triangle[0]] && skinnable[triangle[1]] && skinnable[triangle[2]])
             {
-                GetFace(faces, target, batchIndex, indices[0], indices[1], indices[2], positionData, normalData, skinningData,
-                    positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-                indices += 3;
+                newDecal.indices_[numIndices++] = triangle[0];
+                newDecal.indices_[numIndices++] = triangle[1];
+                newDecal.indices_[numIndices++] = triangle[2];
             }
         }
-    }
-    else
-    {
-        // Non-indexed geometry
-        unsigned indices = geometry->GetVertexStart();
-        unsigned indicesEnd = indices + geometry->GetVertexCount();
+        newDecal.indices_.Resize(numIndices);
 
-        while (indices + 2 < indicesEnd)
-        {
-            GetFace(faces, target, batchIndex, indices, indices + 1, indices + 2, positionData, normalData, skinningData,
-                positionStride, normalStride, skinningStride, frustum, decalNormal, normalCutoff);
-            indices += 3;
-        }
+        // Update amount of shader data in the decal batch
+        UpdateBatch();
+
+        if (newDecal.indices_.Empty())
+            return true;
     }
-}
 
-void DecalSet::GetFace(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, unsigned i0, unsigned i1,
-    unsigned i2, const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData,
-    unsigned positionStride, unsigned normalStride, unsigned skinningStride, const Frustum& frustum, const Vector3& decalNormal,
-    float normalCutoff)
-{
-    bool hasNormals = normalData != 0;
-    bool hasSkinning = skinned_ && skinningData != 0;
+    decals_.Push(newDecal);
+    Decal& addedDecal = decals_.Back();
+    numVertices_ += addedDecal.vertices_.Size();
+    numIndices_ += addedDecal.indices_.Size();
 
-    const Vector3& v0 = *((const Vector3*)(&positionData[i0 * positionStride]));
-    const Vector3& v1 = *((const Vector3*)(&positionData[i1 * positionStride]));
-    const Vector3& v2 = *((const Vector3*)(&positionData[i2 * positionStride]));
+    PlaceDecal(addedDecal);
+    MarkDecalsDirty();
 
-    // Calculate unsmoothed face normals if no normal data
-    Vector3 faceNormal = Vector3::ZERO;
-    if (!hasNormals)
-    {
-        Vector3 dist1 = v1 - v0;
-        Vector3 dist2 = v2 - v0;
-        faceNormal = (dist1.CrossProduct(dist2)).Normalized();
-    }
+    LOGDEBUG("Added decal with " + String(addedDecal.vertices_.Size()) + " vertices");
+
+    // If new decal is time limited, subscribe to scene post-update
+    if (addedDecal.timeToLive_ > 0.0f && !subscribed_)
+        UpdateEventSubscription(false);
 
-    const Vector3& n0 = hasNormals ? *((const Vector3*)(&normalData[i0 * normalStride])) : faceNormal;
-    const Vector3& n1 = hasNormals ? *((const Vector3*)(&normalData[i1 * normalStride])) : faceNormal;
-    const Vector3& n2 = hasNormals ? *((const Vector3*)(&normalData[i2 * normalStride])) : faceNormal;
+    return true;
+}
 
-    const unsigned char* s0 = hasSkinning ? &skinningData[i0 * skinningStride] : (const unsigned char*)0;
-    const unsigned char* s1 = hasSkinning ? &skinningData[i1 * skinningStride] : (const unsigned char*)0;
-    const unsigned char* s2 = hasSkinning ? &skinningData[i2 * skinningStride] : (const unsigned char*)0;
+DecalGeometryCache* DecalSet::GetGeometryCache(Geometry* geometry)
+{
+    if (!geometry)
+        return 0;
 
-    // Check if face is too much away from the decal normal
-    if (decalNormal.DotProduct((n0 + n1 + n2) / 3.0f) < normalCutoff)
-        return;
+    HashMap<Geometry*, SharedPtr<DecalGeometryCache> >::Iterator i = geometryCaches_.Find(geometry);
+    if (i != geometryCaches_.End() && i->second_->IsValid(geometry))
+        return i->second_;
 
-    // Check if face is culled completely by any of the planes
-    for (unsigned i = PLANE_FAR; i < NUM_FRUSTUM_PLANES; --i)
-    {
-        const Plane& plane = frustum.planes_[i];
-        if (plane.Distance(v0) < 0.0f && plane.Distance(v1) < 0.0f && plane.Distance(v2) < 0.0f)
-            return;
-    }
+    PROFILE(BuildDecalGeometryCache);
 
-    faces.Resize(faces.Size() + 1);
-    PODVector<DecalVertex>& face = faces.Back();
-    if (!hasSkinning)
+    // Forget the caches of destroyed geometries. Queued decals still referring to them keep them alive
+    for (HashMap<Geometry*, SharedPtr<DecalGeometryCache> >::Iterator j = geometryCaches_.Begin(); j != geometryCaches_.End();)
     {
-        face.Reserve(3);
-        face.Push(DecalVertex(v0, n0));
-        face.Push(DecalVertex(v1, n1));
-        face.Push(DecalVertex(v2, n2));
+        if (j->second_->geometry_.Expired())
+            j = geometryCaches_.Erase(j);
+        else
+            ++j;
     }
-    else
-    {
-        const float* bw0 = (const float*)s0;
-        const float* bw1 = (const float*)s1;
-        const float* bw2 = (const float*)s2;
-        const unsigned char* bi0 = s0 + sizeof(float) * 4;
-        const unsigned char* bi1 = s1 + sizeof(float) * 4;
-        const unsigned char* bi2 = s2 + sizeof(float) * 4;
-        unsigned char nbi0[4];
-        unsigned char nbi1[4];
-        unsigned char nbi2[4];
-
-        // Make sure all bones are found and that there is room in the skinning matrices
-        if (!GetBones(target, batchIndex, bw0, bi0, nbi0) || !GetBones(target, batchIndex, bw1, bi1, nbi1) ||
-            !GetBones(target, batchIndex, bw2, bi2, nbi2))
-            return;
 
-        face.Reserve(3);
-        face.Push(DecalVertex(v0, n0, bw0, nbi0));
-        face.Push(DecalVertex(v1, n1, bw1, nbi1));
-        face.Push(DecalVertex(v2, n2, bw2, nbi2));
-    }
+    SharedPtr<DecalGeometryCache> cache(new DecalGeometryCache());
+    if (!cache->Build(geometry))
+        return 0;
+
+    geometryCaches_[geometry] = cache;
+    return cache;
 }
 
-bool DecalSet::GetBones(Drawable* target, unsigned batchIndex, const float* blendWeights, const unsigned char* blendIndices,
-    unsigned char* newBlendIndices)
+bool DecalSet::GetBones(AnimatedModel* model, const float* blendWeights, unsigned char* blendIndices)
 {
-    AnimatedModel* animatedModel = dynamic_cast<AnimatedModel*>(target);
-    if (!animatedModel)
-        return false;
-
-    // Check whether target is using global or per-geometry skinning
-    const Vector<PODVector<Matrix3x4> >& geometrySkinMatrices = animatedModel->GetGeometrySkinMatrices();
-    const Vector<PODVector<unsigned> >& geometryBoneMappings = animatedModel->GetGeometryBoneMappings();
+    unsigned char newBlendIndices[4];
 
     for (unsigned i = 0; i < 4; ++i)
     {
         if (blendWeights[i] > 0.0f)
         {
-            Bone* bone = 0;
-            if (geometrySkinMatrices.Empty())
-                bone = animatedModel->GetSkeleton().GetBone(blendIndices[i]);
-            else if (blendIndices[i] < geometryBoneMappings[batchIndex].Size())
-                bone = animatedModel->GetSkeleton().GetBone(geometryBoneMappings[batchIndex][blendIndices[i]]);
-
+            Bone* bone = model->GetSkeleton().GetBone(blendIndices[i]);
             if (!bone)
             {
                 LOGWARNING("Out of range bone index for skinned decal");
@@ -944,39 +1296,143 @@ bool DecalSet::GetBones(Drawable* target, unsigned batchIndex, const float* blen
             newBlendIndices[i] = 0;
     }
 
-    // Update amount of shader data in the decal batch
-    UpdateBatch();
+    for (unsigned i = 0; i < 4; ++i)
+        blendIndices[i] = newBlendIndices[i];
+
     return true;
 }
 
-void DecalSet::CalculateUVs(Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV,
-    const Vector2& bottomRightUV)
+void DecalSet::PlaceDecal(Decal& decal)
 {
-    Matrix4 viewProj = projection * view;
+    // If the buffers will be rewritten anyway, only keep within the limits. The rewrite packs the decals
+    if (bufferDirty_ || bufferSizeDirty_)
+    {
+        while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
+            RemoveDecals(1);
+        return;
+    }
 
-    for (PODVector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    unsigned vertexCount = decal.vertices_.Size();
+    unsigned indexCount = decal.indices_.Size();
+
+    // Wrap to the start of the ring if the decal does not fit at the head
+    if (vertexHead_ + vertexCount > maxVertices_ || indexHead_ + indexCount > maxIndices_)
     {
-        Vector3 projected = viewProj * i->position_;
-        i->texCoord_ = Vector2(
-            Lerp(topLeftUV.x_, bottomRightUV.x_, projected.x_ * 0.5f + 0.5f),
-            Lerp(bottomRightUV.y_, topLeftUV.y_, projected.y_ * 0.5f + 0.5f)
-        );
+        vertexHead_ = 0;
+        indexHead_ = 0;
+    }
+
+    decal.vertexStart_ = vertexHead_;
+    decal.indexStart_ = indexHead_;
+    vertexHead_ += vertexCount;
+    indexHead_ += indexCount;
+
+    // Remove all decals in the way. They are not necessarily the oldest ones, as after a wrap the decals left over from the
+    // previous pass at the end of the ring are older than those at the start
+    for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End();)
+    {
+        if (&(*i) == &decal)
+        {
+            ++i;
+            continue;
+        }
+
+        bool vertexOverlap = i->vertexStart_ < vertexHead_ && decal.vertexStart_ < i->vertexStart_ + i->vertices_.Size();
+        bool indexOverlap = i->indexStart_ < indexHead_ && decal.indexStart_ < i->indexStart_ + i->indices_.Size();
+        if (vertexOverlap || indexOverlap)
+            i = RemoveDecal(i);
+        else
+            ++i;
     }
+
+    WriteDecal(decal);
+    MarkBufferRange(decal.vertexStart_, vertexCount, decal.indexStart_, indexCount);
 }
 
-void DecalSet::TransformVertices(Decal& decal, const Matrix3x4& transform)
+void DecalSet::WriteDecal(const Decal& decal)
 {
-    for (PODVector<DecalVertex>::Iterator i = decal.vertices_.Begin(); i != decal.vertices_.End(); ++i)
+    float* vertices = (float*)(vertexBuffer_->GetShadowData() + decal.vertexStart_ * vertexBuffer_->GetVertexSize());
+    unsigned short* indices = ((unsigned short*)indexBuffer_->GetShadowData()) + decal.indexStart_;
+
+    for (unsigned i = 0; i < decal.vertices_.Size(); ++i)
     {
-        i->position_ = transform * i->position_;
-        i->normal_ = (transform * i->normal_).Normalized();
+        const DecalVertex& vertex = decal.vertices_[i];
+        *vertices++ = vertex.position_.x_;
+        *vertices++ = vertex.position_.y_;
+        *vertices++ = vertex.position_.z_;
+        *vertices++ = vertex.normal_.x_;
+        *vertices++ = vertex.normal_.y_;
+        *vertices++ = vertex.normal_.z_;
+        *vertices++ = vertex.texCoord_.x_;
+        *vertices++ = vertex.texCoord_.y_;
+        *vertices++ = vertex.tangent_.x_;
+        *vertices++ = vertex.tangent_.y_;
+        *vertices++ = vertex.tangent_.z_;
+        *vertices++ = vertex.tangent_.w_;
+        if (skinned_)
+        {
+            *vertices++ = vertex.blendWeights_[0];
+            *vertices++ = vertex.blendWeights_[1];
+            *vertices++ = vertex.blendWeights_[2];
+            *vertices++ = vertex.blendWeights_[3];
+            *vertices++ = *((float*)vertex.blendIndices_);
+        }
+    }
+
+    for (unsigned i = 0; i < decal.indices_.Size(); ++i)
+        *indices++ = (unsigned short)(decal.indices_[i] + decal.vertexStart_);
+}
+
+void DecalSet::MarkBufferRange(unsigned vertexStart, unsigned vertexCount, unsigned indexStart, unsigned indexCount)
+{
+    if (vertexCount)
+    {
+        if (vertexStart < dirtyVertexStart_)
+            dirtyVertexStart_ = vertexStart;
+        if (vertexStart + vertexCount > dirtyVertexEnd_)
+            dirtyVertexEnd_ = vertexStart + vertexCount;
+    }
+    if (indexCount)
+    {
+        if (indexStart < dirtyIndexStart_)
+            dirtyIndexStart_ = indexStart;
+        if (indexStart + indexCount > dirtyIndexEnd_)
+            dirtyIndexEnd_ = indexStart + indexCount;
+    }
+
+    bufferRangeDirty_ = true;
+}
+
+void DecalSet::CancelRequests()
+{
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+
+    for (List<DecalRequest>::Iterator i = requests_.Begin(); i != requests_.End(); ++i)
+    {
+        // If the projection already started executing, wait for it as it accesses the request
+        if (i->item_ && !i->item_->completed_ && queue && !queue->RemoveWorkItem(i->item_))
+        {
+            while (!i->item_->completed_)
+                Time::Sleep(0);
+        }
     }
+
+    requests_.Clear();
 }
 
 List<Decal>::Iterator DecalSet::RemoveDecal(List<Decal>::Iterator i)
 {
     numVertices_ -= i->vertices_.Size();
     numIndices_ -= i->indices_.Size();
+
+    // Leave degenerate triangles in place of the decal, unless the buffers will be rewritten anyway
+    if (!bufferDirty_ && !bufferSizeDirty_ && !i->indices_.Empty())
+    {
+        unsigned short* indices = ((unsigned short*)indexBuffer_->GetShadowData()) + i->indexStart_;
+        memset(indices, 0, i->indices_.Size() * sizeof(unsigned short));
+        MarkBufferRange(0, 0, i->indexStart_, i->indices_.Size());
+    }
+
     MarkDecalsDirty();
     return decals_.Erase(i);
 }
@@ -988,7 +1444,6 @@ void DecalSet::MarkDecalsDirty()
         boundingBoxDirty_ = true;
         OnMarkedDirty(node_);
     }
-    bufferDirty_ = true;
 }
 
 void DecalSet::CalculateBoundingBox()
@@ -1012,54 +1467,74 @@ void DecalSet::UpdateBufferSize()
 
 void DecalSet::UpdateBuffers()
 {
-    geometry_->SetDrawRange(TRIANGLE_LIST, 0, numIndices_, 0, numVertices_);
+    // Loaded decals may exceed the limits
+    while (decals_.Size() && (numVertices_ > maxVertices_ || numIndices_ > maxIndices_))
+        RemoveDecals(1);
 
-    float* vertices = (float*)vertexBuffer_->Lock(0, numVertices_);
-    unsigned short* indices = (unsigned short*)indexBuffer_->Lock(0, numIndices_);
+    unsigned char* vertexData = vertexBuffer_->GetShadowData();
+    unsigned char* indexData = indexBuffer_->GetShadowData();
 
-    if (vertices && indices)
+    if (vertexData && indexData)
     {
-        unsigned short indexStart = 0;
+        // Pack the decals to the start of the ring, oldest first
+        vertexHead_ = 0;
+        indexHead_ = 0;
 
-        for (List<Decal>::ConstIterator i = decals_.Begin(); i != decals_.End(); ++i)
+        for (List<Decal>::Iterator i = decals_.Begin(); i != decals_.End(); ++i)
         {
-            for (unsigned j = 0; j < i->vertices_.Size(); ++j)
-            {
-                const DecalVertex& vertex = i->vertices_[j];
-                *vertices++ = vertex.position_.x_;
-                *vertices++ = vertex.position_.y_;
-                *vertices++ = vertex.position_.z_;
-                *vertices++ = vertex.normal_.x_;
-                *vertices++ = vertex.normal_.y_;
-                *vertices++ = vertex.normal_.z_;
-                *vertices++ = vertex.texCoord_.x_;
-                *vertices++ = vertex.texCoord_.y_;
-                *vertices++ = vertex.tangent_.x_;
-                *vertices++ = vertex.tangent_.y_;
-                *vertices++ = vertex.tangent_.z_;
-                *vertices++ = vertex.tangent_.w_;
-                if (skinned_)
-                {
-                    *vertices++ = vertex.blendWeights_[0];
-                    *vertices++ = vertex.blendWeights_[1];
-                    *vertices++ = vertex.blendWeights_[2];
-                    *vertices++ = vertex.blendWeights_[3];
-                    *vertices++ = *((float*)vertex.blendIndices_);
-                }
-            }
+            i->vertexStart_ = vertexHead_;
+            i->indexStart_ = indexHead_;
+            WriteDecal(*i);
+            vertexHead_ += i->vertices_.Size();
+            indexHead_ += i->indices_.Size();
+        }
 
-            for (unsigned j = 0; j < i->indices_.Size(); ++j)
-                *indices++ = i->indices_[j] + indexStart;
+        // Fill the rest of the index buffer with degenerate triangles
+        memset(indexData + indexHead_ * sizeof(unsigned short), 0, (maxIndices_ - indexHead_) * sizeof(unsigned short));
 
-            indexStart += i->vertices_.Size();
-        }
+        geometry_->SetDrawRange(TRIANGLE_LIST, 0, numIndices_, 0, numVertices_);
+        vertexBuffer_->SetData(vertexData);
+        indexBuffer_->SetData(indexData);
     }
 
-    vertexBuffer_->Unlock();
     vertexBuffer_->ClearDataLost();
-    indexBuffer_->Unlock();
     indexBuffer_->ClearDataLost();
+    dirtyVertexStart_ = dirtyIndexStart_ = M_MAX_UNSIGNED;
+    dirtyVertexEnd_ = dirtyIndexEnd_ = 0;
     bufferDirty_ = false;
+    bufferRangeDirty_ = false;
+}
+
+void DecalSet::UpdateBufferRanges()
+{
+    // Draw up to the end of the furthest decal in the ring. Gaps left by removed decals hold degenerate triangles
+    unsigned vertexEnd = 0;
+    unsigned indexEnd = 0;
+
+    for (List<Decal>::ConstIterator i = decals_.Begin(); i != decals_.End(); ++i)
+    {
+        if (i->vertexStart_ + i->vertices_.Size() > vertexEnd)
+            vertexEnd = i->vertexStart_ + i->vertices_.Size();
+        if (i->indexStart_ + i->indices_.Size() > indexEnd)
+            indexEnd = i->indexStart_ + i->indices_.Size();
+    }
+
+    geometry_->SetDrawRange(TRIANGLE_LIST, 0, indexEnd, 0, vertexEnd);
+
+    if (dirtyVertexEnd_ > dirtyVertexStart_)
+    {
+        vertexBuffer_->SetDataRange(vertexBuffer_->GetShadowData() + dirtyVertexStart_ * vertexBuffer_->GetVertexSize(),
+            dirtyVertexStart_, dirtyVertexEnd_ - dirtyVertexStart_);
+    }
+    if (dirtyIndexEnd_ > dirtyIndexStart_)
+    {
+        indexBuffer_->SetDataRange(indexBuffer_->GetShadowData() + dirtyIndexStart_ * indexBuffer_->GetIndexSize(),
+            dirtyIndexStart_, dirtyIndexEnd_ - dirtyIndexStart_);
+    }
+
+    dirtyVertexStart_ = dirtyIndexStart_ = M_MAX_UNSIGNED;
+    dirtyVertexEnd_ = dirtyIndexEnd_ = 0;
+    bufferRangeDirty_ = false;
 }
 
 void DecalSet::UpdateSkinning()
@@ -1133,8 +1608,8 @@ void DecalSet::UpdateEventSubscription(bool checkAllDecals)
             }
         }
 
-        // If no time limited decals, no need to subscribe to scene update
-        enabled = hasTimeLimitedDecals;
+        // If no time limited or queued decals, no need to subscribe to scene update
+        enabled = hasTimeLimitedDecals || !requests_.Empty();
     }
 
     if (enabled && !subscribed_)
@@ -1165,6 +1640,21 @@ void DecalSet::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData
         else
             ++i;
     }
+
+    // Add the finished queued decals in the order they were queued
+    if (!requests_.Empty())
+    {
+        PROFILE(CommitDecals);
+
+        while (!requests_.Empty() && requests_.Front().item_->completed_)
+        {
+            CommitDecal(requests_.Front());
+            requests_.PopFront();
+        }
+
+        if (requests_.Empty())
+            UpdateEventSubscription(true);
+    }
 }
 
 }
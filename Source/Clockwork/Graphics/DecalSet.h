@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "../Container/HashMap.h"
 #include "../Container/List.h"
 #include "../Graphics/Drawable.h"
 #include "../Graphics/Skeleton.h"
@@ -30,8 +31,10 @@
 namespace Clockwork
 {
 
+class AnimatedModel;
 class IndexBuffer;
 class VertexBuffer;
+struct WorkItem;
 
 /// %Decal vertex.
 struct DecalVertex
@@ -80,7 +83,9 @@ struct Decal
     /// Construct with defaults.
     Decal() :
         timer_(0.0f),
-        timeToLive_(0.0f)
+        timeToLive_(0.0f),
+        vertexStart_(0),
+        indexStart_(0)
     {
     }
 
@@ -99,6 +104,96 @@ struct Decal
     PODVector<DecalVertex> vertices_;
     /// Decal indices.
     PODVector<unsigned short> indices_;
+    /// First vertex in the vertex buffer ring.
+    unsigned vertexStart_;
+    /// First index in the index buffer ring.
+    unsigned indexStart_;
+};
+
+/// Bounding volume hierarchy node of a decal target geometry.
+struct DecalBVHNode
+{
+    /// Bounding box of the node's triangles.
+    BoundingBox boundingBox_;
+    /// First triangle for a leaf node, or index of the second child node for an inner node. The first child follows its parent.
+    unsigned start_;
+    /// Number of triangles for a leaf node, 0 for an inner node.
+    unsigned count_;
+};
+
+/// Triangles of a decal target geometry in model space, arranged in a bounding volume hierarchy for decal projection.
+struct DecalGeometryCache : public RefCounted
+{
+    /// Construct.
+    DecalGeometryCache() :
+        indexStart_(0),
+        indexCount_(0),
+        vertexStart_(0),
+        vertexCount_(0),
+        skinned_(false)
+    {
+    }
+
+    /// Build from a geometry's CPU-side data. Return true if successful.
+    bool Build(Geometry* geometry);
+    /// Return whether is up to date with a geometry, including its vertex data.
+    bool IsValid(Geometry* geometry) const;
+
+    /// Source geometry.
+    WeakPtr<Geometry> geometry_;
+    /// Triangle vertices, three per triangle, in hierarchy order. Blend indices refer to the geometry's bone mapping.
+    PODVector<DecalVertex> vertices_;
+    /// Hierarchy nodes, root first.
+    PODVector<DecalBVHNode> nodes_;
+    /// Source geometry index start.
+    unsigned indexStart_;
+    /// Source geometry index count.
+    unsigned indexCount_;
+    /// Source geometry vertex start.
+    unsigned vertexStart_;
+    /// Source geometry vertex count.
+    unsigned vertexCount_;
+    /// Source geometry vertex buffers and their data versions. Vertex data may be rewritten in place, for example by morphing.
+    PODVector<Pair<VertexBuffer*, unsigned> > vertexVersions_;
+    /// Skinning data present flag.
+    bool skinned_;
+};
+
+/// %Decal projection queued for a worker thread.
+struct DecalRequest
+{
+    /// Target drawable.
+    WeakPtr<Drawable> target_;
+    /// Target geometries to project against.
+    Vector<SharedPtr<DecalGeometryCache> > geometries_;
+    /// Bone mappings of the target geometries. Empty if the geometry uses skeleton bone indices directly.
+    Vector<PODVector<unsigned> > boneMappings_;
+    /// %Decal frustum in target model space.
+    Frustum frustum_;
+    /// %Decal frustum transform in target model space.
+    Matrix3x4 frustumTransform_;
+    /// Transform from target model space to decal set local space.
+    Matrix3x4 vertexTransform_;
+    /// %Decal projection.
+    Matrix4 projection_;
+    /// %Decal normal in target model space.
+    Vector3 decalNormal_;
+    /// Top left texture coordinate.
+    Vector2 topLeftUV_;
+    /// Bottom right texture coordinate.
+    Vector2 bottomRightUV_;
+    /// Minimum dot product of face and decal normals.
+    float normalCutoff_;
+    /// Vertex limit.
+    unsigned maxVertices_;
+    /// Index limit.
+    unsigned maxIndices_;
+    /// Skinned target flag.
+    bool skinned_;
+    /// Resulting decal.
+    Decal decal_;
+    /// Work item.
+    SharedPtr<WorkItem> item_;
 };
 
 /// %Decal renderer component.
@@ -137,6 +232,10 @@ public:
     bool AddDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio,
         float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f, float normalCutoff = 0.1f,
         unsigned subGeometry = M_MAX_UNSIGNED);
+    /// Queue a decal to be projected in a worker thread and added on the next scene post-update, in the order queued. Parameters are as in AddDecal(). Return true if queued.
+    bool QueueDecal(Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation, float size, float aspectRatio,
+        float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive = 0.0f, float normalCutoff = 0.1f,
+        unsigned subGeometry = M_MAX_UNSIGNED);
     /// Remove n oldest decals.
     void RemoveDecals(unsigned num);
     /// Remove all decals.
@@ -148,6 +247,9 @@ public:
     /// Return number of decals.
     unsigned GetNumDecals() const { return decals_.Size(); }
 
+    /// Return number of queued decals not yet added.
+    unsigned GetNumQueuedDecals() const { return requests_.Size(); }
+
     /// Retur number of vertices in the decals.
     unsigned GetNumVertices() const { return numVertices_; }
 
@@ -176,26 +278,27 @@ protected:
     virtual void OnMarkedDirty(Node* node);
 
 private:
-    /// Get triangle faces from the target geometry.
-    void GetFaces(Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, const Frustum& frustum,
-        const Vector3& decalNormal, float normalCutoff);
-    /// Get triangle face from the target geometry.
-    void GetFace
-        (Vector<PODVector<DecalVertex> >& faces, Drawable* target, unsigned batchIndex, unsigned i0, unsigned i1, unsigned i2,
-            const unsigned char* positionData, const unsigned char* normalData, const unsigned char* skinningData,
-            unsigned positionStride, unsigned normalStride, unsigned skinningStride, const Frustum& frustum,
-            const Vector3& decalNormal, float normalCutoff);
-    /// Get bones referenced by skinning data and remap the skinning indices. Return true if successful.
-    bool GetBones(Drawable* target, unsigned batchIndex, const float* blendWeights, const unsigned char* blendIndices,
-        unsigned char* newBlendIndices);
-    /// Calculate UV coordinates for the decal.
-    void CalculateUVs
-        (Decal& decal, const Matrix3x4& view, const Matrix4& projection, const Vector2& topLeftUV, const Vector2& bottomRightUV);
-    /// Transform decal's vertices from the target geometry to the decal set local space.
-    void TransformVertices(Decal& decal, const Matrix3x4& transform);
+    /// Prepare a decal projection against the target's cached geometries. Return true if successful.
+    bool PrepareDecal(DecalRequest& request, Drawable* target, const Vector3& worldPosition, const Quaternion& worldRotation,
+        float size, float aspectRatio, float depth, const Vector2& topLeftUV, const Vector2& bottomRightUV, float timeToLive,
+        float normalCutoff, unsigned subGeometry);
+    /// Add the decal of a finished projection. Return true if successful.
+    bool CommitDecal(DecalRequest& request);
+    /// Return the cached triangle hierarchy of a target geometry, building it if necessary.
+    DecalGeometryCache* GetGeometryCache(Geometry* geometry);
+    /// Get bones referenced by skeleton bone indices and remap them to the decal bones. Return true if successful.
+    bool GetBones(AnimatedModel* model, const float* blendWeights, unsigned char* blendIndices);
+    /// Place a decal at the head of the vertex and index buffer ring, removing the oldest decals in the way.
+    void PlaceDecal(Decal& decal);
+    /// Write a decal's vertices and indices to the buffer shadow data.
+    void WriteDecal(const Decal& decal);
+    /// Add to the dirty buffer ranges.
+    void MarkBufferRange(unsigned vertexStart, unsigned vertexCount, unsigned indexStart, unsigned indexCount);
+    /// Cancel the queued decal projections, waiting for those already executing.
+    void CancelRequests();
     /// Remove a decal by iterator and return iterator to the next decal.
     List<Decal>::Iterator RemoveDecal(List<Decal>::Iterator i);
-    /// Mark decals and the bounding box dirty.
+    /// Mark the bounding box dirty.
     void MarkDecalsDirty();
     /// Recalculate the local-space bounding box.
     void CalculateBoundingBox();
@@ -203,6 +306,8 @@ private:
     void UpdateBufferSize();
     /// Rewrite decal vertex and index buffers.
     void UpdateBuffers();
+    /// Upload the dirty ranges of the decal vertex and index buffers.
+    void UpdateBufferRanges();
     /// Recalculate skinning.
     void UpdateSkinning();
     /// Update the batch (geometry type, shader data.)
@@ -222,6 +327,10 @@ private:
     SharedPtr<IndexBuffer> indexBuffer_;
     /// Decals.
     List<Decal> decals_;
+    /// Queued decal projections.
+    List<DecalRequest> requests_;
+    /// Cached target geometry triangle hierarchies.
+    HashMap<Geometry*, SharedPtr<DecalGeometryCache> > geometryCaches_;
     /// Bones used for skinned decals.
     Vector<Bone> bones_;
     /// Skinning matrices.
@@ -234,12 +343,26 @@ private:
     unsigned maxVertices_;
     /// Maximum indices.
     unsigned maxIndices_;
+    /// Next vertex to write in the ring.
+    unsigned vertexHead_;
+    /// Next index to write in the ring.
+    unsigned indexHead_;
+    /// First dirty vertex.
+    unsigned dirtyVertexStart_;
+    /// End of dirty vertices.
+    unsigned dirtyVertexEnd_;
+    /// First dirty index.
+    unsigned dirtyIndexStart_;
+    /// End of dirty indices.
+    unsigned dirtyIndexEnd_;
     /// Skinned mode flag.
     bool skinned_;
     /// Vertex buffer needs resize flag.
     bool bufferSizeDirty_;
     /// Vertex buffer needs rewrite flag.
     bool bufferDirty_;
+    /// Vertex buffer has dirty ranges flag.
+    bool bufferRangeDirty_;
     /// Bounding box needs update flag.
     bool boundingBoxDirty_;
     /// Skinning dirty flag.
@@ -109,6 +109,7 @@ VertexBuffer::VertexBuffer(Context* context) :
     lockStart_(0),
     lockCount_(0),
     lockScratchData_(0),
+    dataVersion_(0),
     dynamic_(false),
     shadowed_(false)
 {
@@ -176,6 +177,8 @@ bool VertexBuffer::SetSize(unsigned vertexCount, unsigned elementMask, bool dyna
     else
         shadowData_.Reset();
 
+    ++dataVersion_;
+
     return Create();
 }
 
@@ -196,6 +199,8 @@ bool VertexBuffer::SetData(const void* data)
     if (shadowData_ && data != shadowData_.Get())
         memcpy(shadowData_.Get(), data, vertexCount_ * vertexSize_);
 
+    ++dataVersion_;
+
     if (object_)
     {
         if (dynamic_)
@@ -255,6 +260,8 @@ bool VertexBuffer::SetDataRange(const void* data, unsigned start, unsigned count
     if (shadowData_ && shadowData_.Get() + start * vertexSize_ != data)
         memcpy(shadowData_.Get() + start * vertexSize_, data, count * vertexSize_);
 
+    ++dataVersion_;
+
     if (object_)
     {
         if (dynamic_)
@@ -86,6 +86,9 @@ public:
     /// Return shared array pointer to the CPU memory shadow data.
     SharedArrayPtr<unsigned char> GetShadowDataShared() const { return shadowData_; }
 
+    /// Return data version, which changes whenever the buffer is resized or its data is set.
+    unsigned GetDataVersion() const { return dataVersion_; }
+
     /// Return vertex size corresponding to a vertex element mask.
     static unsigned GetVertexSize(unsigned elementMask);
     /// Return element offset from an element mask.
@@ -130,6 +133,8 @@ private:
     unsigned lockCount_;
     /// Scratch buffer for fallback locking.
     void* lockScratchData_;
+    /// Data version.
+    unsigned dataVersion_;
     /// Dynamic flag.
     bool dynamic_;
     /// Shadowed flag.
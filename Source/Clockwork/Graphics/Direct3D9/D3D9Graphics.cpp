@@ -35,6 +35,7 @@
 #include "../../Graphics/Graphics.h"
 #include "../../Graphics/GraphicsEvents.h"
 #include "../../Graphics/GraphicsImpl.h"
+#include "../../Graphics/Impostor.h"
 #include "../../Graphics/IndexBuffer.h"
 #include "../../Graphics/Material.h"
 #include "../../Graphics/Octree.h"
@@ -44,6 +45,7 @@
 #include "../../Graphics/ShaderPrecache.h"
 #include "../../Graphics/ShaderProgram.h"
 #include "../../Graphics/Skybox.h"
+#include "../../Graphics/StaticModelCluster.h"
 #include "../../Graphics/StaticModelGroup.h"
 #include "../../Graphics/Technique.h"
 #include "../../Graphics/Terrain.h"
@@ -2734,11 +2736,13 @@ void RegisterGraphicsLibrary(Context* context)
     Light::RegisterObject(context);
     StaticModel::RegisterObject(context);
     StaticModelGroup::RegisterObject(context);
+    StaticModelCluster::RegisterObject(context);
     Skybox::RegisterObject(context);
     AnimatedModel::RegisterObject(context);
     AnimationController::RegisterObject(context);
     BillboardSet::RegisterObject(context);
     ParticleEffect::RegisterObject(context);
+    Impostor::RegisterObject(context);
     ParticleEmitter::RegisterObject(context);
     CustomGeometry::RegisterObject(context);
     DecalSet::RegisterObject(context);
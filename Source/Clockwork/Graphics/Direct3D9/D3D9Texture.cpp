@@ -241,6 +241,13 @@ unsigned Texture::GetComponents() const
         return GetRowDataSize(width_) / width_;
 }
 
+bool Texture::GetLoadSRGB(const XMLElement& element) const
+{
+    // Only the flag is read here, as this is called from the background loading thread
+    XMLElement srgbElem = element.GetChild("srgb");
+    return sRGB_ || (srgbElem && srgbElem.GetBool("enable"));
+}
+
 void Texture::SetParameters(XMLFile* file)
 {
     if (!file)
@@ -126,6 +126,8 @@ public:
 protected:
     /// Check whether texture memory budget has been exceeded. Free unused materials in that case to release the texture references.
     void CheckTextureBudget(StringHash type);
+    /// Return whether images loaded for the texture hold sRGB data, either by the current setting or by an sRGB element in the parameters. Their mip levels are then filtered in linear space.
+    bool GetLoadSRGB(const XMLElement& element) const;
 
     /// Texture format.
     unsigned format_;
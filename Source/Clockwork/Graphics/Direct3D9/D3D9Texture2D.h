@@ -29,8 +29,10 @@
 namespace Clockwork
 {
 
+class File;
 class Image;
 class XMLFile;
+struct WorkItem;
 
 /// 2D texture resource.
 class CLOCKWORK_API Texture2D : public Texture
@@ -65,6 +67,19 @@ public:
 
     /// Get data from a mip level. The destination buffer must be big enough. Return true if successful.
     bool GetData(unsigned level, void* dest) const;
+    /// Stream in the next mip level if it fits the byte budget. Called from the main thread by ResourceCache. Return bytes uploaded or reserved.
+    virtual unsigned StreamDetail(unsigned budget);
+    /// Set the most detailed mip level allowed to be resident when streaming.
+    virtual void SetMaxResidentMip(unsigned mip);
+
+    /// Return whether mip levels remain to be streamed in or out.
+    virtual bool IsStreaming() const { return streaming_; }
+
+    /// Return the most detailed mip level allowed to be resident when streaming.
+    unsigned GetMaxResidentMip() const { return maxResidentMip_; }
+
+    /// Return number of largest mip levels currently not resident due to streaming.
+    unsigned GetStreamSkipLevels() const { return streamSkipLevels_; }
 
     /// Return render surface.
     RenderSurface* GetRenderSurface() const { return renderSurface_; }
@@ -74,6 +89,10 @@ private:
     bool Create();
     /// Handle render surface update event.
     void HandleRenderSurfaceUpdate(StringHash eventType, VariantMap& eventData);
+    /// Return number of largest mip levels to leave out once streaming is finished.
+    unsigned GetStreamTargetLevels() const;
+    /// Cancel streaming and wait for a pending streaming step to finish.
+    void CancelStreaming();
 
     /// Render surface.
     SharedPtr<RenderSurface> renderSurface_;
@@ -81,6 +100,20 @@ private:
     SharedPtr<Image> loadImage_;
     /// Parameter file acquired during BeginLoad.
     SharedPtr<XMLFile> loadParameters_;
+    /// Image being loaded for the next streaming step.
+    SharedPtr<Image> streamImage_;
+    /// Source file for the next streaming step.
+    SharedPtr<File> streamFile_;
+    /// Work item loading the next streaming step.
+    SharedPtr<WorkItem> streamItem_;
+    /// Number of largest mip levels not resident due to streaming.
+    unsigned streamSkipLevels_;
+    /// Most detailed mip level allowed to be resident.
+    unsigned maxResidentMip_;
+    /// Loaded with texture streaming flag.
+    bool streamed_;
+    /// Streaming in progress flag.
+    bool streaming_;
 };
 
 }
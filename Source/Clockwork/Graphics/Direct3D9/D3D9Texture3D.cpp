@@ -97,9 +97,13 @@ bool Texture3D::BeginLoad(Deserializer& source)
             name = texPath + name;
 
         loadImage_ = cache->GetTempResource<Image>(name);
-        // Precalculate mip levels if async loading
-        if (loadImage_ && GetAsyncLoadState() == ASYNC_LOADING)
-            loadImage_->PrecalculateLevels();
+        if (loadImage_)
+        {
+            // Filter the mip levels of sRGB data in linear space. Precalculate them if async loading
+            loadImage_->SetSRGB(loadImage_->IsSRGB() || GetLoadSRGB(textureElem));
+            if (GetAsyncLoadState() == ASYNC_LOADING)
+                loadImage_->PrecalculateLevels();
+        }
         cache->StoreResourceDependency(this, name);
         return true;
     }
@@ -121,9 +125,13 @@ bool Texture3D::BeginLoad(Deserializer& source)
             loadImage_.Reset();
             return false;
         }
-        // Precalculate mip levels if async loading
-        if (loadImage_ && GetAsyncLoadState() == ASYNC_LOADING)
-            loadImage_->PrecalculateLevels();
+        if (loadImage_)
+        {
+            // Filter the mip levels of sRGB data in linear space. Precalculate them if async loading
+            loadImage_->SetSRGB(loadImage_->IsSRGB() || GetLoadSRGB(textureElem));
+            if (GetAsyncLoadState() == ASYNC_LOADING)
+                loadImage_->PrecalculateLevels();
+        }
         cache->StoreResourceDependency(this, name);
         return true;
     }
@@ -195,6 +195,9 @@ void Drawable::SetLodBias(float bias)
 void Drawable::SetViewMask(unsigned mask)
 {
     viewMask_ = mask;
+    // The view mask affects octree query results, so record as a change
+    if (octant_)
+        octant_->GetRoot()->MarkDrawableChanged(this);
     MarkNetworkUpdate();
 }
 
@@ -397,7 +400,10 @@ void Drawable::AddToOctree()
     {
         Octree* octree = scene->GetComponent<Octree>();
         if (octree)
+        {
             octree->InsertDrawable(this);
+            octree->MarkDrawableChanged(this);
+        }
         else
             LOGERROR("No Octree component in scene, drawable will not render");
     }
@@ -419,6 +425,7 @@ void Drawable::RemoveFromOctree()
         // Perform subclass specific deinitialization if necessary
         OnRemoveFromOctree();
 
+        octree->MarkDrawableChanged(this, true);
         octant_->RemoveDrawable(this);
     }
 }
@@ -47,4 +47,18 @@ EVENT(E_TERRAINCREATED, TerrainCreated)
     PARAM(P_NODE, Node);                    // Node pointer
 }
 
+/// Streamed terrain tile loaded and its patches created.
+EVENT(E_TERRAINTILELOADED, TerrainTileLoaded)
+{
+    PARAM(P_NODE, Node);                    // Node pointer
+    PARAM(P_TILE, Tile);                    // IntVector2
+}
+
+/// Streamed terrain tile unloaded and its patches removed.
+EVENT(E_TERRAINTILEUNLOADED, TerrainTileUnloaded)
+{
+    PARAM(P_NODE, Node);                    // Node pointer
+    PARAM(P_TILE, Tile);                    // IntVector2
+}
+
 }
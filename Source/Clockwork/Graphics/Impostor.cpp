@@ -0,0 +1,309 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Core/Context.h"
+#include "../Graphics/Geometry.h"
+#include "../Graphics/Impostor.h"
+#include "../Graphics/IndexBuffer.h"
+#include "../Graphics/Material.h"
+#include "../Graphics/VertexBuffer.h"
+#include "../IO/Log.h"
+#include "../Resource/ResourceCache.h"
+#include "../Resource/XMLFile.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const unsigned IMPOSTOR_VERTEX_MASK = MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT;
+
+static inline float SignNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+Impostor::Impostor(Context* context) :
+    Resource(context),
+    numFrames_(DEFAULT_IMPOSTOR_FRAMES),
+    center_(Vector3::ZERO),
+    size_(1.0f)
+{
+}
+
+Impostor::~Impostor()
+{
+}
+
+void Impostor::RegisterObject(Context* context)
+{
+    context->RegisterFactory<Impostor>();
+}
+
+bool Impostor::BeginLoad(Deserializer& source)
+{
+    loadMaterialName_.Clear();
+
+    XMLFile file(context_);
+    if (!file.Load(source))
+    {
+        LOGERROR("Load impostor file failed");
+        return false;
+    }
+
+    XMLElement rootElem = file.GetRoot("impostor");
+    if (!rootElem)
+    {
+        LOGERROR("Impostor file does not have impostor root element");
+        return false;
+    }
+
+    material_.Reset();
+    numFrames_ = DEFAULT_IMPOSTOR_FRAMES;
+    center_ = Vector3::ZERO;
+    size_ = 1.0f;
+
+    if (rootElem.HasChild("material"))
+    {
+        loadMaterialName_ = rootElem.GetChild("material").GetAttribute("name");
+        // If async loading, can not GetResource() the material. But can do a background request for it
+        if (GetAsyncLoadState() == ASYNC_LOADING)
+            GetSubsystem<ResourceCache>()->BackgroundLoadResource<Material>(loadMaterialName_, true, this);
+    }
+
+    if (rootElem.HasChild("frames"))
+        numFrames_ = (unsigned)Clamp(rootElem.GetChild("frames").GetInt("value"), 1, (int)MAX_IMPOSTOR_FRAMES);
+    if (rootElem.HasChild("center"))
+        center_ = rootElem.GetChild("center").GetVector3("value");
+    if (rootElem.HasChild("size"))
+        size_ = Max(rootElem.GetChild("size").GetFloat("value"), M_EPSILON);
+
+    return true;
+}
+
+bool Impostor::EndLoad()
+{
+    // Apply the material now, and create the frame quads in the main thread
+    if (!loadMaterialName_.Empty())
+    {
+        SetMaterial(GetSubsystem<ResourceCache>()->GetResource<Material>(loadMaterialName_));
+        loadMaterialName_.Clear();
+    }
+
+    UpdateGeometries();
+    return true;
+}
+
+bool Impostor::Save(Serializer& dest) const
+{
+    SharedPtr<XMLFile> xml(new XMLFile(context_));
+    XMLElement rootElem = xml->CreateRoot("impostor");
+
+    if (material_)
+        rootElem.CreateChild("material").SetAttribute("name", material_->GetName());
+    rootElem.CreateChild("frames").SetUInt("value", numFrames_);
+    rootElem.CreateChild("center").SetVector3("value", center_);
+    rootElem.CreateChild("size").SetFloat("value", size_);
+
+    return xml->Save(dest);
+}
+
+void Impostor::SetMaterial(Material* material)
+{
+    material_ = material;
+}
+
+void Impostor::SetNumFrames(unsigned num)
+{
+    num = (unsigned)Clamp((int)num, 1, (int)MAX_IMPOSTOR_FRAMES);
+    if (num != numFrames_)
+    {
+        numFrames_ = num;
+        UpdateGeometries();
+    }
+}
+
+void Impostor::SetCenter(const Vector3& center)
+{
+    if (center != center_)
+    {
+        center_ = center;
+        UpdateGeometries();
+    }
+}
+
+void Impostor::SetSize(float size)
+{
+    size = Max(size, M_EPSILON);
+    if (size != size_)
+    {
+        size_ = size;
+        UpdateGeometries();
+    }
+}
+
+Geometry* Impostor::GetFrameGeometry(const Vector3& direction) const
+{
+    unsigned index = GetFrameIndex(direction, numFrames_);
+    return index < geometries_.Size() ? geometries_[index].Get() : (Geometry*)0;
+}
+
+unsigned Impostor::GetFrameIndex(const Vector3& direction, unsigned numFrames)
+{
+    if (!numFrames)
+        return 0;
+
+    // Project the direction onto the octahedron, and unfold its lower half to the corners
+    float length = Abs(direction.x_) + Abs(direction.y_) + Abs(direction.z_);
+    if (length < M_EPSILON)
+        return 0;
+    float u = direction.x_ / length;
+    float v = direction.z_ / length;
+    if (direction.y_ < 0.0f)
+    {
+        float lowerU = (1.0f - Abs(v)) * SignNotZero(u);
+        float lowerV = (1.0f - Abs(u)) * SignNotZero(v);
+        u = lowerU;
+        v = lowerV;
+    }
+
+    int x = Clamp((int)((u * 0.5f + 0.5f) * numFrames), 0, (int)numFrames - 1);
+    int y = Clamp((int)((v * 0.5f + 0.5f) * numFrames), 0, (int)numFrames - 1);
+    return (unsigned)(y * numFrames + x);
+}
+
+Vector3 Impostor::GetFrameDirection(unsigned index, unsigned numFrames)
+{
+    if (!numFrames)
+        return Vector3::UP;
+
+    float u = ((index % numFrames) + 0.5f) / numFrames * 2.0f - 1.0f;
+    float v = ((index / numFrames) + 0.5f) / numFrames * 2.0f - 1.0f;
+    Vector3 direction(u, 1.0f - Abs(u) - Abs(v), v);
+    if (direction.y_ < 0.0f)
+    {
+        direction.x_ = (1.0f - Abs(v)) * SignNotZero(u);
+        direction.z_ = (1.0f - Abs(u)) * SignNotZero(v);
+    }
+
+    return direction.Normalized();
+}
+
+void Impostor::GetFrameAxes(const Vector3& direction, Vector3& right, Vector3& up)
+{
+    Vector3 forward = -direction.Normalized();
+    Vector3 upReference = Abs(forward.y_) > 0.999f ? Vector3::FORWARD : Vector3::UP;
+    right = upReference.CrossProduct(forward).Normalized();
+    up = forward.CrossProduct(right);
+}
+
+void Impostor::UpdateGeometries()
+{
+    unsigned numQuads = numFrames_ * numFrames_;
+
+    if (!vertexBuffer_)
+    {
+        vertexBuffer_ = new VertexBuffer(context_);
+        indexBuffer_ = new IndexBuffer(context_);
+        // Shadow the data so that the quads are restored after the graphics context is lost
+        vertexBuffer_->SetShadowed(true);
+        indexBuffer_->SetShadowed(true);
+    }
+
+    vertexBuffer_->SetSize(numQuads * 4, IMPOSTOR_VERTEX_MASK);
+    indexBuffer_->SetSize(numQuads * 6, false);
+
+    PODVector<float> vertexData(numQuads * 4 * vertexBuffer_->GetVertexSize() / sizeof(float));
+    PODVector<unsigned short> indexData(numQuads * 6);
+    float* dest = &vertexData[0];
+    unsigned short* indexDest = &indexData[0];
+    float frameSize = 1.0f / numFrames_;
+
+    geometries_.Resize(numQuads);
+
+    for (unsigned i = 0; i < numQuads; ++i)
+    {
+        Vector3 direction = GetFrameDirection(i, numFrames_);
+        Vector3 right, up;
+        GetFrameAxes(direction, right, up);
+        right *= size_;
+        up *= size_;
+
+        // Corners clockwise from top left, with the frame's atlas cell as the texture coordinates
+        Vector3 positions[4] =
+        {
+            center_ - right + up,
+            center_ + right + up,
+            center_ + right - up,
+            center_ - right - up
+        };
+        float left = (i % numFrames_) * frameSize;
+        float top = (i / numFrames_) * frameSize;
+        Vector2 texCoords[4] =
+        {
+            Vector2(left, top),
+            Vector2(left + frameSize, top),
+            Vector2(left + frameSize, top + frameSize),
+            Vector2(left, top + frameSize)
+        };
+        Vector3 tangent = right.Normalized();
+
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            *dest++ = positions[j].x_;
+            *dest++ = positions[j].y_;
+            *dest++ = positions[j].z_;
+            *dest++ = direction.x_;
+            *dest++ = direction.y_;
+            *dest++ = direction.z_;
+            *dest++ = texCoords[j].x_;
+            *dest++ = texCoords[j].y_;
+            *dest++ = tangent.x_;
+            *dest++ = tangent.y_;
+            *dest++ = tangent.z_;
+            *dest++ = 1.0f;
+        }
+
+        unsigned short vertexStart = (unsigned short)(i * 4);
+        *indexDest++ = vertexStart;
+        *indexDest++ = vertexStart + 1;
+        *indexDest++ = vertexStart + 2;
+        *indexDest++ = vertexStart;
+        *indexDest++ = vertexStart + 2;
+        *indexDest++ = vertexStart + 3;
+
+        if (!geometries_[i])
+            geometries_[i] = new Geometry(context_);
+        Geometry* geometry = geometries_[i];
+        geometry->SetVertexBuffer(0, vertexBuffer_, IMPOSTOR_VERTEX_MASK);
+        geometry->SetIndexBuffer(indexBuffer_);
+        geometry->SetDrawRange(TRIANGLE_LIST, i * 6, 6, i * 4, 4);
+    }
+
+    vertexBuffer_->SetData(&vertexData[0]);
+    indexBuffer_->SetData(&indexData[0]);
+}
+
+}
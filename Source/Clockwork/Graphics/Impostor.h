@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Math/Vector3.h"
+#include "../Resource/Resource.h"
+
+namespace Clockwork
+{
+
+static const unsigned DEFAULT_IMPOSTOR_FRAMES = 8;
+static const unsigned MAX_IMPOSTOR_FRAMES = 64;
+
+class Geometry;
+class IndexBuffer;
+class Material;
+class VertexBuffer;
+
+/// %Impostor definition. Holds a model's views captured from the octahedrally mapped directions of a square atlas, and a camera-facing quad for each view to draw it with instead of the model.
+class CLOCKWORK_API Impostor : public Resource
+{
+    OBJECT(Impostor);
+
+public:
+    /// Construct.
+    Impostor(Context* context);
+    /// Destruct.
+    virtual ~Impostor();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Load resource from stream. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoad(Deserializer& source);
+    /// Finish resource loading. Always called from the main thread. Return true if successful.
+    virtual bool EndLoad();
+    /// Save resource. Return true if successful.
+    virtual bool Save(Serializer& dest) const;
+
+    /// Set material. Should use the captured atlas and an alpha masked technique.
+    void SetMaterial(Material* material);
+    /// Set number of frames on each atlas axis.
+    void SetNumFrames(unsigned num);
+    /// Set model space center of the captured views.
+    void SetCenter(const Vector3& center);
+    /// Set model space half size of the captured views.
+    void SetSize(float size);
+
+    /// Return material.
+    Material* GetMaterial() const { return material_; }
+
+    /// Return number of frames on each atlas axis.
+    unsigned GetNumFrames() const { return numFrames_; }
+
+    /// Return model space center of the captured views.
+    const Vector3& GetCenter() const { return center_; }
+
+    /// Return model space half size of the captured views.
+    float GetSize() const { return size_; }
+
+    /// Return the quad geometry of the frame closest to a model space direction from the center towards the viewer.
+    Geometry* GetFrameGeometry(const Vector3& direction) const;
+
+    /// Return the frame index closest to a view direction.
+    static unsigned GetFrameIndex(const Vector3& direction, unsigned numFrames);
+    /// Return the view direction of a frame.
+    static Vector3 GetFrameDirection(unsigned index, unsigned numFrames);
+    /// Return the right and up axes of the view from a direction.
+    static void GetFrameAxes(const Vector3& direction, Vector3& right, Vector3& up);
+
+private:
+    /// Rebuild the frame quads.
+    void UpdateGeometries();
+
+    /// Material.
+    SharedPtr<Material> material_;
+    /// Vertex buffer of the frame quads.
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    /// Index buffer of the frame quads.
+    SharedPtr<IndexBuffer> indexBuffer_;
+    /// Frame quad geometries.
+    Vector<SharedPtr<Geometry> > geometries_;
+    /// Number of frames on each atlas axis.
+    unsigned numFrames_;
+    /// Model space center.
+    Vector3 center_;
+    /// Model space half size.
+    float size_;
+    /// Material name acquired during BeginLoad().
+    String loadMaterialName_;
+};
+
+}
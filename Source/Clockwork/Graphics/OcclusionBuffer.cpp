@@ -22,10 +22,16 @@
 
 #include "../Precompiled.h"
 
+#include "../Core/Profiler.h"
+#include "../Core/WorkQueue.h"
 #include "../Graphics/Camera.h"
 #include "../Graphics/OcclusionBuffer.h"
 #include "../IO/Log.h"
 
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 namespace Clockwork
@@ -38,6 +44,17 @@ static const unsigned CLIPMASK_Y_NEG = 0x8;
 static const unsigned CLIPMASK_Z_POS = 0x10;
 static const unsigned CLIPMASK_Z_NEG = 0x20;
 
+void RasterizeOcclusionTilesWork(const WorkItem* item, unsigned threadIndex)
+{
+    OcclusionBuffer* buffer = reinterpret_cast<OcclusionBuffer*>(item->aux_);
+    PODVector<unsigned>* start = reinterpret_cast<PODVector<unsigned>*>(item->start_);
+    PODVector<unsigned>* end = reinterpret_cast<PODVector<unsigned>*>(item->end_);
+    PODVector<unsigned>* first = &buffer->tileTriangles_[0];
+
+    while (start != end)
+        buffer->RasterizeTile((unsigned)(start++ - first));
+}
+
 OcclusionBuffer::OcclusionBuffer(Context* context) :
     Object(context),
     buffer_(0),
@@ -49,7 +66,9 @@ OcclusionBuffer::OcclusionBuffer(Context* context) :
     depthHierarchyDirty_(true),
     reverseCulling_(false),
     nearClip_(0.0f),
-    farClip_(0.0f)
+    farClip_(0.0f),
+    numTilesX_(0),
+    numTilesY_(0)
 {
 }
 
@@ -83,6 +102,14 @@ bool OcclusionBuffer::SetSize(int width, int height)
     buffer_ = fullBuffer_.Get() + width + 1;
     mipBuffers_.Clear();
 
+    // Allocate the rasterization tiles
+    numTilesX_ = (width_ + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    numTilesY_ = (height_ + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    tileTriangles_.Clear();
+    tileTriangles_.Resize((unsigned)(numTilesX_ * numTilesY_));
+    tileMaxDepths_.Resize((unsigned)(numTilesX_ * numTilesY_));
+    triangles_.Clear();
+
     // Build buffers for mip levels
     for (;;)
     {
@@ -144,6 +171,7 @@ void OcclusionBuffer::Clear()
         return;
 
     Reset();
+    triangles_.Clear();
 
     int* dest = buffer_;
     int count = width_ * height_;
@@ -152,6 +180,9 @@ void OcclusionBuffer::Clear()
     while (count--)
         *dest++ = fillValue;
 
+    for (PODVector<int>::Iterator i = tileMaxDepths_.Begin(); i != tileMaxDepths_.End(); ++i)
+        *i = fillValue;
+
     depthHierarchyDirty_ = true;
 }
 
@@ -185,6 +216,9 @@ bool OcclusionBuffer::Draw(const Matrix3x4& model, const void* vertexData, unsig
         index += 3;
     }
 
+    if (triangles_.Size() >= OCCLUSION_BATCH_TRIANGLES)
+        DrawTriangles();
+
     return true;
 }
 
@@ -245,14 +279,82 @@ bool OcclusionBuffer::Draw(const Matrix3x4& model, const void* vertexData, unsig
         }
     }
 
+    // Rasterize in batches so that the occluders drawn later can be tested against the ones already drawn
+    if (triangles_.Size() >= OCCLUSION_BATCH_TRIANGLES)
+        DrawTriangles();
+
     return true;
 }
 
+void OcclusionBuffer::DrawTriangles()
+{
+    if (triangles_.Empty())
+        return;
+
+    PROFILE(RasterizeOcclusion);
+
+    // Bin the triangles to the tiles they overlap
+    for (Vector<PODVector<unsigned> >::Iterator i = tileTriangles_.Begin(); i != tileTriangles_.End(); ++i)
+        i->Clear();
+
+    for (unsigned i = 0; i < triangles_.Size(); ++i)
+    {
+        const OcclusionTriangle& triangle = triangles_[i];
+        int tileLeft = triangle.left_ / OCCLUSION_TILE_WIDTH;
+        int tileTop = triangle.top_ / OCCLUSION_TILE_HEIGHT;
+        int tileRight = triangle.right_ / OCCLUSION_TILE_WIDTH;
+        int tileBottom = triangle.bottom_ / OCCLUSION_TILE_HEIGHT;
+
+        for (int y = tileTop; y <= tileBottom; ++y)
+        {
+            for (int x = tileLeft; x <= tileRight; ++x)
+                tileTriangles_[y * numTilesX_ + x].Push(i);
+        }
+    }
+
+    // Tiles do not share pixels, so they can be rasterized in worker threads without synchronization. Use several work items
+    // per thread, as the triangles are usually unevenly distributed
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numTiles = tileTriangles_.Size();
+    if (queue && queue->GetNumThreads() && numTiles > 1)
+    {
+        unsigned numWorkItems = (unsigned)Min((int)(queue->GetNumThreads() + 1) * 4, (int)numTiles);
+        unsigned tilesPerItem = numTiles / numWorkItems;
+        PODVector<unsigned>* start = &tileTriangles_[0];
+        PODVector<unsigned>* end = start + numTiles;
+
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = RasterizeOcclusionTilesWork;
+            item->aux_ = this;
+            item->start_ = start;
+            item->end_ = i < numWorkItems - 1 ? start + tilesPerItem : end;
+            queue->AddWorkItem(item);
+
+            start += tilesPerItem;
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+    }
+    else
+    {
+        for (unsigned i = 0; i < numTiles; ++i)
+            RasterizeTile(i);
+    }
+
+    triangles_.Clear();
+    depthHierarchyDirty_ = true;
+}
+
 void OcclusionBuffer::BuildDepthHierarchy()
 {
     if (!buffer_)
         return;
 
+    DrawTriangles();
+
     // Build the first mip level from the pixel-level data
     int width = (width_ + 1) / 2;
     int height = (height_ + 1) / 2;
@@ -343,6 +445,111 @@ void OcclusionBuffer::BuildDepthHierarchy()
     depthHierarchyDirty_ = false;
 }
 
+void OcclusionBuffer::CopyFrom(const OcclusionBuffer& source)
+{
+    if (!source.buffer_ || !SetSize(source.width_, source.height_))
+        return;
+
+    view_ = source.view_;
+    projection_ = source.projection_;
+    viewProj_ = source.viewProj_;
+    nearClip_ = source.nearClip_;
+    farClip_ = source.farClip_;
+    reverseCulling_ = source.reverseCulling_;
+    CalculateViewport();
+
+    numTriangles_ = source.numTriangles_;
+    triangles_.Clear();
+    memcpy(buffer_, source.buffer_, width_ * height_ * sizeof(int));
+    tileMaxDepths_ = source.tileMaxDepths_;
+    depthHierarchyDirty_ = true;
+}
+
+void OcclusionBuffer::Reproject(const OcclusionBuffer& source)
+{
+    if (!buffer_ || !source.buffer_)
+        return;
+
+    PROFILE(ReprojectOcclusion);
+
+    // Rasterize own triangles first so that the merge sees them
+    DrawTriangles();
+
+    // Transform from the source's normalized device coordinates to this buffer's clip space
+    Matrix4 transform = viewProj_ * source.viewProj_.Inverse();
+    int farDepth = (int)OCCLUSION_Z_SCALE;
+
+    reprojectBuffer_.Resize((unsigned)(width_ * height_));
+    int* reprojected = &reprojectBuffer_[0];
+    for (int i = 0; i < width_ * height_; ++i)
+        reprojected[i] = -1;
+
+    // Splat each source pixel to the destination pixel it lands on, keeping the farthest sample. Empty source pixels are
+    // splatted from the far plane, so that they keep occluders from growing at their silhouettes
+    for (int y = 0; y < source.height_; ++y)
+    {
+        const int* src = source.buffer_ + y * source.width_;
+        float ndcY = ((float)y + 1.0f - source.offsetY_) / source.scaleY_;
+
+        for (int x = 0; x < source.width_; ++x)
+        {
+            // Use the farthest depth around the sample, as it lands between the destination pixel centers
+            int depth = src[x];
+            for (int dy = Max(y - 1, 0); dy <= Min(y + 1, source.height_ - 1); ++dy)
+            {
+                const int* neighbours = source.buffer_ + dy * source.width_;
+                for (int dx = Max(x - 1, 0); dx <= Min(x + 1, source.width_ - 1); ++dx)
+                    depth = Max(depth, neighbours[dx]);
+            }
+
+            float ndcX = ((float)x + 1.0f - source.offsetX_) / source.scaleX_;
+            float ndcZ = depth < farDepth ? (float)depth / OCCLUSION_Z_SCALE : 1.0f;
+
+            Vector4 clip = transform * Vector4(ndcX, ndcY, ndcZ, 1.0f);
+            if (clip.w_ <= M_EPSILON || clip.z_ < 0.0f)
+                continue;
+
+            Vector3 projected = ViewportTransform(clip);
+            // Pixel centers are at +1 offsets from the pixel coordinates
+            if (projected.x_ < 0.5f || projected.y_ < 0.5f || projected.x_ >= (float)width_ + 0.5f ||
+                projected.y_ >= (float)height_ + 0.5f)
+                continue;
+
+            int newDepth = depth < farDepth ? Min((int)(projected.z_ + 0.5f), farDepth) : farDepth;
+            int& dest = reprojected[(int)(projected.y_ - 0.5f) * width_ + (int)(projected.x_ - 0.5f)];
+            if (newDepth > dest)
+                dest = newDepth;
+        }
+    }
+
+    // Merge with the current depth. A hole is filled with the farthest of its neighbours if it is enclosed by reprojected
+    // samples on all four sides, otherwise it stays unoccluded
+    for (int y = 0; y < height_; ++y)
+    {
+        const int* row = reprojected + y * width_;
+        int* dest = buffer_ + y * width_;
+
+        for (int x = 0; x < width_; ++x)
+        {
+            int depth = row[x];
+            if (depth < 0)
+            {
+                if (x > 0 && x < width_ - 1 && y > 0 && y < height_ - 1 && row[x - 1] >= 0 && row[x + 1] >= 0 &&
+                    row[x - width_] >= 0 && row[x + width_] >= 0)
+                    depth = Max(Max(row[x - 1], row[x + 1]), Max(row[x - width_], row[x + width_]));
+                else
+                    continue;
+            }
+
+            if (depth < dest[x])
+                dest[x] = depth;
+        }
+    }
+
+    // The tile depth bounds are not lowered, which is conservative for any triangles drawn afterward
+    depthHierarchyDirty_ = true;
+}
+
 void OcclusionBuffer::ResetUseTimer()
 {
     useTimer_.Reset();
@@ -353,7 +560,60 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
     if (!buffer_)
         return true;
 
-    // Transform corners to projection space
+    // Transform corners to projection space, then to screen space. If any of the corners cross the near plane, assume visible
+    float minX, maxX, minY, maxY, minZ;
+
+#ifdef CLOCKWORK_SSE2
+    // Transform four corners at a time: first the corners on the minimum Z side of the box, then the maximum
+    __m128 boxX = _mm_setr_ps(worldSpaceBox.min_.x_, worldSpaceBox.max_.x_, worldSpaceBox.min_.x_, worldSpaceBox.max_.x_);
+    __m128 boxY = _mm_setr_ps(worldSpaceBox.min_.y_, worldSpaceBox.min_.y_, worldSpaceBox.max_.y_, worldSpaceBox.max_.y_);
+    __m128 minXs = _mm_set1_ps(M_INFINITY);
+    __m128 maxXs = _mm_set1_ps(-M_INFINITY);
+    __m128 minYs = minXs;
+    __m128 maxYs = maxXs;
+    __m128 minZs = minXs;
+
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        __m128 boxZ = _mm_set1_ps(i ? worldSpaceBox.max_.z_ : worldSpaceBox.min_.z_);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m00_), boxX), _mm_mul_ps(_mm_set1_ps(viewProj_.m01_),
+            boxY)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m02_), boxZ), _mm_set1_ps(viewProj_.m03_)));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m10_), boxX), _mm_mul_ps(_mm_set1_ps(viewProj_.m11_),
+            boxY)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m12_), boxZ), _mm_set1_ps(viewProj_.m13_)));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m20_), boxX), _mm_mul_ps(_mm_set1_ps(viewProj_.m21_),
+            boxY)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m22_), boxZ), _mm_set1_ps(viewProj_.m23_)));
+        __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m30_), boxX), _mm_mul_ps(_mm_set1_ps(viewProj_.m31_),
+            boxY)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(viewProj_.m32_), boxZ), _mm_set1_ps(viewProj_.m33_)));
+
+        // Apply a far clip relative bias
+        z = _mm_sub_ps(z, _mm_set1_ps(OCCLUSION_RELATIVE_BIAS));
+        if (_mm_movemask_ps(_mm_cmple_ps(z, _mm_setzero_ps())))
+            return true;
+
+        __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), w);
+        x = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(x, invW), _mm_set1_ps(scaleX_)), _mm_set1_ps(offsetX_));
+        y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, invW), _mm_set1_ps(scaleY_)), _mm_set1_ps(offsetY_));
+        z = _mm_mul_ps(_mm_mul_ps(z, invW), _mm_set1_ps(OCCLUSION_Z_SCALE));
+
+        minXs = _mm_min_ps(minXs, x);
+        maxXs = _mm_max_ps(maxXs, x);
+        minYs = _mm_min_ps(minYs, y);
+        maxYs = _mm_max_ps(maxYs, y);
+        minZs = _mm_min_ps(minZs, z);
+    }
+
+    // Reduce the four lanes
+    minXs = _mm_min_ps(minXs, _mm_shuffle_ps(minXs, minXs, _MM_SHUFFLE(1, 0, 3, 2)));
+    maxXs = _mm_max_ps(maxXs, _mm_shuffle_ps(maxXs, maxXs, _MM_SHUFFLE(1, 0, 3, 2)));
+    minYs = _mm_min_ps(minYs, _mm_shuffle_ps(minYs, minYs, _MM_SHUFFLE(1, 0, 3, 2)));
+    maxYs = _mm_max_ps(maxYs, _mm_shuffle_ps(maxYs, maxYs, _MM_SHUFFLE(1, 0, 3, 2)));
+    minZs = _mm_min_ps(minZs, _mm_shuffle_ps(minZs, minZs, _MM_SHUFFLE(1, 0, 3, 2)));
+    minX = _mm_cvtss_f32(_mm_min_ss(minXs, _mm_shuffle_ps(minXs, minXs, _MM_SHUFFLE(2, 3, 0, 1))));
+    maxX = _mm_cvtss_f32(_mm_max_ss(maxXs, _mm_shuffle_ps(maxXs, maxXs, _MM_SHUFFLE(2, 3, 0, 1))));
+    minY = _mm_cvtss_f32(_mm_min_ss(minYs, _mm_shuffle_ps(minYs, minYs, _MM_SHUFFLE(2, 3, 0, 1))));
+    maxY = _mm_cvtss_f32(_mm_max_ss(maxYs, _mm_shuffle_ps(maxYs, maxYs, _MM_SHUFFLE(2, 3, 0, 1))));
+    minZ = _mm_cvtss_f32(_mm_min_ss(minZs, _mm_shuffle_ps(minZs, minZs, _MM_SHUFFLE(2, 3, 0, 1))));
+#else
     Vector4 vertices[8];
     vertices[0] = ModelTransform(viewProj_, worldSpaceBox.min_);
     vertices[1] = ModelTransform(viewProj_, Vector3(worldSpaceBox.max_.x_, worldSpaceBox.min_.y_, worldSpaceBox.min_.z_));
@@ -368,9 +628,6 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
     for (unsigned i = 0; i < 8; ++i)
         vertices[i].z_ -= OCCLUSION_RELATIVE_BIAS;
 
-    // Transform to screen space. If any of the corners cross the near plane, assume visible
-    float minX, maxX, minY, maxY, minZ;
-
     if (vertices[0].z_ <= 0.0f)
         return true;
 
@@ -393,6 +650,7 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
         if (projected.y_ > maxY) maxY = projected.y_;
         if (projected.z_ < minZ) minZ = projected.z_;
     }
+#endif
 
     // Expand the bounding box 1 pixel in each direction to be conservative and correct rasterization offset
     IntRect rect(
@@ -418,6 +676,10 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
 
     // Convert depth to integer and apply final bias
     int z = (int)(minZ + 0.5f) - OCCLUSION_FIXED_BIAS;
+#ifdef CLOCKWORK_SSE2
+    // Depth is visible where z <= buffer value, ie. buffer value > z - 1
+    __m128i zMinusOne = _mm_set1_epi32(z - 1);
+#endif
 
     if (!depthHierarchyDirty_)
     {
@@ -438,6 +700,18 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
             {
                 DepthValue* src = row + left;
                 DepthValue* end = row + right;
+#ifdef CLOCKWORK_SSE2
+                // Test two depth ranges at a time; the even lanes hold the minimums and the odd lanes the maximums
+                while (src < end)
+                {
+                    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_loadu_si128((__m128i*)src), zMinusOne)));
+                    if (mask & 0x5)
+                        return true;
+                    if (mask & 0xa)
+                        allOccluded = false;
+                    src += 2;
+                }
+#endif
                 while (src <= end)
                 {
                     if (z <= src->min_)
@@ -461,6 +735,14 @@ bool OcclusionBuffer::IsVisible(const BoundingBox& worldSpaceBox) const
     {
         int* src = row + rect.left_;
         int* end = row + rect.right_;
+#ifdef CLOCKWORK_SSE2
+        while (src + 3 <= end)
+        {
+            if (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(_mm_loadu_si128((__m128i*)src), zMinusOne))))
+                return true;
+            src += 4;
+        }
+#endif
         while (src <= end)
         {
             if (z <= *src)
@@ -571,7 +853,7 @@ void OcclusionBuffer::DrawTriangle(Vector4* vertices)
         bool clockwise = SignedArea(projected[0], projected[1], projected[2]) < 0.0f;
         if (cullMode_ == CULL_NONE || (cullMode_ == CULL_CCW && clockwise) || (cullMode_ == CULL_CW && !clockwise))
         {
-            DrawTriangle2D(projected, clockwise);
+            AddTriangle2D(projected);
             drawOk = true;
         }
     }
@@ -609,7 +891,7 @@ void OcclusionBuffer::DrawTriangle(Vector4* vertices)
                 bool clockwise = SignedArea(projected[0], projected[1], projected[2]) < 0.0f;
                 if (cullMode_ == CULL_NONE || (cullMode_ == CULL_CCW && clockwise) || (cullMode_ == CULL_CW && !clockwise))
                 {
-                    DrawTriangle2D(projected, clockwise);
+                    AddTriangle2D(projected);
                     drawOk = true;
                 }
             }
@@ -690,232 +972,183 @@ void OcclusionBuffer::ClipVertices(const Vector4& plane, Vector4* vertices, bool
     }
 }
 
-// Code based on Chris Hecker's Perspective Texture Mapping series in the Game Developer magazine
-// Also available online at http://chrishecker.com/Miscellaneous_Technical_Articles
-
-/// %Gradients of a software rasterized triangle.
-struct Gradients
+void OcclusionBuffer::AddTriangle2D(const Vector3* vertices)
 {
-    /// Construct from vertices.
-    Gradients(const Vector3* vertices)
-    {
-        float invdX = 1.0f / (((vertices[1].x_ - vertices[2].x_) *
-                               (vertices[0].y_ - vertices[2].y_)) -
-                              ((vertices[0].x_ - vertices[2].x_) *
-                               (vertices[1].y_ - vertices[2].y_)));
-
-        float invdY = -invdX;
-
-        dInvZdX_ = invdX * (((vertices[1].z_ - vertices[2].z_) * (vertices[0].y_ - vertices[2].y_)) -
-                            ((vertices[0].z_ - vertices[2].z_) * (vertices[1].y_ - vertices[2].y_)));
+    // The viewport transform places pixel centers at +1 offsets; move them to integer coordinates
+    float x0 = vertices[0].x_ - 1.0f;
+    float y0 = vertices[0].y_ - 1.0f;
+    float x1 = vertices[1].x_ - 1.0f;
+    float y1 = vertices[1].y_ - 1.0f;
+    float x2 = vertices[2].x_ - 1.0f;
+    float y2 = vertices[2].y_ - 1.0f;
+
+    float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0.0f)
+        return;
 
-        dInvZdY_ = invdY * (((vertices[1].z_ - vertices[2].z_) * (vertices[0].x_ - vertices[2].x_)) -
-                            ((vertices[0].z_ - vertices[2].z_) * (vertices[1].x_ - vertices[2].x_)));
+    OcclusionTriangle triangle;
+    triangle.left_ = Max((int)ceilf(Min(Min(x0, x1), x2)), 0);
+    triangle.top_ = Max((int)ceilf(Min(Min(y0, y1), y2)), 0);
+    triangle.right_ = Min((int)floorf(Max(Max(x0, x1), x2)), width_ - 1);
+    triangle.bottom_ = Min((int)floorf(Max(Max(y0, y1), y2)), height_ - 1);
+    // Check for no pixel centers covered
+    if (triangle.left_ > triangle.right_ || triangle.top_ > triangle.bottom_)
+        return;
 
-        dInvZdXInt_ = (int)dInvZdX_;
+    // Orient the edge functions so that the inside is positive regardless of winding
+    float sign = area > 0.0f ? 1.0f : -1.0f;
+    const float xs[3] = { x0, x1, x2 };
+    const float ys[3] = { y0, y1, y2 };
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        unsigned j = i < 2 ? i + 1 : 0;
+        float dx = xs[j] - xs[i];
+        float dy = ys[j] - ys[i];
+        triangle.edgeA_[i] = -dy * sign;
+        triangle.edgeB_[i] = dx * sign;
+        triangle.edgeC_[i] = (dy * xs[i] - dx * ys[i]) * sign;
     }
 
-    /// Integer horizontal gradient.
-    int dInvZdXInt_;
-    /// Horizontal gradient.
-    float dInvZdX_;
-    /// Vertical gradient.
-    float dInvZdY_;
-};
+    // Interpolate depth relative to the first vertex for better precision with steep triangles
+    float z0 = vertices[0].z_;
+    float z1 = vertices[1].z_;
+    float z2 = vertices[2].z_;
+    float invArea = 1.0f / area;
+    triangle.dZdX_ = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * invArea;
+    triangle.dZdY_ = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) * invArea;
+    triangle.refX_ = x0;
+    triangle.refY_ = y0;
+    triangle.refZ_ = z0;
+    triangle.minZ_ = Min(Min(z0, z1), z2);
+    triangle.maxZ_ = Max(Max(z0, z1), z2);
+
+    triangles_.Push(triangle);
+}
 
-/// %Edge of a software rasterized triangle.
-struct Edge
+void OcclusionBuffer::RasterizeTile(unsigned index)
 {
-    /// Construct from gradients and top & bottom vertices.
-    Edge(const Gradients& gradients, const Vector3& top, const Vector3& bottom, int topY)
-    {
-        float height = (bottom.y_ - top.y_);
-        float slope = (height != 0.0f) ? (bottom.x_ - top.x_) / height : 0.0f;
-        float yPreStep = (float)(topY + 1) - top.y_;
-        float xPreStep = slope * yPreStep;
-
-        x_ = (int)((xPreStep + top.x_) * OCCLUSION_X_SCALE + 0.5f);
-        xStep_ = (int)(slope * OCCLUSION_X_SCALE + 0.5f);
-        invZ_ = (int)(top.z_ + xPreStep * gradients.dInvZdX_ + yPreStep * gradients.dInvZdY_ + 0.5f);
-        invZStep_ = (int)(slope * gradients.dInvZdX_ + gradients.dInvZdY_ + 0.5f);
-    }
+    const PODVector<unsigned>& tileTriangles = tileTriangles_[index];
+    if (tileTriangles.Empty())
+        return;
 
-    /// X coordinate.
-    int x_;
-    /// X coordinate step.
-    int xStep_;
-    /// Inverse Z.
-    int invZ_;
-    /// Inverse Z step.
-    int invZStep_;
-};
-
-void OcclusionBuffer::DrawTriangle2D(const Vector3* vertices, bool clockwise)
-{
-    int top, middle, bottom;
-    bool middleIsRight;
+    int tileLeft = (int)(index % numTilesX_) * OCCLUSION_TILE_WIDTH;
+    int tileTop = (int)(index / numTilesX_) * OCCLUSION_TILE_HEIGHT;
+    int tileRight = Min(tileLeft + OCCLUSION_TILE_WIDTH, width_) - 1;
+    int tileBottom = Min(tileTop + OCCLUSION_TILE_HEIGHT, height_) - 1;
+    int& tileMaxDepth = tileMaxDepths_[index];
 
-    // Sort vertices in Y-direction
-    if (vertices[0].y_ < vertices[1].y_)
-    {
-        if (vertices[2].y_ < vertices[0].y_)
-        {
-            top = 2;
-            middle = 0;
-            bottom = 1;
-            middleIsRight = true;
-        }
-        else
-        {
-            top = 0;
-            if (vertices[1].y_ < vertices[2].y_)
-            {
-                middle = 1;
-                bottom = 2;
-                middleIsRight = true;
-            }
-            else
-            {
-                middle = 2;
-                bottom = 1;
-                middleIsRight = false;
-            }
-        }
-    }
-    else
+    for (PODVector<unsigned>::ConstIterator i = tileTriangles.Begin(); i != tileTriangles.End(); ++i)
     {
-        if (vertices[2].y_ < vertices[1].y_)
-        {
-            top = 2;
-            middle = 1;
-            bottom = 0;
-            middleIsRight = false;
-        }
-        else
-        {
-            top = 1;
-            if (vertices[0].y_ < vertices[2].y_)
-            {
-                middle = 0;
-                bottom = 2;
-                middleIsRight = false;
-            }
-            else
-            {
-                middle = 2;
-                bottom = 0;
-                middleIsRight = true;
-            }
-        }
-    }
-
-    int topY = (int)vertices[top].y_;
-    int middleY = (int)vertices[middle].y_;
-    int bottomY = (int)vertices[bottom].y_;
-
-    // Check for degenerate triangle
-    if (topY == bottomY)
-        return;
+        const OcclusionTriangle& triangle = triangles_[*i];
 
-    // Reverse middleIsRight test if triangle is counterclockwise
-    if (!clockwise)
-        middleIsRight = !middleIsRight;
+        // Skip if the triangle is behind everything already drawn to the tile
+        if ((int)(triangle.minZ_ + 0.5f) >= tileMaxDepth)
+            continue;
 
-    Gradients gradients(vertices);
-    Edge topToMiddle(gradients, vertices[top], vertices[middle], topY);
-    Edge topToBottom(gradients, vertices[top], vertices[bottom], topY);
-    Edge middleToBottom(gradients, vertices[middle], vertices[bottom], middleY);
+        int left = Max(triangle.left_, tileLeft);
+        int top = Max(triangle.top_, tileTop);
+        int right = Min(triangle.right_, tileRight);
+        int bottom = Min(triangle.bottom_, tileBottom);
 
-    if (middleIsRight)
-    {
-        // Top half
-        int* row = buffer_ + topY * width_;
-        int* endRow = buffer_ + middleY * width_;
-        while (row < endRow)
+        // Check whether the triangle covers the whole tile, in which case the edge functions need not be evaluated, and the
+        // tile's maximum depth can be lowered to the triangle's maximum depth within the tile
+        bool covered = true;
+        for (unsigned j = 0; j < 3; ++j)
         {
-            int invZ = topToBottom.invZ_;
-            int* dest = row + (topToBottom.x_ >> 16);
-            int* end = row + (topToMiddle.x_ >> 16);
-            while (dest < end)
+            float a = triangle.edgeA_[j];
+            float b = triangle.edgeB_[j];
+            if (a * (float)(a > 0.0f ? tileLeft : tileRight) + b * (float)(b > 0.0f ? tileTop : tileBottom) +
+                triangle.edgeC_[j] < 0.0f)
             {
-                if (invZ < *dest)
-                    *dest = invZ;
-                invZ += gradients.dInvZdXInt_;
-                ++dest;
+                covered = false;
+                break;
             }
-
-            topToBottom.x_ += topToBottom.xStep_;
-            topToBottom.invZ_ += topToBottom.invZStep_;
-            topToMiddle.x_ += topToMiddle.xStep_;
-            row += width_;
         }
-
-        // Bottom half
-        row = buffer_ + middleY * width_;
-        endRow = buffer_ + bottomY * width_;
-        while (row < endRow)
+        if (covered)
         {
-            int invZ = topToBottom.invZ_;
-            int* dest = row + (topToBottom.x_ >> 16);
-            int* end = row + (middleToBottom.x_ >> 16);
-            while (dest < end)
-            {
-                if (invZ < *dest)
-                    *dest = invZ;
-                invZ += gradients.dInvZdXInt_;
-                ++dest;
-            }
-
-            topToBottom.x_ += topToBottom.xStep_;
-            topToBottom.invZ_ += topToBottom.invZStep_;
-            middleToBottom.x_ += middleToBottom.xStep_;
-            row += width_;
+            float cornerMaxZ = triangle.refZ_ +
+                triangle.dZdX_ * ((float)(triangle.dZdX_ > 0.0f ? tileRight : tileLeft) - triangle.refX_) +
+                triangle.dZdY_ * ((float)(triangle.dZdY_ > 0.0f ? tileBottom : tileTop) - triangle.refY_);
+            tileMaxDepth = Min(tileMaxDepth, (int)(Min(cornerMaxZ, triangle.maxZ_) + 0.5f));
         }
-    }
-    else
-    {
-        // Top half
-        int* row = buffer_ + topY * width_;
-        int* endRow = buffer_ + middleY * width_;
-        while (row < endRow)
+
+#ifdef CLOCKWORK_SSE2
+        // Rasterize four pixels at a time. Tiles start at multiples of four pixels, so the groups never cross tile edges
+        if (!(width_ & 3))
         {
-            int invZ = topToMiddle.invZ_;
-            int* dest = row + (topToMiddle.x_ >> 16);
-            int* end = row + (topToBottom.x_ >> 16);
-            while (dest < end)
+            int startX = left & ~3;
+            __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            __m128 zero = _mm_setzero_ps();
+            __m128 half = _mm_set1_ps(0.5f);
+            __m128 minZ = _mm_set1_ps(triangle.minZ_);
+            __m128 maxZ = _mm_set1_ps(triangle.maxZ_);
+            __m128 a0 = _mm_set1_ps(triangle.edgeA_[0]);
+            __m128 a1 = _mm_set1_ps(triangle.edgeA_[1]);
+            __m128 a2 = _mm_set1_ps(triangle.edgeA_[2]);
+            __m128 step0 = _mm_set1_ps(triangle.edgeA_[0] * 4.0f);
+            __m128 step1 = _mm_set1_ps(triangle.edgeA_[1] * 4.0f);
+            __m128 step2 = _mm_set1_ps(triangle.edgeA_[2] * 4.0f);
+            __m128 dZdX = _mm_set1_ps(triangle.dZdX_);
+            __m128 zStep = _mm_set1_ps(triangle.dZdX_ * 4.0f);
+            __m128 coveredMask = _mm_castsi128_ps(_mm_set1_epi32(covered ? -1 : 0));
+
+            for (int y = top; y <= bottom; ++y)
             {
-                if (invZ < *dest)
-                    *dest = invZ;
-                invZ += gradients.dInvZdXInt_;
-                ++dest;
+                float fx = (float)startX;
+                float fy = (float)y;
+                __m128 e0 = _mm_add_ps(_mm_set1_ps(triangle.edgeA_[0] * fx + triangle.edgeB_[0] * fy + triangle.edgeC_[0]),
+                    _mm_mul_ps(a0, laneOffsets));
+                __m128 e1 = _mm_add_ps(_mm_set1_ps(triangle.edgeA_[1] * fx + triangle.edgeB_[1] * fy + triangle.edgeC_[1]),
+                    _mm_mul_ps(a1, laneOffsets));
+                __m128 e2 = _mm_add_ps(_mm_set1_ps(triangle.edgeA_[2] * fx + triangle.edgeB_[2] * fy + triangle.edgeC_[2]),
+                    _mm_mul_ps(a2, laneOffsets));
+                __m128 z = _mm_add_ps(_mm_set1_ps(triangle.refZ_ + triangle.dZdX_ * (fx - triangle.refX_) +
+                    triangle.dZdY_ * (fy - triangle.refY_)), _mm_mul_ps(dZdX, laneOffsets));
+                int* dest = buffer_ + y * width_ + startX;
+
+                for (int x = startX; x <= right; x += 4)
+                {
+                    __m128 inside = _mm_or_ps(coveredMask, _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+                        _mm_cmpge_ps(e2, zero)));
+                    if (_mm_movemask_ps(inside))
+                    {
+                        __m128i depth = _mm_cvttps_epi32(_mm_add_ps(_mm_min_ps(_mm_max_ps(z, minZ), maxZ), half));
+                        __m128i old = _mm_loadu_si128((__m128i*)dest);
+                        __m128i write = _mm_and_si128(_mm_castps_si128(inside), _mm_cmplt_epi32(depth, old));
+                        _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_and_si128(write, depth), _mm_andnot_si128(write, old)));
+                    }
+
+                    e0 = _mm_add_ps(e0, step0);
+                    e1 = _mm_add_ps(e1, step1);
+                    e2 = _mm_add_ps(e2, step2);
+                    z = _mm_add_ps(z, zStep);
+                    dest += 4;
+                }
             }
 
-            topToMiddle.x_ += topToMiddle.xStep_;
-            topToMiddle.invZ_ += topToMiddle.invZStep_;
-            topToBottom.x_ += topToBottom.xStep_;
-            row += width_;
+            continue;
         }
+#endif
 
-        // Bottom half
-        row = buffer_ + middleY * width_;
-        endRow = buffer_ + bottomY * width_;
-        while (row < endRow)
+        for (int y = top; y <= bottom; ++y)
         {
-            int invZ = middleToBottom.invZ_;
-            int* dest = row + (middleToBottom.x_ >> 16);
-            int* end = row + (topToBottom.x_ >> 16);
-            while (dest < end)
+            float fy = (float)y;
+            int* dest = buffer_ + y * width_ + left;
+
+            for (int x = left; x <= right; ++x)
             {
-                if (invZ < *dest)
-                    *dest = invZ;
-                invZ += gradients.dInvZdXInt_;
+                float fx = (float)x;
+                if (covered || (triangle.edgeA_[0] * fx + triangle.edgeB_[0] * fy + triangle.edgeC_[0] >= 0.0f &&
+                    triangle.edgeA_[1] * fx + triangle.edgeB_[1] * fy + triangle.edgeC_[1] >= 0.0f &&
+                    triangle.edgeA_[2] * fx + triangle.edgeB_[2] * fy + triangle.edgeC_[2] >= 0.0f))
+                {
+                    float z = triangle.refZ_ + triangle.dZdX_ * (fx - triangle.refX_) + triangle.dZdY_ * (fy - triangle.refY_);
+                    int depth = (int)(Clamp(z, triangle.minZ_, triangle.maxZ_) + 0.5f);
+                    if (depth < *dest)
+                        *dest = depth;
+                }
                 ++dest;
             }
-
-            middleToBottom.x_ += middleToBottom.xStep_;
-            middleToBottom.invZ_ += middleToBottom.invZStep_;
-            topToBottom.x_ += topToBottom.xStep_;
-            row += width_;
         }
     }
 }
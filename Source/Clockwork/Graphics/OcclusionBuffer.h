@@ -36,8 +36,7 @@ class Camera;
 class IndexBuffer;
 class IntRect;
 class VertexBuffer;
-struct Edge;
-struct Gradients;
+struct WorkItem;
 
 /// Occlusion hierarchy depth range.
 struct DepthValue
@@ -48,18 +47,55 @@ struct DepthValue
     int max_;
 };
 
+/// Screen-space occluder triangle set up for half-space rasterization. Pixel centers are at integer coordinates.
+struct OcclusionTriangle
+{
+    /// Edge function X coefficients. A pixel is inside when all three edge functions are non-negative.
+    float edgeA_[3];
+    /// Edge function Y coefficients.
+    float edgeB_[3];
+    /// Edge function constants.
+    float edgeC_[3];
+    /// Depth gradient along X.
+    float dZdX_;
+    /// Depth gradient along Y.
+    float dZdY_;
+    /// Reference vertex X.
+    float refX_;
+    /// Reference vertex Y.
+    float refY_;
+    /// Reference vertex depth.
+    float refZ_;
+    /// Minimum vertex depth.
+    float minZ_;
+    /// Maximum vertex depth.
+    float maxZ_;
+    /// Bounding rectangle left pixel.
+    int left_;
+    /// Bounding rectangle top pixel.
+    int top_;
+    /// Bounding rectangle right pixel (inclusive.)
+    int right_;
+    /// Bounding rectangle bottom pixel (inclusive.)
+    int bottom_;
+};
+
 static const int OCCLUSION_MIN_SIZE = 8;
 static const int OCCLUSION_DEFAULT_MAX_TRIANGLES = 5000;
 static const float OCCLUSION_RELATIVE_BIAS = 0.00001f;
 static const int OCCLUSION_FIXED_BIAS = 16;
-static const float OCCLUSION_X_SCALE = 65536.0f;
 static const float OCCLUSION_Z_SCALE = 16777216.0f;
+static const int OCCLUSION_TILE_WIDTH = 32;
+static const int OCCLUSION_TILE_HEIGHT = 16;
+static const unsigned OCCLUSION_BATCH_TRIANGLES = 1024;
 
 /// Software renderer for occlusion.
 class CLOCKWORK_API OcclusionBuffer : public Object
 {
     OBJECT(OcclusionBuffer);
 
+    friend void RasterizeOcclusionTilesWork(const WorkItem* item, unsigned threadIndex);
+
 public:
     /// Construct.
     OcclusionBuffer(Context* context);
@@ -83,8 +119,14 @@ public:
     /// Draw a triangle mesh to the buffer using indexed geometry.
     bool Draw(const Matrix3x4& model, const void* vertexData, unsigned vertexSize, const void* indexData, unsigned indexSize,
         unsigned indexStart, unsigned indexCount);
-    /// Build reduced size mip levels.
+    /// Rasterize the triangles queued by Draw(). The buffer is split into tiles, which are rasterized in worker threads. Called automatically when enough triangles have been queued, and by BuildDepthHierarchy().
+    void DrawTriangles();
+    /// Rasterize the queued triangles and build reduced size mip levels.
     void BuildDepthHierarchy();
+    /// Copy the rasterized depth, size and view of another buffer. Triangles still queued in the source are not copied.
+    void CopyFrom(const OcclusionBuffer& source);
+    /// Reproject another buffer's depth, typically the previous frame's, into this buffer's view and merge it with the current depth. Holes are filled only where enclosed by reprojected samples, and otherwise left unoccluded.
+    void Reproject(const OcclusionBuffer& source);
     /// Reset last used timer.
     void ResetUseTimer();
 
@@ -106,13 +148,16 @@ public:
     /// Return number of rendered triangles.
     unsigned GetNumTriangles() const { return numTriangles_; }
 
+    /// Return number of triangles queued for rasterization. They are not yet taken into account by IsVisible().
+    unsigned GetNumQueuedTriangles() const { return triangles_.Size(); }
+
     /// Return maximum number of triangles.
     unsigned GetMaxTriangles() const { return maxTriangles_; }
 
     /// Return culling mode.
     CullMode GetCullMode() const { return cullMode_; }
 
-    /// Test a bounding box for visibility. For best performance, build depth hierarchy first.
+    /// Test a bounding box for visibility. For best performance, build depth hierarchy first. Triangles still queued for rasterization do not occlude.
     bool IsVisible(const BoundingBox& worldSpaceBox) const;
     /// Return time since last use in milliseconds.
     unsigned GetUseTimer();
@@ -132,8 +177,10 @@ private:
     void DrawTriangle(Vector4* vertices);
     /// Clip vertices against a plane.
     void ClipVertices(const Vector4& plane, Vector4* vertices, bool* triangles, unsigned& numTriangles);
-    /// Draw a clipped triangle.
-    void DrawTriangle2D(const Vector3* vertices, bool clockwise);
+    /// Set up a clipped triangle for rasterization and queue it.
+    void AddTriangle2D(const Vector3* vertices);
+    /// Rasterize the queued triangles overlapping a tile.
+    void RasterizeTile(unsigned index);
 
     /// Highest level depth buffer.
     int* buffer_;
@@ -179,6 +226,18 @@ private:
     SharedArrayPtr<int> fullBuffer_;
     /// Reduced size depth buffers.
     Vector<SharedArrayPtr<DepthValue> > mipBuffers_;
+    /// Triangles queued for rasterization.
+    PODVector<OcclusionTriangle> triangles_;
+    /// Indices of the queued triangles overlapping each tile.
+    Vector<PODVector<unsigned> > tileTriangles_;
+    /// Maximum depth of each tile. Triangles behind it can be skipped.
+    PODVector<int> tileMaxDepths_;
+    /// Scratch buffer for reprojected depth.
+    PODVector<int> reprojectBuffer_;
+    /// Number of tiles horizontally.
+    int numTilesX_;
+    /// Number of tiles vertically.
+    int numTilesY_;
 };
 
 }
@@ -26,10 +26,12 @@
 #include "../Core/CoreEvents.h"
 #include "../Core/Profiler.h"
 #include "../Core/Thread.h"
+#include "../Core/Timer.h"
 #include "../Core/WorkQueue.h"
 #include "../Graphics/DebugRenderer.h"
 #include "../Graphics/Graphics.h"
 #include "../Graphics/Octree.h"
+#include "../Graphics/Renderer.h"
 #include "../IO/Log.h"
 #include "../Scene/Scene.h"
 #include "../Scene/SceneEvents.h"
@@ -46,6 +48,8 @@ namespace Clockwork
 static const float DEFAULT_OCTREE_SIZE = 1000.0f;
 static const int DEFAULT_OCTREE_LEVELS = 8;
 static const int RAYCASTS_PER_WORK_ITEM = 4;
+static const float MAX_ANIMATION_LOD_SCALE = 16.0f;
+static const unsigned MAX_OCTREE_CHANGES = 65536;
 
 extern const char* SUBSYSTEM_CATEGORY;
 
@@ -332,7 +336,10 @@ void Octant::GetDrawablesOnlyInternal(RayOctreeQuery& query, PODVector<Drawable*
 Octree::Octree(Context* context) :
     Component(context),
     Octant(BoundingBox(-DEFAULT_OCTREE_SIZE, DEFAULT_OCTREE_SIZE), 0, 0, this),
-    numLevels_(DEFAULT_OCTREE_LEVELS)
+    firstChange_(0),
+    previousUpdateChanges_(0),
+    numLevels_(DEFAULT_OCTREE_LEVELS),
+    animationLodScale_(1.0f)
 {
     // Resize threaded ray query intermediate result vector according to number of worker threads
     WorkQueue* workQueue = GetSubsystem<WorkQueue>();
@@ -396,6 +403,10 @@ void Octree::SetSize(const BoundingBox& box, unsigned numLevels)
 
 void Octree::Update(const FrameInfo& frame)
 {
+    // Poses shared between animated models are only valid for one frame
+    poseCache_.Clear();
+    HiresTimer updateTimer;
+
     // Let drawables update themselves before reinsertion. This can be used for animation
     if (!drawableUpdates_.Empty())
     {
@@ -432,7 +443,30 @@ void Octree::Update(const FrameInfo& frame)
 
         queue->Complete(M_MAX_UNSIGNED);
         scene->EndThreadedUpdate();
+
+        // Drawables queued from the worker threads were kept aside so that the vector being iterated is not reallocated.
+        // They still need to be reinserted
+        if (!threadedDrawableUpdates_.Empty())
+        {
+            drawableUpdates_.Push(threadedDrawableUpdates_);
+            threadedDrawableUpdates_.Clear();
+        }
+    }
+
+    // If the drawable update, which is dominated by animation, exceeds the renderer's animation budget, scale up the animation
+    // LOD distances so that distant models update less often. Relax back gradually once well within the budget
+    Renderer* renderer = GetSubsystem<Renderer>();
+    float budget = renderer ? renderer->GetAnimationBudget() : 0.0f;
+    if (budget > 0.0f)
+    {
+        float elapsed = updateTimer.GetUSec(false) / 1000.0f;
+        if (elapsed > budget)
+            animationLodScale_ = Min(animationLodScale_ * Min(elapsed / budget, 2.0f), MAX_ANIMATION_LOD_SCALE);
+        else if (elapsed < budget * 0.75f)
+            animationLodScale_ = Max(animationLodScale_ * 0.9f, 1.0f);
     }
+    else
+        animationLodScale_ = 1.0f;
 
     // Notify drawable update being finished. Custom animation (eg. IK) can be done at this point
     Scene* scene = GetScene();
@@ -462,6 +496,9 @@ void Octree::Update(const FrameInfo& frame)
             // Skip if no octant or does not belong to this octree anymore
             if (!octant || octant->GetRoot() != this)
                 continue;
+
+            MarkDrawableChanged(drawable);
+
             // Skip if still fits the current octant
             if (drawable->IsOccludee() && octant->GetCullingBox().IsInside(box) == INSIDE && octant->CheckDrawableFit(box))
                 continue;
@@ -481,6 +518,11 @@ void Octree::Update(const FrameInfo& frame)
     }
 
     drawableUpdates_.Clear();
+
+    // Forget the changes recorded before the previous update ended. Views updated since then have already seen them
+    changes_.Erase(0, previousUpdateChanges_ - firstChange_);
+    firstChange_ = previousUpdateChanges_;
+    previousUpdateChanges_ = GetNumChanges();
 }
 
 void Octree::AddManualDrawable(Drawable* drawable)
@@ -489,6 +531,7 @@ void Octree::AddManualDrawable(Drawable* drawable)
         return;
 
     AddDrawable(drawable);
+    MarkDrawableChanged(drawable);
 }
 
 void Octree::RemoveManualDrawable(Drawable* drawable)
@@ -498,7 +541,27 @@ void Octree::RemoveManualDrawable(Drawable* drawable)
 
     Octant* octant = drawable->GetOctant();
     if (octant && octant->GetRoot() == this)
+    {
+        MarkDrawableChanged(drawable, true);
         octant->RemoveDrawable(drawable);
+    }
+}
+
+void Octree::MarkDrawableChanged(Drawable* drawable, bool removed)
+{
+    // If the octree is not being updated, do not let the changes grow without limit. Skipping the changes makes the cached
+    // query results of all views invalid
+    if (changes_.Size() >= MAX_OCTREE_CHANGES)
+    {
+        firstChange_ = previousUpdateChanges_ = GetNumChanges();
+        changes_.Clear();
+    }
+
+    OctreeChange change;
+    change.drawable_ = drawable;
+    if (!removed)
+        change.box_ = drawable->GetWorldBoundingBox();
+    changes_.Push(change);
 }
 
 void Octree::GetDrawables(OctreeQuery& query) const
@@ -611,7 +674,7 @@ void Octree::QueueUpdate(Drawable* drawable)
     if (scene && scene->IsThreadedUpdate())
     {
         MutexLock lock(octreeMutex_);
-        drawableUpdates_.Push(drawable);
+        threadedDrawableUpdates_.Push(drawable);
     }
     else
         drawableUpdates_.Push(drawable);
@@ -622,6 +685,7 @@ void Octree::QueueUpdate(Drawable* drawable)
 void Octree::CancelUpdate(Drawable* drawable)
 {
     drawableUpdates_.Remove(drawable);
+    threadedDrawableUpdates_.Remove(drawable);
     drawable->updateQueued_ = false;
 }
 
@@ -26,6 +26,7 @@
 #include "../Core/Mutex.h"
 #include "../Graphics/Drawable.h"
 #include "../Graphics/OctreeQuery.h"
+#include "../Graphics/PoseCache.h"
 
 namespace Clockwork
 {
@@ -35,6 +36,15 @@ class Octree;
 static const int NUM_OCTANTS = 8;
 static const unsigned ROOT_INDEX = M_MAX_UNSIGNED;
 
+/// Record of a drawable object added to, moved within or removed from the octree.
+struct OctreeChange
+{
+    /// Drawable object. It may have been destroyed since, so compare only the pointer.
+    Drawable* drawable_;
+    /// World bounding box after the change. Undefined if the drawable was removed.
+    BoundingBox box_;
+};
+
 /// %Octree octant
 class CLOCKWORK_API Octant
 {
@@ -195,6 +205,20 @@ public:
     /// Return subdivision levels.
     unsigned GetNumLevels() const { return numLevels_; }
 
+    /// Return the cache of skeletal poses shared by animated models in this scene.
+    PoseCache& GetPoseCache() { return poseCache_; }
+
+    /// Return the multiplier applied to animation LOD distances to stay within the renderer's animation budget. 1 when within budget.
+    float GetAnimationLodScale() const { return animationLodScale_; }
+
+    /// Record a drawable object as added, moved or removed, for keeping cached query results up to date. Called by Drawable.
+    void MarkDrawableChanged(Drawable* drawable, bool removed = false);
+    /// Return the change number following the latest recorded change.
+    unsigned GetNumChanges() const { return firstChange_ + changes_.Size(); }
+    /// Return the oldest change number still recorded. Changes are kept until the update after the one during which they were recorded.
+    unsigned GetFirstChange() const { return firstChange_; }
+    /// Return a recorded change by change number.
+    const OctreeChange& GetChange(unsigned index) const { return changes_[index - firstChange_]; }
     /// Mark drawable object as requiring an update and a reinsertion.
     void QueueUpdate(Drawable* drawable);
     /// Cancel drawable object's update.
@@ -208,8 +232,16 @@ private:
 
     /// Drawable objects that require update.
     PODVector<Drawable*> drawableUpdates_;
+    /// Drawable objects that were queued for update during the threaded update.
+    PODVector<Drawable*> threadedDrawableUpdates_;
     /// Drawable objects that require reinsertion.
     PODVector<Drawable*> drawableReinsertions_;
+    /// Recorded drawable object changes.
+    PODVector<OctreeChange> changes_;
+    /// Change number of the first recorded change.
+    unsigned firstChange_;
+    /// Change number following the changes recorded before the end of the previous update.
+    unsigned previousUpdateChanges_;
     /// Mutex for octree reinsertions.
     Mutex octreeMutex_;
     /// Current threaded ray query.
@@ -218,8 +250,12 @@ private:
     mutable PODVector<Drawable*> rayQueryDrawables_;
     /// Threaded ray query intermediate results.
     mutable Vector<PODVector<RayQueryResult> > rayQueryResults_;
+    /// Shared skeletal poses of the current frame.
+    PoseCache poseCache_;
     /// Subdivision level.
     unsigned numLevels_;
+    /// Animation LOD distance multiplier.
+    float animationLodScale_;
 };
 
 }
@@ -423,6 +423,13 @@ unsigned Texture::GetDataType(unsigned format)
 #endif
 }
 
+bool Texture::GetLoadSRGB(const XMLElement& element) const
+{
+    // Only the flag is read here, as this is called from the background loading thread
+    XMLElement srgbElem = element.GetChild("srgb");
+    return sRGB_ || (srgbElem && srgbElem.GetBool("enable"));
+}
+
 void Texture::SetParameters(XMLFile* file)
 {
     if (!file)
@@ -24,11 +24,13 @@
 
 #include "../../Core/Context.h"
 #include "../../Core/Profiler.h"
+#include "../../Core/WorkQueue.h"
 #include "../../Graphics/Graphics.h"
 #include "../../Graphics/GraphicsEvents.h"
 #include "../../Graphics/GraphicsImpl.h"
 #include "../../Graphics/Renderer.h"
 #include "../../Graphics/Texture2D.h"
+#include "../../IO/File.h"
 #include "../../IO/FileSystem.h"
 #include "../../IO/Log.h"
 #include "../../Resource/ResourceCache.h"
@@ -40,13 +42,18 @@ namespace Clockwork
 {
 
 Texture2D::Texture2D(Context* context) :
-    Texture(context)
+    Texture(context),
+    streamSkipLevels_(0),
+    maxResidentMip_(0),
+    streamed_(false),
+    streaming_(false)
 {
     target_ = GL_TEXTURE_2D;
 }
 
 Texture2D::~Texture2D()
 {
+    CancelStreaming();
     Release();
 }
 
@@ -69,23 +76,26 @@ bool Texture2D::BeginLoad(Deserializer& source)
         return true;
     }
 
-    // Load the image data for EndLoad()
+    // Load the image data for EndLoad(). If texture streaming is enabled, load only the mip tail now
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
     loadImage_ = new Image(context_);
+    if (cache->GetStreamingBudget())
+        loadImage_->SetSkipLevels(M_MAX_UNSIGNED);
     if (!loadImage_->Load(source))
     {
         loadImage_.Reset();
         return false;
     }
 
-    // Precalculate mip levels if async loading
-    if (GetAsyncLoadState() == ASYNC_LOADING)
-        loadImage_->PrecalculateLevels();
-
     // Load the optional parameters file
-    ResourceCache* cache = GetSubsystem<ResourceCache>();
     String xmlName = ReplaceExtension(GetName(), ".xml");
     loadParameters_ = cache->GetTempResource<XMLFile>(xmlName, false);
 
+    // Filter the mip levels of sRGB data in linear space. Precalculate them if async loading
+    loadImage_->SetSRGB(loadImage_->IsSRGB() || GetLoadSRGB(loadParameters_ ? loadParameters_->GetRoot() : XMLElement()));
+    if (GetAsyncLoadState() == ASYNC_LOADING)
+        loadImage_->PrecalculateLevels();
+
     return true;
 }
 
@@ -98,9 +108,22 @@ bool Texture2D::EndLoad()
     // If over the texture budget, see if materials can be freed to allow textures to be freed
     CheckTextureBudget(GetTypeStatic());
 
+    // Discard a streaming step of the previous data if reloading
+    CancelStreaming();
+
     SetParameters(loadParameters_);
     bool success = SetData(loadImage_);
 
+    // If only the mip tail was loaded, stream in the rest over the following frames
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    streamed_ = success && loadImage_ && loadImage_->IsCompressed() && cache->GetStreamingBudget();
+    streamSkipLevels_ = streamed_ ? loadImage_->GetSkippedLevels() : 0;
+    if (streamed_ && streamSkipLevels_ != GetStreamTargetLevels())
+    {
+        streaming_ = true;
+        cache->AddStreamingResource(this);
+    }
+
     loadImage_.Reset();
     loadParameters_.Reset();
 
@@ -360,7 +383,8 @@ bool Texture2D::SetData(SharedPtr<Image> image, bool useAlpha)
             needDecompress = true;
         }
 
-        unsigned mipsToSkip = mipsToSkip_[quality];
+        // Levels skipped already when loading the image (texture streaming) take the place of the quality setting
+        unsigned mipsToSkip = image->GetSkippedLevels() ? 0 : mipsToSkip_[quality];
         if (mipsToSkip >= levels)
             mipsToSkip = levels - 1;
         while (mipsToSkip && (width / (1 << mipsToSkip) < 4 || height / (1 << mipsToSkip) < 4))
@@ -223,12 +223,14 @@ bool TextureCube::BeginLoad(Deserializer& source)
         }
     }
 
-    // Precalculate mip levels if async loading
-    if (GetAsyncLoadState() == ASYNC_LOADING)
+    // Filter the mip levels of sRGB data in linear space. Precalculate them if async loading
+    bool sRGB = GetLoadSRGB(textureElem);
+    for (unsigned i = 0; i < loadImages_.Size(); ++i)
     {
-        for (unsigned i = 0; i < loadImages_.Size(); ++i)
+        if (loadImages_[i])
         {
-            if (loadImages_[i])
+            loadImages_[i]->SetSRGB(loadImages_[i]->IsSRGB() || sRGB);
+            if (GetAsyncLoadState() == ASYNC_LOADING)
                 loadImages_[i]->PrecalculateLevels();
         }
     }
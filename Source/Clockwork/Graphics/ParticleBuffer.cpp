@@ -0,0 +1,269 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Graphics/ParticleBuffer.h"
+#include "../Math/MathDefs.h"
+
+#include <cstring>
+
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+ParticleBuffer::ParticleBuffer() :
+    numStreams_(0),
+    maxParticles_(0),
+    stride_(0),
+    numParticles_(0)
+{
+}
+
+void ParticleBuffer::Define(unsigned numStreams, unsigned maxParticles)
+{
+    unsigned stride = (maxParticles + 3) & ~3U;
+    if (!stride)
+        stride = 4;
+
+    if (numStreams != numStreams_)
+        numParticles_ = 0;
+    else if (numParticles_ > maxParticles)
+        numParticles_ = maxParticles;
+
+    if (numStreams != numStreams_ || stride != stride_)
+    {
+        PODVector<unsigned> newData(numStreams * stride);
+        if (numParticles_)
+        {
+            for (unsigned i = 0; i < numStreams; ++i)
+                memcpy(&newData[i * stride], &data_[i * stride_], numParticles_ * sizeof(unsigned));
+        }
+
+        data_.Swap(newData);
+        stride_ = stride;
+    }
+
+    numStreams_ = numStreams;
+    maxParticles_ = maxParticles;
+}
+
+void ParticleBuffer::SetNumParticles(unsigned num)
+{
+    numParticles_ = num < maxParticles_ ? num : maxParticles_;
+}
+
+unsigned ParticleBuffer::AddParticle()
+{
+    if (numParticles_ >= maxParticles_)
+        return M_MAX_UNSIGNED;
+
+    return numParticles_++;
+}
+
+void ParticleBuffer::RemoveParticle(unsigned index)
+{
+    if (index >= numParticles_)
+        return;
+
+    unsigned last = --numParticles_;
+    if (index == last)
+        return;
+
+    for (unsigned i = 0; i < numStreams_; ++i)
+    {
+        unsigned* stream = &data_[i * stride_];
+        stream[index] = stream[last];
+    }
+}
+
+unsigned ParticleBuffer::RemoveExpired(unsigned lifeStream)
+{
+    return RemoveExpiredParticles(0, GetStream(lifeStream));
+}
+
+unsigned ParticleBuffer::RemoveExpired(unsigned ageStream, unsigned lifeStream)
+{
+    return RemoveExpiredParticles(GetStream(ageStream), GetStream(lifeStream));
+}
+
+unsigned ParticleBuffer::RemoveExpiredParticles(const float* ages, const float* lives)
+{
+    unsigned oldNumParticles = numParticles_;
+    unsigned i = 0;
+
+    // The removal order matches removing one particle at a time, so that the result does not depend on the SIMD path
+    while (i < numParticles_)
+    {
+#ifdef CLOCKWORK_SSE2
+        // Skip four particles at a time while none of them have expired
+        if (i + 4 <= numParticles_)
+        {
+            __m128 age = ages ? _mm_loadu_ps(&ages[i]) : _mm_setzero_ps();
+            if (!_mm_movemask_ps(_mm_cmpge_ps(age, _mm_loadu_ps(&lives[i]))))
+            {
+                i += 4;
+                continue;
+            }
+        }
+#endif
+        if ((ages ? ages[i] : 0.0f) >= lives[i])
+            RemoveParticle(i);
+        else
+            ++i;
+    }
+
+    return oldNumParticles - numParticles_;
+}
+
+void ParticleAdd(float* dest, float value, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    __m128 v = _mm_set1_ps(value);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(&dest[i], _mm_add_ps(_mm_loadu_ps(&dest[i]), v));
+#endif
+
+    for (; i < count; ++i)
+        dest[i] += value;
+}
+
+void ParticleMultiplyAdd(float* dest, const float* src, float scale, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    __m128 s = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(&dest[i], _mm_add_ps(_mm_loadu_ps(&dest[i]), _mm_mul_ps(_mm_loadu_ps(&src[i]), s)));
+#endif
+
+    for (; i < count; ++i)
+        dest[i] += src[i] * scale;
+}
+
+void ParticleMultiplyAdd(float* dest, const float* src, const float* scales, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(&dest[i], _mm_add_ps(_mm_loadu_ps(&dest[i]), _mm_mul_ps(_mm_loadu_ps(&src[i]),
+            _mm_loadu_ps(&scales[i]))));
+    }
+#endif
+
+    for (; i < count; ++i)
+        dest[i] += src[i] * scales[i];
+}
+
+void ParticleConsumeLife(float* steps, float* lives, float timeStep, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    __m128 t = _mm_set1_ps(timeStep);
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 life = _mm_loadu_ps(&lives[i]);
+        __m128 step = _mm_min_ps(t, life);
+        _mm_storeu_ps(&steps[i], step);
+        _mm_storeu_ps(&lives[i], _mm_sub_ps(life, step));
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float step = timeStep > lives[i] ? lives[i] : timeStep;
+        steps[i] = step;
+        lives[i] -= step;
+    }
+}
+
+void ParticleScaleCurve(float* scales, float add, float mul, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    __m128 a = _mm_set1_ps(add);
+    __m128 m = _mm_set1_ps(mul);
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(&scales[i], _mm_mul_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(&scales[i]), a), zero), m));
+#endif
+
+    for (; i < count; ++i)
+    {
+        float scale = scales[i] + add;
+        if (scale < 0.0f)
+            scale = 0.0f;
+        scales[i] = scale * mul;
+    }
+}
+
+void ParticleRange(const float* values, const float* extents, float extentScale, unsigned count, float& min, float& max)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    if (count >= 4)
+    {
+        __m128 s = _mm_set1_ps(extentScale);
+        __m128 vMin = _mm_set1_ps(min);
+        __m128 vMax = _mm_set1_ps(max);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 value = _mm_loadu_ps(&values[i]);
+            __m128 extent = _mm_mul_ps(_mm_loadu_ps(&extents[i]), s);
+            vMin = _mm_min_ps(vMin, _mm_sub_ps(value, extent));
+            vMax = _mm_max_ps(vMax, _mm_add_ps(value, extent));
+        }
+
+        float mins[4];
+        float maxs[4];
+        _mm_storeu_ps(mins, vMin);
+        _mm_storeu_ps(maxs, vMax);
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            min = Min(min, mins[j]);
+            max = Max(max, maxs[j]);
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        float extent = extents[i] * extentScale;
+        min = Min(min, values[i] - extent);
+        max = Max(max, values[i] + extent);
+    }
+}
+
+}
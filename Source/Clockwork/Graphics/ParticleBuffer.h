@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "../Container/Vector.h"
+
+namespace Clockwork
+{
+
+/// Structure-of-arrays particle storage. Each particle attribute is stored in its own stream of 32-bit values, so that the simulation kernels can process four particles at a time with SIMD instructions. Live particles are kept packed at the start of the streams.
+class CLOCKWORK_API ParticleBuffer
+{
+public:
+    /// Construct empty.
+    ParticleBuffer();
+
+    /// Set number of streams and maximum number of particles. Live particles are preserved up to the new maximum if the number of streams does not change.
+    void Define(unsigned numStreams, unsigned maxParticles);
+    /// Set number of live particles, clamped to the maximum. The stream values of added particles are undefined.
+    void SetNumParticles(unsigned num);
+    /// Add a particle to the end and return its index, or M_MAX_UNSIGNED if full. Its stream values are undefined.
+    unsigned AddParticle();
+    /// Remove a particle by moving the last particle in its place.
+    void RemoveParticle(unsigned index);
+    /// Remove particles whose life stream value is zero or less. Return number of particles removed.
+    unsigned RemoveExpired(unsigned lifeStream);
+    /// Remove particles whose age stream value is greater or equal to the life stream value. Return number of particles removed.
+    unsigned RemoveExpired(unsigned ageStream, unsigned lifeStream);
+    /// Remove all particles.
+    void Clear() { numParticles_ = 0; }
+
+    /// Return stream.
+    float* GetStream(unsigned index) { return reinterpret_cast<float*>(&data_[index * stride_]); }
+    /// Return stream.
+    const float* GetStream(unsigned index) const { return reinterpret_cast<const float*>(&data_[index * stride_]); }
+    /// Return stream interpreted as unsigned integers.
+    unsigned* GetUIntStream(unsigned index) { return &data_[index * stride_]; }
+    /// Return stream interpreted as unsigned integers.
+    const unsigned* GetUIntStream(unsigned index) const { return &data_[index * stride_]; }
+
+    /// Return number of streams.
+    unsigned GetNumStreams() const { return numStreams_; }
+
+    /// Return maximum number of particles.
+    unsigned GetMaxParticles() const { return maxParticles_; }
+
+    /// Return number of live particles.
+    unsigned GetNumParticles() const { return numParticles_; }
+
+    /// Return whether no more particles can be added.
+    bool IsFull() const { return numParticles_ >= maxParticles_; }
+
+private:
+    /// Remove expired particles. If ages is null, age is taken to be zero.
+    unsigned RemoveExpiredParticles(const float* ages, const float* lives);
+
+    /// Stream data.
+    PODVector<unsigned> data_;
+    /// Number of streams.
+    unsigned numStreams_;
+    /// Maximum number of particles.
+    unsigned maxParticles_;
+    /// Distance between streams, padded to a multiple of four.
+    unsigned stride_;
+    /// Number of live particles.
+    unsigned numParticles_;
+};
+
+/// Particle kernel: add a constant to each value.
+CLOCKWORK_API void ParticleAdd(float* dest, float value, unsigned count);
+/// Particle kernel: add the source values multiplied by a constant, for example velocity times timestep to position.
+CLOCKWORK_API void ParticleMultiplyAdd(float* dest, const float* src, float scale, unsigned count);
+/// Particle kernel: add the source values multiplied by per-particle scales.
+CLOCKWORK_API void ParticleMultiplyAdd(float* dest, const float* src, const float* scales, unsigned count);
+/// Particle kernel: clamp the timestep to the remaining life and subtract it from the life. Steps receive the clamped timesteps.
+CLOCKWORK_API void ParticleConsumeLife(float* steps, float* lives, float timeStep, unsigned count);
+/// Particle kernel: apply a size curve step, adding to the scale, clamping it to non-negative and then multiplying.
+CLOCKWORK_API void ParticleScaleCurve(float* scales, float add, float mul, unsigned count);
+/// Particle kernel: extend a range to cover the values, each extended in both directions by its extent multiplied by a constant.
+CLOCKWORK_API void ParticleRange(const float* values, const float* extents, float extentScale, unsigned count, float& min, float& max);
+
+}
@@ -40,6 +40,27 @@ extern const char* GEOMETRY_CATEGORY;
 extern const char* faceCameraModeNames[];
 static const unsigned MAX_PARTICLES_IN_FRAME = 100;
 
+/// Particle attribute streams.
+enum ParticleStream
+{
+    P_VELOCITY_X = 0,
+    P_VELOCITY_Y,
+    P_VELOCITY_Z,
+    P_POSITION_X,
+    P_POSITION_Y,
+    P_POSITION_Z,
+    P_SIZE_X,
+    P_SIZE_Y,
+    P_TIMER,
+    P_TIME_TO_LIVE,
+    P_SCALE,
+    P_ROTATION,
+    P_ROTATION_SPEED,
+    P_COLOR_INDEX,
+    P_TEX_INDEX,
+    NUM_PARTICLE_STREAMS
+};
+
 ParticleEmitter::ParticleEmitter(Context* context) :
     BillboardSet(context),
     periodTimer_(0.0f),
@@ -79,6 +100,51 @@ void ParticleEmitter::RegisterObject(Context* context)
     ATTRIBUTE("Serialize Particles", bool, serializeParticles_, true, AM_FILE);
 }
 
+void ParticleEmitter::ApplyAttributes()
+{
+    if (loadedParticles_.Empty())
+        return;
+
+    // The particles attribute is indexed by billboard. Pack the particles of the enabled billboards to the start
+    PODVector<Billboard> loadedBillboards = billboards_;
+    unsigned numLoaded = loadedParticles_.Size() < loadedBillboards.Size() ? loadedParticles_.Size() : loadedBillboards.Size();
+    particles_.Clear();
+
+    for (unsigned i = 0; i < numLoaded; ++i)
+    {
+        if (!loadedBillboards[i].enabled_)
+            continue;
+        unsigned index = particles_.AddParticle();
+        if (index == M_MAX_UNSIGNED)
+            break;
+
+        const Particle& particle = loadedParticles_[i];
+        const Billboard& billboard = loadedBillboards[i];
+        particles_.GetStream(P_VELOCITY_X)[index] = particle.velocity_.x_;
+        particles_.GetStream(P_VELOCITY_Y)[index] = particle.velocity_.y_;
+        particles_.GetStream(P_VELOCITY_Z)[index] = particle.velocity_.z_;
+        particles_.GetStream(P_POSITION_X)[index] = billboard.position_.x_;
+        particles_.GetStream(P_POSITION_Y)[index] = billboard.position_.y_;
+        particles_.GetStream(P_POSITION_Z)[index] = billboard.position_.z_;
+        particles_.GetStream(P_SIZE_X)[index] = particle.size_.x_;
+        particles_.GetStream(P_SIZE_Y)[index] = particle.size_.y_;
+        particles_.GetStream(P_TIMER)[index] = particle.timer_;
+        particles_.GetStream(P_TIME_TO_LIVE)[index] = particle.timeToLive_;
+        particles_.GetStream(P_SCALE)[index] = particle.scale_;
+        particles_.GetStream(P_ROTATION)[index] = billboard.rotation_;
+        particles_.GetStream(P_ROTATION_SPEED)[index] = particle.rotationSpeed_;
+        particles_.GetUIntStream(P_COLOR_INDEX)[index] = particle.colorIndex_;
+        particles_.GetUIntStream(P_TEX_INDEX)[index] = particle.texIndex_;
+        billboards_[index] = billboard;
+    }
+
+    for (unsigned i = particles_.GetNumParticles(); i < billboards_.Size(); ++i)
+        billboards_[i].enabled_ = false;
+
+    loadedParticles_.Clear();
+    Commit();
+}
+
 void ParticleEmitter::OnSetEnabled()
 {
     BillboardSet::OnSetEnabled();
@@ -103,11 +169,12 @@ void ParticleEmitter::Update(const FrameInfo& frame)
         return;
 
     // If there is an amount mismatch between particles and billboards, correct it
-    if (particles_.Size() != billboards_.Size())
-        SetNumBillboards(particles_.Size());
-
-    bool needCommit = false;
+    if (particles_.GetMaxParticles() != billboards_.Size())
+        SetNumBillboards(particles_.GetMaxParticles());
 
+    // Billboards of the particles that were live on the previous update are enabled
+    unsigned oldNumParticles = particles_.GetNumParticles();
+    bool needCommit = oldNumParticles > 0;
     // Check active/inactive period switching
     periodTimer_ += lastTimeStep_;
     if (emitting_)
@@ -159,6 +226,10 @@ void ParticleEmitter::Update(const FrameInfo& frame)
         }
     }
 
+    // Remove particles that have reached their time to live. The rest are packed to the start of the streams
+    particles_.RemoveExpired(P_TIMER, P_TIME_TO_LIVE);
+    unsigned numParticles = particles_.GetNumParticles();
+
     // Update existing particles
     Vector3 relativeConstantForce = node_->GetWorldRotation().Inverse() * effect_->GetConstantForce();
     // If billboards are not relative, apply scaling to the position update
@@ -166,87 +237,100 @@ void ParticleEmitter::Update(const FrameInfo& frame)
     if (scaled_ && !relative_)
         scaleVector = node_->GetWorldScale();
 
-    for (unsigned i = 0; i < particles_.Size(); ++i)
+    // Time to live
+    float* timer = particles_.GetStream(P_TIMER);
+    ParticleAdd(timer, lastTimeStep_, numParticles);
+
+    // Velocity & position
+    float* velocity[3];
+    float* position[3];
+    for (unsigned i = 0; i < 3; ++i)
     {
-        Particle& particle = particles_[i];
-        Billboard& billboard = billboards_[i];
+        velocity[i] = particles_.GetStream(P_VELOCITY_X + i);
+        position[i] = particles_.GetStream(P_POSITION_X + i);
+    }
 
-        if (billboard.enabled_)
-        {
-            needCommit = true;
+    const Vector3& constantForce = effect_->GetConstantForce();
+    if (constantForce != Vector3::ZERO)
+    {
+        Vector3 velocityAdd = lastTimeStep_ * (relative_ ? relativeConstantForce : constantForce);
+        for (unsigned i = 0; i < 3; ++i)
+            ParticleAdd(velocity[i], velocityAdd.Data()[i], numParticles);
+    }
 
-            // Time to live
-            if (particle.timer_ >= particle.timeToLive_)
-            {
-                billboard.enabled_ = false;
-                continue;
-            }
-            particle.timer_ += lastTimeStep_;
+    float dampingForce = effect_->GetDampingForce();
+    if (dampingForce != 0.0f)
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            ParticleMultiplyAdd(velocity[i], velocity[i], -dampingForce * lastTimeStep_, numParticles);
+    }
 
-            // Velocity & position
-            const Vector3& constantForce = effect_->GetConstantForce();
-            if (constantForce != Vector3::ZERO)
-            {
-                if (relative_)
-                    particle.velocity_ += lastTimeStep_ * relativeConstantForce;
-                else
-                    particle.velocity_ += lastTimeStep_ * constantForce;
-            }
+    for (unsigned i = 0; i < 3; ++i)
+        ParticleMultiplyAdd(position[i], velocity[i], lastTimeStep_ * scaleVector.Data()[i], numParticles);
 
-            float dampingForce = effect_->GetDampingForce();
-            if (dampingForce != 0.0f)
-            {
-                Vector3 force = -dampingForce * particle.velocity_;
-                particle.velocity_ += lastTimeStep_ * force;
-            }
-            billboard.position_ += lastTimeStep_ * particle.velocity_ * scaleVector;
+    // Rotation
+    float* rotation = particles_.GetStream(P_ROTATION);
+    ParticleMultiplyAdd(rotation, particles_.GetStream(P_ROTATION_SPEED), lastTimeStep_, numParticles);
 
-            // Rotation
-            billboard.rotation_ += lastTimeStep_ * particle.rotationSpeed_;
+    // Scaling
+    float* scale = particles_.GetStream(P_SCALE);
+    float sizeAdd = effect_->GetSizeAdd();
+    float sizeMul = effect_->GetSizeMul();
+    if (sizeAdd != 0.0f || sizeMul != 1.0f)
+    {
+        ParticleScaleCurve(scale, lastTimeStep_ * sizeAdd, sizeMul != 1.0f ? (lastTimeStep_ * (sizeMul - 1.0f)) + 1.0f : 1.0f,
+            numParticles);
+    }
 
-            // Scaling
-            float sizeAdd = effect_->GetSizeAdd();
-            float sizeMul = effect_->GetSizeMul();
-            if (sizeAdd != 0.0f || sizeMul != 1.0f)
-            {
-                particle.scale_ += lastTimeStep_ * sizeAdd;
-                if (particle.scale_ < 0.0f)
-                    particle.scale_ = 0.0f;
-                if (sizeMul != 1.0f)
-                    particle.scale_ *= (lastTimeStep_ * (sizeMul - 1.0f)) + 1.0f;
-                billboard.size_ = particle.size_ * particle.scale_;
-            }
+    // Color & texture animation are evaluated per particle while copying to the billboards
+    const float* sizeX = particles_.GetStream(P_SIZE_X);
+    const float* sizeY = particles_.GetStream(P_SIZE_Y);
+    unsigned* colorIndex = particles_.GetUIntStream(P_COLOR_INDEX);
+    unsigned* texIndex = particles_.GetUIntStream(P_TEX_INDEX);
+    const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
+    const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
 
-            // Color interpolation
-            unsigned& index = particle.colorIndex_;
-            const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
-            if (index < colorFrames_.Size())
+    for (unsigned i = 0; i < numParticles; ++i)
+    {
+        Billboard& billboard = billboards_[i];
+        billboard.position_ = Vector3(position[0][i], position[1][i], position[2][i]);
+        billboard.size_ = Vector2(sizeX[i] * scale[i], sizeY[i] * scale[i]);
+        billboard.rotation_ = rotation[i];
+        billboard.enabled_ = true;
+
+        // Color interpolation
+        unsigned& index = colorIndex[i];
+        if (index < colorFrames_.Size())
+        {
+            if (index < colorFrames_.Size() - 1)
             {
-                if (index < colorFrames_.Size() - 1)
-                {
-                    if (particle.timer_ >= colorFrames_[index + 1].time_)
-                        ++index;
-                }
-                if (index < colorFrames_.Size() - 1)
-                    billboard.color_ = colorFrames_[index].Interpolate(colorFrames_[index + 1], particle.timer_);
-                else
-                    billboard.color_ = colorFrames_[index].color_;
+                if (timer[i] >= colorFrames_[index + 1].time_)
+                    ++index;
             }
+            if (index < colorFrames_.Size() - 1)
+                billboard.color_ = colorFrames_[index].Interpolate(colorFrames_[index + 1], timer[i]);
+            else
+                billboard.color_ = colorFrames_[index].color_;
+        }
+        else
+            billboard.color_ = colorFrames_.Size() ? colorFrames_.Back().color_ : Color();
 
-            // Texture animation
-            unsigned& texIndex = particle.texIndex_;
-            const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
-            if (textureFrames_.Size() && texIndex < textureFrames_.Size() - 1)
-            {
-                if (particle.timer_ >= textureFrames_[texIndex + 1].time_)
-                {
-                    billboard.uv_ = textureFrames_[texIndex + 1].uv_;
-                    ++texIndex;
-                }
-            }
+        // Texture animation
+        unsigned& frame = texIndex[i];
+        if (textureFrames_.Size())
+        {
+            if (frame < textureFrames_.Size() - 1 && timer[i] >= textureFrames_[frame + 1].time_)
+                ++frame;
+            billboard.uv_ = textureFrames_[frame < textureFrames_.Size() ? frame : textureFrames_.Size() - 1].uv_;
         }
+        else
+            billboard.uv_ = Rect::POSITIVE;
     }
 
+    // Disable the billboards of removed particles
+    for (unsigned i = numParticles; i < oldNumParticles; ++i)
+        billboards_[i].enabled_ = false;
+
     if (needCommit)
         Commit();
 
@@ -281,7 +365,7 @@ void ParticleEmitter::SetNumParticles(unsigned num)
     if (num > MAX_BILLBOARDS)
         num = MAX_BILLBOARDS;
 
-    particles_.Resize(num);
+    particles_.Define(NUM_PARTICLE_STREAMS, num);
     SetNumBillboards(num);
 }
 
@@ -308,6 +392,9 @@ void ParticleEmitter::ResetEmissionTimer()
 
 void ParticleEmitter::RemoveAllParticles()
 {
+    particles_.Clear();
+    loadedParticles_.Clear();
+
     for (PODVector<Billboard>::Iterator i = billboards_.Begin(); i != billboards_.End(); ++i)
         i->enabled_ = false;
 
@@ -350,7 +437,10 @@ void ParticleEmitter::SetParticlesAttr(const VariantVector& value)
     unsigned index = 0;
     SetNumParticles(index < value.Size() ? value[index++].GetUInt() : 0);
 
-    for (PODVector<Particle>::Iterator i = particles_.Begin(); i != particles_.End() && index < value.Size(); ++i)
+    // The particles are matched with the loaded billboards in ApplyAttributes()
+    loadedParticles_.Resize(particles_.GetMaxParticles());
+    unsigned numLoaded = 0;
+    for (PODVector<Particle>::Iterator i = loadedParticles_.Begin(); i != loadedParticles_.End() && index < value.Size(); ++i)
     {
         i->velocity_ = value[index++].GetVector3();
         i->size_ = value[index++].GetVector2();
@@ -360,7 +450,10 @@ void ParticleEmitter::SetParticlesAttr(const VariantVector& value)
         i->rotationSpeed_ = value[index++].GetFloat();
         i->colorIndex_ = (unsigned)value[index++].GetInt();
         i->texIndex_ = (unsigned)value[index++].GetInt();
+        ++numLoaded;
     }
+
+    loadedParticles_.Resize(numLoaded);
 }
 
 VariantVector ParticleEmitter::GetParticlesAttr() const
@@ -368,22 +461,25 @@ VariantVector ParticleEmitter::GetParticlesAttr() const
     VariantVector ret;
     if (!serializeParticles_)
     {
-        ret.Push(particles_.Size());
+        ret.Push(particles_.GetMaxParticles());
         return ret;
     }
 
-    ret.Reserve(particles_.Size() * 8 + 1);
-    ret.Push(particles_.Size());
-    for (PODVector<Particle>::ConstIterator i = particles_.Begin(); i != particles_.End(); ++i)
+    // Only the live particles are stored. They correspond to the first billboards
+    unsigned numParticles = particles_.GetNumParticles();
+    ret.Reserve(numParticles * 8 + 1);
+    ret.Push(particles_.GetMaxParticles());
+    for (unsigned i = 0; i < numParticles; ++i)
     {
-        ret.Push(i->velocity_);
-        ret.Push(i->size_);
-        ret.Push(i->timer_);
-        ret.Push(i->timeToLive_);
-        ret.Push(i->scale_);
-        ret.Push(i->rotationSpeed_);
-        ret.Push(i->colorIndex_);
-        ret.Push(i->texIndex_);
+        ret.Push(Vector3(particles_.GetStream(P_VELOCITY_X)[i], particles_.GetStream(P_VELOCITY_Y)[i],
+            particles_.GetStream(P_VELOCITY_Z)[i]));
+        ret.Push(Vector2(particles_.GetStream(P_SIZE_X)[i], particles_.GetStream(P_SIZE_Y)[i]));
+        ret.Push(particles_.GetStream(P_TIMER)[i]);
+        ret.Push(particles_.GetStream(P_TIME_TO_LIVE)[i]);
+        ret.Push(particles_.GetStream(P_SCALE)[i]);
+        ret.Push(particles_.GetStream(P_ROTATION_SPEED)[i]);
+        ret.Push(particles_.GetUIntStream(P_COLOR_INDEX)[i]);
+        ret.Push(particles_.GetUIntStream(P_TEX_INDEX)[i]);
     }
     return ret;
 }
@@ -425,12 +521,9 @@ void ParticleEmitter::OnSceneSet(Scene* scene)
 
 bool ParticleEmitter::EmitNewParticle()
 {
-    unsigned index = GetFreeParticle();
+    unsigned index = particles_.AddParticle();
     if (index == M_MAX_UNSIGNED)
         return false;
-    assert(index < particles_.Size());
-    Particle& particle = particles_[index];
-    Billboard& billboard = billboards_[index];
 
     Vector3 startPos;
     Vector3 startDir;
@@ -471,38 +564,31 @@ bool ParticleEmitter::EmitNewParticle()
         startDir = node_->GetWorldRotation() * startDir;
     };
 
-    particle.velocity_ = effect_->GetRandomVelocity() * startDir;
-    particle.size_ = effect_->GetRandomSize();
-    particle.timer_ = 0.0f;
-    particle.timeToLive_ = effect_->GetRandomTimeToLive();
-    particle.scale_ = 1.0f;
-    particle.rotationSpeed_ = effect_->GetRandomRotationSpeed();
-    particle.colorIndex_ = 0;
-    particle.texIndex_ = 0;
-
-    billboard.position_ = startPos;
-    billboard.size_ = particles_[index].size_;
-    const Vector<TextureFrame>& textureFrames_ = effect_->GetTextureFrames();
-    billboard.uv_ = textureFrames_.Size() ? textureFrames_[0].uv_ : Rect::POSITIVE;
-    billboard.rotation_ = effect_->GetRandomRotation();
-    const Vector<ColorFrame>& colorFrames_ = effect_->GetColorFrames();
-    billboard.color_ = colorFrames_.Size() ? colorFrames_[0].color_ : Color();
-    billboard.enabled_ = true;
+    Vector3 velocity = effect_->GetRandomVelocity() * startDir;
+    Vector2 size = effect_->GetRandomSize();
+    float timeToLive = effect_->GetRandomTimeToLive();
+    float rotationSpeed = effect_->GetRandomRotationSpeed();
+
+    // Color and texture frames are applied to the billboard on the next update
+    particles_.GetStream(P_VELOCITY_X)[index] = velocity.x_;
+    particles_.GetStream(P_VELOCITY_Y)[index] = velocity.y_;
+    particles_.GetStream(P_VELOCITY_Z)[index] = velocity.z_;
+    particles_.GetStream(P_POSITION_X)[index] = startPos.x_;
+    particles_.GetStream(P_POSITION_Y)[index] = startPos.y_;
+    particles_.GetStream(P_POSITION_Z)[index] = startPos.z_;
+    particles_.GetStream(P_SIZE_X)[index] = size.x_;
+    particles_.GetStream(P_SIZE_Y)[index] = size.y_;
+    particles_.GetStream(P_TIMER)[index] = 0.0f;
+    particles_.GetStream(P_TIME_TO_LIVE)[index] = timeToLive;
+    particles_.GetStream(P_SCALE)[index] = 1.0f;
+    particles_.GetStream(P_ROTATION)[index] = effect_->GetRandomRotation();
+    particles_.GetStream(P_ROTATION_SPEED)[index] = rotationSpeed;
+    particles_.GetUIntStream(P_COLOR_INDEX)[index] = 0;
+    particles_.GetUIntStream(P_TEX_INDEX)[index] = 0;
 
     return true;
 }
 
-unsigned ParticleEmitter::GetFreeParticle() const
-{
-    for (unsigned i = 0; i < billboards_.Size(); ++i)
-    {
-        if (!billboards_[i].enabled_)
-            return i;
-    }
-
-    return M_MAX_UNSIGNED;
-}
-
 void ParticleEmitter::HandleScenePostUpdate(StringHash eventType, VariantMap& eventData)
 {
     // Store scene's timestep and use it instead of global timestep, as time scale may be other than 1
@@ -23,13 +23,14 @@
 #pragma once
 
 #include "../Graphics/BillboardSet.h"
+#include "../Graphics/ParticleBuffer.h"
 
 namespace Clockwork
 {
 
 class ParticleEffect;
 
-/// One particle in the particle system.
+/// One particle in the particle system, as stored in the particles attribute.
 struct Particle
 {
     /// Velocity.
@@ -63,6 +64,8 @@ public:
     /// Register object factory.
     static void RegisterObject(Context* context);
 
+    /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
+    virtual void ApplyAttributes();
     /// Handle enabled/disabled state change.
     virtual void OnSetEnabled();
     /// Update before octree reinsertion. Is called from a worker thread.
@@ -89,7 +92,7 @@ public:
     ParticleEffect* GetEffect() const { return effect_; }
 
     /// Return maximum number of particles.
-    unsigned GetNumParticles() const { return particles_.Size(); }
+    unsigned GetNumParticles() const { return particles_.GetMaxParticles(); }
 
     /// Return whether is currently emitting.
     bool IsEmitting() const { return emitting_; }
@@ -114,8 +117,6 @@ protected:
 
     /// Create a new particle. Return true if there was room.
     bool EmitNewParticle();
-    /// Return a free particle index.
-    unsigned GetFreeParticle() const;
 
 private:
     /// Handle scene post-update event.
@@ -125,8 +126,10 @@ private:
 
     /// Particle effect.
     SharedPtr<ParticleEffect> effect_;
-    /// Particles.
-    PODVector<Particle> particles_;
+    /// Live particles in structure-of-arrays form, packed to the start of the billboards.
+    ParticleBuffer particles_;
+    /// Particles from the particles attribute, to be matched with the billboards in ApplyAttributes().
+    PODVector<Particle> loadedParticles_;
     /// Active/inactive period timer.
     float periodTimer_;
     /// New particle emission timer.
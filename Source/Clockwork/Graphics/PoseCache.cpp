@@ -0,0 +1,118 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Graphics/Animation.h"
+#include "../Graphics/Model.h"
+#include "../Graphics/PoseCache.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+bool PoseKey::operator ==(const PoseKey& rhs) const
+{
+    if (model_ != rhs.model_ || numBones_ != rhs.numBones_ || states_.Size() != rhs.states_.Size())
+        return false;
+
+    for (unsigned i = 0; i < states_.Size(); ++i)
+    {
+        if (states_[i] != rhs.states_[i])
+            return false;
+    }
+
+    return true;
+}
+
+unsigned PoseKey::ToHash() const
+{
+    unsigned hash = MakeHash(model_) + numBones_;
+
+    for (PODVector<PoseKeyState>::ConstIterator i = states_.Begin(); i != states_.End(); ++i)
+    {
+        hash = hash * 31 + MakeHash(i->animation_);
+        hash = hash * 31 + i->startBone_;
+        hash = hash * 31 + (unsigned)i->time_;
+        hash = hash * 31 + (i->weight_ << 1 | (i->looped_ ? 1 : 0));
+    }
+
+    return hash;
+}
+
+PoseCache::PoseCache() :
+    numHits_(0)
+{
+}
+
+void PoseCache::Clear()
+{
+    MutexLock lock(poseMutex_);
+
+    poses_.Clear();
+    numHits_ = 0;
+}
+
+bool PoseCache::GetPose(const PoseKey& key, PODVector<Matrix3x4>& transforms, BoundingBox& boundingBox)
+{
+    MutexLock lock(poseMutex_);
+
+    HashMap<PoseKey, CachedPose>::ConstIterator i = poses_.Find(key);
+    if (i == poses_.End() || i->second_.transforms_.Size() != transforms.Size())
+        return false;
+
+    const PODVector<Matrix3x4>& cached = i->second_.transforms_;
+    for (unsigned j = 0; j < transforms.Size(); ++j)
+        transforms[j] = cached[j];
+    boundingBox = i->second_.boundingBox_;
+    ++numHits_;
+    return true;
+}
+
+void PoseCache::StorePose(const PoseKey& key, const PODVector<Matrix3x4>& transforms, const BoundingBox& boundingBox)
+{
+    MutexLock lock(poseMutex_);
+
+    // Another instance may have evaluated the same pose concurrently. Either result is valid
+    if (poses_.Contains(key))
+        return;
+
+    CachedPose& pose = poses_[key];
+    pose.transforms_ = transforms;
+    pose.boundingBox_ = boundingBox;
+}
+
+unsigned PoseCache::GetNumPoses() const
+{
+    MutexLock lock(poseMutex_);
+    return poses_.Size();
+}
+
+unsigned PoseCache::GetNumHits() const
+{
+    MutexLock lock(poseMutex_);
+    return numHits_;
+}
+
+}
@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/HashMap.h"
+#include "../Core/Mutex.h"
+#include "../Math/BoundingBox.h"
+#include "../Math/Matrix3x4.h"
+
+namespace Clockwork
+{
+
+class Animation;
+class Model;
+
+/// Time step that animation state times are quantized to when looking up shared poses.
+static const float POSE_CACHE_TIME_STEP = 1.0f / 60.0f;
+
+/// Animation state parameters that determine an evaluated pose.
+struct PoseKeyState
+{
+    /// Test for equality with another key state.
+    bool operator ==(const PoseKeyState& rhs) const
+    {
+        return animation_ == rhs.animation_ && startBone_ == rhs.startBone_ && time_ == rhs.time_ && weight_ == rhs.weight_ &&
+            looped_ == rhs.looped_;
+    }
+
+    /// Test for inequality with another key state.
+    bool operator !=(const PoseKeyState& rhs) const { return !(*this == rhs); }
+
+    /// Animation.
+    Animation* animation_;
+    /// Start bone index.
+    unsigned startBone_;
+    /// Time quantized to POSE_CACHE_TIME_STEP.
+    int time_;
+    /// Blending weight quantized to 8 bits.
+    unsigned weight_;
+    /// Looped flag.
+    bool looped_;
+};
+
+/// Key identifying a pose evaluated from a model's skeleton and a set of animation states.
+struct CLOCKWORK_API PoseKey
+{
+    /// Construct empty.
+    PoseKey() :
+        model_(0),
+        numBones_(0)
+    {
+    }
+
+    /// Test for equality with another key.
+    bool operator ==(const PoseKey& rhs) const;
+    /// Test for inequality with another key.
+    bool operator !=(const PoseKey& rhs) const { return !(*this == rhs); }
+    /// Return hash value for HashMap.
+    unsigned ToHash() const;
+
+    /// Model that defines the skeleton.
+    Model* model_;
+    /// Number of bones animated at the current bone LOD.
+    unsigned numBones_;
+    /// Animation states in blending order.
+    PODVector<PoseKeyState> states_;
+};
+
+/// Pose shared between identical animated model instances.
+struct CachedPose
+{
+    /// Model-space bone transforms.
+    PODVector<Matrix3x4> transforms_;
+    /// Model-space bounding box of the bones.
+    BoundingBox boundingBox_;
+};
+
+/// Per-scene cache of evaluated skeletal poses, which lets animated models showing the same animation frame skip sampling and blending. Accessed from the drawable update worker threads.
+class CLOCKWORK_API PoseCache
+{
+public:
+    /// Construct.
+    PoseCache();
+
+    /// Remove all poses. Called at the start of each frame's drawable update.
+    void Clear();
+    /// Copy a pose to the destination if it exists. Return true if found.
+    bool GetPose(const PoseKey& key, PODVector<Matrix3x4>& transforms, BoundingBox& boundingBox);
+    /// Store a pose. If the pose already exists, the existing one is kept.
+    void StorePose(const PoseKey& key, const PODVector<Matrix3x4>& transforms, const BoundingBox& boundingBox);
+
+    /// Return number of poses stored since the last clear.
+    unsigned GetNumPoses() const;
+    /// Return number of successful lookups since the last clear.
+    unsigned GetNumHits() const;
+
+private:
+    /// Poses.
+    HashMap<PoseKey, CachedPose> poses_;
+    /// Mutex for worker thread access.
+    mutable Mutex poseMutex_;
+    /// Number of successful lookups.
+    unsigned numHits_;
+};
+
+}
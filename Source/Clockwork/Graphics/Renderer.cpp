@@ -270,6 +270,7 @@ Renderer::Renderer(Context* context) :
     maxOccluderTriangles_(5000),
     occlusionBufferSize_(256),
     occluderSizeThreshold_(0.025f),
+    animationBudget_(0.0f),
     mobileShadowBiasMul_(2.0f),
     mobileShadowBiasAdd_(0.0001f),
     numOcclusionBuffers_(0),
@@ -280,6 +281,7 @@ Renderer::Renderer(Context* context) :
     drawShadows_(true),
     reuseShadowMaps_(true),
     dynamicInstancing_(true),
+    temporalOcclusion_(false),
     shadersDirty_(true),
     initialized_(false),
     resetViews_(false)
@@ -473,6 +475,16 @@ void Renderer::SetOccluderSizeThreshold(float screenSize)
     occluderSizeThreshold_ = Max(screenSize, 0.0f);
 }
 
+void Renderer::SetTemporalOcclusion(bool enable)
+{
+    temporalOcclusion_ = enable;
+}
+
+void Renderer::SetAnimationBudget(float milliseconds)
+{
+    animationBudget_ = Max(milliseconds, 0.0f);
+}
+
 void Renderer::ReloadShaders()
 {
     shadersDirty_ = true;
@@ -552,6 +564,20 @@ unsigned Renderer::GetNumOccluders(bool allViews) const
     return numOccluders;
 }
 
+unsigned Renderer::GetNumOccludedDrawables(bool allViews) const
+{
+    unsigned numOccluded = 0;
+    unsigned lastView = allViews ? views_.Size() : 1;
+
+    for (unsigned i = 0; i < lastView; ++i)
+    {
+        if (views_[i])
+            numOccluded += views_[i]->GetNumOccludedDrawables();
+    }
+
+    return numOccluded;
+}
+
 void Renderer::Update(float timeStep)
 {
     PROFILE(UpdateViews);
@@ -1161,9 +1187,10 @@ void Renderer::SetBatchShaders(Batch& batch, Technique* tech, bool allowShadows)
         }
     }
 
-    // Log error if shaders could not be assigned, but only once per technique
+    // Log error if shaders could not be assigned, but only once per technique. Batches may be built in worker threads
     if (!batch.vertexShader_ || !batch.pixelShader_)
     {
+        MutexLock lock(rendererMutex_);
         if (!shaderErrorDisplayed_.Contains(tech))
         {
             shaderErrorDisplayed_.Insert(tech);
@@ -1172,6 +1199,12 @@ void Renderer::SetBatchShaders(Batch& batch, Technique* tech, bool allowShadows)
     }
 }
 
+bool Renderer::HasPassShaders(Pass* pass) const
+{
+    return pass->GetVertexShaders().Size() && pass->GetPixelShaders().Size() &&
+           pass->GetShadersLoadedFrameNumber() == shadersChangedFrameNumber_;
+}
+
 void Renderer::SetLightVolumeBatchShaders(Batch& batch, const String& vsName, const String& psName, const String& vsDefines,
     const String& psDefines)
 {
@@ -200,6 +200,10 @@ public:
     void SetOcclusionBufferSize(int size);
     /// Set required screen size (1.0 = full screen) for occluders.
     void SetOccluderSizeThreshold(float screenSize);
+    /// Set temporal occlusion on/off. When on, each view reprojects the previous frame's occluder depth into the current camera and merges it with the current occluders. Default false.
+    void SetTemporalOcclusion(bool enable);
+    /// Set time budget in milliseconds for the per-frame drawable update, which is dominated by animation. When exceeded, animation LOD distances are scaled up so that distant models update less often. 0 (default) disables.
+    void SetAnimationBudget(float milliseconds);
     /// Set shadow depth bias multiplier for mobile platforms (OpenGL ES.) No effect on desktops. Default 2.
     void SetMobileShadowBiasMul(float mul);
     /// Set shadow depth bias addition for mobile platforms (OpenGL ES.)  No effect on desktops. Default 0.0001.
@@ -266,6 +270,12 @@ public:
     /// Return occluder screen size threshold.
     float GetOccluderSizeThreshold() const { return occluderSizeThreshold_; }
 
+    /// Return whether temporal occlusion is enabled.
+    bool GetTemporalOcclusion() const { return temporalOcclusion_; }
+
+    /// Return animation time budget in milliseconds.
+    float GetAnimationBudget() const { return animationBudget_; }
+
     /// Return shadow depth bias multiplier for mobile platforms.
     float GetMobileShadowBiasMul() const { return mobileShadowBiasMul_; }
 
@@ -289,6 +299,8 @@ public:
     unsigned GetNumShadowMaps(bool allViews = false) const;
     /// Return number of occluders rendered.
     unsigned GetNumOccluders(bool allViews = false) const;
+    /// Return number of drawables culled by occlusion.
+    unsigned GetNumOccludedDrawables(bool allViews = false) const;
 
     /// Return the default zone.
     Zone* GetDefaultZone() const { return defaultZone_; }
@@ -314,6 +326,11 @@ public:
     /// Return the frame update parameters.
     const FrameInfo& GetFrameInfo() const { return frame_; }
 
+    /// Return frame number on which shaders last changed.
+    unsigned GetShadersChangedFrameNumber() const { return shadersChangedFrameNumber_; }
+    /// Return whether a pass has its shaders loaded and up to date, so that batch shaders can be chosen without loading. Can be called from worker threads.
+    bool HasPassShaders(Pass* pass) const;
+
     /// Update for rendering. Called by HandleRenderUpdate().
     void Update(float timeStep);
     /// Render. Called by Engine.
@@ -446,7 +463,7 @@ private:
     HashSet<Octree*> updatedOctrees_;
     /// Techniques for which missing shader error has been displayed.
     HashSet<Technique*> shaderErrorDisplayed_;
-    /// Mutex for shadow camera allocation.
+    /// Mutex for shadow camera allocation and missing shader error logging.
     Mutex rendererMutex_;
     /// Current variation names for deferred light volume shaders.
     Vector<String> deferredLightPSVariations_;
@@ -476,6 +493,8 @@ private:
     int occlusionBufferSize_;
     /// Occluder screen size threshold.
     float occluderSizeThreshold_;
+    /// Animation time budget in milliseconds.
+    float animationBudget_;
     /// Mobile platform shadow depth bias multiplier.
     float mobileShadowBiasMul_;
     /// Mobile platform shadow depth bias addition.
@@ -502,6 +521,8 @@ private:
     bool reuseShadowMaps_;
     /// Dynamic instancing flag.
     bool dynamicInstancing_;
+    /// Temporal occlusion flag.
+    bool temporalOcclusion_;
     /// Shaders need reloading flag.
     bool shadersDirty_;
     /// Initialized flag.
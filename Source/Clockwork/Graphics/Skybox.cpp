@@ -50,6 +50,8 @@ void Skybox::RegisterObject(Context* context)
     context->RegisterFactory<Skybox>(GEOMETRY_CATEGORY);
 
     COPY_BASE_ATTRIBUTES(StaticModel);
+    REMOVE_ATTRIBUTE("Impostor");
+    REMOVE_ATTRIBUTE("Impostor Distance");
 }
 
 void Skybox::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
@@ -28,6 +28,7 @@
 #include "../Graphics/Batch.h"
 #include "../Graphics/Camera.h"
 #include "../Graphics/Geometry.h"
+#include "../Graphics/Impostor.h"
 #include "../Graphics/Material.h"
 #include "../Graphics/OcclusionBuffer.h"
 #include "../Graphics/OctreeQuery.h"
@@ -46,7 +47,9 @@ extern const char* GEOMETRY_CATEGORY;
 StaticModel::StaticModel(Context* context) :
     Drawable(context, DRAWABLE_GEOMETRY),
     occlusionLodLevel_(M_MAX_UNSIGNED),
-    materialsAttr_(Material::GetTypeStatic())
+    materialsAttr_(Material::GetTypeStatic()),
+    impostorDistance_(0.0f),
+    impostorActive_(false)
 {
 }
 
@@ -70,6 +73,9 @@ void StaticModel::RegisterObject(Context* context)
     ACCESSOR_ATTRIBUTE("LOD Bias", GetLodBias, SetLodBias, float, 1.0f, AM_DEFAULT);
     COPY_BASE_ATTRIBUTES(Drawable);
     ATTRIBUTE("Occlusion LOD Level", int, occlusionLodLevel_, M_MAX_UNSIGNED, AM_DEFAULT);
+    MIXED_ACCESSOR_ATTRIBUTE("Impostor", GetImpostorAttr, SetImpostorAttr, ResourceRef, ResourceRef(Impostor::GetTypeStatic()),
+        AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Impostor Distance", GetImpostorDistance, SetImpostorDistance, float, 0.0f, AM_DEFAULT);
 }
 
 void StaticModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
@@ -96,9 +102,9 @@ void StaticModel::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQuer
         {
             distance = M_INFINITY;
 
-            for (unsigned i = 0; i < batches_.Size(); ++i)
+            for (unsigned i = 0; i < geometries_.Size(); ++i)
             {
-                Geometry* geometry = batches_[i].geometry_;
+                Geometry* geometry = GetModelGeometry(i);
                 if (geometry)
                 {
                     Vector3 geometryNormal;
@@ -135,12 +141,12 @@ void StaticModel::UpdateBatches(const FrameInfo& frame)
     const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
     distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
 
-    if (batches_.Size() == 1)
+    if (geometries_.Size() == 1)
         batches_[0].distance_ = distance_;
     else
     {
         const Matrix3x4& worldTransform = node_->GetWorldTransform();
-        for (unsigned i = 0; i < batches_.Size(); ++i)
+        for (unsigned i = 0; i < geometries_.Size(); ++i)
             batches_[i].distance_ = frame.camera_->GetDistance(worldTransform * geometryData_[i].center_);
     }
 
@@ -152,6 +158,9 @@ void StaticModel::UpdateBatches(const FrameInfo& frame)
         lodDistance_ = newLodDistance;
         CalculateLodLevels();
     }
+
+    if (impostor_)
+        CalculateImpostor(frame);
 }
 
 Geometry* StaticModel::GetLodGeometry(unsigned batchIndex, unsigned level)
@@ -163,14 +172,14 @@ Geometry* StaticModel::GetLodGeometry(unsigned batchIndex, unsigned level)
     if (level < geometries_[batchIndex].Size())
         return geometries_[batchIndex][level];
     else
-        return batches_[batchIndex].geometry_;
+        return GetModelGeometry(batchIndex);
 }
 
 unsigned StaticModel::GetNumOccluderTriangles()
 {
     unsigned triangles = 0;
 
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         Geometry* geometry = GetLodGeometry(i, occlusionLodLevel_);
         if (!geometry)
@@ -189,7 +198,7 @@ unsigned StaticModel::GetNumOccluderTriangles()
 
 bool StaticModel::DrawOcclusion(OcclusionBuffer* buffer)
 {
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         Geometry* geometry = GetLodGeometry(i, occlusionLodLevel_);
         if (!geometry)
@@ -273,12 +282,13 @@ void StaticModel::SetModel(Model* model)
         SetBoundingBox(BoundingBox());
     }
 
+    UpdateImpostorBatch();
     MarkNetworkUpdate();
 }
 
 void StaticModel::SetMaterial(Material* material)
 {
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
         batches_[i].material_ = material;
 
     MarkNetworkUpdate();
@@ -286,7 +296,7 @@ void StaticModel::SetMaterial(Material* material)
 
 bool StaticModel::SetMaterial(unsigned index, Material* material)
 {
-    if (index >= batches_.Size())
+    if (index >= geometries_.Size())
     {
         LOGERROR("Material index out of bounds");
         return false;
@@ -303,6 +313,37 @@ void StaticModel::SetOcclusionLodLevel(unsigned level)
     MarkNetworkUpdate();
 }
 
+void StaticModel::SetImpostor(Impostor* impostor)
+{
+    if (impostor == impostor_)
+        return;
+
+    // The impostor batch is kept after the model batches, which the subclasses do not expect
+    if (impostor && GetType() != StaticModel::GetTypeStatic())
+    {
+        LOGERROR("Impostors are only supported by StaticModel");
+        return;
+    }
+
+    // Unsubscribe from the reload event of previous impostor (if any), then subscribe to the new
+    if (impostor_)
+        UnsubscribeFromEvent(impostor_, E_RELOADFINISHED);
+
+    impostor_ = impostor;
+
+    if (impostor_)
+        SubscribeToEvent(impostor_, E_RELOADFINISHED, HANDLER(StaticModel, HandleImpostorReloadFinished));
+
+    UpdateImpostorBatch();
+    MarkNetworkUpdate();
+}
+
+void StaticModel::SetImpostorDistance(float distance)
+{
+    impostorDistance_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
 void StaticModel::ApplyMaterialList(const String& fileName)
 {
     String useFileName = fileName;
@@ -315,7 +356,7 @@ void StaticModel::ApplyMaterialList(const String& fileName)
         return;
 
     unsigned index = 0;
-    while (!file->IsEof() && index < batches_.Size())
+    while (!file->IsEof() && index < geometries_.Size())
     {
         Material* material = cache->GetResource<Material>(file->ReadLine());
         if (material)
@@ -327,7 +368,7 @@ void StaticModel::ApplyMaterialList(const String& fileName)
 
 Material* StaticModel::GetMaterial(unsigned index) const
 {
-    return index < batches_.Size() ? batches_[index].material_ : (Material*)0;
+    return index < geometries_.Size() ? batches_[index].material_ : (Material*)0;
 }
 
 bool StaticModel::IsInside(const Vector3& point) const
@@ -347,9 +388,9 @@ bool StaticModel::IsInsideLocal(const Vector3& point) const
 
     Ray localRay(point, Vector3(1.0f, -1.0f, 1.0f));
 
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
-        Geometry* geometry = batches_[i].geometry_;
+        Geometry* geometry = GetModelGeometry(i);
         if (geometry)
         {
             if (geometry->IsInside(localRay))
@@ -368,6 +409,9 @@ void StaticModel::SetBoundingBox(const BoundingBox& box)
 
 void StaticModel::SetNumGeometries(unsigned num)
 {
+    // Drop the impostor batch first, so that it does not turn into a model batch
+    if (batches_.Size() > geometries_.Size())
+        batches_.Resize(geometries_.Size());
     batches_.Resize(num);
     geometries_.Resize(num);
     geometryData_.Resize(num);
@@ -387,6 +431,12 @@ void StaticModel::SetMaterialsAttr(const ResourceRefList& value)
         SetMaterial(i, cache->GetResource<Material>(value.names_[i]));
 }
 
+void StaticModel::SetImpostorAttr(const ResourceRef& value)
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    SetImpostor(cache->GetResource<Impostor>(value.name_));
+}
+
 ResourceRef StaticModel::GetModelAttr() const
 {
     return GetResourceRef(model_, Model::GetTypeStatic());
@@ -394,13 +444,18 @@ ResourceRef StaticModel::GetModelAttr() const
 
 const ResourceRefList& StaticModel::GetMaterialsAttr() const
 {
-    materialsAttr_.names_.Resize(batches_.Size());
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    materialsAttr_.names_.Resize(geometries_.Size());
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
         materialsAttr_.names_[i] = GetResourceName(batches_[i].material_);
 
     return materialsAttr_;
 }
 
+ResourceRef StaticModel::GetImpostorAttr() const
+{
+    return GetResourceRef(impostor_, Impostor::GetTypeStatic());
+}
+
 void StaticModel::OnWorldBoundingBoxUpdate()
 {
     worldBoundingBox_ = boundingBox_.Transformed(node_->GetWorldTransform());
@@ -409,7 +464,7 @@ void StaticModel::OnWorldBoundingBoxUpdate()
 void StaticModel::ResetLodLevels()
 {
     // Ensure that each subgeometry has at least one LOD level, and reset the current LOD level
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         if (!geometries_[i].Size())
             geometries_[i].Resize(1);
@@ -417,13 +472,18 @@ void StaticModel::ResetLodLevels()
         geometryData_[i].lodLevel_ = 0;
     }
 
+    // Draw the model until the impostor is chosen again
+    if (batches_.Size() > geometries_.Size())
+        batches_.Back().geometry_ = 0;
+    impostorActive_ = false;
+
     // Find out the real LOD levels on next geometry update
     lodDistance_ = M_INFINITY;
 }
 
 void StaticModel::CalculateLodLevels()
 {
-    for (unsigned i = 0; i < batches_.Size(); ++i)
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
         const Vector<SharedPtr<Geometry> >& batchGeometries = geometries_[i];
         // If only one LOD geometry, no reason to go through the LOD calculation
@@ -442,11 +502,81 @@ void StaticModel::CalculateLodLevels()
         if (geometryData_[i].lodLevel_ != newLodLevel)
         {
             geometryData_[i].lodLevel_ = newLodLevel;
-            batches_[i].geometry_ = batchGeometries[newLodLevel];
+            if (!impostorActive_)
+                batches_[i].geometry_ = batchGeometries[newLodLevel];
+        }
+    }
+}
+
+void StaticModel::CalculateImpostor(const FrameInfo& frame)
+{
+    unsigned numGeometries = geometries_.Size();
+    if (batches_.Size() <= numGeometries)
+        return;
+
+    SourceBatch& impostorBatch = batches_[numGeometries];
+    impostorBatch.distance_ = distance_;
+
+    if (impostorDistance_ > 0.0f && numGeometries && lodDistance_ >= impostorDistance_)
+    {
+        // Only raw pointers are written here, as this may be called from several worker threads at once
+        if (!impostorActive_)
+        {
+            for (unsigned i = 0; i < numGeometries; ++i)
+                batches_[i].geometry_ = 0;
+            impostorActive_ = true;
         }
+
+        // Choose the frame captured from the direction closest to the camera's, in model space
+        Matrix3x4 inverseTransform = node_->GetWorldTransform().Inverse();
+        Node* cameraNode = frame.camera_->GetNode();
+        Vector3 direction;
+        if (frame.camera_->IsOrthographic())
+            direction = inverseTransform * Vector4(-cameraNode->GetWorldDirection(), 0.0f);
+        else
+            direction = inverseTransform * cameraNode->GetWorldPosition() - impostor_->GetCenter();
+
+        impostorBatch.geometry_ = impostor_->GetFrameGeometry(direction);
+    }
+    else if (impostorActive_)
+    {
+        for (unsigned i = 0; i < numGeometries; ++i)
+            batches_[i].geometry_ = geometries_[i][geometryData_[i].lodLevel_];
+        impostorBatch.geometry_ = 0;
+        impostorActive_ = false;
+    }
+}
+
+void StaticModel::UpdateImpostorBatch()
+{
+    unsigned numGeometries = geometries_.Size();
+
+    // Return to drawing the model
+    if (impostorActive_)
+    {
+        for (unsigned i = 0; i < numGeometries; ++i)
+            batches_[i].geometry_ = geometries_[i][geometryData_[i].lodLevel_];
+        impostorActive_ = false;
+    }
+
+    batches_.Resize(impostor_ ? numGeometries + 1 : numGeometries);
+    if (impostor_)
+    {
+        SourceBatch& impostorBatch = batches_[numGeometries];
+        impostorBatch.geometry_ = 0;
+        impostorBatch.material_ = impostor_->GetMaterial();
+        impostorBatch.worldTransform_ = node_ ? &node_->GetWorldTransform() : &Matrix3x4::IDENTITY;
     }
 }
 
+Geometry* StaticModel::GetModelGeometry(unsigned batchIndex) const
+{
+    if (impostorActive_)
+        return geometries_[batchIndex][geometryData_[batchIndex].lodLevel_];
+    else
+        return batches_[batchIndex].geometry_;
+}
+
 void StaticModel::HandleModelReloadFinished(StringHash eventType, VariantMap& eventData)
 {
     Model* currentModel = model_;
@@ -454,4 +584,9 @@ void StaticModel::HandleModelReloadFinished(StringHash eventType, VariantMap& ev
     SetModel(currentModel);
 }
 
+void StaticModel::HandleImpostorReloadFinished(StringHash eventType, VariantMap& eventData)
+{
+    UpdateImpostorBatch();
+}
+
 }
@@ -27,6 +27,7 @@
 namespace Clockwork
 {
 
+class Impostor;
 class Model;
 
 /// Static model per-geometry extra data.
@@ -70,6 +71,10 @@ public:
     bool SetMaterial(unsigned index, Material* material);
     /// Set occlusion LOD level. By default (M_MAX_UNSIGNED) same as visible.
     void SetOcclusionLodLevel(unsigned level);
+    /// Set impostor to draw instead of the model beyond the impostor distance.
+    void SetImpostor(Impostor* impostor);
+    /// Set LOD distance beyond which the impostor is drawn. 0 disables.
+    void SetImpostorDistance(float distance);
     /// Apply default materials from a material list file. If filename is empty (default), the model's resource name with extension .txt will be used.
     void ApplyMaterialList(const String& fileName = String::EMPTY);
 
@@ -85,6 +90,15 @@ public:
     /// Return occlusion LOD level.
     unsigned GetOcclusionLodLevel() const { return occlusionLodLevel_; }
 
+    /// Return impostor.
+    Impostor* GetImpostor() const { return impostor_; }
+
+    /// Return impostor distance.
+    float GetImpostorDistance() const { return impostorDistance_; }
+
+    /// Return whether the impostor is currently drawn instead of the model.
+    bool IsImpostorActive() const { return impostorActive_; }
+
     /// Determines if the given world space point is within the model geometry.
     bool IsInside(const Vector3& point) const;
     /// Determines if the given local space point is within the model geometry.
@@ -94,10 +108,14 @@ public:
     void SetModelAttr(const ResourceRef& value);
     /// Set materials attribute.
     void SetMaterialsAttr(const ResourceRefList& value);
+    /// Set impostor attribute.
+    void SetImpostorAttr(const ResourceRef& value);
     /// Return model attribute.
     ResourceRef GetModelAttr() const;
     /// Return materials attribute.
     const ResourceRefList& GetMaterialsAttr() const;
+    /// Return impostor attribute.
+    ResourceRef GetImpostorAttr() const;
 
 protected:
     /// Recalculate the world-space bounding box.
@@ -110,6 +128,12 @@ protected:
     void ResetLodLevels();
     /// Choose LOD levels based on distance.
     void CalculateLodLevels();
+    /// Switch between the model and the impostor based on distance, and choose the impostor frame facing the camera.
+    void CalculateImpostor(const FrameInfo& frame);
+    /// Add or remove the impostor batch after the model batches.
+    void UpdateImpostorBatch();
+    /// Return the model geometry in use for a batch, also while the impostor is drawn instead.
+    Geometry* GetModelGeometry(unsigned batchIndex) const;
 
     /// Extra per-geometry data.
     PODVector<StaticModelGeometryData> geometryData_;
@@ -121,10 +145,18 @@ protected:
     unsigned occlusionLodLevel_;
     /// Material list attribute.
     mutable ResourceRefList materialsAttr_;
+    /// Impostor.
+    SharedPtr<Impostor> impostor_;
+    /// Impostor distance.
+    float impostorDistance_;
+    /// Impostor drawn flag.
+    bool impostorActive_;
 
 private:
     /// Handle model reload finished.
     void HandleModelReloadFinished(StringHash eventType, VariantMap& eventData);
+    /// Handle impostor reload finished.
+    void HandleImpostorReloadFinished(StringHash eventType, VariantMap& eventData);
 };
 
 }
@@ -0,0 +1,424 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Core/Context.h"
+#include "../Graphics/Batch.h"
+#include "../Graphics/Camera.h"
+#include "../Graphics/Geometry.h"
+#include "../Graphics/Material.h"
+#include "../Graphics/Model.h"
+#include "../Graphics/OcclusionBuffer.h"
+#include "../Graphics/OctreeQuery.h"
+#include "../Graphics/StaticModelCluster.h"
+#include "../Graphics/StaticModelGroup.h"
+#include "../Scene/Node.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+StaticModelCluster::StaticModelCluster(Context* context) :
+    Drawable(context, DRAWABLE_GEOMETRY),
+    numEnabled_(0)
+{
+}
+
+StaticModelCluster::~StaticModelCluster()
+{
+}
+
+void StaticModelCluster::RegisterObject(Context* context)
+{
+    context->RegisterFactory<StaticModelCluster>();
+}
+
+void StaticModelCluster::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
+{
+    if (!owner_)
+        return;
+
+    // Report hits as belonging to the owner group, so that the clusters stay an implementation detail
+    RayQueryLevel level = query.level_;
+    if (level < RAY_AABB)
+    {
+        float distance = query.ray_.HitDistance(GetWorldBoundingBox());
+        if (distance < query.maxDistance_)
+        {
+            RayQueryResult result;
+            result.position_ = query.ray_.origin_ + distance * query.ray_.direction_;
+            result.normal_ = -query.ray_.direction_;
+            result.distance_ = distance;
+            result.drawable_ = owner_;
+            result.node_ = owner_->GetNode();
+            result.subObject_ = M_MAX_UNSIGNED;
+            results.Push(result);
+        }
+        return;
+    }
+
+    // GetWorldBoundingBox() updates the world transforms
+    if (query.ray_.HitDistance(GetWorldBoundingBox()) >= query.maxDistance_)
+        return;
+
+    for (unsigned i = 0; i < worldTransforms_.Size(); ++i)
+    {
+        if (!instanceEnabled_[i])
+            continue;
+
+        // Initial test using AABB
+        float distance = query.ray_.HitDistance(instanceBoxes_[i]);
+        Vector3 normal = -query.ray_.direction_;
+
+        // Then proceed to OBB and triangle-level tests if necessary
+        if (level >= RAY_OBB && distance < query.maxDistance_)
+        {
+            Matrix3x4 inverse = worldTransforms_[i].Inverse();
+            Ray localRay = query.ray_.Transformed(inverse);
+            distance = localRay.HitDistance(modelBoundingBox_);
+
+            if (level == RAY_TRIANGLE && distance < query.maxDistance_)
+            {
+                distance = M_INFINITY;
+
+                for (unsigned j = 0; j < batches_.Size(); ++j)
+                {
+                    Geometry* geometry = batches_[j].geometry_;
+                    if (geometry)
+                    {
+                        Vector3 geometryNormal;
+                        float geometryDistance = geometry->GetHitDistance(localRay, &geometryNormal);
+                        if (geometryDistance < query.maxDistance_ && geometryDistance < distance)
+                        {
+                            distance = geometryDistance;
+                            normal = (worldTransforms_[i] * Vector4(geometryNormal, 0.0f)).Normalized();
+                        }
+                    }
+                }
+            }
+        }
+
+        if (distance < query.maxDistance_)
+        {
+            RayQueryResult result;
+            result.position_ = query.ray_.origin_ + distance * query.ray_.direction_;
+            result.normal_ = normal;
+            result.distance_ = distance;
+            result.drawable_ = owner_;
+            result.node_ = owner_->GetNode();
+            result.subObject_ = instanceIndices_[i];
+            results.Push(result);
+        }
+    }
+}
+
+void StaticModelCluster::UpdateBatches(const FrameInfo& frame)
+{
+    // Getting the world bounding box ensures the transforms are updated
+    const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
+    distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
+
+    Model* model = owner_ ? owner_->GetModel() : (Model*)0;
+    unsigned numGeometries = model ? model->GetNumGeometries() : 0;
+
+    const Matrix3x4* transforms = &Matrix3x4::IDENTITY;
+    if (numEnabled_)
+        transforms = numEnabled_ < worldTransforms_.Size() ? &enabledTransforms_[0] : &worldTransforms_[0];
+
+    // Batches beyond the owner's current geometry count are left over from a model change and are resized on the main thread
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        batches_[i].distance_ = distance_;
+        batches_[i].worldTransform_ = transforms;
+        batches_[i].numWorldTransforms_ = i < numGeometries ? numEnabled_ : 0;
+    }
+
+    // Select the LOD level by the size of a single instance, not the whole cluster
+    if (numEnabled_)
+    {
+        float scale = modelBoundingBox_.Transformed(*transforms).Size().DotProduct(DOT_SCALE);
+        lodDistance_ = frame.camera_->GetLodDistance(distance_, scale, owner_->GetLodBias());
+        CalculateLodLevels();
+    }
+}
+
+Geometry* StaticModelCluster::GetLodGeometry(unsigned batchIndex, unsigned level)
+{
+    Model* model = owner_ ? owner_->GetModel() : (Model*)0;
+    if (!model || batchIndex >= batches_.Size())
+        return 0;
+
+    // If level is out of range, use visible geometry
+    const Vector<Vector<SharedPtr<Geometry> > >& geometries = model->GetGeometries();
+    if (batchIndex < geometries.Size() && level < geometries[batchIndex].Size())
+        return geometries[batchIndex][level];
+    else
+        return batches_[batchIndex].geometry_;
+}
+
+unsigned StaticModelCluster::GetNumOccluderTriangles()
+{
+    if (!owner_)
+        return 0;
+
+    // Make sure instance transforms are up-to-date
+    GetWorldBoundingBox();
+
+    unsigned occlusionLodLevel = owner_->GetOcclusionLodLevel();
+    unsigned triangles = 0;
+
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        Geometry* geometry = GetLodGeometry(i, occlusionLodLevel);
+        if (!geometry)
+            continue;
+
+        // Check that the material is suitable for occlusion (default material always is)
+        Material* mat = batches_[i].material_;
+        if (mat && !mat->GetOcclusion())
+            continue;
+
+        triangles += numEnabled_ * geometry->GetIndexCount() / 3;
+    }
+
+    return triangles;
+}
+
+bool StaticModelCluster::DrawOcclusion(OcclusionBuffer* buffer)
+{
+    if (!owner_)
+        return true;
+
+    // Make sure instance transforms are up-to-date
+    GetWorldBoundingBox();
+
+    unsigned occlusionLodLevel = owner_->GetOcclusionLodLevel();
+
+    for (unsigned i = 0; i < worldTransforms_.Size(); ++i)
+    {
+        if (!instanceEnabled_[i])
+            continue;
+
+        for (unsigned j = 0; j < batches_.Size(); ++j)
+        {
+            Geometry* geometry = GetLodGeometry(j, occlusionLodLevel);
+            if (!geometry)
+                continue;
+
+            // Check that the material is suitable for occlusion (default material always is) and set culling mode
+            Material* material = batches_[j].material_;
+            if (material)
+            {
+                if (!material->GetOcclusion())
+                    continue;
+                buffer->SetCullMode(material->GetCullMode());
+            }
+            else
+                buffer->SetCullMode(CULL_CCW);
+
+            const unsigned char* vertexData;
+            unsigned vertexSize;
+            const unsigned char* indexData;
+            unsigned indexSize;
+            unsigned elementMask;
+
+            geometry->GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+            // Check for valid geometry data
+            if (!vertexData || !indexData)
+                continue;
+
+            unsigned indexStart = geometry->GetIndexStart();
+            unsigned indexCount = geometry->GetIndexCount();
+
+            // Draw and check for running out of triangles
+            if (!buffer->Draw(worldTransforms_[i], vertexData, vertexSize, indexData, indexSize, indexStart, indexCount))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void StaticModelCluster::SetOwner(StaticModelGroup* owner)
+{
+    owner_ = owner;
+}
+
+void StaticModelCluster::AddInstance(Node* node, unsigned index)
+{
+    if (!node)
+        return;
+
+    instanceSlots_[node] = instanceNodes_.Size();
+    instanceNodes_.Push(WeakPtr<Node>(node));
+    instanceIndices_.Push(index);
+    worldTransforms_.Push(Matrix3x4::IDENTITY);
+    enabledTransforms_.Push(Matrix3x4::IDENTITY);
+    instanceBoxes_.Push(BoundingBox());
+    instanceEnabled_.Push(0);
+    instanceDirty_.Push(1);
+
+    // Listen to the instance node, so that only the instances that actually move need to be updated
+    node->AddListener(this);
+    Drawable::OnMarkedDirty(node);
+}
+
+void StaticModelCluster::UpdateFromOwner()
+{
+    if (!owner_)
+        return;
+
+    const Vector<SourceBatch>& ownerBatches = owner_->GetBatches();
+    if (batches_.Size() != ownerBatches.Size())
+        batches_.Resize(ownerBatches.Size());
+
+    // Materials are reference counted, so they are only copied here and not during the threaded batch update
+    for (unsigned i = 0; i < batches_.Size(); ++i)
+    {
+        if (batches_[i].material_ != ownerBatches[i].material_)
+            batches_[i].material_ = ownerBatches[i].material_;
+        batches_[i].geometryType_ = ownerBatches[i].geometryType_;
+    }
+
+    drawDistance_ = owner_->GetDrawDistance();
+    shadowDistance_ = owner_->GetShadowDistance();
+    lodBias_ = owner_->GetLodBias();
+    viewMask_ = owner_->GetViewMask();
+    lightMask_ = owner_->GetLightMask();
+    shadowMask_ = owner_->GetShadowMask();
+    zoneMask_ = owner_->GetZoneMask();
+    maxLights_ = owner_->GetMaxLights();
+    castShadows_ = owner_->GetCastShadows();
+    occluder_ = owner_->IsOccluder();
+    occludee_ = owner_->IsOccludee();
+
+    // If the model has changed, all instance bounding boxes need to be recalculated
+    if (owner_->GetBoundingBox() != modelBoundingBox_)
+        Drawable::OnMarkedDirty(node_);
+}
+
+StaticModelGroup* StaticModelCluster::GetOwner() const
+{
+    return owner_;
+}
+
+void StaticModelCluster::OnNodeSetEnabled(Node* node)
+{
+    OnMarkedDirty(node);
+}
+
+void StaticModelCluster::OnMarkedDirty(Node* node)
+{
+    if (node != node_)
+    {
+        HashMap<Node*, unsigned>::ConstIterator i = instanceSlots_.Find(node);
+        if (i != instanceSlots_.End())
+            instanceDirty_[i->second_] = 1;
+    }
+
+    Drawable::OnMarkedDirty(node);
+}
+
+void StaticModelCluster::OnWorldBoundingBoxUpdate()
+{
+    const BoundingBox& modelBox = owner_ ? owner_->GetBoundingBox() : modelBoundingBox_;
+    bool modelChanged = modelBox != modelBoundingBox_;
+    if (modelChanged)
+        modelBoundingBox_ = modelBox;
+
+    BoundingBox worldBox;
+    unsigned numEnabled = 0;
+    bool changed = false;
+
+    // Only instances that have moved or been enabled / disabled have their transforms and bounding boxes rewritten
+    for (unsigned i = 0; i < worldTransforms_.Size(); ++i)
+    {
+        if (instanceDirty_[i] || modelChanged)
+        {
+            Node* node = instanceNodes_[i];
+            bool enabled = node && node->IsEnabled();
+            if (enabled)
+            {
+                worldTransforms_[i] = node->GetWorldTransform();
+                instanceBoxes_[i] = modelBoundingBox_.Transformed(worldTransforms_[i]);
+            }
+
+            instanceEnabled_[i] = enabled ? 1 : 0;
+            instanceDirty_[i] = 0;
+            changed = true;
+        }
+
+        if (instanceEnabled_[i])
+        {
+            worldBox.Merge(instanceBoxes_[i]);
+            ++numEnabled;
+        }
+    }
+
+    // If some instances are disabled, the enabled transforms need to be compacted for rendering. The vector is not resized
+    // here, as this function may be called from multiple worker threads simultaneously
+    if (changed && numEnabled < worldTransforms_.Size())
+    {
+        unsigned index = 0;
+        for (unsigned i = 0; i < worldTransforms_.Size(); ++i)
+        {
+            if (instanceEnabled_[i])
+                enabledTransforms_[index++] = worldTransforms_[i];
+        }
+    }
+
+    worldBoundingBox_ = worldBox;
+    numEnabled_ = numEnabled;
+}
+
+void StaticModelCluster::CalculateLodLevels()
+{
+    Model* model = owner_ ? owner_->GetModel() : (Model*)0;
+    if (!model)
+        return;
+
+    const Vector<Vector<SharedPtr<Geometry> > >& geometries = model->GetGeometries();
+
+    for (unsigned i = 0; i < batches_.Size() && i < geometries.Size(); ++i)
+    {
+        const Vector<SharedPtr<Geometry> >& batchGeometries = geometries[i];
+        if (batchGeometries.Empty())
+        {
+            batches_[i].geometry_ = 0;
+            continue;
+        }
+
+        unsigned j;
+
+        for (j = 1; j < batchGeometries.Size(); ++j)
+        {
+            if (batchGeometries[j] && lodDistance_ <= batchGeometries[j]->GetLodDistance())
+                break;
+        }
+
+        batches_[i].geometry_ = batchGeometries[j - 1];
+    }
+}
+
+}
@@ -0,0 +1,106 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#pragma once
+
+#include "../Container/HashMap.h"
+#include "../Graphics/Drawable.h"
+
+namespace Clockwork
+{
+
+class StaticModelGroup;
+
+/// Spatial cluster of a StaticModelGroup's instances, culled, LOD-selected and occlusion tested as one unit.
+class CLOCKWORK_API StaticModelCluster : public Drawable
+{
+    OBJECT(StaticModelCluster);
+
+public:
+    /// Construct.
+    StaticModelCluster(Context* context);
+    /// Destruct.
+    virtual ~StaticModelCluster();
+    /// Register object factory.
+    static void RegisterObject(Context* context);
+
+    /// Process octree raycast. May be called from a worker thread.
+    virtual void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results);
+    /// Calculate distance and prepare batches for rendering. May be called from worker thread(s), possibly re-entrantly.
+    virtual void UpdateBatches(const FrameInfo& frame);
+    /// Return the geometry for a specific LOD level.
+    virtual Geometry* GetLodGeometry(unsigned batchIndex, unsigned level);
+    /// Return number of occlusion geometry triangles.
+    virtual unsigned GetNumOccluderTriangles();
+    /// Draw to occlusion buffer. Return true if did not run out of triangles.
+    virtual bool DrawOcclusion(OcclusionBuffer* buffer);
+
+    /// Set owner group.
+    void SetOwner(StaticModelGroup* owner);
+    /// Add an instance node. Index is the node's index in the owner group.
+    void AddInstance(Node* node, unsigned index);
+    /// Copy materials and drawable settings from the owner group. Called from the main thread.
+    void UpdateFromOwner();
+
+    /// Return owner group.
+    StaticModelGroup* GetOwner() const;
+
+    /// Return number of instances.
+    unsigned GetNumInstances() const { return instanceNodes_.Size(); }
+
+protected:
+    /// Handle scene node enabled status changing.
+    virtual void OnNodeSetEnabled(Node* node);
+    /// Handle node transform being dirtied.
+    virtual void OnMarkedDirty(Node* node);
+    /// Recalculate the world-space bounding box.
+    virtual void OnWorldBoundingBoxUpdate();
+
+private:
+    /// Select LOD geometries according to the current LOD distance.
+    void CalculateLodLevels();
+
+    /// Owner group.
+    WeakPtr<StaticModelGroup> owner_;
+    /// Instance nodes.
+    Vector<WeakPtr<Node> > instanceNodes_;
+    /// Instance indices in the owner group.
+    PODVector<unsigned> instanceIndices_;
+    /// Slot of each instance node.
+    HashMap<Node*, unsigned> instanceSlots_;
+    /// Cached world transforms of all instances. Only rewritten for instances that have moved.
+    PODVector<Matrix3x4> worldTransforms_;
+    /// Cached world bounding boxes of all instances.
+    PODVector<BoundingBox> instanceBoxes_;
+    /// Per-instance enabled flags.
+    PODVector<unsigned char> instanceEnabled_;
+    /// Per-instance dirty flags.
+    PODVector<unsigned char> instanceDirty_;
+    /// World transforms of enabled instances, used when some instances are disabled.
+    PODVector<Matrix3x4> enabledTransforms_;
+    /// Model bounding box the instance boxes were calculated from.
+    BoundingBox modelBoundingBox_;
+    /// Number of enabled instances.
+    unsigned numEnabled_;
+};
+
+}
@@ -23,12 +23,14 @@
 #include "../Precompiled.h"
 
 #include "../Core/Context.h"
+#include "../Core/CoreEvents.h"
 #include "../Graphics/Batch.h"
 #include "../Graphics/Camera.h"
 #include "../Graphics/Geometry.h"
 #include "../Graphics/Material.h"
 #include "../Graphics/OcclusionBuffer.h"
 #include "../Graphics/OctreeQuery.h"
+#include "../Graphics/StaticModelCluster.h"
 #include "../Graphics/StaticModelGroup.h"
 #include "../Scene/Scene.h"
 
@@ -41,7 +43,9 @@ extern const char* GEOMETRY_CATEGORY;
 
 StaticModelGroup::StaticModelGroup(Context* context) :
     StaticModel(context),
-    nodeIDsDirty_(false)
+    clusterSize_(0.0f),
+    nodeIDsDirty_(false),
+    clustersDirty_(false)
 {
     // Initialize the default node IDs attribute
     UpdateNodeIDs();
@@ -49,6 +53,8 @@ StaticModelGroup::StaticModelGroup(Context* context) :
 
 StaticModelGroup::~StaticModelGroup()
 {
+    if (clusterNode_)
+        clusterNode_->Remove();
 }
 
 void StaticModelGroup::RegisterObject(Context* context)
@@ -56,8 +62,19 @@ void StaticModelGroup::RegisterObject(Context* context)
     context->RegisterFactory<StaticModelGroup>(GEOMETRY_CATEGORY);
 
     COPY_BASE_ATTRIBUTES(StaticModel);
+    REMOVE_ATTRIBUTE("Impostor");
+    REMOVE_ATTRIBUTE("Impostor Distance");
     ACCESSOR_ATTRIBUTE("Instance Nodes", GetNodeIDsAttr, SetNodeIDsAttr, VariantVector, Variant::emptyVariantVector,
         AM_DEFAULT | AM_NODEIDVECTOR);
+    ACCESSOR_ATTRIBUTE("Cluster Size", GetClusterSize, SetClusterSize, float, 0.0f, AM_DEFAULT);
+}
+
+void StaticModelGroup::OnSetEnabled()
+{
+    Drawable::OnSetEnabled();
+
+    if (clusterNode_)
+        clusterNode_->SetEnabled(IsEnabledEffective());
 }
 
 void StaticModelGroup::ApplyAttributes()
@@ -95,11 +112,16 @@ void StaticModelGroup::ApplyAttributes()
 
     worldTransforms_.Resize(instanceNodes_.Size());
     nodeIDsDirty_ = false;
+    MarkClustersDirty();
     OnMarkedDirty(GetNode());
 }
 
 void StaticModelGroup::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
 {
+    // When clustered, the clusters report the hits on behalf of the group
+    if (!clusters_.Empty())
+        return;
+
     // If no bones or no bone-level testing, use the Drawable test
     RayQueryLevel level = query.level_;
     if (level < RAY_AABB)
@@ -279,6 +301,7 @@ void StaticModelGroup::AddInstanceNode(Node* node)
     instanceNodes_.Push(instanceWeak);
 
     UpdateNodeIDs();
+    MarkClustersDirty();
     OnMarkedDirty(GetNode());
     MarkNetworkUpdate();
 }
@@ -293,6 +316,7 @@ void StaticModelGroup::RemoveInstanceNode(Node* node)
     instanceNodes_.Remove(instanceWeak);
 
     UpdateNodeIDs();
+    MarkClustersDirty();
     OnMarkedDirty(GetNode());
     MarkNetworkUpdate();
 }
@@ -309,6 +333,26 @@ void StaticModelGroup::RemoveAllInstanceNodes()
     instanceNodes_.Clear();
 
     UpdateNodeIDs();
+    MarkClustersDirty();
+    OnMarkedDirty(GetNode());
+    MarkNetworkUpdate();
+}
+
+void StaticModelGroup::SetClusterSize(float size)
+{
+    size = Max(size, 0.0f);
+    if (size == clusterSize_)
+        return;
+
+    clusterSize_ = size;
+
+    // The clusters are created and kept up to date on the main thread once per frame
+    if (clusterSize_ > 0.0f)
+        SubscribeToEvent(E_POSTUPDATE, HANDLER(StaticModelGroup, HandlePostUpdate));
+    else
+        UnsubscribeFromEvent(E_POSTUPDATE);
+
+    MarkClustersDirty();
     OnMarkedDirty(GetNode());
     MarkNetworkUpdate();
 }
@@ -357,11 +401,20 @@ void StaticModelGroup::OnNodeSetEnabled(Node* node)
 
 void StaticModelGroup::OnWorldBoundingBoxUpdate()
 {
+    BoundingBox worldBox;
+
+    // When clustered, the clusters track the instance transforms and the group itself renders nothing. The clusters may be
+    // updating in other worker threads, so use the box merged from them on the main thread
+    if (!clusters_.Empty())
+    {
+        worldBoundingBox_ = clusterBoundingBox_;
+        numWorldTransforms_ = 0;
+        return;
+    }
+
     // Update transforms and bounding box at the same time to have to go through the objects only once
     unsigned index = 0;
 
-    BoundingBox worldBox;
-
     for (unsigned i = 0; i < instanceNodes_.Size(); ++i)
     {
         Node* node = instanceNodes_[i];
@@ -396,4 +449,91 @@ void StaticModelGroup::UpdateNodeIDs()
     }
 }
 
+void StaticModelGroup::MarkClustersDirty()
+{
+    // Until the clusters have been rebuilt, the group renders all instances by itself
+    for (unsigned i = 0; i < clusters_.Size(); ++i)
+        clusters_[i]->Remove();
+
+    clusters_.Clear();
+    clusterBoundingBox_.Clear();
+    clustersDirty_ = clusterSize_ > 0.0f;
+}
+
+void StaticModelGroup::UpdateClusters()
+{
+    clustersDirty_ = false;
+
+    if (!GetScene() || clusterSize_ <= 0.0f || instanceNodes_.Empty())
+        return;
+
+    if (!clusterNode_)
+    {
+        clusterNode_ = node_->CreateChild("Clusters", LOCAL);
+        clusterNode_->SetTemporary(true);
+    }
+    clusterNode_->SetEnabled(IsEnabledEffective());
+
+    // Assign each instance to the cluster of the grid cell its position falls into. Instances that move later stay in their
+    // cluster, which then grows accordingly
+    HashMap<unsigned long long, StaticModelCluster*> cellClusters;
+
+    for (unsigned i = 0; i < instanceNodes_.Size(); ++i)
+    {
+        Node* node = instanceNodes_[i];
+        if (!node)
+            continue;
+
+        Vector3 cell = node->GetWorldPosition() / clusterSize_;
+        unsigned long long key = ((unsigned long long)((int)floorf(cell.x_) & 0x1fffff)) |
+            ((unsigned long long)((int)floorf(cell.y_) & 0x1fffff) << 21) |
+            ((unsigned long long)((int)floorf(cell.z_) & 0x1fffff) << 42);
+
+        StaticModelCluster* cluster;
+        HashMap<unsigned long long, StaticModelCluster*>::Iterator j = cellClusters.Find(key);
+        if (j != cellClusters.End())
+            cluster = j->second_;
+        else
+        {
+            cluster = clusterNode_->CreateComponent<StaticModelCluster>(LOCAL);
+            cluster->SetTemporary(true);
+            cluster->SetOwner(this);
+            clusters_.Push(SharedPtr<StaticModelCluster>(cluster));
+            cellClusters[key] = cluster;
+        }
+
+        cluster->AddInstance(node, i);
+    }
+
+    OnMarkedDirty(node_);
+}
+
+void StaticModelGroup::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    // If the cluster node has been removed from outside, start over
+    if (!clusters_.Empty() && !clusterNode_)
+        MarkClustersDirty();
+
+    if (clustersDirty_)
+        UpdateClusters();
+
+    BoundingBox clusterBox;
+    for (unsigned i = 0; i < clusters_.Size(); ++i)
+    {
+        StaticModelCluster* cluster = clusters_[i];
+        cluster->UpdateFromOwner();
+
+        // The octree update has not started yet, so the clusters can update their instances here
+        const BoundingBox& worldBox = cluster->GetWorldBoundingBox();
+        if (worldBox.defined_)
+            clusterBox.Merge(worldBox);
+    }
+
+    if (clusterBox != clusterBoundingBox_ || clusterBox.defined_ != clusterBoundingBox_.defined_)
+    {
+        clusterBoundingBox_ = clusterBox;
+        Drawable::OnMarkedDirty(node_);
+    }
+}
+
 }
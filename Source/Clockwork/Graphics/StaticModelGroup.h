@@ -27,6 +27,8 @@
 namespace Clockwork
 {
 
+class StaticModelCluster;
+
 /// Renders several object instances while culling and receiving light as one unit. Can be used as a CPU-side optimization, but note that also regular StaticModels will use instanced rendering if possible.
 class CLOCKWORK_API StaticModelGroup : public StaticModel
 {
@@ -40,6 +42,8 @@ public:
     /// Register object factory. StaticModel must be registered first.
     static void RegisterObject(Context* context);
 
+    /// Handle enabled/disabled state change.
+    virtual void OnSetEnabled();
     /// Apply attribute changes that can not be applied immediately. Called after scene load or a network update.
     void ApplyAttributes();
     /// Process octree raycast. May be called from a worker thread.
@@ -57,6 +61,8 @@ public:
     void RemoveInstanceNode(Node* node);
     /// Remove all instance scene nodes.
     void RemoveAllInstanceNodes();
+    /// Set cluster size. When nonzero, instances are partitioned into clusters of this world space size, which are culled, LOD-selected and occlusion tested individually. Default 0 (no clustering.)
+    void SetClusterSize(float size);
 
     /// Return number of instance nodes.
     unsigned GetNumInstanceNodes() const { return instanceNodes_.Size(); }
@@ -64,6 +70,12 @@ public:
     /// Return instance node by index.
     Node* GetInstanceNode(unsigned index) const;
 
+    /// Return cluster size.
+    float GetClusterSize() const { return clusterSize_; }
+
+    /// Return number of clusters currently in use.
+    unsigned GetNumClusters() const { return clusters_.Size(); }
+
     /// Set node IDs attribute.
     void SetNodeIDsAttr(const VariantVector& value);
 
@@ -79,6 +91,12 @@ protected:
 private:
     /// Update node IDs attribute and ensure the transforms vector has the right size.
     void UpdateNodeIDs();
+    /// Remove the current clusters and queue them to be rebuilt on the next frame.
+    void MarkClustersDirty();
+    /// Partition the instances into clusters.
+    void UpdateClusters();
+    /// Handle engine post-update. Rebuilds the clusters if necessary, copies the group's settings to them and merges their bounding boxes.
+    void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
 
     /// Instance nodes.
     Vector<WeakPtr<Node> > instanceNodes_;
@@ -86,10 +104,20 @@ private:
     PODVector<Matrix3x4> worldTransforms_;
     /// IDs of instance nodes for serialization.
     mutable VariantVector nodeIDsAttr_;
+    /// Clusters.
+    Vector<SharedPtr<StaticModelCluster> > clusters_;
+    /// Child node holding the clusters.
+    WeakPtr<Node> clusterNode_;
+    /// Merged world bounding box of the clusters. Updated on the main thread, so that the clusters are never updated from the group's worker thread.
+    BoundingBox clusterBoundingBox_;
     /// Number of valid instance node transforms.
     unsigned numWorldTransforms_;
+    /// Cluster size.
+    float clusterSize_;
     /// Whether node IDs have been set and nodes should be searched for during ApplyAttributes.
     bool nodeIDsDirty_;
+    /// Whether the clusters need to be rebuilt.
+    bool clustersDirty_;
 };
 
 }
@@ -71,11 +71,15 @@ static const char* lightingModeNames[] =
     0
 };
 
+/// Counter for unique pass shader versions.
+static unsigned shadersVersionCounter = 0;
+
 Pass::Pass(const String& name) :
     blendMode_(BLEND_REPLACE),
     depthTestMode_(CMP_LESSEQUAL),
     lightingMode_(LIGHTING_UNLIT),
     shadersLoadedFrameNumber_(0),
+    shadersVersion_(++shadersVersionCounter),
     depthWrite_(true),
     alphaMask_(false),
     isDesktop_(false)
@@ -153,6 +157,7 @@ void Pass::ReleaseShaders()
 {
     vertexShaders_.Clear();
     pixelShaders_.Clear();
+    shadersVersion_ = ++shadersVersionCounter;
 }
 
 void Pass::MarkShadersLoaded(unsigned frameNumber)
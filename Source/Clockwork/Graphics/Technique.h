@@ -90,6 +90,9 @@ public:
     /// Return last shaders loaded frame number.
     unsigned GetShadersLoadedFrameNumber() const { return shadersLoadedFrameNumber_; }
 
+    /// Return shader version. Changes whenever the shaders are released, and is unique among all passes.
+    unsigned GetShadersVersion() const { return shadersVersion_; }
+
     /// Return depth write mode.
     bool GetDepthWrite() const { return depthWrite_; }
 
@@ -128,6 +131,8 @@ private:
     PassLightingMode lightingMode_;
     /// Last shaders loaded frame number.
     unsigned shadersLoadedFrameNumber_;
+    /// Shader version.
+    unsigned shadersVersion_;
     /// Depth write mode.
     bool depthWrite_;
     /// Alpha masking hint.
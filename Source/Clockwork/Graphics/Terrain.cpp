@@ -23,19 +23,24 @@
 #include "../Precompiled.h"
 
 #include "../Core/Context.h"
+#include "../Core/CoreEvents.h"
 #include "../Core/Profiler.h"
+#include "../Graphics/Camera.h"
 #include "../Graphics/DrawableEvents.h"
 #include "../Graphics/Geometry.h"
 #include "../Graphics/IndexBuffer.h"
 #include "../Graphics/Material.h"
 #include "../Graphics/Octree.h"
+#include "../Graphics/Renderer.h"
 #include "../Graphics/Terrain.h"
 #include "../Graphics/TerrainPatch.h"
 #include "../Graphics/VertexBuffer.h"
+#include "../Graphics/Viewport.h"
 #include "../IO/Log.h"
 #include "../Resource/Image.h"
 #include "../Resource/ResourceCache.h"
 #include "../Resource/ResourceEvents.h"
+#include "../Resource/XMLFile.h"
 #include "../Scene/Node.h"
 #include "../Scene/Scene.h"
 
@@ -55,6 +60,15 @@ static const unsigned STITCH_NORTH = 1;
 static const unsigned STITCH_SOUTH = 2;
 static const unsigned STITCH_WEST = 4;
 static const unsigned STITCH_EAST = 8;
+static const unsigned MAX_TREE_LEVELS = 16;
+static const unsigned TREE_SPLITS_PER_FRAME = 16;
+static const float TREE_LOD_CONSTANT = 1.0f / 150.0f;
+static const float TREE_MERGE_RATIO = 0.75f;
+static const float TREE_MORPH_TIME = 0.5f;
+static const float DEFAULT_STREAMING_DISTANCE = 1000.0f;
+static const unsigned DEFAULT_STREAMING_BUDGET = 64 * 1024 * 1024;
+static const float TILE_UNLOAD_RATIO = 1.25f;
+static const unsigned TILE_BUILD_VERTICES_PER_FRAME = 65536;
 
 inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
 {
@@ -79,6 +93,10 @@ inline void GrowUpdateRegion(IntRect& updateRegion, int x, int y)
 Terrain::Terrain(Context* context) :
     Component(context),
     indexBuffer_(new IndexBuffer(context)),
+    numTiles_(IntVector2::ZERO),
+    tileSize_(0),
+    streamingDistance_(DEFAULT_STREAMING_DISTANCE),
+    streamingBudget_(DEFAULT_STREAMING_BUDGET),
     spacing_(DEFAULT_SPACING),
     lastSpacing_(Vector3::ZERO),
     patchWorldOrigin_(Vector2::ZERO),
@@ -92,6 +110,7 @@ Terrain::Terrain(Context* context) :
     maxLodLevels_(MAX_LOD_LEVELS),
     occlusionLodLevel_(M_MAX_UNSIGNED),
     smoothing_(false),
+    quadtree_(false),
     visible_(true),
     castShadows_(false),
     occluder_(false),
@@ -138,6 +157,11 @@ void Terrain::RegisterObject(Context* context)
     ACCESSOR_ATTRIBUTE("Shadow Mask", GetShadowMask, SetShadowMask, unsigned, DEFAULT_SHADOWMASK, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Zone Mask", GetZoneMask, SetZoneMask, unsigned, DEFAULT_ZONEMASK, AM_DEFAULT);
     ACCESSOR_ATTRIBUTE("Occlusion LOD level", GetOcclusionLodLevel, SetOcclusionLodLevelAttr, unsigned, M_MAX_UNSIGNED, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Quadtree", GetQuadtree, SetQuadtreeAttr, bool, false, AM_DEFAULT);
+    MIXED_ACCESSOR_ATTRIBUTE("Tiled Height Map", GetTiledHeightMapAttr, SetTiledHeightMapAttr, ResourceRef,
+        ResourceRef(XMLFile::GetTypeStatic()), AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Streaming Distance", GetStreamingDistance, SetStreamingDistance, float, DEFAULT_STREAMING_DISTANCE, AM_DEFAULT);
+    ACCESSOR_ATTRIBUTE("Streaming Budget", GetStreamingBudget, SetStreamingBudget, unsigned, DEFAULT_STREAMING_BUDGET, AM_DEFAULT);
 }
 
 void Terrain::OnSetAttribute(const AttributeInfo& attr, const Variant& src)
@@ -161,7 +185,8 @@ void Terrain::OnSetEnabled()
 
     for (unsigned i = 0; i < patches_.Size(); ++i)
     {
-        if (patches_[i])
+        // Pooled quadtree patches stay disabled until activated
+        if (patches_[i] && patches_[i]->GetTreeLevel() != M_MAX_UNSIGNED)
             patches_[i]->SetEnabled(enabled);
     }
 }
@@ -227,6 +252,17 @@ void Terrain::SetSmoothing(bool enable)
     }
 }
 
+void Terrain::SetQuadtree(bool enable)
+{
+    if (enable != quadtree_)
+    {
+        SetQuadtreeAttr(enable);
+
+        CreateGeometry();
+        MarkNetworkUpdate();
+    }
+}
+
 bool Terrain::SetHeightMap(Image* image)
 {
     bool success = SetHeightMapInternal(image, true);
@@ -235,6 +271,26 @@ bool Terrain::SetHeightMap(Image* image)
     return success;
 }
 
+bool Terrain::SetTiledHeightMap(XMLFile* file)
+{
+    bool success = SetTiledHeightMapInternal(file, true);
+
+    MarkNetworkUpdate();
+    return success;
+}
+
+void Terrain::SetStreamingDistance(float distance)
+{
+    streamingDistance_ = Max(distance, 0.0f);
+    MarkNetworkUpdate();
+}
+
+void Terrain::SetStreamingBudget(unsigned bytes)
+{
+    streamingBudget_ = bytes;
+    MarkNetworkUpdate();
+}
+
 void Terrain::SetMaterial(Material* material)
 {
     material_ = material;
@@ -381,7 +437,7 @@ void Terrain::SetOccludee(bool enable)
 
 void Terrain::ApplyHeightMap()
 {
-    if (heightMap_)
+    if (heightMap_ || tiledHeightMap_)
         CreateGeometry();
 }
 
@@ -395,6 +451,36 @@ Material* Terrain::GetMaterial() const
     return material_;
 }
 
+XMLFile* Terrain::GetTiledHeightMap() const
+{
+    return tiledHeightMap_;
+}
+
+unsigned Terrain::GetNumLoadedTiles() const
+{
+    unsigned numLoaded = 0;
+    for (unsigned i = 0; i < tiles_.Size(); ++i)
+    {
+        if (tiles_[i].state_ == TILE_READY)
+            ++numLoaded;
+    }
+
+    return numLoaded;
+}
+
+unsigned Terrain::GetStreamingMemoryUse() const
+{
+    return GetNumLoadedTiles() * GetTileMemoryUse();
+}
+
+SharedArrayPtr<float> Terrain::GetTileHeightData(int x, int z) const
+{
+    if (x < 0 || x >= numTiles_.x_ || z < 0 || z >= numTiles_.y_)
+        return SharedArrayPtr<float>();
+    else
+        return tiles_[z * numTiles_.x_ + x].heightData_;
+}
+
 TerrainPatch* Terrain::GetPatch(unsigned index) const
 {
     return index < patches_.Size() ? patches_[index] : (TerrainPatch*)0;
@@ -402,7 +488,7 @@ TerrainPatch* Terrain::GetPatch(unsigned index) const
 
 TerrainPatch* Terrain::GetPatch(int x, int z) const
 {
-    if (x < 0 || x >= numPatches_.x_ || z < 0 || z >= numPatches_.y_)
+    if (treeLevels_.Size() || x < 0 || x >= numPatches_.x_ || z < 0 || z >= numPatches_.y_)
         return 0;
     else
         return GetPatch((unsigned)(z * numPatches_.x_ + x));
@@ -491,6 +577,12 @@ IntVector2 Terrain::WorldToHeightMap(const Vector3& worldPosition) const
 
 void Terrain::CreatePatchGeometry(TerrainPatch* patch)
 {
+    if (treeLevels_.Size())
+    {
+        CreateTreePatchGeometry(patch);
+        return;
+    }
+
     PROFILE(CreatePatchGeometry);
 
     unsigned row = (unsigned)(patchSize_ + 1);
@@ -603,6 +695,10 @@ void Terrain::CreatePatchGeometry(TerrainPatch* patch)
 
 void Terrain::UpdatePatchLod(TerrainPatch* patch)
 {
+    // Quadtree patches have a single draw range set when the geometry is created
+    if (treeLevels_.Size())
+        return;
+
     Geometry* geometry = patch->GetGeometry();
 
     // All LOD levels except the coarsest have 16 versions for stitching
@@ -629,6 +725,24 @@ void Terrain::UpdatePatchLod(TerrainPatch* patch)
         geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[drawRangeIndex].first_, drawRanges_[drawRangeIndex].second_, false);
 }
 
+void Terrain::UpdatePatchMorph(TerrainPatch* patch)
+{
+    VertexBuffer* vertexBuffer = patch->GetVertexBuffer();
+    float* vertexData = (float*)vertexBuffer->GetShadowData();
+    const PODVector<float>& morphHeights = patch->GetMorphHeights();
+    unsigned numVertices = vertexBuffer->GetVertexCount();
+    if (!vertexData || morphHeights.Size() != numVertices * 2)
+        return;
+
+    // Rewrite the heights in the shadow data, then upload it whole
+    unsigned vertexStride = vertexBuffer->GetVertexSize() / sizeof(float);
+    float morph = patch->GetMorph();
+    for (unsigned i = 0; i < numVertices; ++i)
+        vertexData[i * vertexStride + 1] = Lerp(morphHeights[i * 2], morphHeights[i * 2 + 1], morph);
+
+    vertexBuffer->SetData(vertexData);
+}
+
 void Terrain::SetMaterialAttr(const ResourceRef& value)
 {
     ResourceCache* cache = GetSubsystem<ResourceCache>();
@@ -676,6 +790,25 @@ void Terrain::SetOcclusionLodLevelAttr(unsigned value)
     }
 }
 
+void Terrain::SetQuadtreeAttr(bool enable)
+{
+    if (enable != quadtree_)
+    {
+        quadtree_ = enable;
+        lastPatchSize_ = 0; // Force full recreate
+        recreateTerrain_ = true;
+
+        UpdateEventSubscriptions();
+    }
+}
+
+void Terrain::SetTiledHeightMapAttr(const ResourceRef& value)
+{
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    XMLFile* file = cache->GetResource<XMLFile>(value.name_);
+    SetTiledHeightMapInternal(file, false);
+}
+
 ResourceRef Terrain::GetMaterialAttr() const
 {
     return GetResourceRef(material_, Material::GetTypeStatic());
@@ -686,6 +819,11 @@ ResourceRef Terrain::GetHeightMapAttr() const
     return GetResourceRef(heightMap_, Image::GetTypeStatic());
 }
 
+ResourceRef Terrain::GetTiledHeightMapAttr() const
+{
+    return GetResourceRef(tiledHeightMap_, XMLFile::GetTypeStatic());
+}
+
 void Terrain::CreateGeometry()
 {
     recreateTerrain_ = false;
@@ -697,10 +835,20 @@ void Terrain::CreateGeometry()
 
     unsigned prevNumPatches = patches_.Size();
 
-    // Determine number of LOD levels
+    // Stream the heightmap if the tile size is compatible with the patch size. Quadtree mode is not used when streaming
+    bool streaming = false;
+    if (tiledHeightMap_)
+    {
+        if ((tileSize_ - 1) % patchSize_)
+            LOGERROR("Heightmap tile size " + String(tileSize_ - 1) + " is not divisible by the patch size");
+        else
+            streaming = true;
+    }
+
+    // Determine number of LOD levels. Quadtree patches always use the full resolution of their tree level
     unsigned lodSize = (unsigned)patchSize_;
     numLodLevels_ = 1;
-    while (lodSize > MIN_PATCH_SIZE && numLodLevels_ < maxLodLevels_)
+    while ((!quadtree_ || streaming) && lodSize > MIN_PATCH_SIZE && numLodLevels_ < maxLodLevels_)
     {
         lodSize >>= 1;
         ++numLodLevels_;
@@ -710,7 +858,18 @@ void Terrain::CreateGeometry()
     patchWorldSize_ = Vector2(spacing_.x_ * (float)patchSize_, spacing_.z_ * (float)patchSize_);
     bool updateAll = false;
 
-    if (heightMap_)
+    if (streaming)
+    {
+        numPatches_ = IntVector2(numTiles_.x_ * (tileSize_ - 1) / patchSize_, numTiles_.y_ * (tileSize_ - 1) / patchSize_);
+        numVertices_ = IntVector2(numPatches_.x_ * patchSize_ + 1, numPatches_.y_ * patchSize_ + 1);
+        patchWorldOrigin_ =
+            Vector2(-0.5f * (float)numPatches_.x_ * patchWorldSize_.x_, -0.5f * (float)numPatches_.y_ * patchWorldSize_.y_);
+        // Streamed tiles are always loaded again from scratch
+        updateAll = true;
+        heightData_.Reset();
+        sourceHeightData_.Reset();
+    }
+    else if (heightMap_)
     {
         numPatches_ = IntVector2((heightMap_->GetWidth() - 1) / patchSize_, (heightMap_->GetHeight() - 1) / patchSize_);
         numVertices_ = IntVector2(numPatches_.x_ * patchSize_ + 1, numPatches_.y_ * patchSize_ + 1);
@@ -757,7 +916,7 @@ void Terrain::CreateGeometry()
         {
             bool nodeOk = false;
             Vector<String> coords = (*i)->GetName().Substring(6).Split('_');
-            if (coords.Size() == 2)
+            if (!quadtree_ && !streaming && coords.Size() == 2)
             {
                 int x = ToInt(coords[0]);
                 int z = ToInt(coords[1]);
@@ -776,8 +935,20 @@ void Terrain::CreateGeometry()
         dirtyPatches[i] = updateAll;
 
     patches_.Clear();
+    freePatches_.Clear();
+    treeLevels_.Clear();
+    tiles_.Clear();
+    pendingTiles_.Clear();
+    rebuildPatches_.Clear();
 
-    if (heightMap_)
+    if (streaming)
+    {
+        // The patches of each tile are created once the tile has been loaded, until then they are null
+        patches_.Resize((unsigned)(numPatches_.x_ * numPatches_.y_));
+        tiles_.Resize((unsigned)(numTiles_.x_ * numTiles_.y_));
+        CreateIndexData();
+    }
+    else if (heightMap_)
     {
         // Copy heightmap data
         const unsigned char* src = heightMap_->GetData();
@@ -839,129 +1010,109 @@ void Terrain::CreateGeometry()
             }
         }
 
-        // If updating a region of the heightmap, check which patches change
-        if (!updateAll)
+        if (quadtree_)
         {
-            int lodExpand = 1 << (numLodLevels_ - 1);
-            // Expand the right & bottom 1 pixel more, as patches share vertices at the edge
-            updateRegion.left_ -= lodExpand;
-            updateRegion.right_ += lodExpand + 1;
-            updateRegion.top_ -= lodExpand;
-            updateRegion.bottom_ += lodExpand + 1;
-
-            int sX = Max(updateRegion.left_ / patchSize_, 0);
-            int eX = Min(updateRegion.right_ / patchSize_, numPatches_.x_ - 1);
-            int sY = Max(updateRegion.top_ / patchSize_, 0);
-            int eY = Min(updateRegion.bottom_ / patchSize_, numPatches_.y_ - 1);
-            for (int y = sY; y <= eY; ++y)
+            // In quadtree mode patches are created on demand for the active tree nodes, so process the whole heightmap
+            if (smoothing_)
             {
-                for (int x = sX; x <= eX; ++x)
-                    dirtyPatches[y * numPatches_.x_ + x] = true;
+                PROFILE(UpdateSmoothing);
+                SmoothHeightData(0, 0, numVertices_.x_ - 1, numVertices_.y_ - 1);
             }
-        }
-
-        patches_.Reserve((unsigned)(numPatches_.x_ * numPatches_.y_));
-
-        bool enabled = IsEnabledEffective();
 
+            CreateTree();
+        }
+        else
         {
-            PROFILE(CreatePatches);
-
-            // Create patches and set node transforms
-            for (int z = 0; z < numPatches_.y_; ++z)
+            // If updating a region of the heightmap, check which patches change
+            if (!updateAll)
             {
-                for (int x = 0; x < numPatches_.x_; ++x)
+                int lodExpand = 1 << (numLodLevels_ - 1);
+                // Expand the right & bottom 1 pixel more, as patches share vertices at the edge
+                updateRegion.left_ -= lodExpand;
+                updateRegion.right_ += lodExpand + 1;
+                updateRegion.top_ -= lodExpand;
+                updateRegion.bottom_ += lodExpand + 1;
+
+                int sX = Max(updateRegion.left_ / patchSize_, 0);
+                int eX = Min(updateRegion.right_ / patchSize_, numPatches_.x_ - 1);
+                int sY = Max(updateRegion.top_ / patchSize_, 0);
+                int eY = Min(updateRegion.bottom_ / patchSize_, numPatches_.y_ - 1);
+                for (int y = sY; y <= eY; ++y)
                 {
-                    String nodeName = "Patch_" + String(x) + "_" + String(z);
-                    Node* patchNode = node_->GetChild(nodeName);
-
-                    if (!patchNode)
-                    {
-                        // Create the patch scene node as local and temporary so that it is not unnecessarily serialized to either
-                        // file or replicated over the network
-                        patchNode = node_->CreateChild(nodeName, LOCAL);
-                        patchNode->SetTemporary(true);
-                    }
-
-                    patchNode->SetPosition(Vector3(patchWorldOrigin_.x_ + (float)x * patchWorldSize_.x_, 0.0f,
-                        patchWorldOrigin_.y_ + (float)z * patchWorldSize_.y_));
-
-                    TerrainPatch* patch = patchNode->GetComponent<TerrainPatch>();
-                    if (!patch)
-                    {
-                        patch = patchNode->CreateComponent<TerrainPatch>();
-                        patch->SetOwner(this);
-                        patch->SetCoordinates(IntVector2(x, z));
-
-                        // Copy initial drawable parameters
-                        patch->SetEnabled(enabled);
-                        patch->SetMaterial(material_);
-                        patch->SetDrawDistance(drawDistance_);
-                        patch->SetShadowDistance(shadowDistance_);
-                        patch->SetLodBias(lodBias_);
-                        patch->SetViewMask(viewMask_);
-                        patch->SetLightMask(lightMask_);
-                        patch->SetShadowMask(shadowMask_);
-                        patch->SetZoneMask(zoneMask_);
-                        patch->SetMaxLights(maxLights_);
-                        patch->SetCastShadows(castShadows_);
-                        patch->SetOccluder(occluder_);
-                        patch->SetOccludee(occludee_);
-                    }
-
-                    patches_.Push(WeakPtr<TerrainPatch>(patch));
+                    for (int x = sX; x <= eX; ++x)
+                        dirtyPatches[y * numPatches_.x_ + x] = true;
                 }
             }
-        }
 
-        // Create the shared index data
-        if (updateAll)
-            CreateIndexData();
-
-        // Create vertex data for patches. First update smoothing to ensure normals are calculated correctly across patch borders
-        if (smoothing_)
-        {
-            PROFILE(UpdateSmoothing);
+            patches_.Reserve((unsigned)(numPatches_.x_ * numPatches_.y_));
 
-            for (unsigned i = 0; i < patches_.Size(); ++i)
             {
-                if (dirtyPatches[i])
+                PROFILE(CreatePatches);
+
+                // Create patches and set node transforms
+                for (int z = 0; z < numPatches_.y_; ++z)
                 {
-                    TerrainPatch* patch = patches_[i];
-                    const IntVector2& coords = patch->GetCoordinates();
-                    int startX = coords.x_ * patchSize_;
-                    int endX = startX + patchSize_;
-                    int startZ = coords.y_ * patchSize_;
-                    int endZ = startZ + patchSize_;
-
-                    for (int z = startZ; z <= endZ; ++z)
+                    for (int x = 0; x < numPatches_.x_; ++x)
                     {
-                        for (int x = startX; x <= endX; ++x)
+                        String nodeName = "Patch_" + String(x) + "_" + String(z);
+                        Node* patchNode = node_->GetChild(nodeName);
+
+                        if (!patchNode)
                         {
-                            float smoothedHeight = (
-                                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
-                                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
-                                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
-                            ) / 16.0f;
+                            // Create the patch scene node as local and temporary so that it is not unnecessarily serialized to either
+                            // file or replicated over the network
+                            patchNode = node_->CreateChild(nodeName, LOCAL);
+                            patchNode->SetTemporary(true);
+                        }
+
+                        patchNode->SetPosition(Vector3(patchWorldOrigin_.x_ + (float)x * patchWorldSize_.x_, 0.0f,
+                            patchWorldOrigin_.y_ + (float)z * patchWorldSize_.y_));
 
-                            heightData_[z * numVertices_.x_ + x] = smoothedHeight;
+                        TerrainPatch* patch = patchNode->GetComponent<TerrainPatch>();
+                        if (!patch)
+                        {
+                            patch = patchNode->CreateComponent<TerrainPatch>();
+                            patch->SetCoordinates(IntVector2(x, z));
+                            InitializePatch(patch);
                         }
+
+                        patches_.Push(WeakPtr<TerrainPatch>(patch));
                     }
                 }
             }
-        }
 
-        for (unsigned i = 0; i < patches_.Size(); ++i)
-        {
-            TerrainPatch* patch = patches_[i];
+            // Create the shared index data
+            if (updateAll)
+                CreateIndexData();
 
-            if (dirtyPatches[i])
+            // Create vertex data for patches. First update smoothing to ensure normals are calculated correctly across patch borders
+            if (smoothing_)
             {
-                CreatePatchGeometry(patch);
-                CalculateLodErrors(patch);
+                PROFILE(UpdateSmoothing);
+
+                for (unsigned i = 0; i < patches_.Size(); ++i)
+                {
+                    if (dirtyPatches[i])
+                    {
+                        const IntVector2& coords = patches_[i]->GetCoordinates();
+                        SmoothHeightData(coords.x_ * patchSize_, coords.y_ * patchSize_, (coords.x_ + 1) * patchSize_,
+                            (coords.y_ + 1) * patchSize_);
+                    }
+                }
             }
 
-            SetNeighbors(patch);
+            for (unsigned i = 0; i < patches_.Size(); ++i)
+            {
+                TerrainPatch* patch = patches_[i];
+
+                if (dirtyPatches[i])
+                {
+                    CreatePatchGeometry(patch);
+                    CalculateLodErrors(patch);
+                }
+
+                SetNeighbors(patch);
+            }
         }
     }
 
@@ -1136,16 +1287,113 @@ void Terrain::CreateIndexData()
     indexBuffer_->SetData(&indices[0]);
 }
 
+void Terrain::SmoothHeightData(int startX, int startZ, int endX, int endZ)
+{
+    for (int z = startZ; z <= endZ; ++z)
+    {
+        for (int x = startX; x <= endX; ++x)
+        {
+            float smoothedHeight = (
+                GetSourceHeight(x - 1, z - 1) + GetSourceHeight(x, z - 1) * 2.0f + GetSourceHeight(x + 1, z - 1) +
+                GetSourceHeight(x - 1, z) * 2.0f + GetSourceHeight(x, z) * 4.0f + GetSourceHeight(x + 1, z) * 2.0f +
+                GetSourceHeight(x - 1, z + 1) + GetSourceHeight(x, z + 1) * 2.0f + GetSourceHeight(x + 1, z + 1)
+            ) / 16.0f;
+
+            heightData_[z * numVertices_.x_ + x] = smoothedHeight;
+        }
+    }
+}
+
+void Terrain::InitializePatch(TerrainPatch* patch)
+{
+    patch->SetOwner(this);
+
+    // Copy initial drawable parameters
+    patch->SetEnabled(IsEnabledEffective());
+    patch->SetMaterial(material_);
+    patch->SetDrawDistance(drawDistance_);
+    patch->SetShadowDistance(shadowDistance_);
+    patch->SetLodBias(lodBias_);
+    patch->SetViewMask(viewMask_);
+    patch->SetLightMask(lightMask_);
+    patch->SetShadowMask(shadowMask_);
+    patch->SetZoneMask(zoneMask_);
+    patch->SetMaxLights(maxLights_);
+    patch->SetCastShadows(castShadows_);
+    patch->SetOccluder(occluder_);
+    patch->SetOccludee(occludee_);
+}
+
 float Terrain::GetRawHeight(int x, int z) const
 {
     if (!heightData_)
-        return 0.0f;
+        return tiles_.Size() ? GetTileHeight(x, z) : 0.0f;
 
     x = Clamp(x, 0, numVertices_.x_ - 1);
     z = Clamp(z, 0, numVertices_.y_ - 1);
     return heightData_[z * numVertices_.x_ + x];
 }
 
+float Terrain::GetTileHeight(int x, int z) const
+{
+    int tileQuads = tileSize_ - 1;
+    if (tileQuads <= 0)
+        return 0.0f;
+
+    x = Clamp(x, 0, numVertices_.x_ - 1);
+    z = Clamp(z, 0, numVertices_.y_ - 1);
+
+    int centerX = Min(x / tileQuads, numTiles_.x_ - 1);
+    int centerZ = Min(z / tileQuads, numTiles_.y_ - 1);
+    int maxRadius = Max(numTiles_.x_, numTiles_.y_);
+    const float* bestHeightData = 0;
+    int bestX = 0;
+    int bestZ = 0;
+    float bestDistance = M_INFINITY;
+
+    // Search rings of tiles outward from the tile of the vertex for the closest loaded tile. Vertices outside the loaded area,
+    // such as those sampled for the normals of the edge patches, are clamped to the edge of that tile
+    for (int radius = 0; radius < maxRadius; ++radius)
+    {
+        // The tiles of this ring are at least this many vertices away, so stop once a closer tile has been found
+        float minDistance = (float)(Max(radius - 1, 0) * tileQuads);
+        if (bestHeightData && minDistance * minDistance > bestDistance)
+            break;
+
+        for (int tileZ = Max(centerZ - radius, 0); tileZ <= Min(centerZ + radius, numTiles_.y_ - 1); ++tileZ)
+        {
+            for (int tileX = Max(centerX - radius, 0); tileX <= Min(centerX + radius, numTiles_.x_ - 1); ++tileX)
+            {
+                if (Abs(tileX - centerX) != radius && Abs(tileZ - centerZ) != radius)
+                    continue;
+
+                const float* heightData = tiles_[tileZ * numTiles_.x_ + tileX].heightData_.Get();
+                if (!heightData)
+                    continue;
+
+                int localX = Clamp(x - tileX * tileQuads, 0, tileQuads);
+                int localZ = Clamp(z - tileZ * tileQuads, 0, tileQuads);
+                // The vertex is inside the tile or on its edge, no other tile can be closer
+                if (localX == x - tileX * tileQuads && localZ == z - tileZ * tileQuads)
+                    return heightData[localZ * tileSize_ + localX];
+
+                float dx = (float)(x - tileX * tileQuads - localX);
+                float dz = (float)(z - tileZ * tileQuads - localZ);
+                float distance = dx * dx + dz * dz;
+                if (distance < bestDistance)
+                {
+                    bestHeightData = heightData;
+                    bestX = localX;
+                    bestZ = localZ;
+                    bestDistance = distance;
+                }
+            }
+        }
+    }
+
+    return bestHeightData ? bestHeightData[bestZ * tileSize_ + bestX] : 0.0f;
+}
+
 float Terrain::GetSourceHeight(int x, int z) const
 {
     if (!sourceHeightData_)
@@ -1253,6 +1501,838 @@ void Terrain::SetNeighbors(TerrainPatch* patch)
         GetPatch(coords.x_ - 1, coords.y_), GetPatch(coords.x_ + 1, coords.y_));
 }
 
+void Terrain::CreateTree()
+{
+    PROFILE(CreateTerrainTree);
+
+    // Return the patches left over from a previous tree to the pool
+    PODVector<Node*> patchNodes;
+    node_->GetChildrenWithComponent<TerrainPatch>(patchNodes);
+    for (PODVector<Node*>::Iterator i = patchNodes.Begin(); i != patchNodes.End(); ++i)
+    {
+        TerrainPatch* patch = (*i)->GetComponent<TerrainPatch>();
+        patches_.Push(WeakPtr<TerrainPatch>(patch));
+        ReleasePatch(patch);
+    }
+
+    if (numPatches_.x_ <= 0 || numPatches_.y_ <= 0)
+        return;
+
+    CreateTreeIndexData();
+
+    // Each level halves the patch grid of the previous, as long as the grid stays divisible by two
+    unsigned numLevels = 1;
+    while (numLevels < MAX_TREE_LEVELS && !((numPatches_.x_ >> (numLevels - 1)) & 1) && !((numPatches_.y_ >> (numLevels - 1)) & 1))
+        ++numLevels;
+
+    treeLevels_.Resize(numLevels);
+
+    for (unsigned level = 0; level < numLevels; ++level)
+    {
+        int width = numPatches_.x_ >> level;
+        int height = numPatches_.y_ >> level;
+        int nodeSize = patchSize_ << level;
+        Vector<TerrainTreeNode>& nodes = treeLevels_[level];
+        nodes.Resize((unsigned)(width * height));
+
+        for (int z = 0; z < height; ++z)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                TerrainTreeNode& treeNode = nodes[z * width + x];
+                int xStart = x * nodeSize;
+                int zStart = z * nodeSize;
+
+                if (!level)
+                {
+                    treeNode.minHeight_ = treeNode.maxHeight_ = GetRawHeight(xStart, zStart);
+                    for (int zPos = zStart; zPos <= zStart + nodeSize; ++zPos)
+                    {
+                        for (int xPos = xStart; xPos <= xStart + nodeSize; ++xPos)
+                        {
+                            float height = GetRawHeight(xPos, zPos);
+                            treeNode.minHeight_ = Min(treeNode.minHeight_, height);
+                            treeNode.maxHeight_ = Max(treeNode.maxHeight_, height);
+                        }
+                    }
+                }
+                else
+                {
+                    // Merge the bounds and errors of the children
+                    const Vector<TerrainTreeNode>& children = treeLevels_[level - 1];
+                    int childWidth = numPatches_.x_ >> (level - 1);
+                    float childError = 0.0f;
+                    treeNode.minHeight_ = M_INFINITY;
+                    treeNode.maxHeight_ = -M_INFINITY;
+
+                    for (int cz = 0; cz < 2; ++cz)
+                    {
+                        for (int cx = 0; cx < 2; ++cx)
+                        {
+                            const TerrainTreeNode& child = children[(z * 2 + cz) * childWidth + x * 2 + cx];
+                            treeNode.minHeight_ = Min(treeNode.minHeight_, child.minHeight_);
+                            treeNode.maxHeight_ = Max(treeNode.maxHeight_, child.maxHeight_);
+                            childError = Max(childError, child.error_);
+                        }
+                    }
+
+                    // The child triangles subdivide the parent triangles, so the largest difference between the two levels is
+                    // found at the child vertices. Adding the child error bounds the error to the full resolution heightmap
+                    int step = 1 << (level - 1);
+                    float maxError = 0.0f;
+                    for (int zPos = zStart; zPos <= zStart + nodeSize; zPos += step)
+                    {
+                        for (int xPos = xStart; xPos <= xStart + nodeSize; xPos += step)
+                        {
+                            float error = Abs(GetLodHeight(xPos, zPos, level) - GetRawHeight(xPos, zPos));
+                            maxError = Max(error, maxError);
+                        }
+                    }
+
+                    // Set error to be at least same as (half vertex spacing x LOD) to prevent horizontal stretches getting too inaccurate
+                    treeNode.error_ = Max(maxError + childError, 0.25f * (spacing_.x_ + spacing_.z_) * (float)(1 << level));
+                }
+            }
+        }
+    }
+
+    // Start from the root nodes. The tree is refined from the viewport cameras on the following updates
+    unsigned topLevel = numLevels - 1;
+    for (int z = 0; z < numPatches_.y_ >> topLevel; ++z)
+    {
+        for (int x = 0; x < numPatches_.x_ >> topLevel; ++x)
+            AcquirePatch(topLevel, x, z, 0.0f);
+    }
+}
+
+void Terrain::CreateTreeIndexData()
+{
+    PROFILE(CreateIndexData);
+
+    PODVector<unsigned short> indices;
+    drawRanges_.Clear();
+    unsigned row = (unsigned)(patchSize_ + 1);
+
+    // Build the main grid
+    for (unsigned z = 0; z < (unsigned)patchSize_; ++z)
+    {
+        for (unsigned x = 0; x < (unsigned)patchSize_; ++x)
+        {
+            indices.Push((unsigned short)((z + 1) * row + x));
+            indices.Push((unsigned short)(z * row + x + 1));
+            indices.Push((unsigned short)(z * row + x));
+            indices.Push((unsigned short)((z + 1) * row + x));
+            indices.Push((unsigned short)((z + 1) * row + x + 1));
+            indices.Push((unsigned short)(z * row + x + 1));
+        }
+    }
+
+    unsigned gridIndexCount = indices.Size();
+
+    /* Build the skirts of the south, north, west and east edges. Each skirt vertex hangs below the matching edge vertex.
+       The skirts are double-sided so that they cover the cracks to neighbor patches on a different tree level regardless of
+       which side they are seen from
+    */
+    unsigned edgeStart[4] = { 0, (unsigned)patchSize_ * row, 0, (unsigned)patchSize_ };
+    unsigned edgeStep[4] = { 1, 1, row, row };
+    for (unsigned edge = 0; edge < 4; ++edge)
+    {
+        for (unsigned i = 0; i < (unsigned)patchSize_; ++i)
+        {
+            unsigned top = edgeStart[edge] + i * edgeStep[edge];
+            unsigned nextTop = top + edgeStep[edge];
+            unsigned bottom = row * row + edge * row + i;
+            unsigned nextBottom = bottom + 1;
+
+            indices.Push((unsigned short)top);
+            indices.Push((unsigned short)nextTop);
+            indices.Push((unsigned short)bottom);
+            indices.Push((unsigned short)nextTop);
+            indices.Push((unsigned short)nextBottom);
+            indices.Push((unsigned short)bottom);
+            indices.Push((unsigned short)top);
+            indices.Push((unsigned short)bottom);
+            indices.Push((unsigned short)nextTop);
+            indices.Push((unsigned short)nextTop);
+            indices.Push((unsigned short)bottom);
+            indices.Push((unsigned short)nextBottom);
+        }
+    }
+
+    // Draw range 0 includes the skirts, draw range 1 is the grid only
+    drawRanges_.Push(MakePair(0U, indices.Size()));
+    drawRanges_.Push(MakePair(0U, gridIndexCount));
+
+    indexBuffer_->SetSize(indices.Size(), false);
+    indexBuffer_->SetData(&indices[0]);
+}
+
+void Terrain::CreateTreePatchGeometry(TerrainPatch* patch)
+{
+    PROFILE(CreatePatchGeometry);
+
+    unsigned level = patch->GetTreeLevel();
+    if (level >= treeLevels_.Size())
+        return;
+
+    unsigned row = (unsigned)(patchSize_ + 1);
+    unsigned gridVertices = row * row;
+    unsigned numVertices = gridVertices + 4 * row;
+    VertexBuffer* vertexBuffer = patch->GetVertexBuffer();
+    Geometry* geometry = patch->GetGeometry();
+    Geometry* maxLodGeometry = patch->GetMaxLodGeometry();
+    Geometry* occlusionGeometry = patch->GetOcclusionGeometry();
+
+    // The vertex data is kept in the shadow copy for rewriting the geomorphed heights
+    vertexBuffer->SetShadowed(true);
+    if (vertexBuffer->GetVertexCount() != numVertices || !vertexBuffer->IsDynamic())
+        vertexBuffer->SetSize(numVertices, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT, true);
+
+    SharedArrayPtr<unsigned char> cpuVertexData(new unsigned char[numVertices * sizeof(Vector3)]);
+    SharedArrayPtr<unsigned char> occlusionCpuVertexData(new unsigned char[numVertices * sizeof(Vector3)]);
+    PODVector<float>& morphHeights = patch->GetMorphHeights();
+    morphHeights.Resize(numVertices * 2);
+
+    float* vertexData = (float*)vertexBuffer->Lock(0, vertexBuffer->GetVertexCount());
+    float* positionData = (float*)cpuVertexData.Get();
+    float* occlusionData = (float*)occlusionCpuVertexData.Get();
+    BoundingBox box;
+
+    if (vertexData)
+    {
+        const IntVector2& coords = patch->GetCoordinates();
+        int stride = 1 << level;
+        bool hasParent = level + 1 < treeLevels_.Size();
+        float morph = patch->GetMorph();
+
+        // The skirts need to reach below the height difference to a neighbor on a coarser level, which is bounded by the error
+        // of the coarser levels
+        unsigned skirtLevel = (unsigned)Min((int)level + 2, (int)treeLevels_.Size() - 1);
+        const TerrainTreeNode& skirtNode = GetTreeNode(skirtLevel, coords.x_ >> (skirtLevel - level),
+            coords.y_ >> (skirtLevel - level));
+        float skirtDepth = Max(skirtNode.error_, 0.5f * (spacing_.x_ + spacing_.z_) * (float)stride);
+
+        for (unsigned i = 0; i < numVertices; ++i)
+        {
+            int x, z;
+            bool skirt = i >= gridVertices;
+            if (!skirt)
+            {
+                x = (int)(i % row);
+                z = (int)(i / row);
+            }
+            else
+            {
+                unsigned edge = (i - gridVertices) / row;
+                int j = (int)((i - gridVertices) % row);
+                x = edge < 2 ? j : (edge == 2 ? 0 : patchSize_);
+                z = edge < 2 ? (edge == 0 ? 0 : patchSize_) : j;
+            }
+
+            int xPos = (coords.x_ * patchSize_ + x) * stride;
+            int zPos = (coords.y_ * patchSize_ + z) * stride;
+
+            // Store both the own and the parent level height, and geomorph between them
+            float height = GetRawHeight(xPos, zPos);
+            float parentHeight = hasParent ? GetLodHeight(xPos, zPos, level + 1) : height;
+            if (skirt)
+            {
+                height -= skirtDepth;
+                parentHeight -= skirtDepth;
+            }
+            morphHeights[i * 2] = height;
+            morphHeights[i * 2 + 1] = parentHeight;
+
+            // Position
+            Vector3 position((float)(x * stride) * spacing_.x_, Lerp(height, parentHeight, morph), (float)(z * stride) * spacing_.z_);
+            *vertexData++ = position.x_;
+            *vertexData++ = position.y_;
+            *vertexData++ = position.z_;
+            *positionData++ = position.x_;
+            *positionData++ = height;
+            *positionData++ = position.z_;
+
+            box.Merge(Vector3(position.x_, height, position.z_));
+            box.Merge(Vector3(position.x_, parentHeight, position.z_));
+
+            // The geomorphed surface never goes below the lower of the two heights
+            *occlusionData++ = position.x_;
+            *occlusionData++ = Min(height, parentHeight);
+            *occlusionData++ = position.z_;
+
+            // Normal
+            Vector3 normal = GetRawNormal(xPos, zPos);
+            *vertexData++ = normal.x_;
+            *vertexData++ = normal.y_;
+            *vertexData++ = normal.z_;
+
+            // Texture coordinate
+            Vector2 texCoord((float)xPos / (float)numVertices_.x_, 1.0f - (float)zPos / (float)numVertices_.y_);
+            *vertexData++ = texCoord.x_;
+            *vertexData++ = texCoord.y_;
+
+            // Tangent
+            Vector3 xyz = (Vector3::RIGHT - normal * normal.DotProduct(Vector3::RIGHT)).Normalized();
+            *vertexData++ = xyz.x_;
+            *vertexData++ = xyz.y_;
+            *vertexData++ = xyz.z_;
+            *vertexData++ = 1.0f;
+        }
+
+        vertexBuffer->Unlock();
+        vertexBuffer->ClearDataLost();
+    }
+
+    patch->SetBoundingBox(box);
+
+    if (drawRanges_.Size() > 1)
+    {
+        geometry->SetIndexBuffer(indexBuffer_);
+        geometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[0].first_, drawRanges_[0].second_, false);
+        geometry->SetRawVertexData(cpuVertexData, sizeof(Vector3), MASK_POSITION);
+        maxLodGeometry->SetIndexBuffer(indexBuffer_);
+        maxLodGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[1].first_, drawRanges_[1].second_, false);
+        maxLodGeometry->SetRawVertexData(cpuVertexData, sizeof(Vector3), MASK_POSITION);
+        occlusionGeometry->SetIndexBuffer(indexBuffer_);
+        occlusionGeometry->SetDrawRange(TRIANGLE_LIST, drawRanges_[1].first_, drawRanges_[1].second_, false);
+        occlusionGeometry->SetRawVertexData(occlusionCpuVertexData, sizeof(Vector3), MASK_POSITION);
+    }
+
+    patch->ResetLod();
+}
+
+TerrainPatch* Terrain::AcquirePatch(unsigned level, int x, int z, float morph)
+{
+    TerrainPatch* patch = 0;
+    while (!patch && freePatches_.Size())
+    {
+        patch = freePatches_.Back();
+        freePatches_.Pop();
+    }
+
+    if (!patch)
+    {
+        // Create the patch scene node as local and temporary so that it is not unnecessarily serialized to either
+        // file or replicated over the network
+        Node* patchNode = node_->CreateChild("Patch", LOCAL);
+        patchNode->SetTemporary(true);
+        patch = patchNode->CreateComponent<TerrainPatch>();
+        InitializePatch(patch);
+        patches_.Push(WeakPtr<TerrainPatch>(patch));
+    }
+
+    float nodeScale = (float)(1 << level);
+    patch->GetNode()->SetPosition(Vector3(patchWorldOrigin_.x_ + (float)x * nodeScale * patchWorldSize_.x_, 0.0f,
+        patchWorldOrigin_.y_ + (float)z * nodeScale * patchWorldSize_.y_));
+    patch->SetCoordinates(IntVector2(x, z));
+    patch->SetTreeLevel(level);
+    patch->SetMorph(morph);
+    CreatePatchGeometry(patch);
+    patch->SetEnabled(IsEnabledEffective());
+
+    TerrainTreeNode& treeNode = GetTreeNode(level, x, z);
+    treeNode.patch_ = patch;
+    treeNode.state_ = TREE_ACTIVE;
+
+    return patch;
+}
+
+void Terrain::ReleasePatch(TerrainPatch* patch)
+{
+    if (!patch)
+        return;
+
+    patch->SetEnabled(false);
+    patch->SetTreeLevel(M_MAX_UNSIGNED);
+    freePatches_.Push(WeakPtr<TerrainPatch>(patch));
+}
+
+void Terrain::SplitTreeNode(unsigned level, int x, int z)
+{
+    TerrainTreeNode& treeNode = GetTreeNode(level, x, z);
+    ReleasePatch(treeNode.patch_);
+    treeNode.patch_.Reset();
+    treeNode.state_ = TREE_SPLIT;
+
+    // The children start from the parent's shape and geomorph to their own
+    for (int cz = 0; cz < 2; ++cz)
+    {
+        for (int cx = 0; cx < 2; ++cx)
+            AcquirePatch(level - 1, x * 2 + cx, z * 2 + cz, 1.0f);
+    }
+}
+
+void Terrain::UpdateTreeNode(unsigned level, int x, int z, const PODVector<Camera*>& cameras, float morphStep, unsigned& numSplits)
+{
+    TerrainTreeNode& treeNode = GetTreeNode(level, x, z);
+
+    switch (treeNode.state_)
+    {
+    case TREE_ACTIVE:
+        if (level > 0 && numSplits < TREE_SPLITS_PER_FRAME && GetTreeNodeLodError(level, x, z, cameras) > TREE_LOD_CONSTANT)
+        {
+            SplitTreeNode(level, x, z);
+            ++numSplits;
+        }
+        else if (treeNode.patch_ && treeNode.patch_->GetMorph() > 0.0f)
+        {
+            treeNode.patch_->SetMorph(treeNode.patch_->GetMorph() - morphStep);
+            UpdatePatchMorph(treeNode.patch_);
+        }
+        break;
+
+    case TREE_SPLIT:
+        {
+            bool childrenActive = true;
+            for (int cz = 0; cz < 2; ++cz)
+            {
+                for (int cx = 0; cx < 2; ++cx)
+                {
+                    UpdateTreeNode(level - 1, x * 2 + cx, z * 2 + cz, cameras, morphStep, numSplits);
+                    if (GetTreeNode(level - 1, x * 2 + cx, z * 2 + cz).state_ != TREE_ACTIVE)
+                        childrenActive = false;
+                }
+            }
+
+            // Merge with a lower threshold than splitting to avoid flipping back and forth at the boundary
+            if (childrenActive && GetTreeNodeLodError(level, x, z, cameras) < TREE_LOD_CONSTANT * TREE_MERGE_RATIO)
+                treeNode.state_ = TREE_MERGING;
+        }
+        break;
+
+    case TREE_MERGING:
+        if (GetTreeNodeLodError(level, x, z, cameras) >= TREE_LOD_CONSTANT * TREE_MERGE_RATIO)
+            treeNode.state_ = TREE_SPLIT;
+        else
+        {
+            // Geomorph the children to the parent's shape, then replace them with the parent
+            bool finished = true;
+            for (int cz = 0; cz < 2; ++cz)
+            {
+                for (int cx = 0; cx < 2; ++cx)
+                {
+                    TerrainPatch* patch = GetTreeNode(level - 1, x * 2 + cx, z * 2 + cz).patch_;
+                    if (patch)
+                    {
+                        patch->SetMorph(patch->GetMorph() + morphStep);
+                        UpdatePatchMorph(patch);
+                        if (patch->GetMorph() < 1.0f)
+                            finished = false;
+                    }
+                }
+            }
+
+            if (finished)
+            {
+                for (int cz = 0; cz < 2; ++cz)
+                {
+                    for (int cx = 0; cx < 2; ++cx)
+                    {
+                        TerrainTreeNode& child = GetTreeNode(level - 1, x * 2 + cx, z * 2 + cz);
+                        ReleasePatch(child.patch_);
+                        child.patch_.Reset();
+                        child.state_ = TREE_INACTIVE;
+                    }
+                }
+
+                AcquirePatch(level, x, z, 0.0f);
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+float Terrain::GetTreeNodeLodError(unsigned level, int x, int z, const PODVector<Camera*>& cameras) const
+{
+    const TerrainTreeNode& treeNode = treeLevels_[level][z * (numPatches_.x_ >> level) + x];
+    float nodeScale = (float)(1 << level);
+    Vector3 min(patchWorldOrigin_.x_ + (float)x * nodeScale * patchWorldSize_.x_, treeNode.minHeight_,
+        patchWorldOrigin_.y_ + (float)z * nodeScale * patchWorldSize_.y_);
+    Vector3 max(min.x_ + nodeScale * patchWorldSize_.x_, treeNode.maxHeight_, min.z_ + nodeScale * patchWorldSize_.y_);
+
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    BoundingBox worldBox = BoundingBox(min, max).Transformed(worldTransform);
+    float scale = worldTransform.Scale().DotProduct(DOT_SCALE);
+    float maxError = 0.0f;
+
+    for (unsigned i = 0; i < cameras.Size(); ++i)
+    {
+        // Measure from the closest point of the node's bounds, so that a node the camera is above or inside of gets refined
+        Camera* camera = cameras[i];
+        const Vector3& cameraPos = camera->GetNode()->GetWorldPosition();
+        Vector3 closest(Clamp(cameraPos.x_, worldBox.min_.x_, worldBox.max_.x_),
+            Clamp(cameraPos.y_, worldBox.min_.y_, worldBox.max_.y_), Clamp(cameraPos.z_, worldBox.min_.z_, worldBox.max_.z_));
+
+        float lodDistance = camera->GetLodDistance(camera->GetDistance(closest), scale, lodBias_);
+        if (lodDistance < M_EPSILON)
+            return M_INFINITY;
+        maxError = Max(maxError, treeNode.error_ / lodDistance);
+    }
+
+    return maxError;
+}
+
+void Terrain::UpdateTree(float timeStep)
+{
+    if (treeLevels_.Empty())
+        return;
+
+    // Refine the tree for every camera that renders this scene
+    PODVector<Camera*> cameras;
+    GetLodCameras(cameras);
+    if (cameras.Empty())
+        return;
+
+    PROFILE(UpdateTerrainTree);
+
+    unsigned topLevel = treeLevels_.Size() - 1;
+    float morphStep = timeStep / TREE_MORPH_TIME;
+    unsigned numSplits = 0;
+
+    for (int z = 0; z < numPatches_.y_ >> topLevel; ++z)
+    {
+        for (int x = 0; x < numPatches_.x_ >> topLevel; ++x)
+            UpdateTreeNode(topLevel, x, z, cameras, morphStep, numSplits);
+    }
+}
+
+void Terrain::GetLodCameras(PODVector<Camera*>& cameras) const
+{
+    cameras.Clear();
+
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (!renderer)
+        return;
+
+    Scene* scene = GetScene();
+    for (unsigned i = 0; i < renderer->GetNumViewports(); ++i)
+    {
+        Viewport* viewport = renderer->GetViewport(i);
+        if (viewport && viewport->GetScene() == scene && viewport->GetCamera() && viewport->GetCamera()->GetNode())
+            cameras.Push(viewport->GetCamera());
+    }
+}
+
+String Terrain::GetTileImageName(int x, int z) const
+{
+    // The tile rows are numbered from the north, same as the rows of a heightmap image
+    return tilePattern_.Replaced("$x", String(x)).Replaced("$y", String(numTiles_.y_ - 1 - z));
+}
+
+unsigned Terrain::GetTileMemoryUse() const
+{
+    unsigned row = (unsigned)(patchSize_ + 1);
+    unsigned patchesPerTile = (unsigned)((tileSize_ - 1) / patchSize_);
+    // Vertex buffer (position, normal, texcoord, tangent), plus the CPU-side position and occlusion vertex data
+    unsigned patchMemory = row * row * (13 * sizeof(float) + 2 * sizeof(Vector3));
+
+    return (unsigned)(tileSize_ * tileSize_) * sizeof(float) + patchesPerTile * patchesPerTile * patchMemory;
+}
+
+bool Terrain::SetTileHeightData(unsigned index, Image* image)
+{
+    if (image->IsCompressed() || image->GetWidth() != tileSize_ || image->GetHeight() != tileSize_)
+    {
+        LOGERROR("Heightmap tile " + image->GetName() + " is compressed or does not match the tile size " + String(tileSize_));
+        return false;
+    }
+
+    const unsigned char* src = image->GetData();
+    unsigned imgComps = image->GetComponents();
+    unsigned imgRow = image->GetWidth() * imgComps;
+    SharedArrayPtr<float> heightData(new float[tileSize_ * tileSize_]);
+    float* dest = heightData.Get();
+
+    for (int z = 0; z < tileSize_; ++z)
+    {
+        const unsigned char* srcRow = src + imgRow * (tileSize_ - 1 - z);
+
+        // If more than 1 component, use the green channel for more accuracy
+        for (int x = 0; x < tileSize_; ++x)
+        {
+            if (imgComps == 1)
+                *dest++ = (float)srcRow[x] * spacing_.y_;
+            else
+                *dest++ = ((float)srcRow[imgComps * x] + (float)srcRow[imgComps * x + 1] / 256.0f) * spacing_.y_;
+        }
+    }
+
+    tiles_[index].heightData_ = heightData;
+
+    // The patches around the tile sampled their edge normals from other tiles before, so queue them for rebuild
+    int tileX = (int)index % numTiles_.x_;
+    int tileZ = (int)index / numTiles_.x_;
+    int patchesPerTile = (tileSize_ - 1) / patchSize_;
+    int startX = tileX * patchesPerTile - 1;
+    int endX = (tileX + 1) * patchesPerTile;
+    int startZ = tileZ * patchesPerTile - 1;
+    int endZ = (tileZ + 1) * patchesPerTile;
+    for (int z = Max(startZ, 0); z <= Min(endZ, numPatches_.y_ - 1); ++z)
+    {
+        for (int x = Max(startX, 0); x <= Min(endX, numPatches_.x_ - 1); ++x)
+        {
+            if (x != startX && x != endX && z != startZ && z != endZ)
+                continue;
+
+            unsigned patchIndex = (unsigned)(z * numPatches_.x_ + x);
+            if (patches_[patchIndex] && !rebuildPatches_.Contains(patchIndex))
+                rebuildPatches_.Push(patchIndex);
+        }
+    }
+
+    return true;
+}
+
+void Terrain::CreateTilePatches(unsigned index, unsigned& numBuildVertices)
+{
+    PROFILE(CreateTilePatches);
+
+    TerrainTile& tile = tiles_[index];
+    int tileX = (int)index % numTiles_.x_;
+    int tileZ = (int)index / numTiles_.x_;
+    int patchesPerTile = (tileSize_ - 1) / patchSize_;
+    unsigned numPatches = (unsigned)(patchesPerTile * patchesPerTile);
+    unsigned patchVertices = (unsigned)((patchSize_ + 1) * (patchSize_ + 1));
+
+    while (tile.numCreatedPatches_ < numPatches && numBuildVertices < TILE_BUILD_VERTICES_PER_FRAME)
+    {
+        int x = tileX * patchesPerTile + (int)tile.numCreatedPatches_ % patchesPerTile;
+        int z = tileZ * patchesPerTile + (int)tile.numCreatedPatches_ / patchesPerTile;
+
+        // Create the patch scene node as local and temporary so that it is not unnecessarily serialized to either
+        // file or replicated over the network
+        Node* patchNode = node_->CreateChild("Patch_" + String(x) + "_" + String(z), LOCAL);
+        patchNode->SetTemporary(true);
+        patchNode->SetPosition(Vector3(patchWorldOrigin_.x_ + (float)x * patchWorldSize_.x_, 0.0f,
+            patchWorldOrigin_.y_ + (float)z * patchWorldSize_.y_));
+
+        TerrainPatch* patch = patchNode->CreateComponent<TerrainPatch>();
+        patch->SetCoordinates(IntVector2(x, z));
+        InitializePatch(patch);
+        CreatePatchGeometry(patch);
+        CalculateLodErrors(patch);
+
+        patches_[z * numPatches_.x_ + x] = patch;
+
+        // Link the new patch to its neighbors, and the neighbors to the new patch
+        SetNeighbors(patch);
+        TerrainPatch* neighbors[] = { patch->GetNorthPatch(), patch->GetSouthPatch(), patch->GetWestPatch(),
+            patch->GetEastPatch() };
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            if (neighbors[i])
+                SetNeighbors(neighbors[i]);
+        }
+
+        ++tile.numCreatedPatches_;
+        numBuildVertices += patchVertices;
+    }
+
+    if (tile.numCreatedPatches_ < numPatches)
+        return;
+
+    tile.state_ = TILE_READY;
+
+    using namespace TerrainTileLoaded;
+
+    VariantMap& eventData = GetEventDataMap();
+    eventData[P_NODE] = node_;
+    eventData[P_TILE] = IntVector2(tileX, tileZ);
+    node_->SendEvent(E_TERRAINTILELOADED, eventData);
+}
+
+void Terrain::UnloadTile(unsigned index)
+{
+    TerrainTile& tile = tiles_[index];
+
+    // A tile that is still being built may already have some of its patches
+    if (tile.state_ == TILE_LOADED || tile.state_ == TILE_READY)
+    {
+        int tileX = (int)index % numTiles_.x_;
+        int tileZ = (int)index / numTiles_.x_;
+        int patchesPerTile = (tileSize_ - 1) / patchSize_;
+
+        for (int z = tileZ * patchesPerTile; z < (tileZ + 1) * patchesPerTile; ++z)
+        {
+            for (int x = tileX * patchesPerTile; x < (tileX + 1) * patchesPerTile; ++x)
+            {
+                WeakPtr<TerrainPatch>& patch = patches_[z * numPatches_.x_ + x];
+                if (patch)
+                    node_->RemoveChild(patch->GetNode());
+                patch.Reset();
+            }
+        }
+    }
+
+    if (tile.state_ == TILE_READY)
+    {
+        int tileX = (int)index % numTiles_.x_;
+        int tileZ = (int)index / numTiles_.x_;
+
+        using namespace TerrainTileUnloaded;
+
+        VariantMap& eventData = GetEventDataMap();
+        eventData[P_NODE] = node_;
+        eventData[P_TILE] = IntVector2(tileX, tileZ);
+        node_->SendEvent(E_TERRAINTILEUNLOADED, eventData);
+    }
+
+    // A background load in progress is left to finish, and its image is released when it arrives
+    tile.heightData_.Reset();
+    tile.state_ = TILE_UNLOADED;
+    tile.numCreatedPatches_ = 0;
+}
+
+void Terrain::RebuildTilePatches(unsigned& numBuildVertices)
+{
+    if (rebuildPatches_.Empty())
+        return;
+
+    PROFILE(RebuildTilePatches);
+
+    unsigned patchVertices = (unsigned)((patchSize_ + 1) * (patchSize_ + 1));
+    unsigned numRebuilt = 0;
+
+    while (numRebuilt < rebuildPatches_.Size() && numBuildVertices < TILE_BUILD_VERTICES_PER_FRAME)
+    {
+        // The patch may have been unloaded since it was queued
+        TerrainPatch* patch = patches_[rebuildPatches_[numRebuilt++]];
+        if (!patch)
+            continue;
+
+        CreatePatchGeometry(patch);
+        CalculateLodErrors(patch);
+        numBuildVertices += patchVertices;
+    }
+
+    rebuildPatches_.Erase(0, numRebuilt);
+}
+
+void Terrain::UpdateTiles()
+{
+    PODVector<Camera*> cameras;
+    GetLodCameras(cameras);
+    if (cameras.Empty())
+        return;
+
+    PROFILE(UpdateTerrainTiles);
+
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+
+    // Release the images of tiles loaded on the previous frames, as their heights have been copied
+    for (unsigned i = 0; i < releasedTileImages_.Size(); ++i)
+        cache->ReleaseResource(Image::GetTypeStatic(), releasedTileImages_[i]);
+    releasedTileImages_.Clear();
+
+    const Matrix3x4& worldTransform = node_->GetWorldTransform();
+    float tileWorldSizeX = spacing_.x_ * (float)(tileSize_ - 1);
+    float tileWorldSizeZ = spacing_.z_ * (float)(tileSize_ - 1);
+    // Heights are not known before loading, so use the full range of the heightmap format
+    float maxHeight = 256.0f * spacing_.y_;
+
+    // Find the tiles within streaming distance. Tiles already in use are kept until a slightly longer distance, so that
+    // they are not reloaded when the camera moves back and forth at the boundary
+    PODVector<Pair<float, unsigned> > wantedTiles;
+    for (unsigned i = 0; i < tiles_.Size(); ++i)
+    {
+        TerrainTile& tile = tiles_[i];
+        if (tile.state_ == TILE_FAILED)
+            continue;
+
+        int tileX = (int)i % numTiles_.x_;
+        int tileZ = (int)i / numTiles_.x_;
+        Vector3 min(patchWorldOrigin_.x_ + (float)tileX * tileWorldSizeX, 0.0f, patchWorldOrigin_.y_ + (float)tileZ * tileWorldSizeZ);
+        Vector3 max(min.x_ + tileWorldSizeX, maxHeight, min.z_ + tileWorldSizeZ);
+        BoundingBox worldBox = BoundingBox(min, max).Transformed(worldTransform);
+
+        float distance = M_INFINITY;
+        for (unsigned j = 0; j < cameras.Size(); ++j)
+        {
+            const Vector3& cameraPos = cameras[j]->GetNode()->GetWorldPosition();
+            Vector3 closest(Clamp(cameraPos.x_, worldBox.min_.x_, worldBox.max_.x_),
+                Clamp(cameraPos.y_, worldBox.min_.y_, worldBox.max_.y_), Clamp(cameraPos.z_, worldBox.min_.z_, worldBox.max_.z_));
+            distance = Min(distance, (closest - cameraPos).Length());
+        }
+
+        float maxDistance = tile.state_ == TILE_UNLOADED ? streamingDistance_ : streamingDistance_ * TILE_UNLOAD_RATIO;
+        if (distance <= maxDistance)
+            wantedTiles.Push(MakePair(distance, i));
+    }
+
+    // Keep the nearest tiles that fit the memory budget
+    Sort(wantedTiles.Begin(), wantedTiles.End());
+    unsigned maxTiles = Max((int)(streamingBudget_ / GetTileMemoryUse()), 1);
+    if (wantedTiles.Size() > maxTiles)
+        wantedTiles.Resize(maxTiles);
+
+    PODVector<bool> keepTiles(tiles_.Size());
+    for (unsigned i = 0; i < keepTiles.Size(); ++i)
+        keepTiles[i] = false;
+    for (unsigned i = 0; i < wantedTiles.Size(); ++i)
+        keepTiles[wantedTiles[i].second_] = true;
+
+    for (unsigned i = 0; i < tiles_.Size(); ++i)
+    {
+        if (!keepTiles[i] && tiles_[i].state_ != TILE_UNLOADED && tiles_[i].state_ != TILE_FAILED)
+            UnloadTile(i);
+    }
+
+    // Fix the seams of the patches next to newly loaded tiles first, then request the missing tiles and create the patches
+    // of the loaded ones, nearest first. The geometry built per frame is limited to avoid frame time spikes from large tiles
+    unsigned numBuildVertices = 0;
+    RebuildTilePatches(numBuildVertices);
+
+    for (unsigned i = 0; i < wantedTiles.Size(); ++i)
+    {
+        unsigned index = wantedTiles[i].second_;
+        TerrainTile& tile = tiles_[index];
+
+        if (tile.state_ == TILE_UNLOADED)
+        {
+            String name = cache->SanitateResourceName(GetTileImageName((int)index % numTiles_.x_, (int)index / numTiles_.x_));
+            tile.state_ = TILE_LOADING;
+            pendingTiles_[StringHash(name)] = index;
+
+            if (!cache->BackgroundLoadResource<Image>(name))
+            {
+                // The image may already be in the cache, otherwise it is either queued already or can not be loaded
+                Image* image = cache->GetExistingResource<Image>(name);
+                if (image)
+                {
+                    pendingTiles_.Erase(StringHash(name));
+                    tile.state_ = SetTileHeightData(index, image) ? TILE_LOADED : TILE_FAILED;
+                    releasedTileImages_.Push(name);
+                }
+                else if (!cache->Exists(name))
+                {
+                    LOGERROR("Could not find heightmap tile " + name);
+                    pendingTiles_.Erase(StringHash(name));
+                    tile.state_ = TILE_FAILED;
+                }
+            }
+        }
+
+        if (tile.state_ == TILE_LOADED && numBuildVertices < TILE_BUILD_VERTICES_PER_FRAME)
+            CreateTilePatches(index, numBuildVertices);
+    }
+}
+
+void Terrain::UpdateEventSubscriptions()
+{
+    if (quadtree_ || tiledHeightMap_)
+        SubscribeToEvent(E_POSTUPDATE, HANDLER(Terrain, HandlePostUpdate));
+    else
+        UnsubscribeFromEvent(E_POSTUPDATE);
+
+    if (tiledHeightMap_)
+        SubscribeToEvent(E_RESOURCEBACKGROUNDLOADED, HANDLER(Terrain, HandleTileLoaded));
+    else
+        UnsubscribeFromEvent(E_RESOURCEBACKGROUNDLOADED);
+}
+
 bool Terrain::SetHeightMapInternal(Image* image, bool recreateNow)
 {
     if (image && image->IsCompressed())
@@ -1277,9 +2357,102 @@ bool Terrain::SetHeightMapInternal(Image* image, bool recreateNow)
     return true;
 }
 
+bool Terrain::SetTiledHeightMapInternal(XMLFile* file, bool recreateNow)
+{
+    bool success = true;
+
+    if (file)
+    {
+        XMLElement rootElem = file->GetRoot("tiledheightmap");
+        int tileSize = rootElem ? rootElem.GetInt("tilesize") : 0;
+        IntVector2 numTiles = rootElem ? rootElem.GetIntVector2("numtiles") : IntVector2::ZERO;
+        String pattern = rootElem ? rootElem.GetAttribute("pattern") : String::EMPTY;
+
+        if (tileSize < MIN_PATCH_SIZE + 1 || !IsPowerOfTwo((unsigned)(tileSize - 1)) || numTiles.x_ <= 0 || numTiles.y_ <= 0 ||
+            pattern.Empty())
+        {
+            LOGERROR("Invalid tiled heightmap description " + file->GetName());
+            file = 0;
+            success = false;
+        }
+        else
+        {
+            tileSize_ = tileSize;
+            numTiles_ = numTiles;
+            tilePattern_ = pattern;
+        }
+    }
+
+    // Unsubscribe from the reload event of previous description (if any), then subscribe to the new
+    if (tiledHeightMap_)
+        UnsubscribeFromEvent(tiledHeightMap_, E_RELOADFINISHED);
+    if (file)
+        SubscribeToEvent(file, E_RELOADFINISHED, HANDLER(Terrain, HandleHeightMapReloadFinished));
+
+    tiledHeightMap_ = file;
+    if (!tiledHeightMap_)
+    {
+        tileSize_ = 0;
+        numTiles_ = IntVector2::ZERO;
+        tilePattern_.Clear();
+    }
+
+    UpdateEventSubscriptions();
+
+    if (recreateNow)
+        CreateGeometry();
+    else
+        recreateTerrain_ = true;
+
+    return success;
+}
+
 void Terrain::HandleHeightMapReloadFinished(StringHash eventType, VariantMap& eventData)
 {
-    CreateGeometry();
+    // Reparse the tiled heightmap description in case it was the one reloaded
+    if (tiledHeightMap_)
+        SetTiledHeightMapInternal(tiledHeightMap_, true);
+    else
+        CreateGeometry();
+}
+
+void Terrain::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+    using namespace PostUpdate;
+
+    if (!IsEnabledEffective())
+        return;
+
+    if (tiles_.Size())
+        UpdateTiles();
+    else
+        UpdateTree(eventData[P_TIMESTEP].GetFloat());
+}
+
+void Terrain::HandleTileLoaded(StringHash eventType, VariantMap& eventData)
+{
+    using namespace ResourceBackgroundLoaded;
+
+    const String& name = eventData[P_RESOURCENAME].GetString();
+    HashMap<StringHash, unsigned>::Iterator i = pendingTiles_.Find(StringHash(name));
+    if (i == pendingTiles_.End())
+        return;
+
+    unsigned index = i->second_;
+    pendingTiles_.Erase(i);
+
+    // The tile may have been unloaded while its image was loading
+    if (index < tiles_.Size() && tiles_[index].state_ == TILE_LOADING)
+    {
+        Image* image = static_cast<Image*>(eventData[P_RESOURCE].GetPtr());
+        if (eventData[P_SUCCESS].GetBool() && image && SetTileHeightData(index, image))
+            tiles_[index].state_ = TILE_LOADED;
+        else
+            tiles_[index].state_ = TILE_FAILED;
+    }
+
+    // The image is added to the cache after this event, so release it on the next update
+    releasedTileImages_.Push(name);
 }
 
 }
@@ -27,11 +27,74 @@
 namespace Clockwork
 {
 
+class Camera;
 class Image;
 class IndexBuffer;
 class Material;
 class Node;
 class TerrainPatch;
+class XMLFile;
+
+/// Quadtree terrain node state.
+enum TerrainTreeState
+{
+    TREE_INACTIVE = 0,
+    TREE_ACTIVE,
+    TREE_SPLIT,
+    TREE_MERGING
+};
+
+/// Quadtree terrain node. Covers 2^level x 2^level patches of the base grid.
+struct TerrainTreeNode
+{
+    /// Construct.
+    TerrainTreeNode() :
+        error_(0.0f),
+        minHeight_(0.0f),
+        maxHeight_(0.0f),
+        state_(TREE_INACTIVE)
+    {
+    }
+
+    /// Patch rendering the node while it is active.
+    WeakPtr<TerrainPatch> patch_;
+    /// Maximum geometrical error compared to the full resolution heightmap.
+    float error_;
+    /// Minimum height.
+    float minHeight_;
+    /// Maximum height.
+    float maxHeight_;
+    /// State.
+    TerrainTreeState state_;
+};
+
+/// Streamed heightmap tile state.
+enum TerrainTileState
+{
+    TILE_UNLOADED = 0,
+    TILE_LOADING,
+    TILE_LOADED,
+    TILE_READY,
+    TILE_FAILED
+};
+
+/// Streamed heightmap tile.
+struct TerrainTile
+{
+    /// Construct.
+    TerrainTile() :
+        state_(TILE_UNLOADED),
+        numCreatedPatches_(0)
+    {
+    }
+
+    /// Height data, present once the tile image has been loaded.
+    SharedArrayPtr<float> heightData_;
+    /// State.
+    TerrainTileState state_;
+    /// Number of patches created so far. The patches of a loaded tile are created over several frames.
+    unsigned numCreatedPatches_;
+};
 
 /// Heightmap terrain component.
 class CLOCKWORK_API Terrain : public Component
@@ -63,8 +126,16 @@ public:
     void SetOcclusionLodLevel(unsigned level);
     /// Set smoothing of heightmap.
     void SetSmoothing(bool enable);
+    /// Set quadtree mode. When enabled, patches are split and merged by distance from the viewport cameras so that far away terrain is rendered with few large patches.
+    void SetQuadtree(bool enable);
     /// Set heightmap image. Dimensions should be a power of two + 1. Uses 8-bit grayscale, or optionally red as MSB and green as LSB for 16-bit accuracy. Return true if successful.
     bool SetHeightMap(Image* image);
+    /// Set tiled heightmap description. The tiles are streamed in and out by distance from the viewport cameras instead of loading the whole heightmap at once. When set, it is used instead of the heightmap image. Return true if successful.
+    bool SetTiledHeightMap(XMLFile* file);
+    /// Set distance from the viewport cameras within which heightmap tiles are streamed in.
+    void SetStreamingDistance(float distance);
+    /// Set memory budget in bytes for streamed tiles, including their height data and patch geometry. The nearest tiles are kept when over budget.
+    void SetStreamingBudget(unsigned bytes);
     /// Set material.
     void SetMaterial(Material* material);
     /// Set draw distance for patches.
@@ -113,13 +184,19 @@ public:
     /// Return whether smoothing is in use.
     bool GetSmoothing() const { return smoothing_; }
 
+    /// Return whether quadtree mode is in use.
+    bool GetQuadtree() const { return quadtree_; }
+
+    /// Return number of quadtree levels. Zero when quadtree mode is not in use.
+    unsigned GetNumTreeLevels() const { return treeLevels_.Size(); }
+
     /// Return heightmap image.
     Image* GetHeightMap() const;
     /// Return material.
     Material* GetMaterial() const;
     /// Return patch by index.
     TerrainPatch* GetPatch(unsigned index) const;
-    /// Return patch by patch coordinates.
+    /// Return patch by patch coordinates. Always null in quadtree mode.
     TerrainPatch* GetPatch(int x, int z) const;
     /// Return height at world coordinates.
     float GetHeight(const Vector3& worldPosition) const;
@@ -128,9 +205,31 @@ public:
     /// Convert world position to heightmap pixel position. Note that the internal height data representation is reversed vertically, but in the heightmap image north is at the top.
     IntVector2 WorldToHeightMap(const Vector3& worldPosition) const;
 
-    /// Return raw height data.
+    /// Return raw height data. Null when streaming a tiled heightmap.
     SharedArrayPtr<float> GetHeightData() const { return heightData_; }
 
+    /// Return tiled heightmap description.
+    XMLFile* GetTiledHeightMap() const;
+
+    /// Return streaming distance.
+    float GetStreamingDistance() const { return streamingDistance_; }
+
+    /// Return streaming memory budget in bytes.
+    unsigned GetStreamingBudget() const { return streamingBudget_; }
+
+    /// Return heightmap size in tiles. Zero when not streaming.
+    const IntVector2& GetNumTiles() const { return numTiles_; }
+
+    /// Return heightmap tile size in vertices.
+    int GetTileSize() const { return tileSize_; }
+
+    /// Return number of streamed tiles that have patches created.
+    unsigned GetNumLoadedTiles() const;
+    /// Return estimated memory use of the streamed tiles in bytes.
+    unsigned GetStreamingMemoryUse() const;
+    /// Return height data of a streamed tile by tile coordinates, or null if not loaded. The tiles share their edge vertices.
+    SharedArrayPtr<float> GetTileHeightData(int x, int z) const;
+
     /// Return draw distance.
     float GetDrawDistance() const { return drawDistance_; }
 
@@ -171,6 +270,8 @@ public:
     void CreatePatchGeometry(TerrainPatch* patch);
     /// Update patch based on LOD and neighbor LOD.
     void UpdatePatchLod(TerrainPatch* patch);
+    /// Update patch vertex heights after its geomorph factor has changed.
+    void UpdatePatchMorph(TerrainPatch* patch);
     /// Set heightmap attribute.
     void SetHeightMapAttr(const ResourceRef& value);
     /// Set material attribute.
@@ -181,18 +282,70 @@ public:
     void SetMaxLodLevelsAttr(unsigned value);
     /// Set occlusion LOD level attribute.
     void SetOcclusionLodLevelAttr(unsigned value);
+    /// Set quadtree mode attribute.
+    void SetQuadtreeAttr(bool enable);
+    /// Set tiled heightmap attribute.
+    void SetTiledHeightMapAttr(const ResourceRef& value);
     /// Return heightmap attribute.
     ResourceRef GetHeightMapAttr() const;
     /// Return material attribute.
     ResourceRef GetMaterialAttr() const;
+    /// Return tiled heightmap attribute.
+    ResourceRef GetTiledHeightMapAttr() const;
 
 private:
     /// Regenerate terrain geometry.
     void CreateGeometry();
     /// Create index data shared by all patches.
     void CreateIndexData();
+    /// Smooth a region of the height data from the source data.
+    void SmoothHeightData(int startX, int startZ, int endX, int endZ);
+    /// Copy the drawable parameters to a newly created patch.
+    void InitializePatch(TerrainPatch* patch);
+    /// Build the quadtree levels and activate the root nodes.
+    void CreateTree();
+    /// Create index data for quadtree patches: the full resolution grid and the edge skirts.
+    void CreateTreeIndexData();
+    /// Regenerate quadtree patch geometry.
+    void CreateTreePatchGeometry(TerrainPatch* patch);
+    /// Take a patch from the pool (or create one) and activate it for a quadtree node.
+    TerrainPatch* AcquirePatch(unsigned level, int x, int z, float morph);
+    /// Disable a patch and return it to the pool.
+    void ReleasePatch(TerrainPatch* patch);
+    /// Replace an active quadtree node with its four children.
+    void SplitTreeNode(unsigned level, int x, int z);
+    /// Update quadtree node splitting, merging and geomorphing recursively.
+    void UpdateTreeNode(unsigned level, int x, int z, const PODVector<Camera*>& cameras, float morphStep, unsigned& numSplits);
+    /// Return the largest screen-space error of a quadtree node over the cameras.
+    float GetTreeNodeLodError(unsigned level, int x, int z, const PODVector<Camera*>& cameras) const;
+    /// Return quadtree node.
+    TerrainTreeNode& GetTreeNode(unsigned level, int x, int z) { return treeLevels_[level][z * (numPatches_.x_ >> level) + x]; }
+    /// Update the quadtree from the viewport cameras.
+    void UpdateTree(float timeStep);
+    /// Return the cameras of the viewports that render the terrain's scene.
+    void GetLodCameras(PODVector<Camera*>& cameras) const;
+    /// Return resource name of a heightmap tile image.
+    String GetTileImageName(int x, int z) const;
+    /// Return estimated memory use of one streamed tile in bytes.
+    unsigned GetTileMemoryUse() const;
+    /// Copy the heights of a loaded tile image and queue the bordering patches of the neighbor tiles for rebuild. Return true if successful.
+    bool SetTileHeightData(unsigned index, Image* image);
+    /// Create patches of a loaded tile until the vertex budget of the frame runs out. The tile is ready once all of its patches exist.
+    void CreateTilePatches(unsigned index, unsigned& numBuildVertices);
+    /// Rebuild the geometry of queued patches until the vertex budget of the frame runs out.
+    void RebuildTilePatches(unsigned& numBuildVertices);
+    /// Remove the patches and height data of a tile.
+    void UnloadTile(unsigned index);
+    /// Request, build and unload tiles by distance from the viewport cameras.
+    void UpdateTiles();
+    /// Update event subscriptions for quadtree and streaming updates.
+    void UpdateEventSubscriptions();
+    /// Set tiled heightmap description and optionally recreate the geometry immediately. Return true if successful.
+    bool SetTiledHeightMapInternal(XMLFile* file, bool recreateNow);
     /// Return an uninterpolated terrain height value, clamping to edges.
     float GetRawHeight(int x, int z) const;
+    /// Return a height value from the streamed tiles, clamping to edges. Vertices outside the loaded tiles use the edge of the closest loaded tile.
+    float GetTileHeight(int x, int z) const;
     /// Return a source terrain height value, clamping to edges. The source data is used for smoothing.
     float GetSourceHeight(int x, int z) const;
     /// Return interpolated height for a specific LOD level.
@@ -207,6 +360,10 @@ private:
     bool SetHeightMapInternal(Image* image, bool recreateNow);
     /// Handle heightmap image reload finished.
     void HandleHeightMapReloadFinished(StringHash eventType, VariantMap& eventData);
+    /// Handle scene post-update event to update the quadtree or the streamed tiles.
+    void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
+    /// Handle a background loaded tile image.
+    void HandleTileLoaded(StringHash eventType, VariantMap& eventData);
 
     /// Shared index buffer.
     SharedPtr<IndexBuffer> indexBuffer_;
@@ -218,8 +375,32 @@ private:
     SharedArrayPtr<float> sourceHeightData_;
     /// Material.
     SharedPtr<Material> material_;
-    /// Terrain patches.
+    /// Terrain patches. In quadtree mode all pooled patches, whether active or not.
     Vector<WeakPtr<TerrainPatch> > patches_;
+    /// Unused patches in quadtree mode.
+    Vector<WeakPtr<TerrainPatch> > freePatches_;
+    /// Quadtree nodes per level, finest first.
+    Vector<Vector<TerrainTreeNode> > treeLevels_;
+    /// Tiled heightmap description.
+    SharedPtr<XMLFile> tiledHeightMap_;
+    /// Tile image name pattern.
+    String tilePattern_;
+    /// Streamed tiles.
+    Vector<TerrainTile> tiles_;
+    /// Tile indices by image name for background loads in progress.
+    HashMap<StringHash, unsigned> pendingTiles_;
+    /// Tile images to release from the resource cache.
+    Vector<String> releasedTileImages_;
+    /// Indices of patches whose geometry needs rebuilding because a neighbor tile has loaded.
+    PODVector<unsigned> rebuildPatches_;
+    /// Heightmap size in tiles.
+    IntVector2 numTiles_;
+    /// Tile size in vertices.
+    int tileSize_;
+    /// Streaming distance.
+    float streamingDistance_;
+    /// Streaming memory budget in bytes.
+    unsigned streamingBudget_;
     /// Draw ranges for different LODs and stitching combinations.
     PODVector<Pair<unsigned, unsigned> > drawRanges_;
     /// Vertex and height spacing.
@@ -248,6 +429,8 @@ private:
     unsigned occlusionLodLevel_;
     /// Smoothing enable flag.
     bool smoothing_;
+    /// Quadtree mode flag.
+    bool quadtree_;
     /// Visible flag.
     bool visible_;
     /// Shadowcaster flag.
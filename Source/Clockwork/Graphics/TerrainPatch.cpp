@@ -52,7 +52,9 @@ TerrainPatch::TerrainPatch(Context* context) :
     occlusionGeometry_(new Geometry(context)),
     vertexBuffer_(new VertexBuffer(context)),
     coordinates_(IntVector2::ZERO),
-    lodLevel_(0)
+    lodLevel_(0),
+    treeLevel_(0),
+    morph_(0.0f)
 {
     geometry_->SetVertexBuffer(0, vertexBuffer_, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
     maxLodGeometry_->SetVertexBuffer(0, vertexBuffer_, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1 | MASK_TANGENT);
@@ -247,6 +249,16 @@ void TerrainPatch::ResetLod()
     lodLevel_ = 0;
 }
 
+void TerrainPatch::SetTreeLevel(unsigned level)
+{
+    treeLevel_ = level;
+}
+
+void TerrainPatch::SetMorph(float morph)
+{
+    morph_ = Clamp(morph, 0.0f, 1.0f);
+}
+
 Geometry* TerrainPatch::GetGeometry() const
 {
     return geometry_;
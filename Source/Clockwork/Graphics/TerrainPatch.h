@@ -73,6 +73,10 @@ public:
     void SetCoordinates(const IntVector2& coordinates);
     /// Reset to LOD level 0.
     void ResetLod();
+    /// Set quadtree level. M_MAX_UNSIGNED marks an unused pooled patch.
+    void SetTreeLevel(unsigned level);
+    /// Set geomorph factor between own (0) and parent quadtree level (1) heights.
+    void SetMorph(float morph);
 
     /// Return visible geometry.
     Geometry* GetGeometry() const;
@@ -106,6 +110,15 @@ public:
     /// Return current LOD level.
     unsigned GetLodLevel() const { return lodLevel_; }
 
+    /// Return quadtree level.
+    unsigned GetTreeLevel() const { return treeLevel_; }
+
+    /// Return geomorph factor.
+    float GetMorph() const { return morph_; }
+
+    /// Return own and parent quadtree level height per vertex.
+    PODVector<float>& GetMorphHeights() { return morphHeights_; }
+
 protected:
     /// Recalculate the world-space bounding box.
     virtual void OnWorldBoundingBoxUpdate();
@@ -138,6 +151,12 @@ private:
     IntVector2 coordinates_;
     /// Current LOD level.
     unsigned lodLevel_;
+    /// Quadtree level.
+    unsigned treeLevel_;
+    /// Geomorph factor.
+    float morph_;
+    /// Own and parent quadtree level height per vertex.
+    PODVector<float> morphHeights_;
 };
 
 }
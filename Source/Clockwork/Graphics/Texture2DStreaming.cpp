@@ -0,0 +1,161 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+#include "../Precompiled.h"
+
+#include "../Core/Context.h"
+#include "../Core/Timer.h"
+#include "../Core/WorkQueue.h"
+#include "../Graphics/Renderer.h"
+#include "../Graphics/Texture2D.h"
+#include "../IO/File.h"
+#include "../IO/Log.h"
+#include "../Resource/Image.h"
+#include "../Resource/ResourceCache.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+/// Load the image of a texture streaming step in a worker thread.
+static void LoadStreamImageWork(const WorkItem* item, unsigned threadIndex)
+{
+    Image* image = reinterpret_cast<Image*>(item->start_);
+    File* file = reinterpret_cast<File*>(item->end_);
+
+    // Zero memory use marks failure to the main thread
+    if (!image->BeginLoad(*file))
+        image->SetMemoryUse(0);
+}
+
+unsigned Texture2D::StreamDetail(unsigned budget)
+{
+    if (!streaming_)
+        return 0;
+
+    if (!streamItem_)
+    {
+        // Refine one mip level at a time, or drop directly to a coarser limit
+        unsigned targetLevels = GetStreamTargetLevels();
+        unsigned skipLevels = targetLevels < streamSkipLevels_ ? streamSkipLevels_ - 1 : targetLevels;
+        unsigned expectedSize = skipLevels < streamSkipLevels_ ? GetMemoryUse() * 4 : GetMemoryUse() / 4;
+        if (expectedSize > budget)
+            return 0;
+
+        ResourceCache* cache = GetSubsystem<ResourceCache>();
+        streamFile_ = cache->GetFile(GetName(), false);
+        if (!streamFile_)
+        {
+            LOGWARNING("Could not open " + GetName() + " for texture streaming");
+            streaming_ = false;
+            return 0;
+        }
+
+        streamImage_ = new Image(context_);
+        streamImage_->SetSkipLevels(skipLevels);
+
+        streamItem_ = new WorkItem();
+        streamItem_->workFunction_ = LoadStreamImageWork;
+        streamItem_->start_ = streamImage_.Get();
+        streamItem_->end_ = streamFile_.Get();
+        streamItem_->aux_ = 0;
+
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        if (queue)
+            queue->AddWorkItem(streamItem_);
+        else
+        {
+            LoadStreamImageWork(streamItem_, 0);
+            streamItem_->completed_ = true;
+        }
+
+        return expectedSize;
+    }
+
+    if (!streamItem_->completed_)
+        return 0;
+
+    SharedPtr<Image> image = streamImage_;
+    streamItem_.Reset();
+    streamImage_.Reset();
+    streamFile_.Reset();
+
+    if (!image->IsCompressed() || !image->GetMemoryUse() || !SetData(image))
+    {
+        LOGWARNING("Failed to stream texture " + GetName());
+        streaming_ = false;
+        return 0;
+    }
+
+    // Stop when the target is reached or when the image could not skip as many levels as requested
+    unsigned lastSkipLevels = streamSkipLevels_;
+    streamSkipLevels_ = image->GetSkippedLevels();
+    if (streamSkipLevels_ == GetStreamTargetLevels() || streamSkipLevels_ == lastSkipLevels)
+        streaming_ = false;
+
+    return image->GetMemoryUse();
+}
+
+void Texture2D::SetMaxResidentMip(unsigned mip)
+{
+    maxResidentMip_ = mip;
+
+    // Only textures loaded with streaming know their source data layout and can change resident levels
+    if (streamed_ && !streaming_ && streamSkipLevels_ != GetStreamTargetLevels())
+    {
+        streaming_ = true;
+        GetSubsystem<ResourceCache>()->AddStreamingResource(this);
+    }
+}
+
+unsigned Texture2D::GetStreamTargetLevels() const
+{
+    int quality = QUALITY_HIGH;
+    Renderer* renderer = GetSubsystem<Renderer>();
+    if (renderer)
+        quality = renderer->GetTextureQuality();
+
+    return (unsigned)Max((int)maxResidentMip_, (int)mipsToSkip_[quality]);
+}
+
+void Texture2D::CancelStreaming()
+{
+    if (streamItem_)
+    {
+        // If the step already started executing, wait for it as it accesses the image and file
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        if (queue && !queue->RemoveWorkItem(streamItem_))
+        {
+            while (!streamItem_->completed_)
+                Time::Sleep(0);
+        }
+
+        streamItem_.Reset();
+        streamImage_.Reset();
+        streamFile_.Reset();
+    }
+
+    streaming_ = false;
+}
+
+}
@@ -0,0 +1,251 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Container/Vector.h"
+#include "../Graphics/VertexCache.h"
+#include "../Math/MathDefs.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const int VERTEX_CACHE_SIZE = 32;
+
+/// Per-vertex state of the vertex cache optimizer.
+struct CacheVertex
+{
+    /// Start of this vertex's triangles in the adjacency list.
+    unsigned triangleStart_;
+    /// Number of triangles not yet output that use this vertex.
+    unsigned useCount_;
+    /// Position in the simulated LRU cache, or -1 if not cached.
+    int cachePosition_;
+    /// Current score.
+    float score_;
+};
+
+static float CalculateVertexScore(const CacheVertex& vertex)
+{
+    // Linear-Speed Vertex Cache Optimisation by Tom Forsyth from
+    // http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
+    const float cacheDecayPower = 1.5f;
+    const float lastTriScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    // No triangle needs this vertex anymore
+    if (vertex.useCount_ == 0)
+        return -1.0f;
+
+    float score = 0.0f;
+    int cachePosition = vertex.cachePosition_;
+    if (cachePosition >= 0)
+    {
+        // A vertex used in the last triangle gets a fixed score, so that the triangle vertex order does not matter
+        if (cachePosition < 3)
+            score = lastTriScore;
+        else
+        {
+            const float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
+            score = 1.0f - (cachePosition - 3) * scaler;
+            score = powf(score, cacheDecayPower);
+        }
+    }
+
+    // Bonus points for having a low number of triangles still to use the vertex, so that lone vertices get used up quickly
+    float valenceBoost = powf((float)vertex.useCount_, -valenceBoostPower);
+    score += valenceBoostScale * valenceBoost;
+    return score;
+}
+
+void OptimizeVertexCache(void* indexData, unsigned indexSize, unsigned indexStart, unsigned indexCount)
+{
+    if (!indexData || indexCount < 6 || indexCount % 3)
+        return;
+
+    unsigned numTriangles = indexCount / 3;
+    unsigned short* shortIndices = (unsigned short*)indexData + indexStart;
+    unsigned* largeIndices = (unsigned*)indexData + indexStart;
+    bool largeIndex = indexSize == sizeof(unsigned);
+
+    PODVector<unsigned> indices(indexCount);
+    unsigned minIndex = M_MAX_UNSIGNED;
+    unsigned maxIndex = 0;
+    for (unsigned i = 0; i < indexCount; ++i)
+    {
+        indices[i] = largeIndex ? largeIndices[i] : shortIndices[i];
+        if (indices[i] < minIndex)
+            minIndex = indices[i];
+        if (indices[i] > maxIndex)
+            maxIndex = indices[i];
+    }
+
+    // The indices may refer to a range in a larger vertex buffer shared by several geometries. Rebase them to the start of
+    // the range, so that the per-vertex data is only sized by the vertices actually used
+    unsigned numVertices = maxIndex - minIndex + 1;
+    for (unsigned i = 0; i < indexCount; ++i)
+        indices[i] -= minIndex;
+
+    // Build the vertex to triangle adjacency as one flat list. The triangles still to be output are kept at the start of
+    // each vertex's range, so that only those are rescored after a triangle is output
+    PODVector<CacheVertex> vertices(numVertices);
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        vertices[i].triangleStart_ = 0;
+        vertices[i].useCount_ = 0;
+        vertices[i].cachePosition_ = -1;
+    }
+    for (unsigned i = 0; i < indexCount; ++i)
+        ++vertices[indices[i]].useCount_;
+
+    unsigned triangleStart = 0;
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        vertices[i].triangleStart_ = triangleStart;
+        triangleStart += vertices[i].useCount_;
+        vertices[i].useCount_ = 0;
+    }
+
+    PODVector<unsigned> vertexTriangles(indexCount);
+    for (unsigned i = 0; i < indexCount; ++i)
+    {
+        CacheVertex& vertex = vertices[indices[i]];
+        vertexTriangles[vertex.triangleStart_ + vertex.useCount_++] = i / 3;
+    }
+
+    for (unsigned i = 0; i < numVertices; ++i)
+        vertices[i].score_ = CalculateVertexScore(vertices[i]);
+
+    PODVector<float> triangleScores(numTriangles);
+    PODVector<bool> triangleAdded(numTriangles);
+    unsigned bestTriangle = 0;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        triangleScores[i] = vertices[indices[i * 3]].score_ + vertices[indices[i * 3 + 1]].score_ +
+            vertices[indices[i * 3 + 2]].score_;
+        triangleAdded[i] = false;
+        if (triangleScores[i] > triangleScores[bestTriangle])
+            bestTriangle = i;
+    }
+
+    // The cache holds room for the vertices of one extra triangle, which get pushed out after rescoring
+    unsigned cache[VERTEX_CACHE_SIZE + 3];
+    unsigned newCache[VERTEX_CACHE_SIZE + 3];
+    unsigned cacheSize = 0;
+    unsigned scanPosition = 0;
+    unsigned outIndex = 0;
+
+    for (unsigned t = 0; t < numTriangles; ++t)
+    {
+        // If no cached vertex has triangles left, continue from the first triangle not yet output
+        if (bestTriangle == M_MAX_UNSIGNED)
+        {
+            while (triangleAdded[scanPosition])
+                ++scanPosition;
+            bestTriangle = scanPosition;
+        }
+
+        const unsigned* triIndices = &indices[bestTriangle * 3];
+        if (largeIndex)
+        {
+            for (unsigned i = 0; i < 3; ++i)
+                largeIndices[outIndex++] = triIndices[i] + minIndex;
+        }
+        else
+        {
+            for (unsigned i = 0; i < 3; ++i)
+                shortIndices[outIndex++] = (unsigned short)(triIndices[i] + minIndex);
+        }
+        triangleAdded[bestTriangle] = true;
+
+        // Remove the triangle from its vertices' remaining triangles
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            CacheVertex& vertex = vertices[triIndices[i]];
+            unsigned* tris = &vertexTriangles[vertex.triangleStart_];
+            for (unsigned j = 0; j < vertex.useCount_; ++j)
+            {
+                if (tris[j] == bestTriangle)
+                {
+                    Swap(tris[j], tris[vertex.useCount_ - 1]);
+                    break;
+                }
+            }
+            --vertex.useCount_;
+        }
+
+        // Model the LRU cache behaviour: the triangle's vertices move to the front
+        unsigned newCacheSize = 0;
+        for (unsigned i = 0; i < 3; ++i)
+        {
+            if (i > 0 && (triIndices[i] == triIndices[0] || (i > 1 && triIndices[i] == triIndices[1])))
+                continue;
+            newCache[newCacheSize++] = triIndices[i];
+        }
+        for (unsigned i = 0; i < cacheSize; ++i)
+        {
+            unsigned v = cache[i];
+            if (v != triIndices[0] && v != triIndices[1] && v != triIndices[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        // Update positions & scores of the cached vertices and the scores of their remaining triangles
+        for (unsigned i = 0; i < newCacheSize; ++i)
+        {
+            CacheVertex& vertex = vertices[newCache[i]];
+            vertex.cachePosition_ = i < (unsigned)VERTEX_CACHE_SIZE ? (int)i : -1;
+            float oldScore = vertex.score_;
+            vertex.score_ = CalculateVertexScore(vertex);
+            float scoreDelta = vertex.score_ - oldScore;
+
+            const unsigned* tris = &vertexTriangles[vertex.triangleStart_];
+            for (unsigned j = 0; j < vertex.useCount_; ++j)
+                triangleScores[tris[j]] += scoreDelta;
+        }
+
+        cacheSize = Min((int)newCacheSize, VERTEX_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(unsigned));
+
+        // Find the best next triangle among those using the cached vertices
+        bestTriangle = M_MAX_UNSIGNED;
+        float bestTriangleScore = -1.0f;
+        for (unsigned i = 0; i < cacheSize; ++i)
+        {
+            const CacheVertex& vertex = vertices[cache[i]];
+            const unsigned* tris = &vertexTriangles[vertex.triangleStart_];
+            for (unsigned j = 0; j < vertex.useCount_; ++j)
+            {
+                if (triangleScores[tris[j]] > bestTriangleScore)
+                {
+                    bestTriangle = tris[j];
+                    bestTriangleScore = triangleScores[tris[j]];
+                }
+            }
+        }
+    }
+}
+
+}
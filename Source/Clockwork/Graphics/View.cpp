@@ -49,6 +49,10 @@
 #include "../Scene/Scene.h"
 #include "../UI/UI.h"
 
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 namespace Clockwork
@@ -64,6 +68,17 @@ static const Vector3* directions[] =
     &Vector3::BACK
 };
 
+/// Number of batch cache entries allowed beyond twice the visible drawables before pruning.
+static const unsigned BATCH_CACHE_MIN_SIZE = 256;
+/// Number of frames a batch cache entry is kept without use when pruning.
+static const unsigned BATCH_CACHE_MAX_AGE = 60;
+/// Number of frames a light query cache entry is kept without use.
+static const unsigned LIGHT_QUERY_CACHE_MAX_AGE = 60;
+/// Minimum number of visible drawables for each work item when building base pass batches in worker threads.
+static const unsigned MIN_BASE_BATCH_WORK_DRAWABLES = 128;
+/// Number of non-instanced batches in a front to back sorted queue at which its batches and groups are sorted in parallel.
+static const unsigned MIN_PARALLEL_SORT_BATCHES = 1024;
+
 /// %Frustum octree query for shadowcasters.
 class ShadowCasterOctreeQuery : public FrustumOctreeQuery
 {
@@ -166,6 +181,75 @@ public:
     OcclusionBuffer* buffer_;
 };
 
+/// Set the visible flag of bounding boxes that are not outside a frustum. Tests four boxes at a time when SSE2 is available.
+static void MarkBoxesInsideFast(const Frustum& frustum, const BoundingBox* boxes, unsigned char* visible, unsigned count)
+{
+    unsigned i = 0;
+
+#ifdef CLOCKWORK_SSE2
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; i + 4 <= count; i += 4)
+    {
+        const BoundingBox* b = boxes + i;
+        __m128 minX = _mm_set_ps(b[3].min_.x_, b[2].min_.x_, b[1].min_.x_, b[0].min_.x_);
+        __m128 minY = _mm_set_ps(b[3].min_.y_, b[2].min_.y_, b[1].min_.y_, b[0].min_.y_);
+        __m128 minZ = _mm_set_ps(b[3].min_.z_, b[2].min_.z_, b[1].min_.z_, b[0].min_.z_);
+        __m128 centerX = _mm_mul_ps(_mm_add_ps(_mm_set_ps(b[3].max_.x_, b[2].max_.x_, b[1].max_.x_, b[0].max_.x_), minX), half);
+        __m128 centerY = _mm_mul_ps(_mm_add_ps(_mm_set_ps(b[3].max_.y_, b[2].max_.y_, b[1].max_.y_, b[0].max_.y_), minY), half);
+        __m128 centerZ = _mm_mul_ps(_mm_add_ps(_mm_set_ps(b[3].max_.z_, b[2].max_.z_, b[1].max_.z_, b[0].max_.z_), minZ), half);
+        __m128 edgeX = _mm_sub_ps(centerX, minX);
+        __m128 edgeY = _mm_sub_ps(centerY, minY);
+        __m128 edgeZ = _mm_sub_ps(centerZ, minZ);
+        __m128 outside = zero;
+
+        // Same test as Frustum::IsInsideFast(), but without the early out
+        for (unsigned j = 0; j < NUM_FRUSTUM_PLANES; ++j)
+        {
+            const Plane& plane = frustum.planes_[j];
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.normal_.x_)),
+                _mm_mul_ps(centerY, _mm_set1_ps(plane.normal_.y_))), _mm_mul_ps(centerZ, _mm_set1_ps(plane.normal_.z_))),
+                _mm_set1_ps(plane.d_));
+            __m128 absDist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edgeX, _mm_set1_ps(plane.absNormal_.x_)),
+                _mm_mul_ps(edgeY, _mm_set1_ps(plane.absNormal_.y_))), _mm_mul_ps(edgeZ, _mm_set1_ps(plane.absNormal_.z_)));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, _mm_sub_ps(zero, absDist)));
+        }
+
+        int outsideMask = _mm_movemask_ps(outside);
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            if (!(outsideMask & (1 << j)))
+                visible[i + j] = 1;
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        if (frustum.IsInsideFast(boxes[i]) != OUTSIDE)
+            visible[i] = 1;
+    }
+}
+
+/// Return whether a sorted pointer array contains a pointer.
+static bool ContainsSorted(const PODVector<Drawable*>& sorted, Drawable* drawable)
+{
+    unsigned first = 0;
+    unsigned last = sorted.Size();
+
+    while (first < last)
+    {
+        unsigned middle = (first + last) >> 1;
+        if (sorted[middle] < drawable)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+
+    return first < sorted.Size() && sorted[first] == drawable;
+}
+
 void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
 {
     View* view = reinterpret_cast<View*>(item->aux_);
@@ -232,6 +316,8 @@ void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex)
                     result.lights_.Push(light);
             }
         }
+        else
+            ++result.numOccluded_;
     }
 }
 
@@ -243,6 +329,22 @@ void ProcessLightWork(const WorkItem* item, unsigned threadIndex)
     view->ProcessLight(*query, threadIndex);
 }
 
+void GetLightQueueBatchesWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    LightQueryResult* query = reinterpret_cast<LightQueryResult*>(item->start_);
+
+    view->GetLightQueueBatches(*query);
+}
+
+void GetBaseBatchesWork(const WorkItem* item, unsigned threadIndex)
+{
+    View* view = reinterpret_cast<View*>(item->aux_);
+    PerThreadBaseBatches* result = reinterpret_cast<PerThreadBaseBatches*>(item->start_);
+
+    view->GetBaseBatchRange(*result);
+}
+
 void UpdateDrawableGeometriesWork(const WorkItem* item, unsigned threadIndex)
 {
     const FrameInfo& frame = *(reinterpret_cast<FrameInfo*>(item->aux_));
@@ -265,6 +367,20 @@ void SortBatchQueueFrontToBackWork(const WorkItem* item, unsigned threadIndex)
     queue->SortFrontToBack();
 }
 
+void SortBatchQueueBatchesFrontToBackWork(const WorkItem* item, unsigned threadIndex)
+{
+    BatchQueue* queue = reinterpret_cast<BatchQueue*>(item->start_);
+
+    queue->SortBatchesFrontToBack();
+}
+
+void SortBatchQueueGroupsFrontToBackWork(const WorkItem* item, unsigned threadIndex)
+{
+    BatchQueue* queue = reinterpret_cast<BatchQueue*>(item->start_);
+
+    queue->SortGroupsFrontToBack();
+}
+
 void SortBatchQueueBackToFrontWork(const WorkItem* item, unsigned threadIndex)
 {
     BatchQueue* queue = reinterpret_cast<BatchQueue*>(item->start_);
@@ -296,8 +412,15 @@ View::View(Context* context) :
     cameraZone_(0),
     farClipZone_(0),
     occlusionBuffer_(0),
+    occlusionHistoryFrame_(0),
+    numOccludedDrawables_(0),
     renderTarget_(0),
-    substituteRenderTarget_(0)
+    substituteRenderTarget_(0),
+    batchCacheCamera_(0),
+    batchCacheShadersFrame_(0),
+    batchCacheBasePassIndex_(0),
+    batchCacheInstancing_(false),
+    threadedBatches_(false)
 {
     // Create octree query and scene results vector for each thread
     unsigned numThreads = GetSubsystem<WorkQueue>()->GetNumThreads() + 1; // Worker threads + main thread
@@ -818,12 +941,20 @@ void View::GetDrawables()
     if (maxOccluderTriangles_ > 0)
     {
         UpdateOccluders(occluders_, camera_);
-        if (occluders_.Size())
+
+        // The previous frame's occlusion can be used if it was rendered from the same camera on the frame just before
+        bool temporalOcclusion = renderer_->GetTemporalOcclusion();
+        bool useHistory = temporalOcclusion && occlusionHistory_ && occlusionHistoryCamera_.Get() == camera_ &&
+            occlusionHistoryFrame_ + 1 == frame_.frameNumber_;
+
+        if (occluders_.Size() || useHistory)
         {
             PROFILE(DrawOcclusion);
 
             occlusionBuffer_ = renderer_->GetOcclusionBuffer(camera_);
             DrawOccluders(occlusionBuffer_, occluders_);
+            if (temporalOcclusion)
+                UpdateOcclusionHistory(occlusionBuffer_, useHistory);
         }
     }
 
@@ -850,6 +981,7 @@ void View::GetDrawables()
             result.lights_.Clear();
             result.minZ_ = M_INFINITY;
             result.maxZ_ = 0.0f;
+            result.numOccluded_ = 0;
         }
 
         int numWorkItems = queue->GetNumThreads() + 1; // Worker threads + main thread
@@ -883,6 +1015,7 @@ void View::GetDrawables()
     lights_.Clear();
     minZ_ = M_INFINITY;
     maxZ_ = 0.0f;
+    numOccludedDrawables_ = 0;
 
     if (sceneResults_.Size() > 1)
     {
@@ -893,6 +1026,7 @@ void View::GetDrawables()
             lights_.Push(result.lights_);
             minZ_ = Min(minZ_, result.minZ_);
             maxZ_ = Max(maxZ_, result.maxZ_);
+            numOccludedDrawables_ += result.numOccluded_;
         }
     }
     else
@@ -901,6 +1035,7 @@ void View::GetDrawables()
         PerThreadSceneResult& result = sceneResults_[0];
         minZ_ = result.minZ_;
         maxZ_ = result.maxZ_;
+        numOccludedDrawables_ = result.numOccluded_;
         Swap(geometries_, result.geometries_);
         Swap(lights_, result.lights_);
     }
@@ -930,6 +1065,7 @@ void View::GetBatches()
     ProcessLights();
     GetLightBatches();
     GetBaseBatches();
+    GroupInstancedBatches();
 }
 
 void View::ProcessLights()
@@ -939,6 +1075,7 @@ void View::ProcessLights()
 
     WorkQueue* queue = GetSubsystem<WorkQueue>();
     lightQueryResults_.Resize(lights_.Size());
+    UpdateLightQueryCache();
 
     for (unsigned i = 0; i < lightQueryResults_.Size(); ++i)
     {
@@ -949,6 +1086,15 @@ void View::ProcessLights()
 
         LightQueryResult& query = lightQueryResults_[i];
         query.light_ = lights_[i];
+        // Look up the volume query cache here, as the worker threads may not modify the cache map
+        if (query.light_->GetLightType() != LIGHT_DIRECTIONAL)
+        {
+            LightQueryCache& cache = lightQueryCache_[query.light_];
+            cache.frameNumber_ = frame_.frameNumber_;
+            query.cache_ = &cache;
+        }
+        else
+            query.cache_ = 0;
 
         item->start_ = &query;
         queue->AddWorkItem(item);
@@ -977,7 +1123,6 @@ void View::GetLightBatches()
 
         lightQueues_.Resize(numLightQueues);
         maxLightsDrawables_.Clear();
-        unsigned maxSortedInstances = (unsigned)renderer_->GetMaxSortedInstances();
 
         for (Vector<LightQueryResult>::Iterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
         {
@@ -1000,8 +1145,6 @@ void View::GetLightBatches()
                 lightQueue.light_ = light;
                 lightQueue.negative_ = light->IsNegative();
                 lightQueue.shadowMap_ = 0;
-                lightQueue.litBaseBatches_.Clear(maxSortedInstances);
-                lightQueue.litBatches_.Clear(maxSortedInstances);
                 lightQueue.volumeBatches_.Clear();
 
                 // Allocate shadow map now
@@ -1022,7 +1165,6 @@ void View::GetLightBatches()
                     shadowQueue.shadowCamera_ = shadowCamera;
                     shadowQueue.nearSplit_ = query.shadowNearSplits_[j];
                     shadowQueue.farSplit_ = query.shadowFarSplits_[j];
-                    shadowQueue.shadowBatches_.Clear(maxSortedInstances);
 
                     // Setup the shadow split viewport and finalize shadow camera parameters
                     shadowQueue.shadowViewport_ = GetShadowMapViewport(light, j, lightQueue.shadowMap_);
@@ -1043,43 +1185,18 @@ void View::GetLightBatches()
                             else if (type == UPDATE_WORKER_THREAD)
                                 threadedGeometries_.Push(drawable);
                         }
-
-                        Zone* zone = GetZone(drawable);
-                        const Vector<SourceBatch>& batches = drawable->GetBatches();
-
-                        for (unsigned l = 0; l < batches.Size(); ++l)
-                        {
-                            const SourceBatch& srcBatch = batches[l];
-
-                            Technique* tech = GetTechnique(drawable, srcBatch.material_);
-                            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
-                                continue;
-
-                            Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
-                            // Skip if material has no shadow pass
-                            if (!pass)
-                                continue;
-
-                            Batch destBatch(srcBatch);
-                            destBatch.pass_ = pass;
-                            destBatch.camera_ = shadowCamera;
-                            destBatch.zone_ = zone;
-
-                            AddBatchToQueue(shadowQueue.shadowBatches_, destBatch, tech);
-                        }
                     }
                 }
 
-                // Process lit geometries
+                // Record the light to lit geometries before building any batches, so that each drawable's first light is
+                // already known when the light queues are built in parallel
                 for (PODVector<Drawable*>::ConstIterator j = query.litGeometries_.Begin(); j != query.litGeometries_.End(); ++j)
                 {
                     Drawable* drawable = *j;
                     drawable->AddLight(light);
 
                     // If drawable limits maximum lights, only record the light, and check maximum count / build batches later
-                    if (!drawable->GetMaxLights())
-                        GetLitBatches(drawable, lightQueue, alphaQueue);
-                    else
+                    if (drawable->GetMaxLights())
                         maxLightsDrawables_.Insert(drawable);
                 }
 
@@ -1114,6 +1231,48 @@ void View::GetLightBatches()
                 }
             }
         }
+
+        // Build the shadow caster and lit batches of each per-pixel light in worker threads
+        WorkQueue* queue = GetSubsystem<WorkQueue>();
+        threadedBatches_ = true;
+
+        for (Vector<LightQueryResult>::Iterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+        {
+            if (i->light_->GetPerVertex() || i->litGeometries_.Empty())
+                continue;
+
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = GetLightQueueBatchesWork;
+            item->aux_ = this;
+            item->start_ = &(*i);
+            queue->AddWorkItem(item);
+        }
+
+        queue->Complete(M_MAX_UNSIGNED);
+        threadedBatches_ = false;
+
+        // Merge the flags of the work items
+        bool shadersMissing = false;
+        for (Vector<LightQueryResult>::ConstIterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+        {
+            if (!i->light_->GetPerVertex() && !i->litGeometries_.Empty() && i->shadersMissing_)
+                shadersMissing = true;
+        }
+
+        for (Vector<LightQueryResult>::Iterator i = lightQueryResults_.Begin(); i != lightQueryResults_.End(); ++i)
+        {
+            if (i->light_->GetPerVertex() || i->litGeometries_.Empty())
+                continue;
+
+            // If pass shaders needed loading, rebuild the light queues on the main thread, where the shaders can be loaded
+            if (shadersMissing)
+                GetLightQueueBatches(*i);
+
+            // Merge the lit transparent batches in light order, so that the alpha queue is the same as if built serially
+            if (alphaQueue)
+                alphaQueue->batches_.Push(i->litAlphaBatches_.batches_);
+        }
     }
 
     // Process drawables with limited per-pixel light count
@@ -1139,92 +1298,431 @@ void View::GetLightBatches()
     }
 }
 
+void View::GetLightQueueBatches(LightQueryResult& query)
+{
+    Light* light = query.light_;
+    LightBatchQueue& lightQueue = *light->GetLightQueue();
+    BatchQueue* alphaQueue = batchQueues_.Contains(alphaPassIndex_) ? &query.litAlphaBatches_ : (BatchQueue*)0;
+    int maxSortedInstances = renderer_->GetMaxSortedInstances();
+
+    lightQueue.litBaseBatches_.Clear(maxSortedInstances);
+    lightQueue.litBatches_.Clear(maxSortedInstances);
+    query.litAlphaBatches_.Clear(maxSortedInstances);
+    query.shadersMissing_ = false;
+
+    for (unsigned i = 0; i < lightQueue.shadowSplits_.Size(); ++i)
+    {
+        ShadowBatchQueue& shadowQueue = lightQueue.shadowSplits_[i];
+        Camera* shadowCamera = shadowQueue.shadowCamera_;
+        shadowQueue.shadowBatches_.Clear(maxSortedInstances);
+
+        // Loop through shadow casters
+        for (PODVector<Drawable*>::ConstIterator j = query.shadowCasters_.Begin() + query.shadowCasterBegin_[i];
+             j < query.shadowCasters_.Begin() + query.shadowCasterEnd_[i]; ++j)
+        {
+            Drawable* drawable = *j;
+            Zone* zone = GetZone(drawable);
+            const Vector<SourceBatch>& batches = drawable->GetBatches();
+
+            for (unsigned k = 0; k < batches.Size(); ++k)
+            {
+                const SourceBatch& srcBatch = batches[k];
+
+                Technique* tech = GetTechnique(drawable, srcBatch.material_);
+                if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
+                    continue;
+
+                Pass* pass = tech->GetSupportedPass(Technique::shadowPassIndex);
+                // Skip if material has no shadow pass
+                if (!pass)
+                    continue;
+
+                Batch destBatch(srcBatch);
+                destBatch.pass_ = pass;
+                destBatch.camera_ = shadowCamera;
+                destBatch.zone_ = zone;
+
+                if (!AddBatchToQueue(shadowQueue.shadowBatches_, destBatch, tech))
+                    query.shadersMissing_ = true;
+            }
+        }
+    }
+
+    // Process lit geometries. Drawables that limit their maximum lights are processed later
+    for (PODVector<Drawable*>::ConstIterator i = query.litGeometries_.Begin(); i != query.litGeometries_.End(); ++i)
+    {
+        Drawable* drawable = *i;
+        if (!drawable->GetMaxLights() && !GetLitBatches(drawable, lightQueue, alphaQueue))
+            query.shadersMissing_ = true;
+    }
+}
+
 void View::GetBaseBatches()
 {
     PROFILE(GetBaseBatches);
 
-    for (PODVector<Drawable*>::ConstIterator i = geometries_.Begin(); i != geometries_.End(); ++i)
+    UpdateBatchCache();
+
+    // Collect geometry updates, check materials and look up batch caches on the main thread
+    bool hasVertexLights = false;
+    baseBatchCaches_.Resize(geometries_.Size());
+
+    for (unsigned i = 0; i < geometries_.Size(); ++i)
     {
-        Drawable* drawable = *i;
+        Drawable* drawable = geometries_[i];
         UpdateGeometryType type = drawable->GetUpdateGeometryType();
         if (type == UPDATE_MAIN_THREAD)
             nonThreadedGeometries_.Push(drawable);
         else if (type == UPDATE_WORKER_THREAD)
             threadedGeometries_.Push(drawable);
 
-        const Vector<SourceBatch>& batches = drawable->GetBatches();
-        bool vertexLightsProcessed = false;
+        // Check here if the material refers to a rendertarget texture with camera(s) attached
+        // Only check this for backbuffer views (null rendertarget)
+        if (!renderTarget_)
+        {
+            const Vector<SourceBatch>& batches = drawable->GetBatches();
+            for (unsigned j = 0; j < batches.Size(); ++j)
+            {
+                Material* material = batches[j].material_;
+                if (material && material->GetAuxViewFrameNumber() != frame_.frameNumber_)
+                    CheckMaterialForAuxView(material);
+            }
+        }
 
-        for (unsigned j = 0; j < batches.Size(); ++j)
+        // Vertex light queues are rebuilt each frame, so batches of vertex lit drawables can not be cached
+        if (drawable->GetVertexLights().Size())
         {
-            const SourceBatch& srcBatch = batches[j];
+            baseBatchCaches_[i] = 0;
+            hasVertexLights = true;
+        }
+        else
+        {
+            DrawableBatchCache& cache = batchCache_[drawable];
+            cache.frameNumber_ = frame_.frameNumber_;
+            baseBatchCaches_[i] = &cache;
+        }
+    }
 
-            // Check here if the material refers to a rendertarget texture with camera(s) attached
-            // Only check this for backbuffer views (null rendertarget)
-            if (srcBatch.material_ && srcBatch.material_->GetAuxViewFrameNumber() != frame_.frameNumber_ && !renderTarget_)
-                CheckMaterialForAuxView(srcBatch.material_);
+    WorkQueue* queue = GetSubsystem<WorkQueue>();
+    unsigned numWorkItems = Min((int)(geometries_.Size() / MIN_BASE_BATCH_WORK_DRAWABLES), (int)queue->GetNumThreads() + 1);
+    // Vertex light queues are created while getting the batches, so vertex lit drawables require the main thread
+    if (hasVertexLights || numWorkItems < 2)
+        numWorkItems = 1;
 
-            Technique* tech = GetTechnique(drawable, srcBatch.material_);
-            if (!srcBatch.geometry_ || !srcBatch.numWorldTransforms_ || !tech)
-                continue;
+    baseBatchResults_.Resize(numWorkItems);
 
-            // Check each of the scene passes
-            for (unsigned k = 0; k < scenePasses_.Size(); ++k)
+    if (numWorkItems > 1)
+    {
+        unsigned drawablesPerItem = geometries_.Size() / numWorkItems;
+        int maxSortedInstances = renderer_->GetMaxSortedInstances();
+
+        threadedBatches_ = true;
+
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            PerThreadBaseBatches& result = baseBatchResults_[i];
+            result.shadersMissing_ = false;
+            result.start_ = i * drawablesPerItem;
+            result.end_ = i < numWorkItems - 1 ? result.start_ + drawablesPerItem : geometries_.Size();
+            result.queues_.Resize(scenePasses_.Size());
+            result.destQueues_.Resize(scenePasses_.Size());
+            for (unsigned j = 0; j < scenePasses_.Size(); ++j)
             {
-                ScenePassInfo& info = scenePasses_[k];
-                // Skip forward base pass if the corresponding litbase pass already exists
-                if (info.passIndex_ == basePassIndex_ && j < 32 && drawable->HasBasePass(j))
-                    continue;
+                result.queues_[j].Clear(maxSortedInstances);
+                result.destQueues_[j] = &result.queues_[j];
+            }
 
-                Pass* pass = tech->GetSupportedPass(info.passIndex_);
-                if (!pass)
-                    continue;
+            SharedPtr<WorkItem> item = queue->GetFreeItem();
+            item->priority_ = M_MAX_UNSIGNED;
+            item->workFunction_ = GetBaseBatchesWork;
+            item->aux_ = this;
+            item->start_ = &result;
+            queue->AddWorkItem(item);
+        }
 
-                Batch destBatch(srcBatch);
-                destBatch.pass_ = pass;
-                destBatch.camera_ = camera_;
-                destBatch.zone_ = GetZone(drawable);
-                destBatch.isBase_ = true;
-                destBatch.lightMask_ = (unsigned char)GetLightMask(drawable);
+        queue->Complete(M_MAX_UNSIGNED);
+        threadedBatches_ = false;
 
-                if (info.vertexLights_)
+        // Merge the flags of the work items
+        bool shadersMissing = false;
+        for (unsigned i = 0; i < numWorkItems; ++i)
+        {
+            if (baseBatchResults_[i].shadersMissing_)
+                shadersMissing = true;
+        }
+
+        if (!shadersMissing)
+        {
+            // Merge in drawable order, so that the batch queues are the same as if built serially
+            for (unsigned i = 0; i < scenePasses_.Size(); ++i)
+            {
+                BatchQueue& dest = *scenePasses_[i].batchQueue_;
+                for (unsigned j = 0; j < numWorkItems; ++j)
                 {
-                    const PODVector<Light*>& drawableVertexLights = drawable->GetVertexLights();
-                    if (drawableVertexLights.Size() && !vertexLightsProcessed)
-                    {
-                        // Limit vertex lights. If this is a deferred opaque batch, remove converted per-pixel lights,
-                        // as they will be rendered as light volumes in any case, and drawing them also as vertex lights
-                        // would result in double lighting
-                        drawable->LimitVertexLights(deferred_ && destBatch.pass_->GetBlendMode() == BLEND_REPLACE);
-                        vertexLightsProcessed = true;
-                    }
+                    dest.batches_.Push(baseBatchResults_[j].queues_[i].batches_);
+                    dest.instancedBatches_.Push(baseBatchResults_[j].queues_[i].instancedBatches_);
+                }
+            }
+            return;
+        }
 
-                    if (drawableVertexLights.Size())
-                    {
-                        // Find a vertex light queue. If not found, create new
-                        unsigned long long hash = GetVertexLightQueueHash(drawableVertexLights);
-                        HashMap<unsigned long long, LightBatchQueue>::Iterator i = vertexLightQueues_.Find(hash);
-                        if (i == vertexLightQueues_.End())
-                        {
-                            i = vertexLightQueues_.Insert(MakePair(hash, LightBatchQueue()));
-                            i->second_.light_ = 0;
-                            i->second_.shadowMap_ = 0;
-                            i->second_.vertexLights_ = drawableVertexLights;
-                        }
+        // Pass shaders needed loading. Discard the results, including batch caches that may have been left incomplete,
+        // and rebuild on the main thread, where the shaders can be loaded
+        for (PODVector<DrawableBatchCache*>::Iterator i = baseBatchCaches_.Begin(); i != baseBatchCaches_.End(); ++i)
+        {
+            if (*i)
+                (*i)->valid_ = false;
+        }
+    }
+
+    PerThreadBaseBatches& result = baseBatchResults_[0];
+    result.start_ = 0;
+    result.end_ = geometries_.Size();
+    result.destQueues_.Resize(scenePasses_.Size());
+    for (unsigned i = 0; i < scenePasses_.Size(); ++i)
+        result.destQueues_[i] = scenePasses_[i].batchQueue_;
+
+    GetBaseBatchRange(result);
+}
+
+void View::GetBaseBatchRange(PerThreadBaseBatches& result)
+{
+    for (unsigned i = result.start_; i < result.end_; ++i)
+    {
+        Drawable* drawable = geometries_[i];
+        DrawableBatchCache* cache = baseBatchCaches_[i];
+
+        if (cache && IsBatchCacheValid(drawable, *cache))
+            AddCachedBaseBatches(drawable, *cache, result.destQueues_);
+        else if (!AddBaseBatches(drawable, cache, result.destQueues_))
+            result.shadersMissing_ = true;
+    }
+}
+
+bool View::AddBaseBatches(Drawable* drawable, DrawableBatchCache* cache, const PODVector<BatchQueue*>& queues)
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    bool shadersSet = true;
+    bool vertexLightsProcessed = false;
+    Zone* zone = GetZone(drawable);
+    unsigned char lightMask = (unsigned char)GetLightMask(drawable);
+
+    if (cache)
+    {
+        cache->sources_.Resize(batches.Size());
+        cache->passes_.Resize(batches.Size() * scenePasses_.Size());
+        cache->batches_.Clear();
+        cache->zone_ = zone;
+        cache->heightFog_ = zone->GetHeightFog();
+        cache->lightMask_ = lightMask;
+        cache->basePassFlags_ = 0;
+        cache->valid_ = true;
+    }
 
-                        destBatch.lightQueue_ = &(i->second_);
+    for (unsigned j = 0; j < batches.Size(); ++j)
+    {
+        const SourceBatch& srcBatch = batches[j];
+        Technique* tech = GetTechnique(drawable, srcBatch.material_);
+
+        if (cache)
+        {
+            CachedSourceBatch& cachedSource = cache->sources_[j];
+            cachedSource.geometry_ = srcBatch.geometry_;
+            cachedSource.material_ = srcBatch.material_;
+            cachedSource.technique_ = tech;
+            cachedSource.geometryType_ = srcBatch.geometryType_;
+            if (j < 32 && drawable->HasBasePass(j))
+                cache->basePassFlags_ |= 1 << j;
+            for (unsigned k = 0; k < scenePasses_.Size(); ++k)
+                cache->passes_[j * scenePasses_.Size() + k] = tech ? tech->GetSupportedPass(scenePasses_[k].passIndex_) : 0;
+        }
+
+        // Batches without world transforms are still cached, as they may have transforms on later frames
+        if (!srcBatch.geometry_ || !tech || (!srcBatch.numWorldTransforms_ && !cache))
+            continue;
+
+        // Check each of the scene passes
+        for (unsigned k = 0; k < scenePasses_.Size(); ++k)
+        {
+            ScenePassInfo& info = scenePasses_[k];
+            // Skip forward base pass if the corresponding litbase pass already exists
+            if (info.passIndex_ == basePassIndex_ && j < 32 && drawable->HasBasePass(j))
+                continue;
+
+            Pass* pass = tech->GetSupportedPass(info.passIndex_);
+            if (!pass)
+                continue;
+
+            Batch destBatch(srcBatch);
+            destBatch.pass_ = pass;
+            destBatch.camera_ = camera_;
+            destBatch.zone_ = zone;
+            destBatch.isBase_ = true;
+            destBatch.lightMask_ = lightMask;
+
+            if (info.vertexLights_)
+            {
+                const PODVector<Light*>& drawableVertexLights = drawable->GetVertexLights();
+                if (drawableVertexLights.Size() && !vertexLightsProcessed)
+                {
+                    // Limit vertex lights. If this is a deferred opaque batch, remove converted per-pixel lights,
+                    // as they will be rendered as light volumes in any case, and drawing them also as vertex lights
+                    // would result in double lighting
+                    drawable->LimitVertexLights(deferred_ && destBatch.pass_->GetBlendMode() == BLEND_REPLACE);
+                    vertexLightsProcessed = true;
+                }
+
+                if (drawableVertexLights.Size())
+                {
+                    // Find a vertex light queue. If not found, create new
+                    unsigned long long hash = GetVertexLightQueueHash(drawableVertexLights);
+                    HashMap<unsigned long long, LightBatchQueue>::Iterator i = vertexLightQueues_.Find(hash);
+                    if (i == vertexLightQueues_.End())
+                    {
+                        i = vertexLightQueues_.Insert(MakePair(hash, LightBatchQueue()));
+                        i->second_.light_ = 0;
+                        i->second_.shadowMap_ = 0;
+                        i->second_.vertexLights_ = drawableVertexLights;
                     }
+
+                    destBatch.lightQueue_ = &(i->second_);
                 }
-                else
-                    destBatch.lightQueue_ = 0;
+            }
+            else
+                destBatch.lightQueue_ = 0;
 
-                bool allowInstancing = info.allowInstancing_;
-                if (allowInstancing && info.markToStencil_ && destBatch.lightMask_ != (destBatch.zone_->GetLightMask() & 0xff))
-                    allowInstancing = false;
+            bool allowInstancing = info.allowInstancing_;
+            if (allowInstancing && info.markToStencil_ && destBatch.lightMask_ != (destBatch.zone_->GetLightMask() & 0xff))
+                allowInstancing = false;
 
-                AddBatchToQueue(*info.batchQueue_, destBatch, tech, allowInstancing);
+            if (!PrepareBatch(destBatch, tech, allowInstancing, true))
+                shadersSet = false;
+
+            if (cache)
+            {
+                CachedBaseBatch cachedBatch;
+                cachedBatch.batch_ = destBatch;
+                cachedBatch.technique_ = tech;
+                cachedBatch.sourceIndex_ = j;
+                cachedBatch.scenePassIndex_ = k;
+                cachedBatch.shadersVersion_ = pass->GetShadersVersion();
+                cache->batches_.Push(cachedBatch);
+            }
+
+            if (srcBatch.numWorldTransforms_)
+                QueueBatch(*queues[k], destBatch, tech, true);
+        }
+    }
+
+    return shadersSet;
+}
+
+bool View::IsBatchCacheValid(Drawable* drawable, const DrawableBatchCache& cache)
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+    if (!cache.valid_ || batches.Size() != cache.sources_.Size())
+        return false;
+
+    Zone* zone = GetZone(drawable);
+    if (zone != cache.zone_ || zone->GetHeightFog() != cache.heightFog_ || (unsigned char)GetLightMask(drawable) != cache.lightMask_)
+        return false;
+
+    unsigned basePassFlags = 0;
+    unsigned numScenePasses = scenePasses_.Size();
+
+    for (unsigned j = 0; j < batches.Size(); ++j)
+    {
+        const SourceBatch& srcBatch = batches[j];
+        const CachedSourceBatch& cachedSource = cache.sources_[j];
+        if (srcBatch.geometry_ != cachedSource.geometry_ || srcBatch.material_ != cachedSource.material_ ||
+            srcBatch.geometryType_ != cachedSource.geometryType_)
+            return false;
+
+        // The technique can change with LOD distance, and the supported passes if the technique is edited
+        Technique* tech = GetTechnique(drawable, srcBatch.material_);
+        if (tech != cachedSource.technique_)
+            return false;
+        if (tech)
+        {
+            for (unsigned k = 0; k < numScenePasses; ++k)
+            {
+                if (tech->GetSupportedPass(scenePasses_[k].passIndex_) != cache.passes_[j * numScenePasses + k])
+                    return false;
             }
         }
+
+        if (j < 32 && drawable->HasBasePass(j))
+            basePassFlags |= 1 << j;
+    }
+
+    if (basePassFlags != cache.basePassFlags_)
+        return false;
+
+    // Passes are known to be alive at this point. Check that their shaders have not been released since
+    for (PODVector<CachedBaseBatch>::ConstIterator i = cache.batches_.Begin(); i != cache.batches_.End(); ++i)
+    {
+        if (i->batch_.pass_->GetShadersVersion() != i->shadersVersion_)
+            return false;
+    }
+
+    return true;
+}
+
+void View::AddCachedBaseBatches(Drawable* drawable, const DrawableBatchCache& cache, const PODVector<BatchQueue*>& queues)
+{
+    const Vector<SourceBatch>& batches = drawable->GetBatches();
+
+    for (PODVector<CachedBaseBatch>::ConstIterator i = cache.batches_.Begin(); i != cache.batches_.End(); ++i)
+    {
+        const SourceBatch& srcBatch = batches[i->sourceIndex_];
+        if (!srcBatch.numWorldTransforms_)
+            continue;
+
+        // Refresh the state that may change each frame without invalidating the cache
+        Batch destBatch(i->batch_);
+        destBatch.distance_ = srcBatch.distance_;
+        destBatch.renderOrder_ = srcBatch.material_ ? srcBatch.material_->GetRenderOrder() : DEFAULT_RENDER_ORDER;
+        destBatch.worldTransform_ = srcBatch.worldTransform_;
+        destBatch.numWorldTransforms_ = srcBatch.numWorldTransforms_;
+
+        QueueBatch(*queues[i->scenePassIndex_], destBatch, i->technique_, true);
+    }
+}
+
+void View::UpdateBatchCache()
+{
+    // Check the view-wide state that the cached batches depend on
+    bool scenePassesChanged = scenePasses_.Size() != batchCacheScenePasses_.Size();
+    for (unsigned i = 0; i < scenePasses_.Size() && !scenePassesChanged; ++i)
+    {
+        const ScenePassInfo& info = scenePasses_[i];
+        const ScenePassInfo& cachedInfo = batchCacheScenePasses_[i];
+        scenePassesChanged = info.passIndex_ != cachedInfo.passIndex_ || info.allowInstancing_ != cachedInfo.allowInstancing_ ||
+            info.markToStencil_ != cachedInfo.markToStencil_ || info.vertexLights_ != cachedInfo.vertexLights_ ||
+            info.batchQueue_ != cachedInfo.batchQueue_;
+    }
+
+    if (scenePassesChanged || camera_ != batchCacheCamera_ || basePassIndex_ != batchCacheBasePassIndex_ ||
+        renderer_->GetShadersChangedFrameNumber() != batchCacheShadersFrame_ ||
+        renderer_->GetDynamicInstancing() != batchCacheInstancing_)
+    {
+        batchCache_.Clear();
+        batchCacheScenePasses_ = scenePasses_;
+        batchCacheCamera_ = camera_;
+        batchCacheBasePassIndex_ = basePassIndex_;
+        batchCacheShadersFrame_ = renderer_->GetShadersChangedFrameNumber();
+        batchCacheInstancing_ = renderer_->GetDynamicInstancing();
+    }
+    // Remove entries of drawables that have not been visible recently, once they outnumber the visible drawables
+    else if (batchCache_.Size() > geometries_.Size() * 2 + BATCH_CACHE_MIN_SIZE)
+    {
+        for (HashMap<Drawable*, DrawableBatchCache>::Iterator i = batchCache_.Begin(); i != batchCache_.End();)
+        {
+            if (frame_.frameNumber_ - i->second_.frameNumber_ > BATCH_CACHE_MAX_AGE)
+                i = batchCache_.Erase(i);
+            else
+                ++i;
+        }
     }
 }
 
@@ -1244,11 +1742,31 @@ void View::UpdateGeometries()
 
             if (command.type_ == CMD_SCENEPASS)
             {
+                BatchQueue& passQueue = batchQueues_[command.passIndex_];
+
+                // Large front to back queues sort their non-instanced batches and instance groups in separate work items
+                if (command.sortMode_ == SORT_FRONTTOBACK && passQueue.batches_.Size() >= MIN_PARALLEL_SORT_BATCHES &&
+                    passQueue.batchGroups_.Size())
+                {
+                    SharedPtr<WorkItem> batchesItem = queue->GetFreeItem();
+                    batchesItem->priority_ = M_MAX_UNSIGNED;
+                    batchesItem->workFunction_ = SortBatchQueueBatchesFrontToBackWork;
+                    batchesItem->start_ = &passQueue;
+                    queue->AddWorkItem(batchesItem);
+
+                    SharedPtr<WorkItem> groupsItem = queue->GetFreeItem();
+                    groupsItem->priority_ = M_MAX_UNSIGNED;
+                    groupsItem->workFunction_ = SortBatchQueueGroupsFrontToBackWork;
+                    groupsItem->start_ = &passQueue;
+                    queue->AddWorkItem(groupsItem);
+                    continue;
+                }
+
                 SharedPtr<WorkItem> item = queue->GetFreeItem();
                 item->priority_ = M_MAX_UNSIGNED;
                 item->workFunction_ =
                     command.sortMode_ == SORT_FRONTTOBACK ? SortBatchQueueFrontToBackWork : SortBatchQueueBackToFrontWork;
-                item->start_ = &batchQueues_[command.passIndex_];
+                item->start_ = &passQueue;
                 queue->AddWorkItem(item);
             }
         }
@@ -1319,7 +1837,7 @@ void View::UpdateGeometries()
     queue->Complete(M_MAX_UNSIGNED);
 }
 
-void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue)
+bool View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue)
 {
     Light* light = lightQueue.light_;
     Zone* zone = GetZone(drawable);
@@ -1328,6 +1846,7 @@ void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQ
     bool allowLitBase =
         useLitBase_ && !lightQueue.negative_ && light == drawable->GetFirstLight() && drawable->GetVertexLights().Empty() &&
         !zone->GetAmbientGradient();
+    bool shadersSet = true;
 
     for (unsigned i = 0; i < batches.Size(); ++i)
     {
@@ -1378,17 +1897,23 @@ void View::GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQ
         if (!isLitAlpha)
         {
             if (destBatch.isBase_)
-                AddBatchToQueue(lightQueue.litBaseBatches_, destBatch, tech);
-            else
-                AddBatchToQueue(lightQueue.litBatches_, destBatch, tech);
+            {
+                if (!AddBatchToQueue(lightQueue.litBaseBatches_, destBatch, tech))
+                    shadersSet = false;
+            }
+            else if (!AddBatchToQueue(lightQueue.litBatches_, destBatch, tech))
+                shadersSet = false;
         }
         else if (alphaQueue)
         {
             // Transparent batches can not be instanced, and shadows on transparencies can only be rendered if shadow maps are
             // not reused
-            AddBatchToQueue(*alphaQueue, destBatch, tech, false, !renderer_->GetReuseShadowMaps());
+            if (!AddBatchToQueue(*alphaQueue, destBatch, tech, false, !renderer_->GetReuseShadowMaps()))
+                shadersSet = false;
         }
     }
+
+    return shadersSet;
 }
 
 void View::ExecuteRenderPathCommands()
@@ -2137,6 +2662,24 @@ void View::DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& oc
     buffer->BuildDepthHierarchy();
 }
 
+void View::UpdateOcclusionHistory(OcclusionBuffer* buffer, bool merge)
+{
+    // Store only this frame's own occluders, so that depth left behind by moved occluders lasts one frame at most
+    if (!nextOcclusionHistory_)
+        nextOcclusionHistory_ = new OcclusionBuffer(context_);
+    nextOcclusionHistory_->CopyFrom(*buffer);
+
+    if (merge)
+    {
+        buffer->Reproject(*occlusionHistory_);
+        buffer->BuildDepthHierarchy();
+    }
+
+    Swap(occlusionHistory_, nextOcclusionHistory_);
+    occlusionHistoryCamera_ = camera_;
+    occlusionHistoryFrame_ = frame_.frameNumber_;
+}
+
 void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
 {
     Light* light = query.light_;
@@ -2168,27 +2711,13 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
         break;
 
     case LIGHT_SPOT:
-        {
-            FrustumOctreeQuery octreeQuery(tempDrawables, light->GetFrustum(), DRAWABLE_GEOMETRY,
-                camera_->GetViewMask());
-            octree_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
-            {
-                if (tempDrawables[i]->IsInView(frame_) && (GetLightMask(tempDrawables[i]) & light->GetLightMask()))
-                    query.litGeometries_.Push(tempDrawables[i]);
-            }
-        }
-        break;
-
     case LIGHT_POINT:
         {
-            SphereOctreeQuery octreeQuery(tempDrawables, Sphere(light->GetNode()->GetWorldPosition(), light->GetRange()),
-                DRAWABLE_GEOMETRY, camera_->GetViewMask());
-            octree_->GetDrawables(octreeQuery);
-            for (unsigned i = 0; i < tempDrawables.Size(); ++i)
+            const PODVector<Drawable*>& drawables = GetLightVolumeDrawables(query, tempDrawables);
+            for (unsigned i = 0; i < drawables.Size(); ++i)
             {
-                if (tempDrawables[i]->IsInView(frame_) && (GetLightMask(tempDrawables[i]) & light->GetLightMask()))
-                    query.litGeometries_.Push(tempDrawables[i]);
+                if (drawables[i]->IsInView(frame_) && (GetLightMask(drawables[i]) & light->GetLightMask()))
+                    query.litGeometries_.Push(drawables[i]);
             }
         }
         break;
@@ -2230,7 +2759,7 @@ void View::ProcessLight(LightQueryResult& query, unsigned threadIndex)
         }
 
         // Check which shadow casters actually contribute to the shadowing
-        ProcessShadowCasters(query, tempDrawables, i);
+        ProcessShadowCasters(query, query.cache_ ? query.cache_->drawables_ : tempDrawables, i);
     }
 
     // If no shadow casters, the light can be rendered unshadowed. At this point we have not allocated a shadow map yet, so the
@@ -2248,6 +2777,7 @@ void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawabl
     const Matrix3x4& lightView = shadowCamera->GetView();
     const Matrix4& lightProj = shadowCamera->GetProjection();
     LightType type = light->GetLightType();
+    bool isOrthographic = shadowCamera->IsOrthographic();
 
     query.shadowCasterBox_[splitIndex].defined_ = false;
 
@@ -2267,12 +2797,45 @@ void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawabl
     if (lightViewFrustum.vertices_[0] == lightViewFrustum.vertices_[4])
         return;
 
-    BoundingBox lightViewBox;
-    BoundingBox lightProjBox;
+    // The light space bounding boxes of a cached light volume query stay valid as long as the shadow camera does not move.
+    // Drawables are in the same order as in the cache, so the boxes can be indexed directly
+    LightQueryCache* cache = query.cache_;
+    BoundingBox* cachedViewBoxes = 0;
+    BoundingBox* cachedExtrudedBoxes = 0;
+    if (cache && !drawables.Empty())
+    {
+        PODVector<BoundingBox>& viewBoxes = cache->splitViewBoxes_[splitIndex];
+        PODVector<BoundingBox>& extrudedBoxes = cache->splitExtrudedBoxes_[splitIndex];
+
+        if (!cache->splitValid_[splitIndex] || cache->splitViews_[splitIndex] != lightView ||
+            cache->splitFarClips_[splitIndex] != shadowCamera->GetFarClip())
+        {
+            viewBoxes.Resize(drawables.Size());
+            extrudedBoxes.Resize(drawables.Size());
+            for (unsigned i = 0; i < viewBoxes.Size(); ++i)
+                viewBoxes[i].defined_ = false;
+            cache->splitViews_[splitIndex] = lightView;
+            cache->splitFarClips_[splitIndex] = shadowCamera->GetFarClip();
+            cache->splitValid_[splitIndex] = true;
+        }
+
+        cachedViewBoxes = &viewBoxes[0];
+        cachedExtrudedBoxes = &extrudedBoxes[0];
+    }
 
-    for (PODVector<Drawable*>::ConstIterator i = drawables.Begin(); i != drawables.End(); ++i)
+    PODVector<Drawable*>& candidates = query.casterCandidates_;
+    PODVector<BoundingBox>& candidateViewBoxes = query.casterViewBoxes_;
+    PODVector<BoundingBox>& candidateTestBoxes = query.casterTestBoxes_;
+    PODVector<unsigned char>& candidateVisible = query.casterVisible_;
+    candidates.Clear();
+    candidateViewBoxes.Clear();
+    candidateTestBoxes.Clear();
+    candidateVisible.Clear();
+
+    // First filter the drawables by their shadow casting settings and collect light space bounding boxes for the rest
+    for (unsigned i = 0; i < drawables.Size(); ++i)
     {
-        Drawable* drawable = *i;
+        Drawable* drawable = drawables[i];
         // In case this is a point or spot light query result reused for optimization, we may have non-shadowcasters included.
         // Check for that first
         if (!drawable->GetCastShadows())
@@ -2297,56 +2860,187 @@ void View::ProcessShadowCasters(LightQueryResult& query, const PODVector<Drawabl
             continue;
 
         // Project shadow caster bounding box to light view space for visibility check
-        lightViewBox = drawable->GetWorldBoundingBox().Transformed(lightView);
-
-        if (IsShadowCasterVisible(drawable, lightViewBox, shadowCamera, lightView, lightViewFrustum, lightViewFrustumBox))
+        BoundingBox lightViewBox;
+        BoundingBox testBox;
+        if (cachedViewBoxes && cachedViewBoxes[i].defined_)
+        {
+            lightViewBox = cachedViewBoxes[i];
+            testBox = cachedExtrudedBoxes[i];
+        }
+        else
         {
-            // Merge to shadow caster bounding box (only needed for focused spot lights) and add to the list
-            if (type == LIGHT_SPOT && light->GetShadowFocus().focus_)
+            lightViewBox = drawable->GetWorldBoundingBox().Transformed(lightView);
+            if (!isOrthographic)
+                testBox = GetExtrudedShadowCasterBox(lightViewBox, shadowCamera);
+            if (cachedViewBoxes)
             {
-                lightProjBox = lightViewBox.Projected(lightProj);
-                query.shadowCasterBox_[splitIndex].Merge(lightProjBox);
+                cachedViewBoxes[i] = lightViewBox;
+                cachedExtrudedBoxes[i] = testBox;
             }
-            query.shadowCasters_.Push(drawable);
         }
+
+        // For orthographic shadow cameras, extrude the light space bounding box up to the far edge of the frustum's light
+        // space bounding box. For perspective lights, if the object is visible, its shadow is too
+        bool visible = false;
+        if (isOrthographic)
+        {
+            testBox = lightViewBox;
+            testBox.max_.z_ = Max(testBox.max_.z_, lightViewFrustumBox.max_.z_);
+        }
+        else
+            visible = drawable->IsInView(frame_);
+
+        candidates.Push(drawable);
+        candidateViewBoxes.Push(lightViewBox);
+        candidateTestBoxes.Push(testBox);
+        candidateVisible.Push(visible ? 1 : 0);
+    }
+
+    // Then test the bounding boxes against the split frustum in batches
+    if (!candidates.Empty())
+        MarkBoxesInsideFast(lightViewFrustum, &candidateTestBoxes[0], &candidateVisible[0], candidates.Size());
+
+    bool mergeCasterBox = type == LIGHT_SPOT && light->GetShadowFocus().focus_;
+
+    for (unsigned i = 0; i < candidates.Size(); ++i)
+    {
+        if (!candidateVisible[i])
+            continue;
+
+        // Merge to shadow caster bounding box (only needed for focused spot lights) and add to the list
+        if (mergeCasterBox)
+            query.shadowCasterBox_[splitIndex].Merge(candidateViewBoxes[i].Projected(lightProj));
+        query.shadowCasters_.Push(candidates[i]);
     }
 
     query.shadowCasterEnd_[splitIndex] = query.shadowCasters_.Size();
 }
 
-bool View::IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView,
-    const Frustum& lightViewFrustum, const BoundingBox& lightViewFrustumBox)
+BoundingBox View::GetExtrudedShadowCasterBox(const BoundingBox& lightViewBox, Camera* shadowCamera) const
 {
-    if (shadowCamera->IsOrthographic())
+    // For perspective lights, extrusion direction depends on the position of the shadow caster
+    Vector3 center = lightViewBox.Center();
+    Ray extrusionRay(center, center);
+
+    float extrusionDistance = shadowCamera->GetFarClip();
+    float originalDistance = Clamp(center.Length(), M_EPSILON, extrusionDistance);
+
+    // Because of the perspective, the bounding box must also grow when it is extruded to the distance
+    float sizeFactor = extrusionDistance / originalDistance;
+
+    // Calculate the endpoint box and merge it to the original. Because it's axis-aligned, it will be larger
+    // than necessary, so the test will be conservative
+    Vector3 newCenter = extrusionDistance * extrusionRay.direction_;
+    Vector3 newHalfSize = lightViewBox.Size() * sizeFactor * 0.5f;
+    BoundingBox extrudedBox(newCenter - newHalfSize, newCenter + newHalfSize);
+    extrudedBox.Merge(lightViewBox);
+
+    return extrudedBox;
+}
+
+const PODVector<Drawable*>& View::GetLightVolumeDrawables(LightQueryResult& query, PODVector<Drawable*>& tempDrawables)
+{
+    Light* light = query.light_;
+    LightQueryCache* cache = query.cache_;
+
+    // Reuse the query of an earlier frame if the light has not moved and no drawables have changed within its volume
+    if (cache && IsLightQueryCacheValid(light, *cache))
+    {
+        cache->changes_ = octree_->GetNumChanges();
+        return cache->drawables_;
+    }
+
+    if (light->GetLightType() == LIGHT_SPOT)
     {
-        // Extrude the light space bounding box up to the far edge of the frustum's light space bounding box
-        lightViewBox.max_.z_ = Max(lightViewBox.max_.z_, lightViewFrustumBox.max_.z_);
-        return lightViewFrustum.IsInsideFast(lightViewBox) != OUTSIDE;
+        FrustumOctreeQuery octreeQuery(tempDrawables, light->GetFrustum(), DRAWABLE_GEOMETRY, camera_->GetViewMask());
+        octree_->GetDrawables(octreeQuery);
     }
     else
     {
-        // If light is not directional, can do a simple check: if object is visible, its shadow is too
-        if (drawable->IsInView(frame_))
-            return true;
+        SphereOctreeQuery octreeQuery(tempDrawables, Sphere(light->GetNode()->GetWorldPosition(), light->GetRange()),
+            DRAWABLE_GEOMETRY, camera_->GetViewMask());
+        octree_->GetDrawables(octreeQuery);
+    }
 
-        // For perspective lights, extrusion direction depends on the position of the shadow caster
-        Vector3 center = lightViewBox.Center();
-        Ray extrusionRay(center, center);
+    if (!cache)
+        return tempDrawables;
 
-        float extrusionDistance = shadowCamera->GetFarClip();
-        float originalDistance = Clamp(center.Length(), M_EPSILON, extrusionDistance);
+    cache->octree_ = octree_;
+    cache->type_ = light->GetLightType();
+    if (cache->type_ == LIGHT_SPOT)
+        cache->frustum_ = light->GetFrustum();
+    else
+        cache->sphere_ = Sphere(light->GetNode()->GetWorldPosition(), light->GetRange());
+    cache->viewMask_ = camera_->GetViewMask();
+    cache->changes_ = octree_->GetNumChanges();
+    cache->drawables_ = tempDrawables;
+    cache->sortedDrawables_ = tempDrawables;
+    Sort(cache->sortedDrawables_.Begin(), cache->sortedDrawables_.End());
+    for (unsigned i = 0; i < MAX_LIGHT_SPLITS; ++i)
+        cache->splitValid_[i] = false;
+    cache->valid_ = true;
+
+    return cache->drawables_;
+}
 
-        // Because of the perspective, the bounding box must also grow when it is extruded to the distance
-        float sizeFactor = extrusionDistance / originalDistance;
+bool View::IsLightQueryCacheValid(Light* light, const LightQueryCache& cache) const
+{
+    LightType type = light->GetLightType();
+    if (!cache.valid_ || cache.octree_.Get() != octree_ || cache.type_ != type || cache.viewMask_ != camera_->GetViewMask())
+        return false;
 
-        // Calculate the endpoint box and merge it to the original. Because it's axis-aligned, it will be larger
-        // than necessary, so the test will be conservative
-        Vector3 newCenter = extrusionDistance * extrusionRay.direction_;
-        Vector3 newHalfSize = lightViewBox.Size() * sizeFactor * 0.5f;
-        BoundingBox extrudedBox(newCenter - newHalfSize, newCenter + newHalfSize);
-        lightViewBox.Merge(extrudedBox);
+    // Check that the light volume is unchanged
+    Frustum frustum;
+    Sphere sphere;
+    if (type == LIGHT_SPOT)
+    {
+        frustum = light->GetFrustum();
+        for (unsigned i = 0; i < NUM_FRUSTUM_VERTICES; ++i)
+        {
+            if (frustum.vertices_[i] != cache.frustum_.vertices_[i])
+                return false;
+        }
+    }
+    else
+    {
+        sphere = Sphere(light->GetNode()->GetWorldPosition(), light->GetRange());
+        if (sphere != cache.sphere_)
+            return false;
+    }
+
+    // Check the octree changes recorded since the cache was last used. If some have already been forgotten, can not be sure
+    unsigned numChanges = octree_->GetNumChanges();
+    if (cache.changes_ < octree_->GetFirstChange() || cache.changes_ > numChanges)
+        return false;
 
-        return lightViewFrustum.IsInsideFast(lightViewBox) != OUTSIDE;
+    for (unsigned i = cache.changes_; i < numChanges; ++i)
+    {
+        // A drawable in the result has moved or been removed, or another one has moved into the light volume
+        const OctreeChange& change = octree_->GetChange(i);
+        if (ContainsSorted(cache.sortedDrawables_, change.drawable_))
+            return false;
+        if (change.box_.defined_)
+        {
+            if (type == LIGHT_SPOT ? frustum.IsInsideFast(change.box_) != OUTSIDE : sphere.IsInsideFast(change.box_) != OUTSIDE)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+void View::UpdateLightQueryCache()
+{
+    // Remove entries of lights that have not been visible recently, once they outnumber the visible lights
+    if (lightQueryCache_.Size() <= lights_.Size() * 2)
+        return;
+
+    for (HashMap<Light*, LightQueryCache>::Iterator i = lightQueryCache_.Begin(); i != lightQueryCache_.End();)
+    {
+        if (frame_.frameNumber_ - i->second_.frameNumber_ > LIGHT_QUERY_CACHE_MAX_AGE)
+            i = lightQueryCache_.Erase(i);
+        else
+            ++i;
     }
 }
 
@@ -2727,7 +3421,14 @@ void View::CheckMaterialForAuxView(Material* material)
     material->MarkForAuxView(frame_.frameNumber_);
 }
 
-void View::AddBatchToQueue(BatchQueue& batchQueue, Batch& batch, Technique* tech, bool allowInstancing, bool allowShadows)
+bool View::AddBatchToQueue(BatchQueue& batchQueue, Batch& batch, Technique* tech, bool allowInstancing, bool allowShadows)
+{
+    bool shadersSet = PrepareBatch(batch, tech, allowInstancing, allowShadows);
+    QueueBatch(batchQueue, batch, tech, allowShadows);
+    return shadersSet;
+}
+
+bool View::PrepareBatch(Batch& batch, Technique* tech, bool allowInstancing, bool allowShadows)
 {
     if (!batch.material_)
         batch.material_ = renderer_->GetDefaultMaterial();
@@ -2736,37 +3437,33 @@ void View::AddBatchToQueue(BatchQueue& batchQueue, Batch& batch, Technique* tech
     if (allowInstancing && batch.geometryType_ == GEOM_STATIC && batch.geometry_->GetIndexBuffer())
         batch.geometryType_ = GEOM_INSTANCED;
 
-    if (batch.geometryType_ == GEOM_INSTANCED)
+    // Instanced batches get their shaders once per batch group
+    if (batch.geometryType_ != GEOM_INSTANCED)
     {
-        BatchGroupKey key(batch);
+        // Shaders can not be loaded while batches are built in worker threads. Report for rebuilding on the main thread instead
+        if (threadedBatches_ && !renderer_->HasPassShaders(batch.pass_))
+            return false;
 
-        HashMap<BatchGroupKey, BatchGroup>::Iterator i = batchQueue.batchGroups_.Find(key);
-        if (i == batchQueue.batchGroups_.End())
-        {
-            // Create a new group based on the batch
-            // In case the group remains below the instancing limit, do not enable instancing shaders yet
-            BatchGroup newGroup(batch);
-            newGroup.geometryType_ = GEOM_STATIC;
-            renderer_->SetBatchShaders(newGroup, tech, allowShadows);
-            newGroup.CalculateSortKey();
-            i = batchQueue.batchGroups_.Insert(MakePair(key, newGroup));
-        }
+        renderer_->SetBatchShaders(batch, tech, allowShadows);
+        batch.CalculateSortKey();
+    }
 
-        int oldSize = i->second_.instances_.Size();
-        i->second_.AddTransforms(batch);
-        // Convert to using instancing shaders when the instancing limit is reached
-        if (oldSize < minInstances_ && (int)i->second_.instances_.Size() >= minInstances_)
-        {
-            i->second_.geometryType_ = GEOM_INSTANCED;
-            renderer_->SetBatchShaders(i->second_, tech, allowShadows);
-            i->second_.CalculateSortKey();
-        }
+    return true;
+}
+
+void View::QueueBatch(BatchQueue& batchQueue, Batch& batch, Technique* tech, bool allowShadows)
+{
+    if (batch.geometryType_ == GEOM_INSTANCED)
+    {
+        // Batch groups are formed from sorted runs once all batches have been queued
+        batchQueue.instancedBatches_.Resize(batchQueue.instancedBatches_.Size() + 1);
+        InstancedBatch& instancedBatch = batchQueue.instancedBatches_.Back();
+        instancedBatch.batch_ = batch;
+        instancedBatch.technique_ = tech;
+        instancedBatch.allowShadows_ = allowShadows;
     }
     else
     {
-        renderer_->SetBatchShaders(batch, tech, allowShadows);
-        batch.CalculateSortKey();
-
         // If batch is static with multiple world transforms and cannot instance, we must push copies of the batch individually
         if (batch.geometryType_ == GEOM_STATIC && batch.numWorldTransforms_ > 1)
         {
@@ -2784,6 +3481,92 @@ void View::AddBatchToQueue(BatchQueue& batchQueue, Batch& batch, Technique* tech
     }
 }
 
+void View::GroupInstancedBatches()
+{
+    PROFILE(GroupInstancedBatches);
+
+    for (HashMap<unsigned, BatchQueue>::Iterator i = batchQueues_.Begin(); i != batchQueues_.End(); ++i)
+        GroupInstancedBatches(i->second_);
+
+    for (Vector<LightBatchQueue>::Iterator i = lightQueues_.Begin(); i != lightQueues_.End(); ++i)
+    {
+        for (unsigned j = 0; j < i->shadowSplits_.Size(); ++j)
+            GroupInstancedBatches(i->shadowSplits_[j].shadowBatches_);
+        GroupInstancedBatches(i->litBaseBatches_);
+        GroupInstancedBatches(i->litBatches_);
+    }
+}
+
+void View::GroupInstancedBatches(BatchQueue& batchQueue)
+{
+    unsigned numBatches = batchQueue.instancedBatches_.Size();
+    if (!numBatches)
+        return;
+
+    // Sort by a 64-bit key derived from the group key. The sort is stable, so instances keep their queueing order
+    groupSortItems_.Resize(numBatches);
+    groupSortTemp_.Resize(numBatches);
+    for (unsigned i = 0; i < numBatches; ++i)
+    {
+        const Batch& batch = batchQueue.instancedBatches_[i].batch_;
+        groupSortItems_[i].key_ = (((unsigned long long)BatchGroupKey(batch).ToHash()) << 32) |
+                                  (unsigned)((size_t)batch.geometry_ / sizeof(Geometry) ^ (size_t)batch.material_ / sizeof(Material));
+        groupSortItems_[i].index_ = i;
+    }
+    RadixSort(groupSortItems_.Begin().ptr_, groupSortTemp_.Begin().ptr_, numBatches);
+
+    // Reserve for one group per run, so that adding groups does not copy the instance lists of earlier groups
+    unsigned numRuns = 1;
+    for (unsigned i = 1; i < numBatches; ++i)
+    {
+        if (groupSortItems_[i].key_ != groupSortItems_[i - 1].key_)
+            ++numRuns;
+    }
+    batchQueue.batchGroups_.Reserve(numRuns);
+
+    unsigned runStart = 0;
+    while (runStart < numBatches)
+    {
+        unsigned runEnd = runStart + 1;
+        while (runEnd < numBatches && groupSortItems_[runEnd].key_ == groupSortItems_[runStart].key_)
+            ++runEnd;
+
+        // Batches with different group keys may still share a run on a key collision, so check the groups of this run
+        unsigned firstGroup = batchQueue.batchGroups_.Size();
+        groupSources_.Clear();
+        for (unsigned i = runStart; i < runEnd; ++i)
+        {
+            const InstancedBatch& instancedBatch = batchQueue.instancedBatches_[groupSortItems_[i].index_];
+            BatchGroupKey key(instancedBatch.batch_);
+
+            unsigned j = firstGroup;
+            while (j < batchQueue.batchGroups_.Size() && BatchGroupKey(batchQueue.batchGroups_[j]) != key)
+                ++j;
+            if (j == batchQueue.batchGroups_.Size())
+            {
+                batchQueue.batchGroups_.Push(BatchGroup(instancedBatch.batch_));
+                groupSources_.Push(&instancedBatch);
+            }
+
+            batchQueue.batchGroups_[j].AddTransforms(instancedBatch.batch_);
+        }
+
+        // The final instance count is known, so choose between instancing and static shaders only once
+        for (unsigned j = firstGroup; j < batchQueue.batchGroups_.Size(); ++j)
+        {
+            BatchGroup& group = batchQueue.batchGroups_[j];
+            const InstancedBatch& source = *groupSources_[j - firstGroup];
+            group.geometryType_ = (int)group.instances_.Size() >= minInstances_ ? GEOM_INSTANCED : GEOM_STATIC;
+            renderer_->SetBatchShaders(group, source.technique_, source.allowShadows_);
+            group.CalculateSortKey();
+        }
+
+        runStart = runEnd;
+    }
+
+    batchQueue.instancedBatches_.Clear();
+}
+
 void View::PrepareInstancingBuffer()
 {
     PROFILE(PrepareInstancingBuffer);
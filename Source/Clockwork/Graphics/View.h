@@ -51,6 +51,56 @@ class Zone;
 struct RenderPathCommand;
 struct WorkItem;
 
+/// Light volume query of a spot or point light cached across frames, along with the state it was made with.
+struct LightQueryCache
+{
+    /// Construct as invalid.
+    LightQueryCache() :
+        type_(LIGHT_POINT),
+        viewMask_(0),
+        changes_(0),
+        frameNumber_(0),
+        valid_(false)
+    {
+        for (unsigned i = 0; i < MAX_LIGHT_SPLITS; ++i)
+        {
+            splitFarClips_[i] = 0.0f;
+            splitValid_[i] = false;
+        }
+    }
+
+    /// Octree that was queried.
+    WeakPtr<Octree> octree_;
+    /// Spot light frustum.
+    Frustum frustum_;
+    /// Point light sphere.
+    Sphere sphere_;
+    /// Drawables inside the light volume.
+    PODVector<Drawable*> drawables_;
+    /// Drawables inside the light volume sorted by address for searching.
+    PODVector<Drawable*> sortedDrawables_;
+    /// Shadow camera view matrices the light space bounding boxes were calculated with.
+    Matrix3x4 splitViews_[MAX_LIGHT_SPLITS];
+    /// Shadow camera far clip distances the extruded bounding boxes were calculated with.
+    float splitFarClips_[MAX_LIGHT_SPLITS];
+    /// Light space bounding boxes of the drawables per split. Undefined if not calculated yet.
+    PODVector<BoundingBox> splitViewBoxes_[MAX_LIGHT_SPLITS];
+    /// Light space bounding boxes extruded to the shadow camera far clip distance per split.
+    PODVector<BoundingBox> splitExtrudedBoxes_[MAX_LIGHT_SPLITS];
+    /// Light type.
+    LightType type_;
+    /// Camera view mask.
+    unsigned viewMask_;
+    /// Octree change number up to which the query has been checked.
+    unsigned changes_;
+    /// Frame number on which last used.
+    unsigned frameNumber_;
+    /// Per split bounding boxes valid flags.
+    bool splitValid_[MAX_LIGHT_SPLITS];
+    /// Valid flag.
+    bool valid_;
+};
+
 /// Intermediate light processing result.
 struct LightQueryResult
 {
@@ -74,6 +124,20 @@ struct LightQueryResult
     float shadowFarSplits_[MAX_LIGHT_SPLITS];
     /// Shadow map split count.
     unsigned numSplits_;
+    /// Lit transparent batches. Merged into the alpha pass queue in light order after the light queues have been built.
+    BatchQueue litAlphaBatches_;
+    /// Light volume query cache, or null for directional lights.
+    LightQueryCache* cache_;
+    /// Shadow caster candidates of the split being processed.
+    PODVector<Drawable*> casterCandidates_;
+    /// Light space bounding boxes of the shadow caster candidates.
+    PODVector<BoundingBox> casterViewBoxes_;
+    /// Light space bounding boxes of the shadow caster candidates extruded for the visibility test.
+    PODVector<BoundingBox> casterTestBoxes_;
+    /// Shadow caster candidate visibility flags.
+    PODVector<unsigned char> casterVisible_;
+    /// Batch shaders could not be set when building the light queue in a worker thread.
+    bool shadersMissing_;
 };
 
 /// Scene render pass info.
@@ -102,6 +166,85 @@ struct PerThreadSceneResult
     float minZ_;
     /// Scene maximum Z value.
     float maxZ_;
+    /// Number of drawables culled by occlusion.
+    unsigned numOccluded_;
+};
+
+/// Per-thread base pass batch construction range and results.
+struct PerThreadBaseBatches
+{
+    /// First drawable index.
+    unsigned start_;
+    /// Drawable index end.
+    unsigned end_;
+    /// Thread-local batch queues by scene pass.
+    Vector<BatchQueue> queues_;
+    /// Destination batch queues by scene pass.
+    PODVector<BatchQueue*> destQueues_;
+    /// Batch shaders could not be set when building the batches in a worker thread.
+    bool shadersMissing_;
+};
+
+/// State of a drawable's source batch that its cached base batches depend on.
+struct CachedSourceBatch
+{
+    /// Geometry.
+    Geometry* geometry_;
+    /// Material.
+    Material* material_;
+    /// Technique chosen for the material.
+    Technique* technique_;
+    /// Geometry type.
+    GeometryType geometryType_;
+};
+
+/// Base pass batch prepared in an earlier frame.
+struct CachedBaseBatch
+{
+    /// Batch with pass, zone, shaders and sort key resolved.
+    Batch batch_;
+    /// Technique.
+    Technique* technique_;
+    /// Source batch index.
+    unsigned sourceIndex_;
+    /// Scene pass index.
+    unsigned scenePassIndex_;
+    /// Shader version of the pass when the shaders were chosen.
+    unsigned shadersVersion_;
+};
+
+/// Base pass batches of a drawable cached across frames, along with the state they were built from.
+struct DrawableBatchCache
+{
+    /// Construct as invalid.
+    DrawableBatchCache() :
+        zone_(0),
+        lightMask_(0),
+        basePassFlags_(0),
+        frameNumber_(0),
+        heightFog_(false),
+        valid_(false)
+    {
+    }
+
+    /// Source batch state.
+    PODVector<CachedSourceBatch> sources_;
+    /// Supported passes per source batch and scene pass.
+    PODVector<Pass*> passes_;
+    /// Prepared batches.
+    PODVector<CachedBaseBatch> batches_;
+    /// Zone.
+    Zone* zone_;
+    /// Light mask.
+    unsigned lightMask_;
+    /// Flags for source batches that had a litbase pass.
+    unsigned basePassFlags_;
+    /// Frame number on which last used.
+    unsigned frameNumber_;
+    /// Zone height fog flag.
+    bool heightFog_;
+    /// Valid flag.
+    bool valid_;
 };
 
 static const unsigned MAX_VIEWPORT_TEXTURES = 2;
@@ -111,6 +254,8 @@ class CLOCKWORK_API View : public Object
 {
     friend void CheckVisibilityWork(const WorkItem* item, unsigned threadIndex);
     friend void ProcessLightWork(const WorkItem* item, unsigned threadIndex);
+    friend void GetLightQueueBatchesWork(const WorkItem* item, unsigned threadIndex);
+    friend void GetBaseBatchesWork(const WorkItem* item, unsigned threadIndex);
 
     OBJECT(View);
 
@@ -165,6 +310,9 @@ public:
     /// Return the last used software occlusion buffer.
     OcclusionBuffer* GetOcclusionBuffer() const { return occlusionBuffer_; }
 
+    /// Return number of drawables culled by the per-drawable occlusion test. Drawables in octants culled by occlusion are not included.
+    unsigned GetNumOccludedDrawables() const { return numOccludedDrawables_; }
+
     /// Set global (per-frame) shader parameters. Called by Batch and internally by View.
     void SetGlobalShaderParameters();
     /// Set camera-specific shader parameters. Called by Batch and internally by View.
@@ -181,12 +329,16 @@ private:
     void ProcessLights();
     /// Get batches from lit geometries and shadowcasters.
     void GetLightBatches();
+    /// Get shadow caster and lit batches of a per-pixel light. Can be called from a worker thread.
+    void GetLightQueueBatches(LightQueryResult& query);
     /// Get unlit batches.
     void GetBaseBatches();
+    /// Get unlit batches of a range of visible drawables. Can be called from a worker thread if there are no vertex lit drawables.
+    void GetBaseBatchRange(PerThreadBaseBatches& result);
     /// Update geometries and sort batches.
     void UpdateGeometries();
-    /// Get pixel lit batches for a certain light and drawable.
-    void GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue);
+    /// Get pixel lit batches for a certain light and drawable. Return false if batch shaders could not be chosen in a worker thread.
+    bool GetLitBatches(Drawable* drawable, LightBatchQueue& lightQueue, BatchQueue* alphaQueue);
     /// Execute render commands.
     void ExecuteRenderPathCommands();
     /// Set rendertargets for current render command.
@@ -209,10 +361,20 @@ private:
     void BlitFramebuffer(Texture* source, RenderSurface* destination, bool depthWrite);
     /// Draw a fullscreen quad. Shaders and renderstates must have been set beforehand.
     void DrawFullscreenQuad(bool nearQuad);
+    /// Add a drawable's base pass batches to batch queues given by scene pass, and optionally record them to a batch cache. Return false if batch shaders could not be chosen in a worker thread.
+    bool AddBaseBatches(Drawable* drawable, DrawableBatchCache* cache, const PODVector<BatchQueue*>& queues);
+    /// Return whether a drawable's cached base pass batches are still valid.
+    bool IsBatchCacheValid(Drawable* drawable, const DrawableBatchCache& cache);
+    /// Add a drawable's cached base pass batches to batch queues given by scene pass.
+    void AddCachedBaseBatches(Drawable* drawable, const DrawableBatchCache& cache, const PODVector<BatchQueue*>& queues);
+    /// Clear the batch cache if view-wide state it depends on has changed, and remove entries not used for a while.
+    void UpdateBatchCache();
     /// Query for occluders as seen from a camera.
     void UpdateOccluders(PODVector<Drawable*>& occluders, Camera* camera);
     /// Draw occluders to occlusion buffer.
     void DrawOccluders(OcclusionBuffer* buffer, const PODVector<Drawable*>& occluders);
+    /// Store the occlusion buffer for the next frame, and merge the previous frame's occlusion into it if it is usable.
+    void UpdateOcclusionHistory(OcclusionBuffer* buffer, bool merge);
     /// Query for lit geometries and shadow casters for a light.
     void ProcessLight(LightQueryResult& query, unsigned threadIndex);
     /// Process shadow casters' visibilities and build their combined view- or projection-space bounding box.
@@ -227,9 +389,14 @@ private:
     /// Quantize a directional light shadow camera view to eliminate swimming.
     void
         QuantizeDirLightShadowCamera(Camera* shadowCamera, Light* light, const IntRect& shadowViewport, const BoundingBox& viewBox);
-    /// Check visibility of one shadow caster.
-    bool IsShadowCasterVisible(Drawable* drawable, BoundingBox lightViewBox, Camera* shadowCamera, const Matrix3x4& lightView,
-        const Frustum& lightViewFrustum, const BoundingBox& lightViewFrustumBox);
+    /// Return a perspective shadow caster's light space bounding box extruded to the shadow camera far clip distance.
+    BoundingBox GetExtrudedShadowCasterBox(const BoundingBox& lightViewBox, Camera* shadowCamera) const;
+    /// Return drawables inside a spot or point light's volume, from the light query cache if still valid.
+    const PODVector<Drawable*>& GetLightVolumeDrawables(LightQueryResult& query, PODVector<Drawable*>& tempDrawables);
+    /// Check whether a light volume query cache is still valid.
+    bool IsLightQueryCacheValid(Light* light, const LightQueryCache& cache) const;
+    /// Remove light query caches of lights that have not been visible recently.
+    void UpdateLightQueryCache();
     /// Return the viewport for a shadow map split.
     IntRect GetShadowMapViewport(Light* light, unsigned splitIndex, Texture2D* shadowMap);
     /// Find and set a new zone for a drawable when it has moved.
@@ -238,8 +405,16 @@ private:
     Technique* GetTechnique(Drawable* drawable, Material* material);
     /// Check if material should render an auxiliary view (if it has a camera attached.)
     void CheckMaterialForAuxView(Material* material);
-    /// Choose shaders for a batch and add it to queue.
-    void AddBatchToQueue(BatchQueue& queue, Batch& batch, Technique* tech, bool allowInstancing = true, bool allowShadows = true);
+    /// Choose shaders for a batch and add it to queue. Return false if the shaders could not be chosen in a worker thread.
+    bool AddBatchToQueue(BatchQueue& queue, Batch& batch, Technique* tech, bool allowInstancing = true, bool allowShadows = true);
+    /// Choose default material, instancing and shaders for a batch and calculate its sort key, as needed before queueing. Return false if the pass shaders need loading, which is not possible in a worker thread.
+    bool PrepareBatch(Batch& batch, Technique* tech, bool allowInstancing, bool allowShadows);
+    /// Add a prepared batch to a queue.
+    void QueueBatch(BatchQueue& queue, Batch& batch, Technique* tech, bool allowShadows);
+    /// Form batch groups from the queued instanced batches of all batch queues.
+    void GroupInstancedBatches();
+    /// Form batch groups from the queued instanced batches of a batch queue.
+    void GroupInstancedBatches(BatchQueue& queue);
     /// Prepare instancing buffer by filling it with all instance transforms.
     void PrepareInstancingBuffer();
     /// Set up a light volume rendering batch.
@@ -301,6 +476,16 @@ private:
     Zone* farClipZone_;
     /// Occlusion buffer for the main camera.
     OcclusionBuffer* occlusionBuffer_;
+    /// Previous frame's occluder depth for temporal occlusion.
+    SharedPtr<OcclusionBuffer> occlusionHistory_;
+    /// Current frame's occluder depth being stored for the next frame.
+    SharedPtr<OcclusionBuffer> nextOcclusionHistory_;
+    /// Camera the occlusion history was rendered from.
+    WeakPtr<Camera> occlusionHistoryCamera_;
+    /// Frame number of the occlusion history.
+    unsigned occlusionHistoryFrame_;
+    /// Number of drawables culled by the per-drawable occlusion test.
+    unsigned numOccludedDrawables_;
     /// Destination color rendertarget.
     RenderSurface* renderTarget_;
     /// Substitute rendertarget for deferred rendering. Allocated if necessary.
@@ -374,8 +559,34 @@ private:
     HashMap<StringHash, Texture*> renderTargets_;
     /// Intermediate light processing results.
     Vector<LightQueryResult> lightQueryResults_;
+    /// Spot and point light volume queries cached across frames.
+    HashMap<Light*, LightQueryCache> lightQueryCache_;
     /// Info for scene render passes defined by the renderpath.
     PODVector<ScenePassInfo> scenePasses_;
+    /// Base pass batches cached across frames per drawable.
+    HashMap<Drawable*, DrawableBatchCache> batchCache_;
+    /// Scene passes the batch cache was built with.
+    PODVector<ScenePassInfo> batchCacheScenePasses_;
+    /// Camera the batch cache was built with.
+    Camera* batchCacheCamera_;
+    /// Renderer shader change frame number the batch cache was built with.
+    unsigned batchCacheShadersFrame_;
+    /// Base pass index the batch cache was built with.
+    unsigned batchCacheBasePassIndex_;
+    /// Renderer dynamic instancing flag the batch cache was built with.
+    bool batchCacheInstancing_;
+    /// Batch caches of the visible geometry objects, or null for those that can not be cached.
+    PODVector<DrawableBatchCache*> baseBatchCaches_;
+    /// Per-thread base pass batch construction results.
+    Vector<PerThreadBaseBatches> baseBatchResults_;
+    /// Batches being built in worker threads flag. Shaders can not be loaded meanwhile.
+    bool threadedBatches_;
+    /// Sort keys for forming batch groups.
+    PODVector<RadixSortItem> groupSortItems_;
+    /// Temporary buffer for sorting the batch group keys.
+    PODVector<RadixSortItem> groupSortTemp_;
+    /// Instanced batches that created the batch groups of the current run.
+    PODVector<const InstancedBatch*> groupSources_;
     /// Per-pixel light queues.
     Vector<LightBatchQueue> lightQueues_;
     /// Per-vertex light queues.
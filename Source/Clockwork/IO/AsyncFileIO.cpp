@@ -0,0 +1,721 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../Core/Thread.h"
+#include "../IO/AsyncFileIO.h"
+#include "../IO/File.h"
+#include "../IO/Log.h"
+
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef CLOCKWORK_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#elif !defined(WIN32)
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const unsigned DEFAULT_IO_THREADS = 2;
+
+/// I/O thread.
+class AsyncIOThread : public Thread, public RefCounted
+{
+public:
+    /// Construct.
+    AsyncIOThread(AsyncFileIO* owner, bool ring) :
+        owner_(owner),
+        ring_(ring)
+    {
+    }
+
+    /// Process requests.
+    virtual void ThreadFunction()
+    {
+        if (ring_)
+            owner_->ProcessRingCompletions();
+        else
+            owner_->ProcessRequests();
+    }
+
+private:
+    /// File I/O subsystem.
+    AsyncFileIO* owner_;
+    /// Whether processes io_uring completions instead of reading from the queue.
+    bool ring_;
+};
+
+/// Read a flag with acquire ordering.
+static inline bool LoadAcquire(const volatile bool& flag)
+{
+#ifdef _MSC_VER
+    // Ordinary loads already have acquire semantics on x86 and x64, only compiler reordering needs to be prevented
+    bool value = flag;
+    _ReadWriteBarrier();
+    return value;
+#else
+    return __atomic_load_n(&flag, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/// Write a flag with release ordering.
+static inline void StoreRelease(volatile bool& flag, bool value)
+{
+#ifdef _MSC_VER
+    _ReadWriteBarrier();
+    flag = value;
+#else
+    __atomic_store_n(&flag, value, __ATOMIC_RELEASE);
+#endif
+}
+
+/// Return whether a file can be read with positional reads on its native descriptor, without touching the file object's own state.
+static bool CanReadDirect(File* file)
+{
+#ifdef WIN32
+    return false;
+#else
+    return file->GetHandle() && !file->IsCompressed();
+#endif
+}
+
+#ifdef CLOCKWORK_IO_URING
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+static const unsigned RING_ENTRIES = 64;
+
+/// A read in flight in the io_uring.
+struct RingRead
+{
+    /// Request.
+    AsyncReadRequest* request_;
+    /// Destination buffer of the current submission.
+    struct iovec iov_;
+};
+
+/// Mapped io_uring submission and completion queues.
+struct IORing
+{
+    /// Ring file descriptor.
+    int fd_;
+    /// Number of submission queue entries.
+    unsigned entries_;
+    /// Number of reads in flight.
+    unsigned numInFlight_;
+    /// Submission queue head.
+    unsigned* sqHead_;
+    /// Submission queue tail.
+    unsigned* sqTail_;
+    /// Submission queue index mask.
+    unsigned* sqMask_;
+    /// Submission queue index array.
+    unsigned* sqArray_;
+    /// Submission queue entries.
+    io_uring_sqe* sqes_;
+    /// Completion queue head.
+    unsigned* cqHead_;
+    /// Completion queue tail.
+    unsigned* cqTail_;
+    /// Completion queue index mask.
+    unsigned* cqMask_;
+    /// Completion queue entries.
+    io_uring_cqe* cqes_;
+    /// Mapped submission queue ring.
+    void* sqRing_;
+    /// Mapped submission queue ring size.
+    size_t sqRingSize_;
+    /// Mapped completion queue ring.
+    void* cqRing_;
+    /// Mapped completion queue ring size.
+    size_t cqRingSize_;
+    /// Mapped submission queue entries size.
+    size_t sqesSize_;
+};
+
+static void DestroyRing(IORing* ring)
+{
+    if (ring->sqes_ && ring->sqes_ != MAP_FAILED)
+        munmap(ring->sqes_, ring->sqesSize_);
+    if (ring->cqRing_ && ring->cqRing_ != MAP_FAILED)
+        munmap(ring->cqRing_, ring->cqRingSize_);
+    if (ring->sqRing_ && ring->sqRing_ != MAP_FAILED)
+        munmap(ring->sqRing_, ring->sqRingSize_);
+    if (ring->fd_ >= 0)
+        close(ring->fd_);
+    delete ring;
+}
+
+static IORing* CreateRing(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof params);
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+        return 0;
+
+    IORing* ring = new IORing();
+    memset(ring, 0, sizeof(IORing));
+    ring->fd_ = fd;
+    ring->entries_ = params.sq_entries;
+    ring->sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring->sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+
+    ring->sqRing_ = mmap(0, ring->sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    ring->cqRing_ = mmap(0, ring->cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    ring->sqes_ = (io_uring_sqe*)mmap(0, ring->sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_SQES);
+    if (ring->sqRing_ == MAP_FAILED || ring->cqRing_ == MAP_FAILED || ring->sqes_ == MAP_FAILED)
+    {
+        DestroyRing(ring);
+        return 0;
+    }
+
+    unsigned char* sq = (unsigned char*)ring->sqRing_;
+    ring->sqHead_ = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail_ = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqMask_ = (unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqArray_ = (unsigned*)(sq + params.sq_off.array);
+
+    unsigned char* cq = (unsigned char*)ring->cqRing_;
+    ring->cqHead_ = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail_ = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask_ = (unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes_ = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+/// Queue a read (or a no-op wakeup if op is null) to the submission queue and submit it. Must be called with the queue mutex held. Return true if the operation is in the ring, or false if it was withdrawn and can be freed.
+static bool SubmitRingOp(IORing* ring, RingRead* op)
+{
+    unsigned tail = *ring->sqTail_;
+    unsigned index = tail & *ring->sqMask_;
+    io_uring_sqe* sqe = &ring->sqes_[index];
+    memset(sqe, 0, sizeof(io_uring_sqe));
+
+    if (op)
+    {
+        File* file = op->request_->GetFile();
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fileno((FILE*)file->GetHandle());
+        sqe->off = (unsigned long long)file->GetOffset() + op->request_->GetFilePosition() + (op->request_->GetRequestSize() -
+            (unsigned)op->iov_.iov_len);
+        sqe->addr = (unsigned long long)(size_t)&op->iov_;
+        sqe->len = 1;
+    }
+    else
+        sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = (unsigned long long)(size_t)op;
+
+    ring->sqArray_[index] = index;
+    __atomic_store_n(ring->sqTail_, tail + 1, __ATOMIC_RELEASE);
+
+    int ret;
+    do
+    {
+        ret = (int)syscall(__NR_io_uring_enter, ring->fd_, 1, 0, 0, 0, 0);
+    }
+    while (ret < 0 && errno == EINTR);
+
+    if (ret == 1)
+        return true;
+
+    // If the kernel did not take the entry, withdraw it, so that the next submission does not pick up an operation the
+    // caller is about to free. All submissions are done under the queue mutex, so no other entry can be pending
+    if (__atomic_load_n(ring->sqHead_, __ATOMIC_ACQUIRE) == tail)
+    {
+        __atomic_store_n(ring->sqTail_, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    else
+        return true;
+}
+
+#endif
+
+AsyncReadRequest::AsyncReadRequest(File* file, unsigned position, unsigned size) :
+    Deserializer(size),
+    completionFunction_(0),
+    aux_(0),
+    file_(file),
+    filePosition_(position),
+    requestSize_(size),
+    bytesRead_(0),
+    threadRead_(false),
+    data_(new unsigned char[size]),
+    checksum_(0),
+    completed_(false)
+{
+}
+
+AsyncReadRequest::~AsyncReadRequest()
+{
+}
+
+unsigned AsyncReadRequest::Read(void* dest, unsigned size)
+{
+    if (!IsCompleted())
+        return 0;
+
+    if (size + position_ > size_)
+        size = size_ - position_;
+    if (!size)
+        return 0;
+
+    memcpy(dest, data_.Get() + position_, size);
+    position_ += size;
+    return size;
+}
+
+unsigned AsyncReadRequest::Seek(unsigned position)
+{
+    if (position > size_)
+        position = size_;
+
+    position_ = position;
+    return position_;
+}
+
+const String& AsyncReadRequest::GetName() const
+{
+    return file_->GetName();
+}
+
+unsigned AsyncReadRequest::GetChecksum()
+{
+    // Package entries have a precalculated checksum which does not require reading the file
+    if (file_->IsPackaged())
+        return file_->GetChecksum();
+
+    if (!IsCompleted() || filePosition_ || requestSize_ != file_->GetSize() || size_ != requestSize_)
+        return 0;
+
+    if (!checksum_)
+    {
+        // Same algorithm as File::GetChecksum() so that results are interchangeable
+        for (unsigned i = 0; i < size_; ++i)
+            checksum_ = SDBMHash(checksum_, data_[i]);
+    }
+
+    return checksum_;
+}
+
+bool AsyncReadRequest::IsCompleted() const
+{
+    return LoadAcquire(completed_);
+}
+
+bool AsyncReadRequest::IsSuccess() const
+{
+    return IsCompleted() && size_ == requestSize_;
+}
+
+AsyncFileIO::AsyncFileIO(Context* context) :
+    Object(context),
+    ring_(0),
+    numPending_(0),
+    numThreads_(DEFAULT_IO_THREADS),
+    started_(false),
+    shutDown_(false)
+{
+}
+
+AsyncFileIO::~AsyncFileIO()
+{
+    // Let the reads in flight finish so that no I/O references the request buffers after they are freed
+    for (;;)
+    {
+        {
+            MutexLock lock(queueMutex_);
+            if (!numPending_)
+                break;
+        }
+        idleCondition_.Wait();
+    }
+
+    shutDown_ = true;
+    requestCondition_.Set();
+
+#ifdef CLOCKWORK_IO_URING
+    // Wake up the completion thread, which waits inside the ring
+    if (ring_)
+    {
+        MutexLock lock(queueMutex_);
+        SubmitRingOp((IORing*)ring_, 0);
+    }
+#endif
+
+    for (unsigned i = 0; i < threads_.Size(); ++i)
+        threads_[i]->Stop();
+    threads_.Clear();
+
+#ifdef CLOCKWORK_IO_URING
+    if (ring_)
+    {
+        DestroyRing((IORing*)ring_);
+        ring_ = 0;
+    }
+#endif
+}
+
+void AsyncFileIO::SetNumThreads(unsigned num)
+{
+    MutexLock lock(queueMutex_);
+
+    if (started_)
+    {
+        LOGERROR("Can not change number of I/O threads after starting");
+        return;
+    }
+
+    numThreads_ = Max((int)num, 1);
+}
+
+SharedPtr<AsyncReadRequest> AsyncFileIO::Read(File* file, unsigned position, unsigned size,
+    void (*completionFunction)(AsyncReadRequest*), void* aux)
+{
+    if (!file || !file->IsOpen() || file->GetMode() == FILE_WRITE)
+    {
+        LOGERROR("File not open for asynchronous reading");
+        return SharedPtr<AsyncReadRequest>();
+    }
+
+    if (position > file->GetSize())
+        position = file->GetSize();
+    if (size + position > file->GetSize())
+        size = file->GetSize() - position;
+
+    SharedPtr<AsyncReadRequest> request(new AsyncReadRequest(file, position, size));
+    request->completionFunction_ = completionFunction;
+    request->aux_ = aux;
+
+    MutexLock lock(queueMutex_);
+
+    if (!started_)
+        Start();
+
+    ++numPending_;
+    queue_.Push(request);
+#ifdef CLOCKWORK_IO_URING
+    if (ring_ && CanReadDirect(file))
+    {
+        SubmitRingRequests();
+        return request;
+    }
+#endif
+    requestCondition_.Set();
+
+    return request;
+}
+
+SharedPtr<AsyncReadRequest> AsyncFileIO::ReadAll(File* file, void (*completionFunction)(AsyncReadRequest*), void* aux)
+{
+    return Read(file, 0, file ? file->GetSize() : 0, completionFunction, aux);
+}
+
+bool AsyncFileIO::Wait(AsyncReadRequest* request)
+{
+    if (!request)
+        return false;
+
+    while (!request->IsCompleted())
+        request->completedCondition_.Wait();
+    // Pass the wakeup on to other threads possibly waiting for the same request
+    request->completedCondition_.Set();
+
+    return request->IsSuccess();
+}
+
+unsigned AsyncFileIO::GetNumPendingRequests() const
+{
+    MutexLock lock(queueMutex_);
+    return numPending_;
+}
+
+void AsyncFileIO::Start()
+{
+    started_ = true;
+
+#ifdef CLOCKWORK_IO_URING
+    ring_ = CreateRing(RING_ENTRIES);
+    if (ring_)
+    {
+        LOGINFO("Using io_uring for asynchronous file reads");
+
+        // One thread reaps the ring completions, another serves the files that need to be decompressed while reading
+        SharedPtr<AsyncIOThread> ringThread(new AsyncIOThread(this, true));
+        ringThread->Run();
+        threads_.Push(ringThread);
+        SharedPtr<AsyncIOThread> thread(new AsyncIOThread(this, false));
+        thread->Run();
+        threads_.Push(thread);
+        return;
+    }
+    else
+        LOGDEBUG("io_uring not available, using I/O threads for asynchronous file reads");
+#endif
+
+    for (unsigned i = 0; i < numThreads_; ++i)
+    {
+        SharedPtr<AsyncIOThread> thread(new AsyncIOThread(this, false));
+        thread->Run();
+        threads_.Push(thread);
+    }
+}
+
+void AsyncFileIO::ProcessRequests()
+{
+    while (!shutDown_)
+    {
+        SharedPtr<AsyncReadRequest> request;
+
+        queueMutex_.Acquire();
+        for (List<SharedPtr<AsyncReadRequest> >::Iterator i = queue_.Begin(); i != queue_.End(); ++i)
+        {
+            // When io_uring is in use, take only the requests it can not serve
+            if (!ring_ || (*i)->threadRead_ || !CanReadDirect((*i)->GetFile()))
+            {
+                request = *i;
+                queue_.Erase(i);
+                break;
+            }
+        }
+        // Wake up another thread for the rest of the queue
+        if (request && !queue_.Empty())
+            requestCondition_.Set();
+        queueMutex_.Release();
+
+        if (request)
+        {
+            ExecuteRead(request);
+            CompleteRequest(request);
+        }
+        else
+            requestCondition_.Wait();
+    }
+
+    // Pass the shutdown wakeup on to the next thread
+    requestCondition_.Set();
+}
+
+void AsyncFileIO::ProcessRingCompletions()
+{
+#ifdef CLOCKWORK_IO_URING
+    IORing* ring = (IORing*)ring_;
+
+    while (!shutDown_)
+    {
+        // Wait for at least one completion. Submissions from other threads will wake up the wait
+        int ret = (int)syscall(__NR_io_uring_enter, ring->fd_, 0, 1, IORING_ENTER_GETEVENTS, 0, 0);
+        if (ret < 0 && errno != EINTR)
+        {
+            LOGERRORF("io_uring wait failed with error %d", errno);
+            // Block until completions are available instead of retrying at once
+            pollfd pollFd;
+            pollFd.fd = ring->fd_;
+            pollFd.events = POLLIN;
+            pollFd.revents = 0;
+            poll(&pollFd, 1, -1);
+        }
+
+        for (;;)
+        {
+            unsigned head = *ring->cqHead_;
+            if (head == __atomic_load_n(ring->cqTail_, __ATOMIC_ACQUIRE))
+                break;
+
+            io_uring_cqe* cqe = &ring->cqes_[head & *ring->cqMask_];
+            RingRead* op = (RingRead*)(size_t)cqe->user_data;
+            int result = cqe->res;
+            __atomic_store_n(ring->cqHead_, head + 1, __ATOMIC_RELEASE);
+
+            // Null operation is the wakeup for shutting down
+            if (!op)
+                continue;
+
+            AsyncReadRequest* request = op->request_;
+            bool resubmitted = false;
+            {
+                MutexLock lock(queueMutex_);
+                --ring->numInFlight_;
+
+                if (result > 0)
+                {
+                    request->bytesRead_ += (unsigned)result;
+                    op->iov_.iov_base = (unsigned char*)op->iov_.iov_base + result;
+                    op->iov_.iov_len -= (size_t)result;
+                }
+
+                // Resubmit the remainder on short reads and interrupted reads. If the ring is full, hand the remainder over
+                // to the I/O thread, which continues from the bytes read so far
+                if ((result > 0 && op->iov_.iov_len) || result == -EINTR || result == -EAGAIN)
+                {
+                    if (SubmitRingOp(ring, op))
+                        ++ring->numInFlight_;
+                    else
+                    {
+                        request->threadRead_ = true;
+                        queue_.PushFront(SharedPtr<AsyncReadRequest>(request));
+                        requestCondition_.Set();
+                        delete op;
+                        request->ReleaseRef();
+                    }
+                    resubmitted = true;
+                }
+            }
+
+            if (resubmitted)
+                continue;
+
+            if (result < 0)
+                LOGERROR("Error while reading asynchronously from file " + request->GetName());
+
+            delete op;
+            CompleteRequest(request);
+            // Release the reference held while in flight
+            request->ReleaseRef();
+        }
+
+        MutexLock lock(queueMutex_);
+        SubmitRingRequests();
+    }
+#endif
+}
+
+void AsyncFileIO::SubmitRingRequests()
+{
+#ifdef CLOCKWORK_IO_URING
+    IORing* ring = (IORing*)ring_;
+
+    for (List<SharedPtr<AsyncReadRequest> >::Iterator i = queue_.Begin(); i != queue_.End() && ring->numInFlight_ <
+        ring->entries_;)
+    {
+        AsyncReadRequest* request = *i;
+        if (request->threadRead_ || !CanReadDirect(request->GetFile()))
+        {
+            ++i;
+            continue;
+        }
+
+        RingRead* op = new RingRead();
+        op->request_ = request;
+        op->iov_.iov_base = request->data_.Get();
+        op->iov_.iov_len = request->requestSize_;
+
+        // The ring holds a reference to the request while in flight
+        request->AddRef();
+        if (SubmitRingOp(ring, op))
+        {
+            ++ring->numInFlight_;
+            i = queue_.Erase(i);
+        }
+        else
+        {
+            // Let the I/O thread read it instead, as nothing may be in flight to retry the submission later
+            request->ReleaseRef();
+            delete op;
+            LOGWARNING("Failed to submit asynchronous read of " + request->GetName() + " to io_uring, reading in an I/O thread");
+            request->threadRead_ = true;
+            requestCondition_.Set();
+            ++i;
+        }
+    }
+#endif
+}
+
+void AsyncFileIO::ExecuteRead(AsyncReadRequest* request)
+{
+    File* file = request->GetFile();
+    unsigned char* dest = request->data_.Get();
+    unsigned size = request->requestSize_;
+
+#ifndef WIN32
+    if (CanReadDirect(file))
+    {
+        int fd = fileno((FILE*)file->GetHandle());
+        off_t offset = (off_t)file->GetOffset() + request->filePosition_;
+        while (request->bytesRead_ < size)
+        {
+            ssize_t ret = pread(fd, dest + request->bytesRead_, size - request->bytesRead_, offset + request->bytesRead_);
+            if (ret > 0)
+                request->bytesRead_ += (unsigned)ret;
+            else if (ret < 0 && errno == EINTR)
+                continue;
+            else
+            {
+                if (ret < 0)
+                    LOGERROR("Error while reading asynchronously from file " + request->GetName());
+                break;
+            }
+        }
+        return;
+    }
+#endif
+
+    // Compressed files and Android assets need to be read through the file object itself
+    file->Seek(request->filePosition_);
+    request->bytesRead_ = file->Read(dest, size);
+}
+
+void AsyncFileIO::CompleteRequest(AsyncReadRequest* request)
+{
+    request->size_ = request->bytesRead_;
+    request->position_ = 0;
+
+    if (request->completionFunction_)
+        request->completionFunction_(request);
+    // The caller holds a reference, so the request stays alive even if a waiting thread releases it right away
+    StoreRelease(request->completed_, true);
+    request->completedCondition_.Set();
+
+    MutexLock lock(queueMutex_);
+    if (!--numPending_)
+        idleCondition_.Set();
+}
+
+}
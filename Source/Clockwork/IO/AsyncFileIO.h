@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/ArrayPtr.h"
+#include "../Container/List.h"
+#include "../Core/Condition.h"
+#include "../Core/Mutex.h"
+#include "../Core/Object.h"
+#include "../IO/Deserializer.h"
+
+namespace Clockwork
+{
+
+class AsyncIOThread;
+class File;
+
+/// Asynchronous file read request. Acts as a future for the result: once completed, the data can be accessed directly or read as a stream.
+class CLOCKWORK_API AsyncReadRequest : public RefCounted, public Deserializer
+{
+    friend class AsyncFileIO;
+
+public:
+    /// Construct.
+    AsyncReadRequest(File* file, unsigned position, unsigned size);
+    /// Destruct.
+    virtual ~AsyncReadRequest();
+
+    /// Read bytes from the data read. Return number of bytes actually read, or 0 if not completed yet.
+    virtual unsigned Read(void* dest, unsigned size);
+    /// Set position from the beginning of the data read.
+    virtual unsigned Seek(unsigned position);
+    /// Return name of the source file.
+    virtual const String& GetName() const;
+    /// Return a checksum of the source file using the SDBM hash algorithm, if the whole file was read. For packaged files return the package entry checksum.
+    virtual unsigned GetChecksum();
+
+    /// Return source file.
+    File* GetFile() const { return file_; }
+
+    /// Return read start position within the source file.
+    unsigned GetFilePosition() const { return filePosition_; }
+
+    /// Return number of bytes requested.
+    unsigned GetRequestSize() const { return requestSize_; }
+
+    /// Return data read. Valid after completion.
+    unsigned char* GetData() const { return data_.Get(); }
+
+    /// Return whether the request has completed, either successfully or not.
+    bool IsCompleted() const;
+    /// Return whether the request has completed and all requested bytes were read.
+    bool IsSuccess() const;
+
+    /// Completion function, called from the I/O thread after the read finishes. Optional.
+    void (*completionFunction_)(AsyncReadRequest*);
+    /// Auxiliary data pointer for the completion function.
+    void* aux_;
+
+private:
+    /// Source file.
+    SharedPtr<File> file_;
+    /// Read start position within the source file.
+    unsigned filePosition_;
+    /// Number of bytes requested.
+    unsigned requestSize_;
+    /// Number of bytes read so far. Used by the I/O backend.
+    unsigned bytesRead_;
+    /// Read in an I/O thread even if io_uring is in use. Set when submitting the read to the ring failed.
+    bool threadRead_;
+    /// Data buffer.
+    SharedArrayPtr<unsigned char> data_;
+    /// Content checksum.
+    unsigned checksum_;
+    /// Completed flag. Written with release and read with acquire ordering, so that the data is visible once it is set.
+    volatile bool completed_;
+    /// Condition set on completion.
+    Condition completedCondition_;
+};
+
+/// %Asynchronous file reading subsystem. Keeps many reads in flight, using io_uring on Linux if available and a pool of I/O threads otherwise.
+class CLOCKWORK_API AsyncFileIO : public Object
+{
+    OBJECT(AsyncFileIO);
+
+    friend class AsyncIOThread;
+
+public:
+    /// Construct.
+    AsyncFileIO(Context* context);
+    /// Destruct. Wait for reads in flight to finish.
+    virtual ~AsyncFileIO();
+
+    /// Set number of I/O threads used when io_uring is not available. Has effect only before the first request. Default 2.
+    void SetNumThreads(unsigned num);
+    /// Queue a read of a range of a file. Return the request, or null if the file is not open for reading. Can be called from outside the main thread. If the file is compressed or an Android asset, it must not be otherwise accessed until the request completes.
+    SharedPtr<AsyncReadRequest> Read(File* file, unsigned position, unsigned size, void (*completionFunction)(AsyncReadRequest*) = 0, void* aux = 0);
+    /// Queue a read of a whole file. Return the request, or null if the file is not open for reading. Can be called from outside the main thread.
+    SharedPtr<AsyncReadRequest> ReadAll(File* file, void (*completionFunction)(AsyncReadRequest*) = 0, void* aux = 0);
+    /// Block until a request has completed. Return true if it was successful.
+    bool Wait(AsyncReadRequest* request);
+
+    /// Return number of I/O threads.
+    unsigned GetNumThreads() const { return numThreads_; }
+
+    /// Return number of requests queued or in flight.
+    unsigned GetNumPendingRequests() const;
+    /// Return whether the io_uring backend is in use. Is known only after the first request.
+    bool IsUsingIOUring() const { return ring_ != 0; }
+
+private:
+    /// Start the backend if not started yet. Called with the queue mutex held.
+    void Start();
+    /// Process queued requests until shut down. Called by the thread pool I/O threads.
+    void ProcessRequests();
+    /// Submit queued requests to the io_uring and process completions until shut down. Called by the io_uring I/O thread.
+    void ProcessRingCompletions();
+    /// Submit queued requests to the io_uring while it has room. Called with the queue mutex held.
+    void SubmitRingRequests();
+    /// Perform a read synchronously in the calling thread.
+    void ExecuteRead(AsyncReadRequest* request);
+    /// Mark a request completed and call its completion function.
+    void CompleteRequest(AsyncReadRequest* request);
+
+    /// I/O threads.
+    Vector<SharedPtr<AsyncIOThread> > threads_;
+    /// Requests waiting to be read or submitted.
+    List<SharedPtr<AsyncReadRequest> > queue_;
+    /// Queue mutex.
+    mutable Mutex queueMutex_;
+    /// Condition set when requests are queued for the I/O threads, or when shutting down.
+    Condition requestCondition_;
+    /// Condition set when the last pending request completes.
+    Condition idleCondition_;
+    /// io_uring state, null if not in use.
+    void* ring_;
+    /// Number of requests queued or in flight.
+    volatile unsigned numPending_;
+    /// Number of I/O threads for the thread pool backend.
+    unsigned numThreads_;
+    /// Started flag.
+    bool started_;
+    /// Shutting down flag.
+    volatile bool shutDown_;
+};
+
+}
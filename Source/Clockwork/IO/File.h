@@ -102,6 +102,12 @@ public:
     /// Return whether the file originates from a package.
     bool IsPackaged() const { return offset_ != 0; }
 
+    /// Return start position within a package file, 0 for regular files.
+    unsigned GetOffset() const { return offset_; }
+
+    /// Return whether the file is read from a compressed package.
+    bool IsCompressed() const { return compressed_; }
+
 private:
     /// File name.
     String fileName_;
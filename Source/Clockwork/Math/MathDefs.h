@@ -27,6 +27,11 @@
 #include <cstdlib>
 #include <cmath>
 
+// SSE2 intrinsics are available when SSE is enabled and the compiler targets SSE2, which is always the case on 64-bit x86
+#if defined(CLOCKWORK_SSE) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define CLOCKWORK_SSE2
+#endif
+
 namespace Clockwork
 {
 
@@ -24,6 +24,7 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../IO/AsyncFileIO.h"
 #include "../IO/Log.h"
 #include "../Resource/BackgroundLoader.h"
 #include "../Resource/ResourceCache.h"
@@ -34,6 +35,9 @@
 namespace Clockwork
 {
 
+/// Maximum number of queued resources to read ahead.
+static const unsigned MAX_PREFETCH_RESOURCES = 4;
+
 BackgroundLoader::BackgroundLoader(ResourceCache* owner) :
     owner_(owner)
 {
@@ -65,17 +69,26 @@ void BackgroundLoader::ThreadFunction()
         {
             BackgroundLoadItem& item = i->second_;
             Resource* resource = item.resource_;
+            SharedPtr<AsyncReadRequest> prefetch = item.prefetch_;
+            item.prefetch_.Reset();
+            resource->SetAsyncLoadState(ASYNC_LOADING);
             // We can be sure that the item is not removed from the queue as long as it is in the
             // "queued" or "loading" state
             backgroundLoadMutex_.Release();
 
+            PrefetchQueuedResources();
+
             bool success = false;
-            SharedPtr<File> file = owner_->GetFile(resource->GetName(), item.sendEventOnFailure_);
-            if (file)
+            AsyncFileIO* asyncFileIO = owner_->GetSubsystem<AsyncFileIO>();
+            if (prefetch && asyncFileIO && asyncFileIO->Wait(prefetch))
+                success = owner_->BeginLoadResource(resource, *prefetch);
+            else
             {
-                resource->SetAsyncLoadState(ASYNC_LOADING);
-                success = resource->BeginLoad(*file);
+                SharedPtr<File> file = owner_->GetFile(resource->GetName(), item.sendEventOnFailure_);
+                if (file)
+                    success = owner_->BeginLoadResource(resource, *file);
             }
+            prefetch.Reset();
 
             // Process dependencies now
             // Need to lock the queue again when manipulating other entries
@@ -247,6 +260,52 @@ unsigned BackgroundLoader::GetNumQueuedResources() const
     return backgroundLoadQueue_.Size();
 }
 
+void BackgroundLoader::PrefetchQueuedResources()
+{
+    AsyncFileIO* asyncFileIO = owner_->GetSubsystem<AsyncFileIO>();
+    if (!asyncFileIO)
+        return;
+
+    // Pick the resources to read ahead with the queue locked, but open their files without it, as that may take long
+    Vector<Pair<StringHash, StringHash> > keys;
+    Vector<String> names;
+    {
+        MutexLock lock(backgroundLoadMutex_);
+
+        unsigned numPrefetched = 0;
+        for (HashMap<Pair<StringHash, StringHash>, BackgroundLoadItem>::Iterator i = backgroundLoadQueue_.Begin();
+             i != backgroundLoadQueue_.End() && numPrefetched < MAX_PREFETCH_RESOURCES; ++i)
+        {
+            BackgroundLoadItem& item = i->second_;
+            if (item.resource_->GetAsyncLoadState() != ASYNC_QUEUED)
+                continue;
+
+            if (!item.prefetch_)
+            {
+                keys.Push(i->first_);
+                names.Push(item.resource_->GetName());
+            }
+
+            ++numPrefetched;
+        }
+    }
+
+    for (unsigned i = 0; i < keys.Size(); ++i)
+    {
+        // Failure to open is reported when the resource is actually loaded
+        SharedPtr<File> file = owner_->GetFile(names[i], false);
+        if (!file)
+            continue;
+        SharedPtr<AsyncReadRequest> prefetch = asyncFileIO->ReadAll(file);
+
+        // Check the item again, as the queue was unlocked meanwhile
+        MutexLock lock(backgroundLoadMutex_);
+        HashMap<Pair<StringHash, StringHash>, BackgroundLoadItem>::Iterator j = backgroundLoadQueue_.Find(keys[i]);
+        if (j != backgroundLoadQueue_.End() && j->second_.resource_->GetAsyncLoadState() == ASYNC_QUEUED && !j->second_.prefetch_)
+            j->second_.prefetch_ = prefetch;
+    }
+}
+
 void BackgroundLoader::FinishBackgroundLoading(BackgroundLoadItem& item)
 {
     Resource* resource = item.resource_;
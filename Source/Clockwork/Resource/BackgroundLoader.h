@@ -33,6 +33,7 @@
 namespace Clockwork
 {
 
+class AsyncReadRequest;
 class Resource;
 class ResourceCache;
 
@@ -45,6 +46,8 @@ struct BackgroundLoadItem
     HashSet<Pair<StringHash, StringHash> > dependencies_;
     /// Resources that depend on this resource's loading.
     HashSet<Pair<StringHash, StringHash> > dependents_;
+    /// Asynchronous read of the resource file started ahead of loading.
+    SharedPtr<AsyncReadRequest> prefetch_;
     /// Whether to send failure event.
     bool sendEventOnFailure_;
 };
@@ -72,6 +75,8 @@ public:
 private:
     /// Finish one background loaded resource.
     void FinishBackgroundLoading(BackgroundLoadItem& item);
+    /// Start asynchronous reads of the files of queued resources, so that their I/O overlaps with loading.
+    void PrefetchQueuedResources();
 
     /// Resource cache.
     ResourceCache* owner_;
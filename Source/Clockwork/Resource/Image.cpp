@@ -24,6 +24,8 @@
 
 #include "../Core/Context.h"
 #include "../Core/Profiler.h"
+#include "../Core/Thread.h"
+#include "../Core/WorkQueue.h"
 #include "../IO/File.h"
 #include "../IO/FileSystem.h"
 #include "../IO/Log.h"
@@ -34,6 +36,10 @@
 #include <STB/stb_image.h>
 #include <STB/stb_image_write.h>
 
+#ifdef CLOCKWORK_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "../DebugNew.h"
 
 extern "C" unsigned char* stbi_write_png_to_mem(unsigned char* pixels, int stride_bytes, int x, int y, int n, int* out_len);
@@ -238,12 +244,321 @@ bool CompressedLevel::Decompress(unsigned char* dest)
     }
 }
 
+/// Return number of largest mip levels that can be skipped, keeping at least one level and the first loaded level at least 4x4.
+static unsigned ClampSkipLevels(unsigned skipLevels, unsigned levels, int width, int height)
+{
+    if (skipLevels >= levels)
+        skipLevels = levels ? levels - 1 : 0;
+    while (skipLevels && ((width >> skipLevels) < 4 || (height >> skipLevels) < 4))
+        --skipLevels;
+    return skipLevels;
+}
+
+/// Return data size of a compressed mip level. Pixel byte size is only used for uncompressed RGBA data.
+static unsigned GetLevelDataSize(CompressedFormat format, unsigned pixelByteSize, int width, int height, int depth)
+{
+    width = Max(width, 1);
+    height = Max(height, 1);
+    depth = Max(depth, 1);
+
+    if (format == CF_RGBA)
+        return pixelByteSize * width * height * depth;
+    else if (format < CF_PVRTC_RGB_2BPP)
+    {
+        unsigned blockSize = (format == CF_DXT1 || format == CF_ETC1) ? 8 : 16;
+        return ((width + 3) / 4) * ((height + 3) / 4) * blockSize * depth;
+    }
+    else
+    {
+        unsigned bitsPerPixel = format < CF_PVRTC_RGB_4BPP ? 2 : 4;
+        return (Max(width, bitsPerPixel == 2 ? 16 : 8) * Max(height, 8) * bitsPerPixel + 7) >> 3;
+    }
+}
+
+/// Minimum number of output pixels for processing image rows in worker threads.
+static const int MIN_PARALLEL_IMAGE_PIXELS = 256 * 256;
+
+/// Lookup tables for converting between sRGB and linear color.
+struct SRGBTables
+{
+    /// Construct.
+    SRGBTables()
+    {
+        for (unsigned i = 0; i < 256; ++i)
+        {
+            float value = (float)i / 255.0f;
+            value = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+            toLinear_[i] = (unsigned short)(value * 65535.0f + 0.5f);
+        }
+        for (unsigned i = 0; i < 4096; ++i)
+        {
+            float value = ((float)i + 0.5f) / 4096.0f;
+            value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+            toSRGB_[i] = (unsigned char)Clamp((int)(value * 255.0f + 0.5f), 0, 255);
+        }
+    }
+
+    /// Return 16-bit linear value of an 8-bit sRGB value.
+    unsigned short ToLinear(unsigned char value) const { return toLinear_[value]; }
+    /// Return 8-bit sRGB value of a 16-bit linear value.
+    unsigned char ToSRGB(unsigned value) const { return toSRGB_[value >> 4]; }
+
+    /// sRGB to 16-bit linear table.
+    unsigned short toLinear_[256];
+    /// 12-bit linear to sRGB table.
+    unsigned char toSRGB_[4096];
+};
+
+static const SRGBTables sRGBTables;
+
+/// Image row processing job, which can be split among worker threads.
+struct ImageRowJob
+{
+    /// Row processing function. Processes output rows from first up to but not including last.
+    void (*function_)(const ImageRowJob& job, int first, int last);
+    /// Source pixel data.
+    const unsigned char* in_;
+    /// Destination pixel data.
+    unsigned char* out_;
+    /// Source width.
+    int widthIn_;
+    /// Source height.
+    int heightIn_;
+    /// Destination width.
+    int widthOut_;
+    /// Destination height.
+    int heightOut_;
+    /// Number of color components.
+    unsigned components_;
+    /// Filter color components in linear space.
+    bool sRGB_;
+    /// Left source pixel per destination column for resampling.
+    const int* columns_;
+    /// Right source pixel weight (0-256) per destination column for resampling.
+    const int* columnWeights_;
+};
+
+/// Return whether a component of an image is a color component and not alpha.
+static inline bool IsColorComponent(unsigned component, unsigned components)
+{
+    return !((components == 2 && component == 1) || (components == 4 && component == 3));
+}
+
+#ifdef CLOCKWORK_SSE2
+/// Add horizontally adjacent pixels of eight 16-bit values and return the four sums in the low half.
+static inline __m128i AddPixelPairs(__m128i values, unsigned components)
+{
+    switch (components)
+    {
+    case 1:
+        values = _mm_add_epi16(values, _mm_srli_si128(values, 2));
+        values = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        return _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 1, 2, 0));
+
+    case 2:
+        values = _mm_add_epi16(values, _mm_srli_si128(values, 4));
+        return _mm_shuffle_epi32(values, _MM_SHUFFLE(3, 1, 2, 0));
+
+    default:
+        return _mm_add_epi16(values, _mm_srli_si128(values, 8));
+    }
+}
+#endif
+
+/// Calculate rows of the next 2D mip level by box filtering.
+static void DownsampleRows(const ImageRowJob& job, int first, int last)
+{
+    const unsigned components = job.components_;
+    const unsigned rowSizeIn = job.widthIn_ * components;
+    const unsigned rowSizeOut = job.widthOut_ * components;
+
+    for (int y = first; y < last; ++y)
+    {
+        const unsigned char* inUpper = job.in_ + (y * 2) * rowSizeIn;
+        const unsigned char* inLower = inUpper + rowSizeIn;
+        unsigned char* out = job.out_ + y * rowSizeOut;
+        unsigned x = 0;
+
+        if (job.sRGB_)
+        {
+            for (; x < rowSizeOut; x += components)
+            {
+                for (unsigned c = 0; c < components; ++c)
+                {
+                    unsigned i = x * 2 + c;
+                    if (IsColorComponent(c, components))
+                    {
+                        unsigned sum = (unsigned)sRGBTables.ToLinear(inUpper[i]) + sRGBTables.ToLinear(inUpper[i + components]) +
+                            sRGBTables.ToLinear(inLower[i]) + sRGBTables.ToLinear(inLower[i + components]);
+                        out[x + c] = sRGBTables.ToSRGB((sum + 2) >> 2);
+                    }
+                    else
+                        out[x + c] = (unsigned char)(((unsigned)inUpper[i] + inUpper[i + components] + inLower[i] + inLower[i + components] + 2) >> 2);
+                }
+            }
+            continue;
+        }
+
+#ifdef CLOCKWORK_SSE2
+        // Read 16 bytes of both source rows and write 8 bytes of the destination row per iteration
+        if (components != 3)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+
+            for (; x + 8 <= rowSizeOut; x += 8)
+            {
+                __m128i upper = _mm_loadu_si128((const __m128i*)(inUpper + x * 2));
+                __m128i lower = _mm_loadu_si128((const __m128i*)(inLower + x * 2));
+                __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(upper, zero), _mm_unpacklo_epi8(lower, zero));
+                __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(upper, zero), _mm_unpackhi_epi8(lower, zero));
+                __m128i sum = _mm_unpacklo_epi64(AddPixelPairs(low, components), AddPixelPairs(high, components));
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+                _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, sum));
+            }
+        }
+#endif
+
+        for (; x < rowSizeOut; ++x)
+        {
+            unsigned i = x * 2 - x % components;
+            out[x] = (unsigned char)(((unsigned)inUpper[i] + inUpper[i + components] + inLower[i] + inLower[i + components] + 2) >> 2);
+        }
+    }
+}
+
+/// Calculate rows of a resized image by bilinear filtering. The source rows are first blended vertically with 8 bits of fractional precision.
+static void ResampleRows(const ImageRowJob& job, int first, int last)
+{
+    const unsigned components = job.components_;
+    const unsigned rowSizeIn = job.widthIn_ * components;
+    const unsigned rowSizeOut = job.widthOut_ * components;
+    PODVector<unsigned short> blended(rowSizeIn);
+
+    for (int y = first; y < last; ++y)
+    {
+        double sourceY = job.heightOut_ > 1 ? (double)y * (job.heightIn_ - 1) / (job.heightOut_ - 1) : 0.0;
+        int y0 = Min((int)sourceY, job.heightIn_ - 1);
+        int y1 = Min(y0 + 1, job.heightIn_ - 1);
+        unsigned weight1 = (unsigned)((sourceY - y0) * 256.0 + 0.5);
+        unsigned weight0 = 256 - weight1;
+        const unsigned char* inUpper = job.in_ + y0 * rowSizeIn;
+        const unsigned char* inLower = job.in_ + y1 * rowSizeIn;
+
+        if (job.sRGB_)
+        {
+            // Blend the color components in linear space
+            unsigned char* out = job.out_ + y * rowSizeOut;
+            for (int i = 0; i < job.widthOut_; ++i)
+            {
+                unsigned left = job.columns_[i] * components;
+                unsigned right = job.columns_[i] < job.widthIn_ - 1 ? left + components : left;
+                unsigned rightWeight = (unsigned)job.columnWeights_[i];
+                unsigned leftWeight = 256 - rightWeight;
+                for (unsigned c = 0; c < components; ++c)
+                {
+                    if (IsColorComponent(c, components))
+                    {
+                        unsigned upper = (sRGBTables.ToLinear(inUpper[left + c]) * leftWeight + sRGBTables.ToLinear(inUpper[right + c]) *
+                            rightWeight) >> 8;
+                        unsigned lower = (sRGBTables.ToLinear(inLower[left + c]) * leftWeight + sRGBTables.ToLinear(inLower[right + c]) *
+                            rightWeight) >> 8;
+                        *out++ = sRGBTables.ToSRGB((upper * weight0 + lower * weight1 + 128) >> 8);
+                    }
+                    else
+                    {
+                        unsigned upper = inUpper[left + c] * leftWeight + inUpper[right + c] * rightWeight;
+                        unsigned lower = inLower[left + c] * leftWeight + inLower[right + c] * rightWeight;
+                        *out++ = (unsigned char)((upper * weight0 + lower * weight1 + 32768) >> 16);
+                    }
+                }
+            }
+            continue;
+        }
+
+        unsigned short* dest = &blended[0];
+        unsigned x = 0;
+
+#ifdef CLOCKWORK_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i upperWeight = _mm_set1_epi16((short)weight0);
+        const __m128i lowerWeight = _mm_set1_epi16((short)weight1);
+        for (; x + 8 <= rowSizeIn; x += 8)
+        {
+            __m128i upper = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(inUpper + x)), zero);
+            __m128i lower = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(inLower + x)), zero);
+            __m128i sum = _mm_add_epi16(_mm_mullo_epi16(upper, upperWeight), _mm_mullo_epi16(lower, lowerWeight));
+            _mm_storeu_si128((__m128i*)(dest + x), sum);
+        }
+#endif
+
+        for (; x < rowSizeIn; ++x)
+            dest[x] = (unsigned short)(inUpper[x] * weight0 + inLower[x] * weight1);
+
+        unsigned char* out = job.out_ + y * rowSizeOut;
+        for (int i = 0; i < job.widthOut_; ++i)
+        {
+            const unsigned short* left = dest + job.columns_[i] * components;
+            const unsigned short* right = job.columns_[i] < job.widthIn_ - 1 ? left + components : left;
+            unsigned rightWeight = (unsigned)job.columnWeights_[i];
+            unsigned leftWeight = 256 - rightWeight;
+            for (unsigned c = 0; c < components; ++c)
+                *out++ = (unsigned char)((left[c] * leftWeight + right[c] * rightWeight + 32768) >> 16);
+        }
+    }
+}
+
+/// Image row work item function.
+static void ProcessImageRowsWork(const WorkItem* item, unsigned threadIndex)
+{
+    const ImageRowJob& job = *reinterpret_cast<const ImageRowJob*>(item->aux_);
+    unsigned rowSize = job.widthOut_ * job.components_;
+    int first = (int)(((unsigned char*)item->start_ - job.out_) / rowSize);
+    int last = (int)(((unsigned char*)item->end_ - job.out_) / rowSize);
+    job.function_(job, first, last);
+}
+
+/// Process all rows of an image job, in worker threads if the image is large and the call is from the main thread.
+static void ProcessImageRows(Context* context, const ImageRowJob& job)
+{
+    WorkQueue* queue = context->GetSubsystem<WorkQueue>();
+    int rows = job.heightOut_;
+
+    if (!queue || !queue->GetNumThreads() || queue->IsCompleting() || !Thread::IsMainThread() ||
+        job.widthOut_ * rows < MIN_PARALLEL_IMAGE_PIXELS)
+    {
+        job.function_(job, 0, rows);
+        return;
+    }
+
+    unsigned rowSize = job.widthOut_ * job.components_;
+    int numItems = (int)queue->GetNumThreads() + 1;
+    int rowsPerItem = (rows + numItems - 1) / numItems;
+
+    for (int first = 0; first < rows; first += rowsPerItem)
+    {
+        int last = Min(first + rowsPerItem, rows);
+
+        SharedPtr<WorkItem> item = queue->GetFreeItem();
+        item->priority_ = M_MAX_UNSIGNED;
+        item->workFunction_ = ProcessImageRowsWork;
+        item->aux_ = const_cast<ImageRowJob*>(&job);
+        item->start_ = job.out_ + first * rowSize;
+        item->end_ = job.out_ + last * rowSize;
+        queue->AddWorkItem(item);
+    }
+
+    queue->Complete(M_MAX_UNSIGNED);
+}
+
 Image::Image(Context* context) :
     Resource(context),
     width_(0),
     height_(0),
     depth_(0),
     components_(0),
+    skipLevels_(0),
+    skippedLevels_(0),
     cubemap_(false),
     array_(false),
     sRGB_(false)
@@ -261,6 +576,8 @@ void Image::RegisterObject(Context* context)
 
 bool Image::BeginLoad(Deserializer& source)
 {
+    skippedLevels_ = 0;
+
     // Check for DDS, KTX or PVR compressed format
     String fileID = source.ReadFileID();
 
@@ -389,6 +706,18 @@ bool Image::BeginLoad(Deserializer& source)
                 dataSize += (ddsd.ddpfPixelFormat_.dwRGBBitCount_ / 8) * Max(x, 1) * Max(y, 1) * Max(z, 1);
         }
 
+        // Skip the largest mip levels if requested. Not supported for volumes
+        unsigned numLevels = Max(ddsd.dwMipMapCount_, 1);
+        unsigned skipLevels = ddsd.dwDepth_ > 1 ? 0 : ClampSkipLevels(skipLevels_, numLevels, ddsd.dwWidth_, ddsd.dwHeight_);
+        unsigned skipSize = 0;
+        for (unsigned i = 0; i < skipLevels; ++i)
+        {
+            skipSize += GetLevelDataSize(compressedFormat_, ddsd.ddpfPixelFormat_.dwRGBBitCount_ / 8, ddsd.dwWidth_ >> i,
+                ddsd.dwHeight_ >> i, 1);
+        }
+        dataSize -= skipSize;
+        skippedLevels_ = skipLevels;
+
         // Do not use a shared ptr here, in case nothing is refcounting the image outside this function.
         // A raw pointer is fine as the image chain (if needed) uses shared ptr's properly
         Image* currentImage = this;
@@ -400,18 +729,18 @@ bool Image::BeginLoad(Deserializer& source)
             currentImage->array_ = array_;
             currentImage->components_ = components_;
             currentImage->compressedFormat_ = compressedFormat_;
-            currentImage->width_ = ddsd.dwWidth_;
-            currentImage->height_ = ddsd.dwHeight_;
+            currentImage->width_ = ddsd.dwWidth_ >> skipLevels;
+            currentImage->height_ = ddsd.dwHeight_ >> skipLevels;
             currentImage->depth_ = ddsd.dwDepth_;
-
-            currentImage->numCompressedLevels_ = ddsd.dwMipMapCount_;
-            if (!currentImage->numCompressedLevels_)
-                currentImage->numCompressedLevels_ = 1;
+            currentImage->numCompressedLevels_ = numLevels - skipLevels;
+            currentImage->skippedLevels_ = skipLevels;
             
             // Memory use needs to be exact per image as it's used for verifying the data size in GetCompressedLevel()
             // even though it would be more proper for the first image to report the size of all siblings combined
             currentImage->SetMemoryUse(dataSize);
 
+            if (skipSize)
+                source.Seek(source.GetPosition() + skipSize);
             source.Read(currentImage->data_.Get(), dataSize);
 
             if (faceIndex < imageChainCount - 1)
@@ -614,6 +943,21 @@ bool Image::BeginLoad(Deserializer& source)
         }
 
         source.Seek(source.GetPosition() + keyValueBytes);
+
+        // Skip the largest mip levels if requested
+        unsigned skipLevels = ClampSkipLevels(skipLevels_, mipmaps, width, height);
+        for (unsigned i = 0; i < skipLevels; ++i)
+        {
+            unsigned levelSize = source.ReadUInt();
+            source.Seek(source.GetPosition() + levelSize);
+            if (source.GetPosition() & 3)
+                source.Seek((source.GetPosition() + 3) & 0xfffffffc);
+        }
+        width >>= skipLevels;
+        height >>= skipLevels;
+        mipmaps -= skipLevels;
+        skippedLevels_ = skipLevels;
+
         unsigned dataSize = (unsigned)(source.GetSize() - source.GetPosition() - mipmaps * sizeof(unsigned));
 
         data_ = new unsigned char[dataSize];
@@ -720,6 +1064,19 @@ bool Image::BeginLoad(Deserializer& source)
         }
 
         source.Seek(source.GetPosition() + metaDataSize);
+
+        // Skip the largest mip levels if requested
+        unsigned skipLevels = ClampSkipLevels(skipLevels_, mipmapCount, width, height);
+        unsigned skipSize = 0;
+        for (unsigned i = 0; i < skipLevels; ++i)
+            skipSize += GetLevelDataSize(compressedFormat_, 0, width >> i, height >> i, 1);
+        if (skipSize)
+            source.Seek(source.GetPosition() + skipSize);
+        width >>= skipLevels;
+        height >>= skipLevels;
+        mipmapCount -= skipLevels;
+        skippedLevels_ = skipLevels;
+
         unsigned dataSize = source.GetSize() - source.GetPosition();
 
         data_ = new unsigned char[dataSize];
@@ -773,6 +1130,86 @@ bool Image::Save(Serializer& dest) const
     return success;
 }
 
+bool Image::BeginLoadCooked(Deserializer& source)
+{
+    if (source.ReadFileID() != "CIMG")
+        return false;
+
+    cubemap_ = false;
+    array_ = false;
+    sRGB_ = false;
+    nextSibling_.Reset();
+
+    unsigned numLevels = source.ReadUInt();
+    Image* level = this;
+    for (unsigned i = 0; i < numLevels; ++i)
+    {
+        int width = source.ReadInt();
+        int height = source.ReadInt();
+        int depth = source.ReadInt();
+        unsigned components = source.ReadUInt();
+        if (!level->SetSize(width, height, depth, components))
+            return false;
+
+        unsigned dataSize = width * height * depth * components;
+        if (source.Read(level->data_.Get(), dataSize) != dataSize)
+            return false;
+
+        if (i + 1 < numLevels)
+        {
+            level->nextLevel_ = new Image(context_);
+            level = level->nextLevel_;
+        }
+        else
+            level->nextLevel_.Reset();
+    }
+
+    return numLevels > 0;
+}
+
+bool Image::IsCookable(Deserializer& source) const
+{
+    // Peek the file ID of the source, then return to where BeginLoad() expects to start
+    unsigned position = source.GetPosition();
+    String fileID = source.ReadFileID();
+    source.Seek(position);
+
+    return fileID != "DDS " && fileID != "\253KTX" && fileID != "PVR\3";
+}
+
+bool Image::SaveCooked(Serializer& dest) const
+{
+    if (IsCompressed() || nextSibling_ || !data_)
+        return false;
+
+    // Store the whole mip chain so that it does not need to be recalculated on load
+    Vector<SharedPtr<Image> > levels;
+    const Image* current = this;
+    while (current->width_ > 1 || current->height_ > 1 || current->depth_ > 1)
+    {
+        SharedPtr<Image> next = current->GetNextLevel();
+        if (!next)
+            return false;
+        levels.Push(next);
+        current = next;
+    }
+
+    dest.WriteFileID("CIMG");
+    dest.WriteUInt(levels.Size() + 1);
+    for (unsigned i = 0; i <= levels.Size(); ++i)
+    {
+        const Image* level = i ? levels[i - 1].Get() : this;
+        unsigned dataSize = level->width_ * level->height_ * level->depth_ * level->components_;
+        dest.WriteInt(level->width_);
+        dest.WriteInt(level->height_);
+        dest.WriteInt(level->depth_);
+        dest.WriteUInt(level->components_);
+        if (dest.Write(level->data_.Get(), dataSize) != dataSize)
+            return false;
+    }
+
+    return true;
+}
 
 bool Image::SetSize(int width, int height, unsigned components)
 {
@@ -800,6 +1237,7 @@ bool Image::SetSize(int width, int height, int depth, unsigned components)
     components_ = components;
     compressedFormat_ = CF_NONE;
     numCompressedLevels_ = 0;
+    skippedLevels_ = 0;
     nextLevel_.Reset();
 
     SetMemoryUse(width * height * depth * components);
@@ -1058,37 +1496,43 @@ bool Image::Resize(int width, int height)
     if (!data_ || width <= 0 || height <= 0)
         return false;
 
-    /// \todo Reducing image size does not sample all needed pixels
-    SharedArrayPtr<unsigned char> newData(new unsigned char[width * height * components_]);
-    for (int y = 0; y < height; ++y)
+    // When reducing size, halve the image with box filtering first so that all source pixels contribute
+    SharedPtr<Image> reduced;
+    const Image* source = this;
+    while (source->width_ >= width * 2 && source->height_ >= height * 2)
     {
-        for (int x = 0; x < width; ++x)
-        {
-            // Calculate float coordinates between 0 - 1 for resampling
-            float xF = (width_ > 1) ? (float)x / (float)(width - 1) : 0.0f;
-            float yF = (height_ > 1) ? (float)y / (float)(height - 1) : 0.0f;
-            unsigned uintColor = GetPixelBilinear(xF, yF).ToUInt();
-            unsigned char* dest = newData + (y * width + x) * components_;
-            unsigned char* src = (unsigned char*)&uintColor;
-
-            switch (components_)
-            {
-            case 4:
-                dest[3] = src[3];
-                // Fall through
-            case 3:
-                dest[2] = src[2];
-                // Fall through
-            case 2:
-                dest[1] = src[1];
-                // Fall through
-            default:
-                dest[0] = src[0];
-                break;
-            }
-        }
+        reduced = source->GetNextLevel();
+        if (!reduced)
+            return false;
+        source = reduced;
     }
 
+    // Precalculate source columns and weights for bilinear filtering
+    PODVector<int> columns(width);
+    PODVector<int> columnWeights(width);
+    for (int x = 0; x < width; ++x)
+    {
+        double sourceX = width > 1 ? (double)x * (source->width_ - 1) / (width - 1) : 0.0;
+        columns[x] = Min((int)sourceX, source->width_ - 1);
+        columnWeights[x] = (int)((sourceX - columns[x]) * 256.0 + 0.5);
+    }
+
+    SharedArrayPtr<unsigned char> newData(new unsigned char[width * height * components_]);
+
+    ImageRowJob job;
+    job.function_ = ResampleRows;
+    job.in_ = source->data_.Get();
+    job.out_ = newData.Get();
+    job.widthIn_ = source->width_;
+    job.heightIn_ = source->height_;
+    job.widthOut_ = width;
+    job.heightOut_ = height;
+    job.components_ = components_;
+    job.sRGB_ = sRGB_;
+    job.columns_ = &columns[0];
+    job.columnWeights_ = &columnWeights[0];
+    ProcessImageRows(context_, job);
+
     width_ = width;
     height_ = height;
     data_ = newData;
@@ -1362,6 +1806,7 @@ SharedPtr<Image> Image::GetNextLevel() const
         mipImage->SetSize(widthOut, heightOut, depthOut, components_);
     else
         mipImage->SetSize(widthOut, heightOut, components_);
+    mipImage->sRGB_ = sRGB_;
 
     const unsigned char* pixelDataIn = data_.Get();
     unsigned char* pixelDataOut = mipImage->data_.Get();
@@ -1415,84 +1860,19 @@ SharedPtr<Image> Image::GetNextLevel() const
     // 2D case
     else if (depth_ == 1)
     {
-        switch (components_)
-        {
-        case 1:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const unsigned char* inUpper = &pixelDataIn[(y * 2) * width_];
-                const unsigned char* inLower = &pixelDataIn[(y * 2 + 1) * width_];
-                unsigned char* out = &pixelDataOut[y * widthOut];
-
-                for (int x = 0; x < widthOut; ++x)
-                {
-                    out[x] = (unsigned char)(((unsigned)inUpper[x * 2] + inUpper[x * 2 + 1] +
-                                              inLower[x * 2] + inLower[x * 2 + 1]) >> 2);
-                }
-            }
-            break;
-
-        case 2:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const unsigned char* inUpper = &pixelDataIn[(y * 2) * width_ * 2];
-                const unsigned char* inLower = &pixelDataIn[(y * 2 + 1) * width_ * 2];
-                unsigned char* out = &pixelDataOut[y * widthOut * 2];
-
-                for (int x = 0; x < widthOut * 2; x += 2)
-                {
-                    out[x] = (unsigned char)(((unsigned)inUpper[x * 2] + inUpper[x * 2 + 2] +
-                                              inLower[x * 2] + inLower[x * 2 + 2]) >> 2);
-                    out[x + 1] = (unsigned char)(((unsigned)inUpper[x * 2 + 1] + inUpper[x * 2 + 3] +
-                                                  inLower[x * 2 + 1] + inLower[x * 2 + 3]) >> 2);
-                }
-            }
-            break;
-
-        case 3:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const unsigned char* inUpper = &pixelDataIn[(y * 2) * width_ * 3];
-                const unsigned char* inLower = &pixelDataIn[(y * 2 + 1) * width_ * 3];
-                unsigned char* out = &pixelDataOut[y * widthOut * 3];
-
-                for (int x = 0; x < widthOut * 3; x += 3)
-                {
-                    out[x] = (unsigned char)(((unsigned)inUpper[x * 2] + inUpper[x * 2 + 3] +
-                                              inLower[x * 2] + inLower[x * 2 + 3]) >> 2);
-                    out[x + 1] = (unsigned char)(((unsigned)inUpper[x * 2 + 1] + inUpper[x * 2 + 4] +
-                                                  inLower[x * 2 + 1] + inLower[x * 2 + 4]) >> 2);
-                    out[x + 2] = (unsigned char)(((unsigned)inUpper[x * 2 + 2] + inUpper[x * 2 + 5] +
-                                                  inLower[x * 2 + 2] + inLower[x * 2 + 5]) >> 2);
-                }
-            }
-            break;
-
-        case 4:
-            for (int y = 0; y < heightOut; ++y)
-            {
-                const unsigned char* inUpper = &pixelDataIn[(y * 2) * width_ * 4];
-                const unsigned char* inLower = &pixelDataIn[(y * 2 + 1) * width_ * 4];
-                unsigned char* out = &pixelDataOut[y * widthOut * 4];
-
-                for (int x = 0; x < widthOut * 4; x += 4)
-                {
-                    out[x] = (unsigned char)(((unsigned)inUpper[x * 2] + inUpper[x * 2 + 4] +
-                                              inLower[x * 2] + inLower[x * 2 + 4]) >> 2);
-                    out[x + 1] = (unsigned char)(((unsigned)inUpper[x * 2 + 1] + inUpper[x * 2 + 5] +
-                                                  inLower[x * 2 + 1] + inLower[x * 2 + 5]) >> 2);
-                    out[x + 2] = (unsigned char)(((unsigned)inUpper[x * 2 + 2] + inUpper[x * 2 + 6] +
-                                                  inLower[x * 2 + 2] + inLower[x * 2 + 6]) >> 2);
-                    out[x + 3] = (unsigned char)(((unsigned)inUpper[x * 2 + 3] + inUpper[x * 2 + 7] +
-                                                  inLower[x * 2 + 3] + inLower[x * 2 + 7]) >> 2);
-                }
-            }
-            break;
-
-        default:
-            assert(false);  // Should never reach here
-            break;
-        }
+        ImageRowJob job;
+        job.function_ = DownsampleRows;
+        job.in_ = pixelDataIn;
+        job.out_ = pixelDataOut;
+        job.widthIn_ = width_;
+        job.heightIn_ = height_;
+        job.widthOut_ = widthOut;
+        job.heightOut_ = heightOut;
+        job.components_ = components_;
+        job.sRGB_ = sRGB_;
+        job.columns_ = 0;
+        job.columnWeights_ = 0;
+        ProcessImageRows(context_, job);
     }
     // 3D case
     else
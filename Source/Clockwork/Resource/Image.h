@@ -103,6 +103,13 @@ public:
     virtual bool BeginLoad(Deserializer& source);
     /// Save the image to a stream. Regardless of original format, the image is saved as png. Compressed image data is not supported. Return true if successful.
     virtual bool Save(Serializer& dest) const;
+    /// Load the image and its mip levels from cooked data. May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoadCooked(Deserializer& source);
+    /// Save the decoded image and its mip levels as cooked data. Only uncompressed single images are supported. Return true if successful.
+    virtual bool SaveCooked(Serializer& dest) const;
+
+    /// Return whether the image supports cooked data for a source stream. Images decoded with stb_image benefit, compressed formats are already upload-ready.
+    virtual bool IsCookable(Deserializer& source) const;
 
     /// Set 2D size and number of color components. Old image data will be destroyed and new data is undefined. Return true if successful.
     bool SetSize(int width, int height, unsigned components);
@@ -118,13 +125,17 @@ public:
     void SetPixelInt(int x, int y, unsigned uintColor);
     /// Set a 3D pixel with an integer color. R component is in the 8 lowest bits.
     void SetPixelInt(int x, int y, int z, unsigned uintColor);
+    /// Set number of largest mip levels to skip when loading compressed data, to stream in the mip tail first. The first loaded level is kept at least 4x4.
+    void SetSkipLevels(unsigned levels) { skipLevels_ = levels; }
+    /// Set whether the color data is sRGB. Mip levels of sRGB images are filtered in linear space.
+    void SetSRGB(bool enable) { sRGB_ = enable; }
     /// Load as color LUT. Return true if successful.
     bool LoadColorLUT(Deserializer& source);
     /// Flip image horizontally. Return true if successful.
     bool FlipHorizontal();
     /// Flip image vertically. Return true if successful.
     bool FlipVertical();
-    /// Resize image by bilinear resampling. Return true if successful.
+    /// Resize image by bilinear resampling. When reducing size, the image is first halved by box filtering. Color components of sRGB images are filtered in linear space. Return true if successful.
     bool Resize(int width, int height);
     /// Clear the image with a color.
     void Clear(const Color& color);
@@ -182,6 +193,9 @@ public:
     /// Return number of compressed mip levels.
     unsigned GetNumCompressedLevels() const { return numCompressedLevels_; }
 
+    /// Return number of largest mip levels that were skipped on load.
+    unsigned GetSkippedLevels() const { return skippedLevels_; }
+
     /// Return next mip level by bilinear filtering.
     SharedPtr<Image> GetNextLevel() const;
     /// Return the next sibling image of an array or cubemap.
@@ -213,6 +227,10 @@ private:
     unsigned components_;
     /// Number of compressed mip levels.
     unsigned numCompressedLevels_;
+    /// Number of largest mip levels to skip on load.
+    unsigned skipLevels_;
+    /// Number of largest mip levels skipped on last load.
+    unsigned skippedLevels_;
     /// Cubemap status if DDS.
     bool cubemap_;
     /// Texture array status if DDS.
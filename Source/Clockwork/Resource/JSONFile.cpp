@@ -22,12 +22,12 @@
 
 #include "../Precompiled.h"
 
-#include "../Container/ArrayPtr.h"
 #include "../Core/Profiler.h"
 #include "../Core/Context.h"
 #include "../IO/Deserializer.h"
 #include "../IO/Log.h"
 #include "../Resource/JSONFile.h"
+#include "../Resource/JSONStreamReader.h"
 #include "../Resource/ResourceCache.h"
 
 #include <rapidjson/document.h>
@@ -55,62 +55,122 @@ void JSONFile::RegisterObject(Context* context)
     context->RegisterFactory<JSONFile>();
 }
 
-// Convert rapidjson value to JSON value.
-static void ToJSONValue(JSONValue& jsonValue, const rapidjson::Value& rapidjsonValue)
+/// Stream handler that builds a JSON value tree directly from parse events.
+class JSONValueBuilder : public JSONStreamHandler
 {
-    switch (rapidjsonValue.GetType())
+public:
+    /// Construct with the value to build into.
+    JSONValueBuilder(JSONValue& root) :
+        root_(root)
     {
-    case kNullType:
-        // Reset to null type
-        jsonValue.SetType(JSON_NULL);
-        break;
+    }
 
-    case kFalseType:
-        jsonValue = false;
-        break;
+    /// Handle object start.
+    virtual bool StartObject()
+    {
+        JSONValue& value = NextValue();
+        value.SetType(JSON_OBJECT);
+        stack_.Push(&value);
+        return true;
+    }
 
-    case kTrueType:
-        jsonValue = true;
-        break;
+    /// Handle object member name.
+    virtual bool Key(const char* name, unsigned length)
+    {
+        key_.Clear();
+        key_.Append(name, length);
+        return true;
+    }
 
-    case kNumberType:
-        if (rapidjsonValue.IsInt())
-            jsonValue = rapidjsonValue.GetInt();
-        else if (rapidjsonValue.IsUint())
-            jsonValue = rapidjsonValue.GetUint();
-        else
-            jsonValue = rapidjsonValue.GetDouble();
-        break;
+    /// Handle object end.
+    virtual bool EndObject(unsigned memberCount)
+    {
+        stack_.Pop();
+        return true;
+    }
 
-    case kStringType:
-        jsonValue = rapidjsonValue.GetString();
-        break;
+    /// Handle array start.
+    virtual bool StartArray()
+    {
+        JSONValue& value = NextValue();
+        value.SetType(JSON_ARRAY);
+        stack_.Push(&value);
+        return true;
+    }
 
-    case kArrayType:
-        {
-            jsonValue.Resize(rapidjsonValue.Size());
-            for (unsigned i = 0; i < rapidjsonValue.Size(); ++i)
-            {
-                ToJSONValue(jsonValue[i], rapidjsonValue[i]);
-            }
-        }
-        break;
+    /// Handle array end.
+    virtual bool EndArray(unsigned elementCount)
+    {
+        stack_.Pop();
+        return true;
+    }
+
+    /// Handle null value.
+    virtual bool NullValue()
+    {
+        NextValue().SetType(JSON_NULL);
+        return true;
+    }
+
+    /// Handle boolean value.
+    virtual bool BoolValue(bool value)
+    {
+        NextValue() = value;
+        return true;
+    }
 
-    case kObjectType:
+    /// Handle integer value.
+    virtual bool IntValue(int value)
+    {
+        NextValue() = value;
+        return true;
+    }
+
+    /// Handle unsigned integer value.
+    virtual bool UIntValue(unsigned value)
+    {
+        NextValue() = value;
+        return true;
+    }
+
+    /// Handle floating point value.
+    virtual bool DoubleValue(double value)
+    {
+        NextValue() = value;
+        return true;
+    }
+
+    /// Handle string value.
+    virtual bool StringValue(const char* value, unsigned length)
+    {
+        NextValue() = String(value, length);
+        return true;
+    }
+
+private:
+    /// Return the value to assign next: the root, a new array element or the member named by the last key.
+    JSONValue& NextValue()
+    {
+        if (stack_.Empty())
+            return root_;
+
+        JSONValue& parent = *stack_.Back();
+        if (parent.IsArray())
         {
-            jsonValue.SetType(JSON_OBJECT);
-            for (rapidjson::Value::ConstMemberIterator i = rapidjsonValue.MemberBegin(); i != rapidjsonValue.MemberEnd(); ++i)
-            {
-                JSONValue& value = jsonValue[String(i->name.GetString())];
-                ToJSONValue(value, i->value);
-            }
+            parent.Push(JSONValue());
+            return parent[parent.Size() - 1];
         }
-        break;
-
-    default:
-        break;
+        else
+            return parent[key_];
     }
-}
+
+    /// Root value.
+    JSONValue& root_;
+    /// Open arrays and objects. Only the innermost container grows, so the pointers stay valid.
+    PODVector<JSONValue*> stack_;
+    /// Last object member name.
+    String key_;
+};
 
 bool JSONFile::BeginLoad(Deserializer& source)
 {
@@ -121,20 +181,16 @@ bool JSONFile::BeginLoad(Deserializer& source)
         return false;
     }
 
-    SharedArrayPtr<char> buffer(new char[dataSize + 1]);
-    if (source.Read(buffer.Get(), dataSize) != dataSize)
-        return false;
-    buffer[dataSize] = '\0';
-
-    rapidjson::Document document;
-    if (document.Parse<0>(buffer).HasParseError())
+    // Build the value tree while streaming the source, without an intermediate rapidjson document or a copy of the whole text
+    root_.SetType(JSON_NULL);
+    JSONValueBuilder builder(root_);
+    JSONStreamReader reader;
+    if (!reader.Parse(source, builder))
     {
-        LOGERROR("Could not parse JSON data from " + source.GetName());
+        root_.SetType(JSON_NULL);
         return false;
     }
 
-    ToJSONValue(root_, document);
-
     SetMemoryUse(dataSize);
 
     return true;
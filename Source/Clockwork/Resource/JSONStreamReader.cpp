@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../IO/Deserializer.h"
+#include "../IO/Log.h"
+#include "../Resource/JSONStreamReader.h"
+
+#include <rapidjson/reader.h>
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const unsigned READ_BUFFER_SIZE = 65536;
+
+/// Container state while parsing.
+enum JSONContainerState
+{
+    JCS_ARRAY = 0,
+    JCS_OBJECT_KEY,
+    JCS_OBJECT_VALUE
+};
+
+/// Buffered source and event translation for one parse. Implements the rapidjson handler concept.
+class JSONParseState
+{
+public:
+    typedef char Ch;
+
+    /// Construct.
+    JSONParseState(Deserializer& source, char* buffer, JSONStreamHandler& handler) :
+        source_(source),
+        buffer_(buffer),
+        handler_(handler),
+        position_(0),
+        size_(0),
+        offset_(0),
+        aborted_(false)
+    {
+    }
+
+    /// Return next character without consuming it. Returns zero at end of data or after abort, which terminates rapidjson parsing.
+    char Peek()
+    {
+        if (aborted_ || (position_ == size_ && !FillBuffer()))
+            return 0;
+        return buffer_[position_];
+    }
+
+    /// Consume and return next character.
+    char Take()
+    {
+        if (aborted_ || (position_ == size_ && !FillBuffer()))
+            return 0;
+        return buffer_[position_++];
+    }
+
+    /// Return current read offset.
+    size_t Tell() const { return offset_ + position_; }
+
+    void Null() { Handle(handler_.NullValue()); }
+    void Bool(bool value) { Handle(handler_.BoolValue(value)); }
+    void Int(int value) { Handle(handler_.IntValue(value)); }
+    void Uint(unsigned value) { Handle((int)value >= 0 ? handler_.IntValue((int)value) : handler_.UIntValue(value)); }
+    void Int64(int64_t value) { Handle(handler_.DoubleValue((double)value)); }
+    void Uint64(uint64_t value) { Handle(handler_.DoubleValue((double)value)); }
+    void Double(double value) { Handle(handler_.DoubleValue(value)); }
+
+    void String(const char* str, rapidjson::SizeType length, bool copy)
+    {
+        if (aborted_)
+            return;
+
+        // rapidjson reports member names as strings, so tell them apart by the container state
+        if (!containers_.Empty() && containers_.Back() == JCS_OBJECT_KEY)
+        {
+            containers_.Back() = JCS_OBJECT_VALUE;
+            if (!handler_.Key(str, length))
+                aborted_ = true;
+        }
+        else
+            Handle(handler_.StringValue(str, length));
+    }
+
+    void StartObject()
+    {
+        if (aborted_)
+            return;
+
+        containers_.Push(JCS_OBJECT_KEY);
+        if (!handler_.StartObject())
+            aborted_ = true;
+    }
+
+    void EndObject(rapidjson::SizeType memberCount)
+    {
+        containers_.Pop();
+        Handle(handler_.EndObject(memberCount));
+    }
+
+    void StartArray()
+    {
+        if (aborted_)
+            return;
+
+        containers_.Push(JCS_ARRAY);
+        if (!handler_.StartArray())
+            aborted_ = true;
+    }
+
+    void EndArray(rapidjson::SizeType elementCount)
+    {
+        containers_.Pop();
+        Handle(handler_.EndArray(elementCount));
+    }
+
+    /// Return whether the handler aborted.
+    bool IsAborted() const { return aborted_; }
+
+private:
+    /// Refill the read buffer. Return false at end of data.
+    bool FillBuffer()
+    {
+        if (source_.IsEof())
+            return false;
+
+        offset_ += size_;
+        position_ = 0;
+        size_ = source_.Read(buffer_, READ_BUFFER_SIZE);
+        return size_ != 0;
+    }
+
+    /// Record the result of a value event and expect the next member name if inside an object.
+    void Handle(bool success)
+    {
+        // After an abort rapidjson may still finish the current value; ignore the result
+        if (!success)
+            aborted_ = true;
+        if (!containers_.Empty() && containers_.Back() == JCS_OBJECT_VALUE)
+            containers_.Back() = JCS_OBJECT_KEY;
+    }
+
+    /// Source stream.
+    Deserializer& source_;
+    /// Read buffer.
+    char* buffer_;
+    /// Event handler.
+    JSONStreamHandler& handler_;
+    /// Read position in buffer.
+    unsigned position_;
+    /// Valid data size in buffer.
+    unsigned size_;
+    /// Source offset of the buffer start.
+    unsigned offset_;
+    /// Open container states.
+    PODVector<unsigned char> containers_;
+    /// Handler aborted flag.
+    bool aborted_;
+};
+
+/// Input stream passed to rapidjson. rapidjson copies the stream by value, so it only refers to the shared parse state.
+class JSONInputStream
+{
+public:
+    typedef char Ch;
+
+    /// Construct.
+    JSONInputStream(JSONParseState* state) :
+        state_(state)
+    {
+    }
+
+    /// Return next character without consuming it.
+    char Peek() const { return state_->Peek(); }
+    /// Consume and return next character.
+    char Take() { return state_->Take(); }
+    /// Return current read offset.
+    size_t Tell() const { return state_->Tell(); }
+    /// In-situ parsing is not supported. Required by the rapidjson stream concept only.
+    char* PutBegin() { assert(false); return 0; }
+    /// In-situ parsing is not supported. Required by the rapidjson stream concept only.
+    void Put(char c) { assert(false); }
+    /// In-situ parsing is not supported. Required by the rapidjson stream concept only.
+    size_t PutEnd(char* begin) { assert(false); return 0; }
+
+private:
+    /// Parse state.
+    JSONParseState* state_;
+};
+
+JSONStreamReader::JSONStreamReader() :
+    aborted_(false)
+{
+}
+
+bool JSONStreamReader::Parse(Deserializer& source, JSONStreamHandler& handler)
+{
+    if (!buffer_)
+        buffer_ = new char[READ_BUFFER_SIZE];
+
+    JSONParseState state(source, buffer_.Get(), handler);
+    JSONInputStream stream(&state);
+    rapidjson::Reader reader;
+    bool success = reader.Parse<0>(stream, state);
+
+    aborted_ = state.IsAborted();
+    if (aborted_)
+        return false;
+
+    if (!success)
+    {
+        LOGERROR("Could not parse JSON data from " + source.GetName() + ": " + String(reader.GetParseError()) + " at offset " +
+                 String((unsigned)reader.GetErrorOffset()));
+        return false;
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/ArrayPtr.h"
+
+namespace Clockwork
+{
+
+class Deserializer;
+
+/// Receiver of JSONStreamReader parse events. Return false from any event to abort parsing. String pointers are only valid during the call.
+class CLOCKWORK_API JSONStreamHandler
+{
+public:
+    /// Destruct.
+    virtual ~JSONStreamHandler() {}
+
+    /// Handle object start.
+    virtual bool StartObject() { return true; }
+    /// Handle object member name. The member's value follows.
+    virtual bool Key(const char* name, unsigned length) { return true; }
+    /// Handle object end.
+    virtual bool EndObject(unsigned memberCount) { return true; }
+    /// Handle array start.
+    virtual bool StartArray() { return true; }
+    /// Handle array end.
+    virtual bool EndArray(unsigned elementCount) { return true; }
+    /// Handle null value.
+    virtual bool NullValue() { return true; }
+    /// Handle boolean value.
+    virtual bool BoolValue(bool value) { return true; }
+    /// Handle integer value.
+    virtual bool IntValue(int value) { return true; }
+    /// Handle unsigned integer value that does not fit an int.
+    virtual bool UIntValue(unsigned value) { return true; }
+    /// Handle floating point value, or an integer that does not fit 32 bits.
+    virtual bool DoubleValue(double value) { return true; }
+    /// Handle string value.
+    virtual bool StringValue(const char* value, unsigned length) { return true; }
+};
+
+/// Streaming (SAX-style) JSON reader. Reads the source in fixed size chunks and reports values to a handler as they are parsed, without building a document tree.
+class CLOCKWORK_API JSONStreamReader
+{
+public:
+    /// Construct.
+    JSONStreamReader();
+
+    /// Parse JSON data from a stream. Return true if the whole document was parsed successfully and the handler did not abort.
+    bool Parse(Deserializer& source, JSONStreamHandler& handler);
+
+    /// Return whether the last parse was aborted by the handler.
+    bool IsAborted() const { return aborted_; }
+
+private:
+    /// Read buffer, reused between parses.
+    SharedArrayPtr<char> buffer_;
+    /// Handler aborted flag.
+    bool aborted_;
+};
+
+}
@@ -25,6 +25,7 @@
 #include "../Core/Profiler.h"
 #include "../IO/Log.h"
 #include "../Resource/Resource.h"
+#include "../Resource/ResourceCache.h"
 
 namespace Clockwork
 {
@@ -51,7 +52,8 @@ bool Resource::Load(Deserializer& source)
     // If we are loading synchronously in a non-main thread, behave as if async loading (for example use
     // GetTempResource() instead of GetResource() to load resource dependencies)
     SetAsyncLoadState(Thread::IsMainThread() ? ASYNC_DONE : ASYNC_LOADING);
-    bool success = BeginLoad(source);
+    ResourceCache* cache = GetSubsystem<ResourceCache>();
+    bool success = cache ? cache->BeginLoadResource(this, source) : BeginLoad(source);
     if (success)
         success &= EndLoad();
     SetAsyncLoadState(ASYNC_DONE);
@@ -82,6 +84,17 @@ bool Resource::Save(Serializer& dest) const
     return false;
 }
 
+bool Resource::BeginLoadCooked(Deserializer& source)
+{
+    // Only needs to be overridden by subclasses that return true from IsCookable()
+    return false;
+}
+
+bool Resource::SaveCooked(Serializer& dest) const
+{
+    return false;
+}
+
 void Resource::SetName(const String& name)
 {
     name_ = name;
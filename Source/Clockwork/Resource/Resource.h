@@ -64,6 +64,19 @@ public:
     virtual bool EndLoad();
     /// Save resource. Return true if successful.
     virtual bool Save(Serializer& dest) const;
+    /// Load resource from cooked data written by SaveCooked(). May be called from a worker thread. Return true if successful.
+    virtual bool BeginLoadCooked(Deserializer& source);
+    /// Save the state after BeginLoad() as cooked data for the resource cache. May be called from a worker thread. Return true if successful.
+    virtual bool SaveCooked(Serializer& dest) const;
+
+    /// Return whether the resource supports loading from and saving to cooked data for a source stream. The stream position must be left unchanged.
+    virtual bool IsCookable(Deserializer& source) const { return false; }
+    /// Stream in the next step of detail, for example a texture mip level, if it fits the byte budget. Called from the main thread by ResourceCache once per frame while IsStreaming() is true. Return bytes uploaded.
+    virtual unsigned StreamDetail(unsigned budget) { return 0; }
+    /// Set the most detailed mip level allowed to be resident. 0 allows full detail. Only has effect on streamed resources, which add themselves to the ResourceCache streaming when the resident detail needs to change.
+    virtual void SetMaxResidentMip(unsigned mip) {}
+    /// Return whether more detail remains to be streamed in or out.
+    virtual bool IsStreaming() const { return false; }
 
     /// Set name.
     void SetName(const String& name);
@@ -37,6 +37,7 @@
 #include "../Resource/ResourceCache.h"
 #include "../Resource/ResourceEvents.h"
 #include "../Resource/XMLFile.h"
+#include "../Revision.h"
 
 #include "../DebugNew.h"
 
@@ -65,13 +66,17 @@ static const char* checkDirs[] =
 
 static const SharedPtr<Resource> noResource;
 
+/// Cooked resource data file ID.
+static const char* COOKED_FILE_ID = "CRES";
+
 ResourceCache::ResourceCache(Context* context) :
     Object(context),
     autoReloadResources_(false),
     returnFailedResources_(false),
     searchPackagesFirst_(true),
     isRouting_(false),
-    finishBackgroundResourcesMs_(5)
+    finishBackgroundResourcesMs_(5),
+    streamingBudget_(0)
 {
     // Register Resource library object factories
     RegisterResourceLibrary(context_);
@@ -449,6 +454,26 @@ void ResourceCache::SetAutoReloadResources(bool enable)
     }
 }
 
+void ResourceCache::SetCookedResourceDir(const String& pathName)
+{
+    if (pathName.Empty())
+    {
+        cookedResourceDir_.Clear();
+        return;
+    }
+
+    String fixedPath = SanitateResourceDirName(pathName);
+    FileSystem* fileSystem = GetSubsystem<FileSystem>();
+    if (!fileSystem || (!fileSystem->DirExists(fixedPath) && !fileSystem->CreateDir(fixedPath)))
+    {
+        LOGERROR("Could not open or create cooked resource directory " + pathName);
+        return;
+    }
+
+    cookedResourceDir_ = fixedPath;
+    LOGINFO("Using cooked resource directory " + fixedPath);
+}
+
 void ResourceCache::AddResourceRouter(ResourceRouter* router, bool addAsFirst)
 {
     // Check for duplicate
@@ -624,6 +649,83 @@ Resource* ResourceCache::GetResource(StringHash type, const String& nameIn, bool
     return resource;
 }
 
+bool ResourceCache::BeginLoadResource(Resource* resource, Deserializer& source)
+{
+    if (!resource)
+        return false;
+
+    if (cookedResourceDir_.Empty() || !resource->IsCookable(source))
+        return resource->BeginLoad(source);
+
+    // Key the cooked data by the source stream, as eg. the image inside a texture is loaded without a resource name
+    const String& sourceName = source.GetName();
+    unsigned checksum = source.GetChecksum();
+    if (sourceName.Empty() || !checksum)
+        return resource->BeginLoad(source);
+
+    FileSystem* fileSystem = GetSubsystem<FileSystem>();
+    String cookedFileName = GetCookedFileName(resource->GetTypeName(), sourceName);
+
+    if (fileSystem->FileExists(cookedFileName))
+    {
+        File cookedFile(context_, cookedFileName);
+        if (cookedFile.IsOpen() && cookedFile.ReadFileID() == COOKED_FILE_ID && cookedFile.ReadString() == GetRevision() &&
+            cookedFile.ReadUInt() == checksum && cookedFile.ReadString() == sourceName)
+        {
+            if (resource->BeginLoadCooked(cookedFile))
+                return true;
+
+            LOGWARNING("Failed to load cooked data for " + sourceName + ", loading from source");
+        }
+    }
+
+    if (!resource->BeginLoad(source))
+        return false;
+
+    // Write a new cooked entry. Failure is not an error, the resource is just loaded from source again next time
+    bool cooked = false;
+    {
+        File cookedFile(context_, cookedFileName, FILE_WRITE);
+        if (cookedFile.IsOpen())
+        {
+            cookedFile.WriteFileID(COOKED_FILE_ID);
+            cookedFile.WriteString(GetRevision());
+            cookedFile.WriteUInt(checksum);
+            cookedFile.WriteString(sourceName);
+            cooked = resource->SaveCooked(cookedFile);
+        }
+    }
+    if (cooked)
+        LOGDEBUG("Stored cooked data for " + sourceName);
+    else if (fileSystem->FileExists(cookedFileName))
+        fileSystem->Delete(cookedFileName);
+
+    return true;
+}
+
+void ResourceCache::AddStreamingResource(Resource* resource)
+{
+    if (!resource)
+        return;
+
+    for (unsigned i = 0; i < streamingResources_.Size(); ++i)
+    {
+        if (streamingResources_[i] == resource)
+            return;
+    }
+
+    streamingResources_.Push(WeakPtr<Resource>(resource));
+}
+
+void ResourceCache::SetMaxResidentMip(Resource* resource, unsigned mip)
+{
+    if (!resource)
+        return;
+
+    // The resource adds itself to the streamed resources if it needs to stream
+    resource->SetMaxResidentMip(mip);
+}
+
 bool ResourceCache::BackgroundLoadResource(StringHash type, const String& nameIn, bool sendEventOnFailure, Resource* caller)
 {
     // If empty name, fail immediately
@@ -991,6 +1093,45 @@ void ResourceCache::UpdateResourceGroup(StringHash type)
     }
 }
 
+void ResourceCache::UpdateStreamingResources()
+{
+    if (streamingResources_.Empty())
+        return;
+
+    PROFILE(UpdateStreamingResources);
+
+    PODVector<StringHash> changedTypes;
+    unsigned used = 0;
+
+    for (Vector<WeakPtr<Resource> >::Iterator i = streamingResources_.Begin(); i != streamingResources_.End();)
+    {
+        Resource* resource = *i;
+        if (!resource || !resource->IsStreaming())
+        {
+            i = streamingResources_.Erase(i);
+            continue;
+        }
+
+        if (used >= streamingBudget_)
+            break;
+
+        // The first step of each frame is allowed to exceed the budget, so that large mip levels can not stall
+        unsigned bytes = resource->StreamDetail(used ? streamingBudget_ - used : M_MAX_UNSIGNED);
+        if (bytes)
+        {
+            used += bytes;
+            if (!changedTypes.Contains(resource->GetType()))
+                changedTypes.Push(resource->GetType());
+        }
+
+        ++i;
+    }
+
+    // Resource memory use changes as detail is streamed in or out
+    for (unsigned i = 0; i < changedTypes.Size(); ++i)
+        UpdateResourceGroup(changedTypes[i]);
+}
+
 void ResourceCache::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
 {
     for (unsigned i = 0; i < fileWatchers_.Size(); ++i)
@@ -1015,6 +1156,10 @@ void ResourceCache::HandleBeginFrame(StringHash eventType, VariantMap& eventData
         PROFILE(FinishBackgroundResources);
         backgroundLoader_->FinishResources(finishBackgroundResourcesMs_);
     }
+
+    // Stream in detail of previously loaded resources
+    if (streamingBudget_)
+        UpdateStreamingResources();
 }
 
 File* ResourceCache::SearchResourceDirs(const String& nameIn)
@@ -1050,6 +1195,11 @@ File* ResourceCache::SearchPackages(const String& nameIn)
     return 0;
 }
 
+String ResourceCache::GetCookedFileName(const String& typeName, const String& sourceName) const
+{
+    return cookedResourceDir_ + typeName + "_" + StringHash(sourceName).ToString() + ".cooked";
+}
+
 void RegisterResourceLibrary(Context* context)
 {
     Image::RegisterObject(context);
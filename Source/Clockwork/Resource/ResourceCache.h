@@ -128,6 +128,12 @@ public:
 
     /// Set how many milliseconds maximum per frame to spend on finishing background loaded resources.
     void SetFinishBackgroundResourcesMs(int ms) { finishBackgroundResourcesMs_ = Max(ms, 1); }
+    /// Set how many bytes of resource detail, such as texture mip levels, to stream in per frame after the initial load. Streamed textures load their mip tail first. 0 (default) disables streaming. Should be set before loading resources.
+    void SetStreamingBudget(unsigned bytes) { streamingBudget_ = bytes; }
+    /// Set the most detailed mip level allowed to be resident for a streamed resource. 0 allows full detail.
+    void SetMaxResidentMip(Resource* resource, unsigned mip);
+    /// Set directory for cooked resource data. Resources that support cooking are then loaded from ready-to-use binary data keyed by source file checksum and engine revision, and stale or missing entries are rewritten after loading from source. Empty (default) disables. Should be set before loading resources.
+    void SetCookedResourceDir(const String& pathName);
 
     /// Add a resource router object. By default there is none, so the routing process is skipped.
     void AddResourceRouter(ResourceRouter* router, bool addAsFirst = false);
@@ -140,6 +146,10 @@ public:
     Resource* GetResource(StringHash type, const String& name, bool sendEventOnFailure = true);
     /// Load a resource without storing it in the resource cache. Return null if not found or if fails. Can be called from outside the main thread if the resource itself is safe to load completely (it does not possess for example GPU data.)
     SharedPtr<Resource> GetTempResource(StringHash type, const String& name, bool sendEventOnFailure = true);
+    /// Begin loading a resource from a source stream, preferring cooked data if the cooked resource directory is set. Called by Resource::Load() and the background loader. Can be called from outside the main thread.
+    bool BeginLoadResource(Resource* resource, Deserializer& source);
+    /// Add a resource which has more detail to stream in or out. Called by streamed resources when loaded.
+    void AddStreamingResource(Resource* resource);
     /// Background load a resource. An event will be sent when complete. Return true if successfully stored to the load queue, false if eg. already exists. Can be called from outside the main thread.
     bool BackgroundLoadResource(StringHash type, const String& name, bool sendEventOnFailure = true, Resource* caller = 0);
     /// Return number of pending background-loaded resources.
@@ -191,6 +201,15 @@ public:
     /// Return how many milliseconds maximum to spend on finishing background loaded resources.
     int GetFinishBackgroundResourcesMs() const { return finishBackgroundResourcesMs_; }
 
+    /// Return how many bytes of resource detail to stream in per frame.
+    unsigned GetStreamingBudget() const { return streamingBudget_; }
+
+    /// Return number of resources still streaming.
+    unsigned GetNumStreamingResources() const { return streamingResources_.Size(); }
+
+    /// Return cooked resource data directory.
+    const String& GetCookedResourceDir() const { return cookedResourceDir_; }
+
     /// Return a resource router by index.
     ResourceRouter* GetResourceRouter(unsigned index) const;
 
@@ -214,12 +233,16 @@ private:
     void ReleasePackageResources(PackageFile* package, bool force = false);
     /// Update a resource group. Recalculate memory use and release resources if over memory budget.
     void UpdateResourceGroup(StringHash type);
-    /// Handle begin frame event. Automatic resource reloads and the finalization of background loaded resources are processed here.
+    /// Handle begin frame event. Automatic resource reloads, the finalization of background loaded resources and resource streaming are processed here.
     void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+    /// Stream in resource detail within the per-frame budget.
+    void UpdateStreamingResources();
     /// Search FileSystem for file.
     File* SearchResourceDirs(const String& nameIn);
     /// Search resource packages for file.
     File* SearchPackages(const String& nameIn);
+    /// Return cooked data file name for a resource type and source stream name.
+    String GetCookedFileName(const String& typeName, const String& sourceName) const;
 
     /// Mutex for thread-safe access to the resource directories, resource packages and resource dependencies.
     mutable Mutex resourceMutex_;
@@ -237,6 +260,10 @@ private:
     SharedPtr<BackgroundLoader> backgroundLoader_;
     /// Resource routers.
     Vector<SharedPtr<ResourceRouter> > resourceRouters_;
+    /// Resources with detail left to stream.
+    Vector<WeakPtr<Resource> > streamingResources_;
+    /// Cooked resource data directory.
+    String cookedResourceDir_;
     /// Automatic resource reloading flag.
     bool autoReloadResources_;
     /// Return failed resources flag.
@@ -247,6 +274,8 @@ private:
     mutable bool isRouting_;
     /// How many milliseconds maximum per frame to spend on finishing background loaded resources.
     int finishBackgroundResourcesMs_;
+    /// How many bytes of resource detail to stream in per frame.
+    unsigned streamingBudget_;
 };
 
 template <class T> T* ResourceCache::GetExistingResource(const String& name)
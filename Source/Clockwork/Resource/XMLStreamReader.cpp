@@ -0,0 +1,563 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../IO/Deserializer.h"
+#include "../IO/Log.h"
+#include "../Resource/XMLStreamReader.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+static const unsigned READ_BUFFER_SIZE = 65536;
+
+static inline bool IsXMLWhitespace(int c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool IsNameTerminator(int c)
+{
+    return c < 0 || IsXMLWhitespace(c) || c == '/' || c == '>' || c == '=' || c == '<';
+}
+
+XMLStreamElement::XMLStreamElement() :
+    numAttributes_(0)
+{
+}
+
+bool XMLStreamElement::HasAttribute(const String& name) const
+{
+    for (unsigned i = 0; i < numAttributes_; ++i)
+    {
+        if (attributeNames_[i] == name)
+            return true;
+    }
+
+    return false;
+}
+
+const String& XMLStreamElement::GetAttribute(const String& name) const
+{
+    for (unsigned i = 0; i < numAttributes_; ++i)
+    {
+        if (attributeNames_[i] == name)
+            return attributeValues_[i];
+    }
+
+    return String::EMPTY;
+}
+
+bool XMLStreamElement::GetBool(const String& name) const
+{
+    return ToBool(GetAttribute(name));
+}
+
+int XMLStreamElement::GetInt(const String& name) const
+{
+    return ToInt(GetAttribute(name));
+}
+
+unsigned XMLStreamElement::GetUInt(const String& name) const
+{
+    return ToUInt(GetAttribute(name));
+}
+
+float XMLStreamElement::GetFloat(const String& name) const
+{
+    return ToFloat(GetAttribute(name));
+}
+
+XMLStreamReader::XMLStreamReader() :
+    source_(0),
+    position_(0),
+    size_(0),
+    line_(1),
+    depth_(0),
+    rootFound_(false),
+    aborted_(false)
+{
+}
+
+bool XMLStreamReader::Parse(Deserializer& source, XMLStreamHandler& handler)
+{
+    source_ = &source;
+    if (!buffer_)
+        buffer_ = new char[READ_BUFFER_SIZE];
+    position_ = 0;
+    size_ = 0;
+    line_ = 1;
+    depth_ = 0;
+    text_.Clear();
+    rootFound_ = false;
+    aborted_ = false;
+
+    // Skip UTF-8 byte order mark
+    if (Peek() == 0xef)
+    {
+        Get();
+        if (Get() != 0xbb || Get() != 0xbf)
+            return Error("Invalid byte order mark");
+    }
+
+    for (;;)
+    {
+        int c = Get();
+        if (c < 0)
+            break;
+
+        if (c != '<')
+        {
+            if (!depth_)
+            {
+                if (!IsXMLWhitespace(c))
+                    return Error("Text outside the root element");
+                continue;
+            }
+
+            if (c == '&')
+            {
+                if (!ReadEntity(text_))
+                    return false;
+            }
+            else if (c == '\r')
+            {
+                // Normalize line endings
+                Accept('\n');
+                text_.Append('\n');
+            }
+            else
+                text_.Append((char)c);
+            continue;
+        }
+
+        c = Peek();
+        if (c == '!')
+        {
+            Get();
+            if (!ReadMarkup())
+                return false;
+        }
+        else if (c == '?')
+        {
+            Get();
+            if (!SkipUntil("?>"))
+                return false;
+        }
+        else if (c == '/')
+        {
+            Get();
+            if (!FlushText(handler) || !ReadEndTag(handler))
+                return false;
+        }
+        else
+        {
+            if (!FlushText(handler) || !ReadStartTag(handler))
+                return false;
+        }
+    }
+
+    if (depth_)
+        return Error("Unexpected end of data inside element " + openElements_[depth_ - 1]);
+    if (!rootFound_)
+        return Error("No root element");
+
+    return true;
+}
+
+bool XMLStreamReader::FillBuffer()
+{
+    if (!source_ || source_->IsEof())
+        return false;
+
+    position_ = 0;
+    size_ = source_->Read(buffer_.Get(), READ_BUFFER_SIZE);
+    return size_ != 0;
+}
+
+void XMLStreamReader::SkipWhitespace()
+{
+    while (IsXMLWhitespace(Peek()))
+        Get();
+}
+
+bool XMLStreamReader::Accept(char c)
+{
+    if (Peek() != (unsigned char)c)
+        return false;
+
+    Get();
+    return true;
+}
+
+bool XMLStreamReader::ReadName(String& dest)
+{
+    dest.Clear();
+    while (!IsNameTerminator(Peek()))
+        dest.Append((char)Get());
+
+    if (dest.Empty())
+        return Error("Expected a name");
+    return true;
+}
+
+bool XMLStreamReader::ReadAttributeValue(String& dest)
+{
+    dest.Clear();
+
+    int quote = Get();
+    if (quote != '"' && quote != '\'')
+        return Error("Expected a quoted attribute value");
+
+    for (;;)
+    {
+        int c = Get();
+        if (c == quote)
+            return true;
+
+        switch (c)
+        {
+        case -1:
+            return Error("Unexpected end of data in attribute value");
+
+        case '<':
+            return Error("Invalid character '<' in attribute value");
+
+        case '&':
+            if (!ReadEntity(dest))
+                return false;
+            break;
+
+        case '\r':
+            // Whitespace in attribute values is normalized to spaces, with CR+LF counted once
+            Accept('\n');
+            dest.Append(' ');
+            break;
+
+        case '\n':
+        case '\t':
+            dest.Append(' ');
+            break;
+
+        default:
+            dest.Append((char)c);
+            break;
+        }
+    }
+}
+
+bool XMLStreamReader::ReadEntity(String& dest)
+{
+    // Entity names are short; anything longer than this is left as literal text
+    static const unsigned MAX_ENTITY_LENGTH = 10;
+
+    char name[MAX_ENTITY_LENGTH + 1];
+    unsigned length = 0;
+    int c;
+    while ((c = Peek()) != ';' && length < MAX_ENTITY_LENGTH && c >= 0 && !IsXMLWhitespace(c) && c != '<' && c != '&' &&
+           c != '"' && c != '\'')
+        name[length++] = (char)Get();
+    name[length] = 0;
+
+    if (!Accept(';'))
+    {
+        // Not a terminated reference: keep the ampersand and the consumed characters as is
+        dest.Append('&');
+        dest.Append(name, length);
+        return true;
+    }
+
+    if (name[0] == '#')
+    {
+        unsigned code = 0;
+        bool valid = length > 1;
+        if (name[1] == 'x')
+        {
+            valid = length > 2;
+            for (unsigned i = 2; i < length && valid; ++i)
+            {
+                char d = name[i];
+                if (d >= '0' && d <= '9')
+                    code = code * 16 + (d - '0');
+                else if (d >= 'a' && d <= 'f')
+                    code = code * 16 + (d - 'a' + 10);
+                else if (d >= 'A' && d <= 'F')
+                    code = code * 16 + (d - 'A' + 10);
+                else
+                    valid = false;
+            }
+        }
+        else
+        {
+            for (unsigned i = 1; i < length && valid; ++i)
+            {
+                char d = name[i];
+                if (d >= '0' && d <= '9')
+                    code = code * 10 + (d - '0');
+                else
+                    valid = false;
+            }
+        }
+
+        if (!valid || !code)
+            return Error("Invalid character reference &" + String(name) + ";");
+        dest.AppendUTF8(code);
+    }
+    else if (!strcmp(name, "lt"))
+        dest.Append('<');
+    else if (!strcmp(name, "gt"))
+        dest.Append('>');
+    else if (!strcmp(name, "amp"))
+        dest.Append('&');
+    else if (!strcmp(name, "quot"))
+        dest.Append('"');
+    else if (!strcmp(name, "apos"))
+        dest.Append('\'');
+    else
+    {
+        // Unknown entities are kept as literal text
+        dest.Append('&');
+        dest.Append(name, length);
+        dest.Append(';');
+    }
+
+    return true;
+}
+
+bool XMLStreamReader::ReadStartTag(XMLStreamHandler& handler)
+{
+    if (!depth_ && rootFound_)
+        return Error("Multiple root elements");
+    if (!ReadName(element_.name_))
+        return false;
+
+    element_.numAttributes_ = 0;
+    bool empty = false;
+
+    for (;;)
+    {
+        SkipWhitespace();
+
+        int c = Peek();
+        if (c == '>')
+        {
+            Get();
+            break;
+        }
+        else if (c == '/')
+        {
+            Get();
+            if (!Accept('>'))
+                return Error("Expected '>' after '/' in element " + element_.name_);
+            empty = true;
+            break;
+        }
+        else if (c < 0)
+            return Error("Unexpected end of data in element " + element_.name_);
+
+        // Reuse the attribute string storage of previous elements
+        unsigned index = element_.numAttributes_++;
+        if (element_.attributeNames_.Size() <= index)
+        {
+            element_.attributeNames_.Resize(index + 1);
+            element_.attributeValues_.Resize(index + 1);
+        }
+
+        if (!ReadName(element_.attributeNames_[index]))
+            return false;
+        SkipWhitespace();
+        if (!Accept('='))
+            return Error("Expected '=' after attribute " + element_.attributeNames_[index]);
+        SkipWhitespace();
+        if (!ReadAttributeValue(element_.attributeValues_[index]))
+            return false;
+    }
+
+    rootFound_ = true;
+
+    if (!handler.StartElement(element_))
+    {
+        aborted_ = true;
+        return false;
+    }
+
+    if (empty)
+    {
+        if (!handler.EndElement(element_.name_))
+        {
+            aborted_ = true;
+            return false;
+        }
+    }
+    else
+    {
+        if (openElements_.Size() <= depth_)
+            openElements_.Resize(depth_ + 1);
+        openElements_[depth_++] = element_.name_;
+    }
+
+    return true;
+}
+
+bool XMLStreamReader::ReadEndTag(XMLStreamHandler& handler)
+{
+    if (!ReadName(endName_))
+        return false;
+    SkipWhitespace();
+    if (!Accept('>'))
+        return Error("Expected '>' in end tag " + endName_);
+    if (!depth_ || endName_ != openElements_[depth_ - 1])
+        return Error("Mismatched end tag " + endName_);
+
+    --depth_;
+    if (!handler.EndElement(openElements_[depth_]))
+    {
+        aborted_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+bool XMLStreamReader::ReadMarkup()
+{
+    if (Accept('-'))
+    {
+        if (!Accept('-'))
+            return Error("Invalid comment");
+        return SkipUntil("-->");
+    }
+
+    if (Accept('['))
+    {
+        static const char* cdataStart = "CDATA[";
+        for (const char* ptr = cdataStart; *ptr; ++ptr)
+        {
+            if (!Accept(*ptr))
+                return Error("Invalid CDATA section");
+        }
+        if (!depth_)
+            return Error("CDATA section outside the root element");
+
+        // Copy the content verbatim up to the terminating "]]>"
+        for (;;)
+        {
+            int c = Get();
+            if (c < 0)
+                return Error("Unexpected end of data in CDATA section");
+
+            if (c == ']' && Peek() == ']')
+            {
+                Get();
+                while (Peek() == ']')
+                {
+                    text_.Append(']');
+                    Get();
+                }
+                if (Accept('>'))
+                    return true;
+                text_.Append("]]");
+            }
+            else
+                text_.Append((char)c);
+        }
+    }
+
+    // Doctype or other declaration: skip, allowing an internal subset in brackets
+    unsigned brackets = 0;
+    for (;;)
+    {
+        int c = Get();
+        if (c < 0)
+            return Error("Unexpected end of data in declaration");
+        else if (c == '[')
+            ++brackets;
+        else if (c == ']' && brackets)
+            --brackets;
+        else if (c == '>' && !brackets)
+            return true;
+    }
+}
+
+bool XMLStreamReader::SkipUntil(const char* terminator)
+{
+    // Compare a sliding window of the most recent characters against the terminator
+    static const unsigned MAX_TERMINATOR_LENGTH = 4;
+
+    unsigned length = (unsigned)strlen(terminator);
+    assert(length <= MAX_TERMINATOR_LENGTH);
+    char window[MAX_TERMINATOR_LENGTH];
+    unsigned count = 0;
+
+    for (;;)
+    {
+        int c = Get();
+        if (c < 0)
+            return Error("Unexpected end of data, expected " + String(terminator));
+
+        if (count == length)
+        {
+            for (unsigned i = 1; i < length; ++i)
+                window[i - 1] = window[i];
+            --count;
+        }
+        window[count++] = (char)c;
+
+        if (count == length && !memcmp(window, terminator, length))
+            return true;
+    }
+}
+
+bool XMLStreamReader::FlushText(XMLStreamHandler& handler)
+{
+    if (text_.Empty())
+        return true;
+
+    bool whitespaceOnly = true;
+    for (unsigned i = 0; i < text_.Length(); ++i)
+    {
+        if (!IsXMLWhitespace(text_[i]))
+        {
+            whitespaceOnly = false;
+            break;
+        }
+    }
+
+    bool success = whitespaceOnly || handler.Text(text_);
+    text_.Clear();
+    if (!success)
+        aborted_ = true;
+    return success;
+}
+
+bool XMLStreamReader::Error(const String& message)
+{
+    LOGERROR("Could not parse XML data from " + (source_ ? source_->GetName() : String::EMPTY) + ": " + message +
+             " at line " + String(line_));
+    return false;
+}
+
+}
@@ -0,0 +1,174 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Container/ArrayPtr.h"
+#include "../Container/Str.h"
+#include "../Container/Vector.h"
+
+namespace Clockwork
+{
+
+class Deserializer;
+
+/// Element start tag passed to an XMLStreamHandler. Only valid during the handler call.
+class CLOCKWORK_API XMLStreamElement
+{
+    friend class XMLStreamReader;
+
+public:
+    /// Construct.
+    XMLStreamElement();
+
+    /// Return whether has an attribute.
+    bool HasAttribute(const String& name) const;
+    /// Return attribute value, or empty if missing.
+    const String& GetAttribute(const String& name) const;
+    /// Return bool attribute, or false if missing.
+    bool GetBool(const String& name) const;
+    /// Return int attribute, or zero if missing.
+    int GetInt(const String& name) const;
+    /// Return unsigned attribute, or zero if missing.
+    unsigned GetUInt(const String& name) const;
+    /// Return float attribute, or zero if missing.
+    float GetFloat(const String& name) const;
+
+    /// Return element name.
+    const String& GetName() const { return name_; }
+    /// Return number of attributes.
+    unsigned GetNumAttributes() const { return numAttributes_; }
+    /// Return attribute name by index.
+    const String& GetAttributeName(unsigned index) const { return index < numAttributes_ ? attributeNames_[index] : String::EMPTY; }
+    /// Return attribute value by index.
+    const String& GetAttributeValue(unsigned index) const { return index < numAttributes_ ? attributeValues_[index] : String::EMPTY; }
+
+private:
+    /// Element name.
+    String name_;
+    /// Attribute names. Storage is reused between elements, so may be larger than the attribute count.
+    Vector<String> attributeNames_;
+    /// Attribute values. Storage is reused between elements, so may be larger than the attribute count.
+    Vector<String> attributeValues_;
+    /// Number of attributes in use.
+    unsigned numAttributes_;
+};
+
+/// Receiver of XMLStreamReader parse events. Return false from any event to abort parsing.
+class CLOCKWORK_API XMLStreamHandler
+{
+public:
+    /// Destruct.
+    virtual ~XMLStreamHandler() {}
+
+    /// Handle an element start tag. Empty elements are followed immediately by EndElement().
+    virtual bool StartElement(const XMLStreamElement& element) = 0;
+    /// Handle an element end tag.
+    virtual bool EndElement(const String& name) = 0;
+    /// Handle non-whitespace text content of the current element, with entities and CDATA sections already decoded.
+    virtual bool Text(const String& text) { return true; }
+};
+
+/// Streaming (SAX-style) XML reader. Reads the source in fixed size chunks and reports elements to a handler as they are parsed, without building a document tree. Comments, processing instructions and the doctype are skipped.
+class CLOCKWORK_API XMLStreamReader
+{
+public:
+    /// Construct.
+    XMLStreamReader();
+
+    /// Parse XML data from a stream. Return true if the whole document was parsed successfully and the handler did not abort.
+    bool Parse(Deserializer& source, XMLStreamHandler& handler);
+
+    /// Return whether the last parse was aborted by the handler.
+    bool IsAborted() const { return aborted_; }
+
+private:
+    /// Refill the read buffer. Return false at end of data.
+    bool FillBuffer();
+    /// Return next character without consuming it, or -1 at end of data.
+    int Peek()
+    {
+        if (position_ == size_ && !FillBuffer())
+            return -1;
+        return (unsigned char)buffer_[position_];
+    }
+    /// Consume and return next character, or -1 at end of data.
+    int Get()
+    {
+        if (position_ == size_ && !FillBuffer())
+            return -1;
+        unsigned char c = (unsigned char)buffer_[position_++];
+        if (c == '\n')
+            ++line_;
+        return c;
+    }
+    /// Skip whitespace.
+    void SkipWhitespace();
+    /// Consume the next character if it matches. Return true if matched.
+    bool Accept(char c);
+    /// Read an element or attribute name. Return false if empty.
+    bool ReadName(String& dest);
+    /// Read a quoted attribute value.
+    bool ReadAttributeValue(String& dest);
+    /// Decode an entity reference after the '&' character.
+    bool ReadEntity(String& dest);
+    /// Read a start tag after the '<' character and report it.
+    bool ReadStartTag(XMLStreamHandler& handler);
+    /// Read an end tag after the "</" characters and report it.
+    bool ReadEndTag(XMLStreamHandler& handler);
+    /// Read a comment, CDATA section or doctype after the "<!" characters.
+    bool ReadMarkup();
+    /// Skip until a terminating character sequence has been consumed.
+    bool SkipUntil(const char* terminator);
+    /// Report accumulated text if it contains anything else than whitespace, and clear it.
+    bool FlushText(XMLStreamHandler& handler);
+    /// Log a parse error and return false.
+    bool Error(const String& message);
+
+    /// Source stream.
+    Deserializer* source_;
+    /// Read buffer.
+    SharedArrayPtr<char> buffer_;
+    /// Read position in buffer.
+    unsigned position_;
+    /// Valid data size in buffer.
+    unsigned size_;
+    /// Current line for error messages.
+    unsigned line_;
+    /// Current start tag.
+    XMLStreamElement element_;
+    /// Open element names. Storage is reused, so may be larger than the depth.
+    Vector<String> openElements_;
+    /// Number of open elements.
+    unsigned depth_;
+    /// Accumulated text content.
+    String text_;
+    /// Scratch end tag name.
+    String endName_;
+    /// Root element found flag.
+    bool rootFound_;
+    /// Handler aborted flag.
+    bool aborted_;
+};
+
+}
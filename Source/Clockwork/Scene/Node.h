@@ -58,6 +58,7 @@ class CLOCKWORK_API Node : public Animatable
     BASEOBJECT(Node);
 
     friend class Connection;
+    friend class SceneXMLLoader;
 
 public:
     /// Construct.
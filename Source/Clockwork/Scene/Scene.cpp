@@ -32,11 +32,13 @@
 #include "../Resource/ResourceCache.h"
 #include "../Resource/ResourceEvents.h"
 #include "../Resource/XMLFile.h"
+#include "../Resource/XMLStreamReader.h"
 #include "../Scene/Component.h"
 #include "../Scene/ObjectAnimation.h"
 #include "../Scene/ReplicationState.h"
 #include "../Scene/Scene.h"
 #include "../Scene/SceneEvents.h"
+#include "../Scene/SceneXMLLoader.h"
 #include "../Scene/SmoothedTransform.h"
 #include "../Scene/SplinePath.h"
 #include "../Scene/UnknownComponent.h"
@@ -202,21 +204,27 @@ bool Scene::LoadXML(Deserializer& source)
 
     StopAsyncLoading();
 
-    SharedPtr<XMLFile> xml(new XMLFile(context_));
-    if (!xml->Load(source))
-        return false;
-
     LOGINFO("Loading scene from " + source.GetName());
 
     Clear();
 
-    if (Node::LoadXML(xml->GetRoot()))
+    // Create nodes and components while the file is parsed instead of building a document tree first
+    SceneResolver resolver;
+    SceneXMLLoader loader(this, resolver);
+    XMLStreamReader reader;
+    if (reader.Parse(source, loader))
     {
+        resolver.Resolve();
+        ApplyAttributes();
         FinishLoading(&source);
         return true;
     }
     else
+    {
+        // Do not leave a partially loaded scene
+        Clear();
         return false;
+    }
 }
 
 bool Scene::SaveXML(Serializer& dest, const String& indentation) const
@@ -441,11 +449,25 @@ Node* Scene::InstantiateXML(const XMLElement& source, const Vector3& position, c
 
 Node* Scene::InstantiateXML(Deserializer& source, const Vector3& position, const Quaternion& rotation, CreateMode mode)
 {
-    SharedPtr<XMLFile> xml(new XMLFile(context_));
-    if (!xml->Load(source))
-        return 0;
+    PROFILE(InstantiateXML);
 
-    return InstantiateXML(xml->GetRoot(), position, rotation, mode);
+    SceneResolver resolver;
+    // Rewrite IDs when instantiating
+    Node* node = CreateChild(0, mode);
+    SceneXMLLoader loader(node, resolver, true, mode);
+    XMLStreamReader reader;
+    if (reader.Parse(source, loader))
+    {
+        resolver.Resolve();
+        node->ApplyAttributes();
+        node->SetTransform(position, rotation);
+        return node;
+    }
+    else
+    {
+        node->Remove();
+        return 0;
+    }
 }
 
 void Scene::Clear(bool clearReplicated, bool clearLocal)
@@ -100,7 +100,7 @@ public:
     /// Add a replication state that is tracking this scene.
     virtual void AddReplicationState(NodeReplicationState* state);
 
-    /// Load from an XML file. Return true if successful.
+    /// Load from an XML file. The file is streamed without building a document tree. Return true if successful; on failure the scene is left empty.
     bool LoadXML(Deserializer& source);
     /// Save to an XML file. Return true if successful.
     bool SaveXML(Serializer& dest, const String& indentation = "\t") const;
@@ -115,7 +115,7 @@ public:
     /// Instantiate scene content from XML data. Return root node if successful.
     Node* InstantiateXML
         (const XMLElement& source, const Vector3& position, const Quaternion& rotation, CreateMode mode = REPLICATED);
-    /// Instantiate scene content from XML data. Return root node if successful.
+    /// Instantiate scene content from XML data. The data is streamed without building a document tree. Return root node if successful.
     Node* InstantiateXML(Deserializer& source, const Vector3& position, const Quaternion& rotation, CreateMode mode = REPLICATED);
     /// Clear scene completely of either replicated, local or all nodes and components.
     void Clear(bool clearReplicated = true, bool clearLocal = true);
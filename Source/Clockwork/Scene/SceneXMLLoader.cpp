@@ -0,0 +1,211 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include "../Precompiled.h"
+
+#include "../IO/Log.h"
+#include "../Resource/XMLFile.h"
+#include "../Scene/Component.h"
+#include "../Scene/Scene.h"
+#include "../Scene/SceneResolver.h"
+#include "../Scene/SceneXMLLoader.h"
+
+#include "../DebugNew.h"
+
+namespace Clockwork
+{
+
+SceneXMLLoader::SceneXMLLoader(Node* root, SceneResolver& resolver, bool rewriteIDs, CreateMode mode) :
+    root_(root),
+    resolver_(resolver),
+    rewriteIDs_(rewriteIDs),
+    mode_(mode),
+    component_(0),
+    skipDepth_(0),
+    nodeDataPending_(false),
+    lateNodeData_(false)
+{
+    if (root)
+        fragment_ = new XMLFile(root->GetContext());
+}
+
+SceneXMLLoader::~SceneXMLLoader()
+{
+}
+
+bool SceneXMLLoader::StartElement(const XMLStreamElement& element)
+{
+    if (skipDepth_)
+    {
+        ++skipDepth_;
+        return true;
+    }
+
+    if (nodes_.Empty())
+    {
+        if (!root_)
+        {
+            LOGERROR("Null root node for loading XML data");
+            return false;
+        }
+
+        // Read own ID. Will not be applied, only stored for resolving possible references
+        resolver_.AddNode(element.GetUInt("id"), root_);
+        root_->RemoveAllChildren();
+        root_->RemoveAllComponents();
+        nodes_.Push(root_);
+        BeginFragment(element);
+        nodeDataPending_ = true;
+        return true;
+    }
+
+    // Inside a component, or inside an element of node data: collect into the fragment
+    if (component_ || fragmentElements_.Size() > 1)
+    {
+        AddToFragment(element);
+        return true;
+    }
+
+    const String& name = element.GetName();
+    Node* node = nodes_.Back();
+
+    if (name == "component")
+    {
+        if (!FlushNodeData())
+            return false;
+
+        const String& typeName = element.GetAttribute("type");
+        unsigned compID = element.GetUInt("id");
+        Component* newComponent = node->SafeCreateComponent(typeName, StringHash(typeName),
+            (mode_ == REPLICATED && compID < FIRST_LOCAL_ID) ? REPLICATED : LOCAL, rewriteIDs_ ? 0 : compID);
+        if (newComponent)
+        {
+            resolver_.AddComponent(compID, newComponent);
+            component_ = newComponent;
+            BeginFragment(element);
+        }
+        else
+            skipDepth_ = 1;
+    }
+    else if (name == "node")
+    {
+        if (!FlushNodeData())
+            return false;
+
+        unsigned nodeID = element.GetUInt("id");
+        Node* newNode = node->CreateChild(rewriteIDs_ ? 0 : nodeID, (mode_ == REPLICATED && nodeID < FIRST_LOCAL_ID) ? REPLICATED :
+            LOCAL);
+        resolver_.AddNode(nodeID, newNode);
+        nodes_.Push(newNode);
+        BeginFragment(element);
+        nodeDataPending_ = true;
+    }
+    else
+    {
+        // Node attributes or animation. These are normally written before components and child nodes, but if not, start a new fragment for them
+        if (!nodeDataPending_)
+        {
+            fragmentElements_.Clear();
+            fragmentElements_.Push(fragment_->CreateRoot("node"));
+            nodeDataPending_ = true;
+            lateNodeData_ = true;
+        }
+        AddToFragment(element);
+    }
+
+    return true;
+}
+
+bool SceneXMLLoader::EndElement(const String& name)
+{
+    if (skipDepth_)
+    {
+        --skipDepth_;
+        return true;
+    }
+
+    if (fragmentElements_.Size() > 1)
+    {
+        fragmentElements_.Pop();
+        return true;
+    }
+
+    if (component_)
+    {
+        bool success = component_->LoadXML(fragmentElements_.Front());
+        fragmentElements_.Clear();
+        component_ = 0;
+        return success;
+    }
+
+    // End of a node
+    if (!FlushNodeData())
+        return false;
+    nodes_.Pop();
+    return true;
+}
+
+bool SceneXMLLoader::Text(const String& text)
+{
+    if (!skipDepth_ && !fragmentElements_.Empty())
+        fragmentElements_.Back().SetValue(text);
+
+    return true;
+}
+
+void SceneXMLLoader::BeginFragment(const XMLStreamElement& element)
+{
+    XMLElement fragmentRoot = fragment_->CreateRoot(element.GetName());
+    for (unsigned i = 0; i < element.GetNumAttributes(); ++i)
+        fragmentRoot.SetAttribute(element.GetAttributeName(i), element.GetAttributeValue(i));
+
+    fragmentElements_.Clear();
+    fragmentElements_.Push(fragmentRoot);
+}
+
+void SceneXMLLoader::AddToFragment(const XMLStreamElement& element)
+{
+    XMLElement child = fragmentElements_.Back().CreateChild(element.GetName());
+    for (unsigned i = 0; i < element.GetNumAttributes(); ++i)
+        child.SetAttribute(element.GetAttributeName(i), element.GetAttributeValue(i));
+
+    fragmentElements_.Push(child);
+}
+
+bool SceneXMLLoader::FlushNodeData()
+{
+    if (!nodeDataPending_)
+        return true;
+
+    Node* node = nodes_.Back();
+    // Late data only sets attributes, so that animations already loaded are not reset
+    bool success = lateNodeData_ ? node->Serializable::LoadXML(fragmentElements_.Front()) :
+        node->Animatable::LoadXML(fragmentElements_.Front());
+
+    fragmentElements_.Clear();
+    nodeDataPending_ = false;
+    lateNodeData_ = false;
+    return success;
+}
+
+}
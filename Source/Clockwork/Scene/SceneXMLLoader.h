@@ -0,0 +1,84 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "../Resource/XMLElement.h"
+#include "../Resource/XMLStreamReader.h"
+#include "../Scene/Node.h"
+
+namespace Clockwork
+{
+
+class SceneResolver;
+class XMLFile;
+
+/// Streaming XML loader for a node hierarchy. Creates child nodes and components as their elements are parsed by an XMLStreamReader, so that no document tree of the whole file is built. Only the data of one node or component is held in memory at a time, and passed to its existing LoadXML() function.
+class CLOCKWORK_API SceneXMLLoader : public XMLStreamHandler
+{
+public:
+    /// Construct for loading the root element into a node. Existing child nodes and components of the node are removed when loading starts.
+    SceneXMLLoader(Node* root, SceneResolver& resolver, bool rewriteIDs = false, CreateMode mode = REPLICATED);
+    /// Destruct.
+    virtual ~SceneXMLLoader();
+
+    /// Handle an element start tag.
+    virtual bool StartElement(const XMLStreamElement& element);
+    /// Handle an element end tag.
+    virtual bool EndElement(const String& name);
+    /// Handle text content.
+    virtual bool Text(const String& text);
+
+private:
+    /// Start a new data fragment from an element.
+    void BeginFragment(const XMLStreamElement& element);
+    /// Add an element to the data fragment.
+    void AddToFragment(const XMLStreamElement& element);
+    /// Apply pending data of the innermost node. Return true if successful.
+    bool FlushNodeData();
+
+    /// Root node.
+    WeakPtr<Node> root_;
+    /// Node and component ID resolver.
+    SceneResolver& resolver_;
+    /// Rewrite IDs flag.
+    bool rewriteIDs_;
+    /// Create mode for nodes and components.
+    CreateMode mode_;
+    /// Scratch document for the data of the node or component being loaded.
+    SharedPtr<XMLFile> fragment_;
+    /// Open elements in the fragment, the fragment root first.
+    Vector<XMLElement> fragmentElements_;
+    /// Open nodes, the innermost last.
+    PODVector<Node*> nodes_;
+    /// Component whose data is being read.
+    Component* component_;
+    /// Depth of an element subtree being skipped.
+    unsigned skipDepth_;
+    /// Innermost node has fragment data not yet applied.
+    bool nodeDataPending_;
+    /// Pending node data follows the node's components or child nodes.
+    bool lateNodeData_;
+};
+
+}
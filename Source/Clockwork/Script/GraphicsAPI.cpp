@@ -32,6 +32,7 @@
 #include "../Graphics/DecalSet.h"
 #include "../Graphics/Geometry.h"
 #include "../Graphics/Graphics.h"
+#include "../Graphics/Impostor.h"
 #include "../Graphics/IndexBuffer.h"
 #include "../Graphics/Light.h"
 #include "../Graphics/Material.h"
@@ -899,6 +900,20 @@ static void RegisterModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Model", "uint get_numMorphs() const", asMETHOD(Model, GetNumMorphs), asCALL_THISCALL);
 }
 
+static void RegisterImpostor(asIScriptEngine* engine)
+{
+    RegisterResource<Impostor>(engine, "Impostor");
+    engine->RegisterObjectMethod("Impostor", "Geometry@+ GetFrameGeometry(const Vector3&in) const", asMETHOD(Impostor, GetFrameGeometry), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "void set_material(Material@+)", asMETHOD(Impostor, SetMaterial), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "Material@+ get_material() const", asMETHOD(Impostor, GetMaterial), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "void set_numFrames(uint)", asMETHOD(Impostor, SetNumFrames), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "uint get_numFrames() const", asMETHOD(Impostor, GetNumFrames), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "void set_center(const Vector3&in)", asMETHOD(Impostor, SetCenter), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "const Vector3& get_center() const", asMETHOD(Impostor, GetCenter), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "void set_size(float)", asMETHOD(Impostor, SetSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Impostor", "float get_size() const", asMETHOD(Impostor, GetSize), asCALL_THISCALL);
+}
+
 static AnimationTriggerPoint* AnimationGetTrigger(unsigned index, Animation* animation)
 {
     const Vector<AnimationTriggerPoint>& points = animation->GetTriggers();
@@ -918,6 +933,9 @@ static void RegisterAnimation(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Animation", "void AddTrigger(float, bool, const Variant&in)", asMETHOD(Animation, AddTrigger), asCALL_THISCALL);
     engine->RegisterObjectMethod("Animation", "void RemoveTrigger(uint)", asMETHOD(Animation, RemoveTrigger), asCALL_THISCALL);
     engine->RegisterObjectMethod("Animation", "void RemoveAllTriggers()", asMETHOD(Animation, RemoveAllTriggers), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Animation", "bool Compress(float = 0.0005f, float = 0.0005f, float = 0.0005f)", asMETHOD(Animation, Compress), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Animation", "void Decompress()", asMETHOD(Animation, Decompress), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Animation", "bool get_compressed() const", asMETHOD(Animation, IsCompressed), asCALL_THISCALL);
     engine->RegisterObjectMethod("Animation", "float get_length() const", asMETHOD(Animation, GetLength), asCALL_THISCALL);
     engine->RegisterObjectMethod("Animation", "uint get_numTracks() const", asMETHOD(Animation, GetNumTracks), asCALL_THISCALL);
     engine->RegisterObjectMethod("Animation", "void set_numTriggers(uint)", asMETHOD(Animation, SetNumTriggers), asCALL_THISCALL);
@@ -1085,6 +1103,11 @@ static void RegisterStaticModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("StaticModel", "uint get_numGeometries() const", asMETHOD(StaticModel, GetNumGeometries), asCALL_THISCALL);
     engine->RegisterObjectMethod("StaticModel", "void set_occlusionLodLevel(uint) const", asMETHOD(StaticModel, SetOcclusionLodLevel), asCALL_THISCALL);
     engine->RegisterObjectMethod("StaticModel", "uint get_occlusionLodLevel() const", asMETHOD(StaticModel, GetOcclusionLodLevel), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModel", "void set_impostor(Impostor@+)", asMETHOD(StaticModel, SetImpostor), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModel", "Impostor@+ get_impostor() const", asMETHOD(StaticModel, GetImpostor), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModel", "void set_impostorDistance(float)", asMETHOD(StaticModel, SetImpostorDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModel", "float get_impostorDistance() const", asMETHOD(StaticModel, GetImpostorDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModel", "bool get_impostorActive() const", asMETHOD(StaticModel, IsImpostorActive), asCALL_THISCALL);
 }
 
 static void RegisterStaticModelGroup(asIScriptEngine* engine)
@@ -1097,6 +1120,9 @@ static void RegisterStaticModelGroup(asIScriptEngine* engine)
     engine->RegisterObjectMethod("StaticModelGroup", "void RemoveAllInstanceNodes()", asMETHOD(StaticModelGroup, RemoveAllInstanceNodes), asCALL_THISCALL);
     engine->RegisterObjectMethod("StaticModelGroup", "uint get_numInstanceNodes() const", asMETHOD(StaticModelGroup, GetNumInstanceNodes), asCALL_THISCALL);
     engine->RegisterObjectMethod("StaticModelGroup", "Node@+ get_instanceNodes(uint) const", asMETHOD(StaticModelGroup, GetInstanceNode), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModelGroup", "void set_clusterSize(float)", asMETHOD(StaticModelGroup, SetClusterSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModelGroup", "float get_clusterSize() const", asMETHOD(StaticModelGroup, GetClusterSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("StaticModelGroup", "uint get_numClusters() const", asMETHOD(StaticModelGroup, GetNumClusters), asCALL_THISCALL);
 }
 
 static void RegisterSkybox(asIScriptEngine* engine)
@@ -1166,6 +1192,7 @@ static void RegisterAnimatedModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("AnimatedModel", "void RemoveAllAnimationStates()", asMETHOD(AnimatedModel, RemoveAllAnimationStates), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void SetMorphWeight(uint, float)", asMETHODPR(AnimatedModel, SetMorphWeight, (unsigned, float), void), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void ResetMorphWeights()", asMETHOD(AnimatedModel, ResetMorphWeights), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "Node@+ CreateBoneNode(const String&in)", asMETHOD(AnimatedModel, CreateBoneNode), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "float GetMorphWeight(uint) const", asMETHODPR(AnimatedModel, GetMorphWeight, (unsigned) const, float), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ GetAnimationState(Animation@+) const", asMETHODPR(AnimatedModel, GetAnimationState, (Animation*) const, AnimationState*), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ GetAnimationState(uint) const", asMETHODPR(AnimatedModel, GetAnimationState, (unsigned) const, AnimationState*), asCALL_THISCALL);
@@ -1174,6 +1201,12 @@ static void RegisterAnimatedModel(asIScriptEngine* engine)
     engine->RegisterObjectMethod("AnimatedModel", "float get_animationLodBias() const", asMETHOD(AnimatedModel, GetAnimationLodBias), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "void set_updateInvisible(bool)", asMETHOD(AnimatedModel, SetUpdateInvisible), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "bool get_updateInvisible() const", asMETHOD(AnimatedModel, GetUpdateInvisible), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "void set_boneNodesEnabled(bool)", asMETHOD(AnimatedModel, SetBoneNodesEnabled), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "bool get_boneNodesEnabled() const", asMETHOD(AnimatedModel, GetBoneNodesEnabled), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "void set_poseSharing(bool)", asMETHOD(AnimatedModel, SetPoseSharing), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "bool get_poseSharing() const", asMETHOD(AnimatedModel, GetPoseSharing), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "void set_boneLodDistance(float)", asMETHOD(AnimatedModel, SetBoneLodDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("AnimatedModel", "float get_boneLodDistance() const", asMETHOD(AnimatedModel, GetBoneLodDistance), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "Skeleton@+ get_skeleton()", asMETHOD(AnimatedModel, GetSkeleton), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "uint get_numAnimationStates() const", asMETHOD(AnimatedModel, GetNumAnimationStates), asCALL_THISCALL);
     engine->RegisterObjectMethod("AnimatedModel", "AnimationState@+ get_animationStates(const String&in) const", asMETHODPR(AnimatedModel, GetAnimationState, (const String&) const, AnimationState*), asCALL_THISCALL);
@@ -1249,6 +1282,8 @@ static void RegisterBillboardSet(asIScriptEngine* engine)
     engine->RegisterObjectMethod("BillboardSet", "bool get_relative() const", asMETHOD(BillboardSet, IsRelative), asCALL_THISCALL);
     engine->RegisterObjectMethod("BillboardSet", "void set_sorted(bool)", asMETHOD(BillboardSet, SetSorted), asCALL_THISCALL);
     engine->RegisterObjectMethod("BillboardSet", "bool get_sorted() const", asMETHOD(BillboardSet, IsSorted), asCALL_THISCALL);
+    engine->RegisterObjectMethod("BillboardSet", "void set_sortThreshold(float)", asMETHOD(BillboardSet, SetSortThreshold), asCALL_THISCALL);
+    engine->RegisterObjectMethod("BillboardSet", "float get_sortThreshold() const", asMETHOD(BillboardSet, GetSortThreshold), asCALL_THISCALL);
     engine->RegisterObjectMethod("BillboardSet", "void set_scaled(bool)", asMETHOD(BillboardSet, SetScaled), asCALL_THISCALL);
     engine->RegisterObjectMethod("BillboardSet", "bool get_scaled() const", asMETHOD(BillboardSet, IsScaled), asCALL_THISCALL);
     engine->RegisterObjectMethod("BillboardSet", "void set_faceCameraMode(FaceCameraMode)", asMETHOD(BillboardSet, SetFaceCameraMode), asCALL_THISCALL);
@@ -1371,6 +1406,8 @@ static void RegisterParticleEmitter(asIScriptEngine* engine)
     engine->RegisterObjectMethod("ParticleEmitter", "bool get_relative() const", asMETHOD(ParticleEmitter, IsRelative), asCALL_THISCALL);
     engine->RegisterObjectMethod("ParticleEmitter", "void set_sorted(bool)", asMETHOD(ParticleEmitter, SetSorted), asCALL_THISCALL);
     engine->RegisterObjectMethod("ParticleEmitter", "bool get_sorted() const", asMETHOD(ParticleEmitter, IsSorted), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ParticleEmitter", "void set_sortThreshold(float)", asMETHOD(ParticleEmitter, SetSortThreshold), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ParticleEmitter", "float get_sortThreshold() const", asMETHOD(ParticleEmitter, GetSortThreshold), asCALL_THISCALL);
     engine->RegisterObjectMethod("ParticleEmitter", "void set_scaled(bool)", asMETHOD(ParticleEmitter, SetScaled), asCALL_THISCALL);
     engine->RegisterObjectMethod("ParticleEmitter", "bool get_scaled() const", asMETHOD(ParticleEmitter, IsScaled), asCALL_THISCALL);
     engine->RegisterObjectMethod("ParticleEmitter", "void set_faceCameraMode(FaceCameraMode)", asMETHOD(ParticleEmitter, SetFaceCameraMode), asCALL_THISCALL);
@@ -1431,11 +1468,13 @@ static void RegisterDecalSet(asIScriptEngine* engine)
 {
     RegisterDrawable<DecalSet>(engine, "DecalSet");
     engine->RegisterObjectMethod("DecalSet", "bool AddDecal(Drawable@+, const Vector3&in, const Quaternion&in, float, float, float, const Vector2&in, const Vector2&in, float timeToLive = 0.0, float normalCutoff = 0.1, uint subGeometry = 0xffffffff)", asMETHOD(DecalSet, AddDecal), asCALL_THISCALL);
+    engine->RegisterObjectMethod("DecalSet", "bool QueueDecal(Drawable@+, const Vector3&in, const Quaternion&in, float, float, float, const Vector2&in, const Vector2&in, float timeToLive = 0.0, float normalCutoff = 0.1, uint subGeometry = 0xffffffff)", asMETHOD(DecalSet, QueueDecal), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "void RemoveDecals(uint)", asMETHOD(DecalSet, RemoveDecals), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "void RemoveAllDecals()", asMETHOD(DecalSet, RemoveAllDecals), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "void set_material(Material@+)", asMETHOD(DecalSet, SetMaterial), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "Material@+ get_material() const", asMETHOD(DecalSet, GetMaterial), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "uint get_numDecals() const", asMETHOD(DecalSet, GetNumDecals), asCALL_THISCALL);
+    engine->RegisterObjectMethod("DecalSet", "uint get_numQueuedDecals() const", asMETHOD(DecalSet, GetNumQueuedDecals), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "uint get_numVertices() const", asMETHOD(DecalSet, GetNumVertices), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "uint get_numIndices() const", asMETHOD(DecalSet, GetNumVertices), asCALL_THISCALL);
     engine->RegisterObjectMethod("DecalSet", "void set_maxVertices(uint)", asMETHOD(DecalSet, SetMaxVertices), asCALL_THISCALL);
@@ -1462,6 +1501,19 @@ static void RegisterTerrain(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Terrain", "uint get_occlusionLodLevel() const", asMETHOD(Terrain, GetOcclusionLodLevel), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "void set_smoothing(bool)", asMETHOD(Terrain, SetSmoothing), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "bool get_smoothing() const", asMETHOD(Terrain, GetSmoothing), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "void set_quadtree(bool)", asMETHOD(Terrain, SetQuadtree), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "bool get_quadtree() const", asMETHOD(Terrain, GetQuadtree), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "uint get_numTreeLevels() const", asMETHOD(Terrain, GetNumTreeLevels), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "void set_tiledHeightMap(XMLFile@+)", asMETHOD(Terrain, SetTiledHeightMap), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "XMLFile@+ get_tiledHeightMap() const", asMETHOD(Terrain, GetTiledHeightMap), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "void set_streamingDistance(float)", asMETHOD(Terrain, SetStreamingDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "float get_streamingDistance() const", asMETHOD(Terrain, GetStreamingDistance), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "void set_streamingBudget(uint)", asMETHOD(Terrain, SetStreamingBudget), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "uint get_streamingBudget() const", asMETHOD(Terrain, GetStreamingBudget), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "uint get_streamingMemoryUse() const", asMETHOD(Terrain, GetStreamingMemoryUse), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "const IntVector2& get_numTiles() const", asMETHOD(Terrain, GetNumTiles), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "int get_tileSize() const", asMETHOD(Terrain, GetTileSize), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Terrain", "uint get_numLoadedTiles() const", asMETHOD(Terrain, GetNumLoadedTiles), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "void set_heightMap(Image@+)", asMETHOD(Terrain, SetHeightMap), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "Image@+ get_heightMap() const", asMETHOD(Terrain, GetHeightMap), asCALL_THISCALL);
     engine->RegisterObjectMethod("Terrain", "void set_patchSize(int)", asMETHOD(Terrain, SetPatchSize), asCALL_THISCALL);
@@ -1639,6 +1691,10 @@ static void RegisterRenderer(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Renderer", "int get_occlusionBufferSize() const", asMETHOD(Renderer, GetOcclusionBufferSize), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_occluderSizeThreshold(float)", asMETHOD(Renderer, SetOccluderSizeThreshold), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "float get_occluderSizeThreshold() const", asMETHOD(Renderer, GetOccluderSizeThreshold), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_temporalOcclusion(bool)", asMETHOD(Renderer, SetTemporalOcclusion), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "bool get_temporalOcclusion() const", asMETHOD(Renderer, GetTemporalOcclusion), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "void set_animationBudget(float)", asMETHOD(Renderer, SetAnimationBudget), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "float get_animationBudget() const", asMETHOD(Renderer, GetAnimationBudget), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_mobileShadowBiasMul(float)", asMETHOD(Renderer, SetMobileShadowBiasMul), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "float get_mobileShadowBiasMul() const", asMETHOD(Renderer, GetMobileShadowBiasMul), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "void set_mobileShadowBiasAdd(float)", asMETHOD(Renderer, SetMobileShadowBiasAdd), asCALL_THISCALL);
@@ -1650,6 +1706,7 @@ static void RegisterRenderer(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Renderer", "uint get_numLights(bool) const", asMETHOD(Renderer, GetNumLights), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "uint get_numShadowMaps(bool) const", asMETHOD(Renderer, GetNumShadowMaps), asCALL_THISCALL);
     engine->RegisterObjectMethod("Renderer", "uint get_numOccluders(bool) const", asMETHOD(Renderer, GetNumOccluders), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Renderer", "uint get_numOccludedDrawables(bool) const", asMETHOD(Renderer, GetNumOccludedDrawables), asCALL_THISCALL);
     engine->RegisterGlobalFunction("Renderer@+ get_renderer()", asFUNCTION(GetRenderer), asCALL_CDECL);
 }
 
@@ -1814,6 +1871,7 @@ void RegisterGraphicsAPI(asIScriptEngine* engine)
     RegisterMaterial(engine);
     RegisterBuffers(engine);
     RegisterModel(engine);
+    RegisterImpostor(engine);
     RegisterAnimation(engine);
     RegisterDrawable(engine);
     RegisterLight(engine);
@@ -168,6 +168,12 @@ static void RegisterResourceCache(asIScriptEngine* engine)
     engine->RegisterObjectMethod("ResourceCache", "bool get_returnFailedResources() const", asMETHOD(ResourceCache, GetReturnFailedResources), asCALL_THISCALL);
     engine->RegisterObjectMethod("ResourceCache", "void set_finishBackgroundResourcesMs(int)", asMETHOD(ResourceCache, SetFinishBackgroundResourcesMs), asCALL_THISCALL);
     engine->RegisterObjectMethod("ResourceCache", "int get_finishBackgroundResourcesMs() const", asMETHOD(ResourceCache, GetFinishBackgroundResourcesMs), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "void SetMaxResidentMip(Resource@+, uint)", asMETHOD(ResourceCache, SetMaxResidentMip), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "void set_streamingBudget(uint)", asMETHOD(ResourceCache, SetStreamingBudget), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "uint get_streamingBudget() const", asMETHOD(ResourceCache, GetStreamingBudget), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "uint get_numStreamingResources() const", asMETHOD(ResourceCache, GetNumStreamingResources), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "void set_cookedResourceDir(const String&in)", asMETHOD(ResourceCache, SetCookedResourceDir), asCALL_THISCALL);
+    engine->RegisterObjectMethod("ResourceCache", "const String& get_cookedResourceDir() const", asMETHOD(ResourceCache, GetCookedResourceDir), asCALL_THISCALL);
     engine->RegisterObjectMethod("ResourceCache", "uint get_numBackgroundLoadResources() const", asMETHOD(ResourceCache, GetNumBackgroundLoadResources), asCALL_THISCALL);
     engine->RegisterGlobalFunction("ResourceCache@+ get_resourceCache()", asFUNCTION(GetResourceCache), asCALL_CDECL);
     engine->RegisterGlobalFunction("ResourceCache@+ get_cache()", asFUNCTION(GetResourceCache), asCALL_CDECL);
@@ -231,6 +237,7 @@ static void RegisterImage(asIScriptEngine* engine)
     engine->RegisterObjectMethod("Image", "Image@+ GetSubimage(const IntRect&in) const", asMETHOD(Image, GetSubimage), asCALL_THISCALL);
     engine->RegisterObjectMethod("Image", "bool get_cubemap() const", asMETHOD(Image, IsCubemap), asCALL_THISCALL);
     engine->RegisterObjectMethod("Image", "bool get_array() const", asMETHOD(Image, IsArray), asCALL_THISCALL);
+    engine->RegisterObjectMethod("Image", "void set_sRGB(bool)", asMETHOD(Image, SetSRGB), asCALL_THISCALL);
     engine->RegisterObjectMethod("Image", "bool get_sRGB() const", asMETHOD(Image, IsSRGB), asCALL_THISCALL);
 }
 
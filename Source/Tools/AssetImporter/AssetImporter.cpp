@@ -34,6 +34,7 @@
 #include <Clockwork/Graphics/Material.h>
 #include <Clockwork/Graphics/Octree.h>
 #include <Clockwork/Graphics/VertexBuffer.h>
+#include <Clockwork/Graphics/VertexCache.h>
 #include <Clockwork/Graphics/Zone.h>
 #include <Clockwork/IO/File.h>
 #include <Clockwork/IO/FileSystem.h>
@@ -53,6 +54,8 @@
 #include <assimp/postprocess.h>
 #include <assimp/DefaultLogger.hpp>
 
+#include "MeshSimplifier.h"
+
 #include <Clockwork/DebugNew.h>
 
 using namespace Clockwork;
@@ -80,6 +83,14 @@ struct OutModel
     unsigned totalIndices_;
 };
 
+struct OutLodLevel
+{
+    unsigned geometryIndex_;
+    unsigned lodLevel_;
+    SharedPtr<VertexBuffer> vertexBuffer_;
+    PODVector<unsigned> indices_;
+};
+
 struct OutScene
 {
     String outName_;
@@ -113,7 +124,11 @@ bool noOverwriteMaterial_ = false;
 bool noOverwriteTexture_ = false;
 bool noOverwriteNewerTexture_ = false;
 bool checkUniqueModel_ = true;
+bool compressAnimations_ = false;
 unsigned maxBones_ = 64;
+unsigned generateLodLevels_ = 0;
+float lodRatio_ = 0.5f;
+float lodDistance_ = 10.0f;
 Vector<String> nonSkinningBoneIncludes_;
 Vector<String> nonSkinningBoneExcludes_;
 
@@ -160,6 +175,9 @@ String GenerateMaterialName(aiMaterial* material);
 String GenerateTextureName(unsigned texIndex);
 unsigned GetNumValidFaces(aiMesh* mesh);
 
+void GenerateLodLevels(aiMesh* mesh, const Matrix3x4& vertexTransform, const Vector<PODVector<unsigned char> >& blendIndices,
+    const Vector<PODVector<float> >& blendWeights, unsigned geometryIndex, VertexBuffer* vb, unsigned vertexOffset,
+    Vector<OutLodLevel>& lodLevels);
 void WriteShortIndices(unsigned short*& dest, aiMesh* mesh, unsigned index, unsigned offset);
 void WriteLargeIndices(unsigned*& dest, aiMesh* mesh, unsigned index, unsigned offset);
 void WriteVertex(float*& dest, aiMesh* mesh, unsigned index, unsigned elementMask, BoundingBox& box,
@@ -224,6 +242,10 @@ void Run(const Vector<String>& arguments)
             "-nf         Do not fix infacing normals\n"
             "-ne         Do not save empty nodes (scene mode only)\n"
             "-mb <x>     Maximum number of bones per submesh. Default 64\n"
+            "-lg <num>   Generate simplified LOD levels for each geometry. Default 0\n"
+            "-lr <ratio> Triangle count ratio of each generated LOD level to the previous.\n"
+            "            Default 0.5\n"
+            "-ld <dist>  Distance step of generated LOD levels. Default 10\n"
             "-p <path>   Set path for scene resources. Default is output file path\n"
             "-r <name>   Use the named scene node as root node\n"
             "-f <freq>   Animation tick frequency to use if unspecified. Default 4800\n"
@@ -239,6 +261,7 @@ void Run(const Vector<String>& arguments)
             "-ct         Check and do not overwrite if texture exists\n"
             "-ctn        Check and do not overwrite if texture has newer timestamp\n"
             "-am         Export all meshes even if identical (scene mode only)\n"
+            "-ca         Save animations in the compressed format\n"
         );
     }
 
@@ -338,6 +361,21 @@ void Run(const Vector<String>& arguments)
                     maxBones_ = 1;
                 ++i;
             }
+            else if (argument == "lg" && !value.Empty())
+            {
+                generateLodLevels_ = ToUInt(value);
+                ++i;
+            }
+            else if (argument == "lr" && !value.Empty())
+            {
+                lodRatio_ = Clamp(ToFloat(value), 0.01f, 0.99f);
+                ++i;
+            }
+            else if (argument == "ld" && !value.Empty())
+            {
+                lodDistance_ = Max(ToFloat(value), 0.0f);
+                ++i;
+            }
             else if (argument == "p" && !value.Empty())
             {
                 resourcePath_ = AddTrailingSlash(value);
@@ -380,6 +418,8 @@ void Run(const Vector<String>& arguments)
                 noOverwriteNewerTexture_ = true;
             else if (argument == "am")
                 checkUniqueModel_ = false;
+            else if (argument == "ca")
+                compressAnimations_ = true;
         }
     }
 
@@ -795,6 +835,7 @@ void BuildAndSaveModel(OutModel& model)
     SharedPtr<VertexBuffer> vb;
     Vector<SharedPtr<VertexBuffer> > vbVector;
     Vector<SharedPtr<IndexBuffer> > ibVector;
+    Vector<OutLodLevel> lodLevels;
     unsigned startVertexOffset = 0;
     unsigned startIndexOffset = 0;
     unsigned destGeomIndex = 0;
@@ -905,6 +946,12 @@ void BuildAndSaveModel(OutModel& model)
         outModel->SetNumGeometryLodLevels(destGeomIndex, 1);
         outModel->SetGeometry(destGeomIndex, 0, geom);
         outModel->SetGeometryCenter(destGeomIndex, center);
+        if (generateLodLevels_)
+        {
+            unsigned numLodLevels = lodLevels.Size();
+            GenerateLodLevels(mesh, vertexTransform, blendIndices, blendWeights, destGeomIndex, vb, startVertexOffset, lodLevels);
+            outModel->SetNumGeometryLodLevels(destGeomIndex, 1 + lodLevels.Size() - numLodLevels);
+        }
         if (model.bones_.Size() > maxBones_)
             allBoneMappings.Push(boneMappings);
 
@@ -913,6 +960,53 @@ void BuildAndSaveModel(OutModel& model)
         ++destGeomIndex;
     }
 
+    // Write the generated LOD levels into an index buffer of their own, sharing the vertex buffers of the original geometries
+    if (lodLevels.Size())
+    {
+        unsigned totalIndices = 0;
+        bool largeIndices = false;
+        for (unsigned i = 0; i < lodLevels.Size(); ++i)
+        {
+            const PODVector<unsigned>& indices = lodLevels[i].indices_;
+            totalIndices += indices.Size();
+            for (unsigned j = 0; j < indices.Size() && !largeIndices; ++j)
+            {
+                if (indices[j] > 65535)
+                    largeIndices = true;
+            }
+        }
+
+        SharedPtr<IndexBuffer> lodIb(new IndexBuffer(context_));
+        lodIb->SetSize(totalIndices, largeIndices);
+        unsigned char* indexData = lodIb->GetShadowData();
+        unsigned indexStart = 0;
+
+        for (unsigned i = 0; i < lodLevels.Size(); ++i)
+        {
+            const OutLodLevel& level = lodLevels[i];
+            const PODVector<unsigned>& indices = level.indices_;
+            for (unsigned j = 0; j < indices.Size(); ++j)
+            {
+                if (largeIndices)
+                    ((unsigned*)indexData)[indexStart + j] = indices[j];
+                else
+                    ((unsigned short*)indexData)[indexStart + j] = (unsigned short)indices[j];
+            }
+            OptimizeVertexCache(indexData, lodIb->GetIndexSize(), indexStart, indices.Size());
+
+            SharedPtr<Geometry> geom(new Geometry(context_));
+            geom->SetIndexBuffer(lodIb);
+            geom->SetVertexBuffer(0, level.vertexBuffer_);
+            geom->SetDrawRange(TRIANGLE_LIST, indexStart, indices.Size(), true);
+            geom->SetLodDistance(lodDistance_ * level.lodLevel_);
+            outModel->SetGeometry(level.geometryIndex_, level.lodLevel_, geom);
+
+            indexStart += indices.Size();
+        }
+
+        ibVector.Push(lodIb);
+    }
+
     // Define the model buffers and bounding box
     PODVector<unsigned> emptyMorphRange;
     outModel->SetVertexBuffers(vbVector, emptyMorphRange, emptyMorphRange);
@@ -1188,6 +1282,11 @@ void BuildAndSaveAnimations(OutModel* model)
         }
 
         outAnim->SetTracks(tracks);
+        if (compressAnimations_ && outAnim->Compress())
+        {
+            PrintLine("Compressed animation " + animName + " to " + String(outAnim->GetCompressedData().GetNumKeys()) +
+                " keys in " + String(outAnim->GetCompressedData().GetNumChannels()) + " channels");
+        }
 
         File outFile(context_);
         if (!outFile.Open(animOutName, FILE_WRITE))
@@ -2049,6 +2148,74 @@ unsigned GetNumValidFaces(aiMesh* mesh)
     return ret;
 }
 
+void GenerateLodLevels(aiMesh* mesh, const Matrix3x4& vertexTransform, const Vector<PODVector<unsigned char> >& blendIndices,
+    const Vector<PODVector<float> >& blendWeights, unsigned geometryIndex, VertexBuffer* vb, unsigned vertexOffset,
+    Vector<OutLodLevel>& lodLevels)
+{
+    PODVector<Vector3> positions(mesh->mNumVertices);
+    PODVector<unsigned> skinGroups(mesh->mNumVertices);
+    for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+    {
+        positions[i] = vertexTransform * ToVector3(mesh->mVertices[i]);
+
+        // Use the most influential bone to keep differently skinned parts apart
+        skinGroups[i] = M_MAX_UNSIGNED;
+        float maxWeight = 0.0f;
+        if (i < blendWeights.Size())
+        {
+            for (unsigned j = 0; j < blendWeights[i].Size(); ++j)
+            {
+                if (blendWeights[i][j] > maxWeight)
+                {
+                    skinGroups[i] = blendIndices[i][j];
+                    maxWeight = blendWeights[i][j];
+                }
+            }
+        }
+    }
+
+    PODVector<unsigned> indices;
+    for (unsigned i = 0; i < mesh->mNumFaces; ++i)
+    {
+        const aiFace& face = mesh->mFaces[i];
+        if (face.mNumIndices == 3)
+        {
+            indices.Push(face.mIndices[0]);
+            indices.Push(face.mIndices[1]);
+            indices.Push(face.mIndices[2]);
+        }
+    }
+
+    // Each level is simplified further from the previous one
+    MeshSimplifier simplifier(positions, indices, skinGroups);
+    unsigned numTriangles = simplifier.GetNumTriangles();
+    for (unsigned i = 1; i <= generateLodLevels_; ++i)
+    {
+        unsigned targetTriangles = (unsigned)(numTriangles * lodRatio_);
+        if (!targetTriangles)
+            break;
+        unsigned newNumTriangles = simplifier.Simplify(targetTriangles);
+        if (newNumTriangles >= numTriangles)
+        {
+            PrintLine("Could not simplify geometry " + String(geometryIndex) + " further after " + String(i - 1) +
+                " LOD levels");
+            break;
+        }
+        numTriangles = newNumTriangles;
+
+        OutLodLevel level;
+        level.geometryIndex_ = geometryIndex;
+        level.lodLevel_ = i;
+        level.vertexBuffer_ = vb;
+        simplifier.GetIndices(level.indices_);
+        for (unsigned j = 0; j < level.indices_.Size(); ++j)
+            level.indices_[j] += vertexOffset;
+        lodLevels.Push(level);
+
+        PrintLine("Generated LOD level " + String(i) + " with " + String(numTriangles * 3) + " indices");
+    }
+}
+
 void WriteShortIndices(unsigned short*& dest, aiMesh* mesh, unsigned index, unsigned offset)
 {
     if (mesh->mFaces[index].mNumIndices == 3)
@@ -0,0 +1,390 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Clockwork/Container/HashMap.h>
+#include <Clockwork/Container/Sort.h>
+#include <Clockwork/Math/BoundingBox.h>
+
+#include "MeshSimplifier.h"
+
+#include <Clockwork/DebugNew.h>
+
+/// Weight of the planes that keep open borders in place.
+static const float BORDER_WEIGHT = 10.0f;
+/// Skinning group crossing penalty as a fraction of the mesh bounding box diagonal, squared when applied.
+static const float SKIN_PENALTY_SCALE = 0.05f;
+
+/// Vertex position and index for finding coincident vertices.
+struct SortedVertex
+{
+    /// Test for less than with another vertex, ordering by position.
+    bool operator < (const SortedVertex& rhs) const
+    {
+        if (position_.x_ != rhs.position_.x_)
+            return position_.x_ < rhs.position_.x_;
+        if (position_.y_ != rhs.position_.y_)
+            return position_.y_ < rhs.position_.y_;
+        return position_.z_ < rhs.position_.z_;
+    }
+
+    /// Position.
+    Vector3 position_;
+    /// Vertex index.
+    unsigned index_;
+};
+
+static unsigned long long MakeEdgeKey(unsigned classA, unsigned classB)
+{
+    if (classA > classB)
+        Swap(classA, classB);
+    return ((unsigned long long)classA << 32) | classB;
+}
+
+MeshSimplifier::MeshSimplifier(const PODVector<Vector3>& positions, const PODVector<unsigned>& indices,
+    const PODVector<unsigned>& skinGroups) :
+    positions_(positions),
+    skinGroups_(skinGroups),
+    indices_(indices),
+    skinPenalty_(0.0),
+    numTriangles_(0)
+{
+    if (skinGroups_.Size() != positions_.Size())
+        skinGroups_.Resize(positions_.Size());
+
+    Initialize();
+}
+
+unsigned MeshSimplifier::Simplify(unsigned targetTriangles)
+{
+    PODVector<EdgeCollapse> collapses;
+
+    while (numTriangles_ > targetTriangles)
+    {
+        // Gather the possible collapses in both directions of each remaining edge and apply them cheapest first. Collapsing
+        // changes the costs and validity of the surrounding edges, so those are locked until the next pass
+        collapses.Clear();
+        for (unsigned i = 0; i < indices_.Size(); i += 3)
+        {
+            if (triangleRemoved_[i / 3])
+                continue;
+
+            for (unsigned j = 0; j < 3; ++j)
+            {
+                unsigned classA = vertexClasses_[indices_[i + j]];
+                unsigned classB = vertexClasses_[indices_[i + (j + 1) % 3]];
+                const Vector3& positionA = positions_[classVertices_[classA][0]];
+                const Vector3& positionB = positions_[classVertices_[classB][0]];
+                Quadric quadric = classQuadrics_[classA];
+                quadric += classQuadrics_[classB];
+
+                double skinCost = skinGroups_[classVertices_[classA][0]] != skinGroups_[classVertices_[classB][0]] ?
+                    skinPenalty_ : 0.0;
+
+                EdgeCollapse collapse;
+                collapse.cost_ = quadric.Evaluate(positionB) + skinCost;
+                collapse.from_ = classA;
+                collapse.to_ = classB;
+                collapses.Push(collapse);
+                collapse.cost_ = quadric.Evaluate(positionA) + skinCost;
+                collapse.from_ = classB;
+                collapse.to_ = classA;
+                collapses.Push(collapse);
+            }
+        }
+
+        Sort(collapses.Begin(), collapses.End());
+
+        for (unsigned i = 0; i < classLocked_.Size(); ++i)
+            classLocked_[i] = false;
+
+        // Stop the pass once past the cheapest quarter, so that costlier collapses are re-evaluated after the cheap ones
+        unsigned numCollapsed = 0;
+        for (unsigned i = 0; i < collapses.Size() && numTriangles_ > targetTriangles; ++i)
+        {
+            if (numCollapsed && i >= collapses.Size() / 4)
+                break;
+
+            const EdgeCollapse& collapse = collapses[i];
+            if (classLocked_[collapse.from_] || classLocked_[collapse.to_])
+                continue;
+            if (Collapse(collapse.from_, collapse.to_))
+                ++numCollapsed;
+        }
+
+        if (!numCollapsed)
+            break;
+    }
+
+    return numTriangles_;
+}
+
+void MeshSimplifier::GetIndices(PODVector<unsigned>& dest) const
+{
+    dest.Clear();
+    dest.Reserve(numTriangles_ * 3);
+
+    for (unsigned i = 0; i < indices_.Size(); i += 3)
+    {
+        if (!triangleRemoved_[i / 3])
+        {
+            dest.Push(indices_[i]);
+            dest.Push(indices_[i + 1]);
+            dest.Push(indices_[i + 2]);
+        }
+    }
+}
+
+void MeshSimplifier::Initialize()
+{
+    unsigned numVertices = positions_.Size();
+    unsigned numTriangles = indices_.Size() / 3;
+    indices_.Resize(numTriangles * 3);
+
+    // Group vertices with the exact same position into classes
+    PODVector<SortedVertex> sortedVertices(numVertices);
+    BoundingBox box;
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        sortedVertices[i].position_ = positions_[i];
+        sortedVertices[i].index_ = i;
+        box.Merge(positions_[i]);
+    }
+    Sort(sortedVertices.Begin(), sortedVertices.End());
+
+    vertexClasses_.Resize(numVertices);
+    classVertices_.Clear();
+    for (unsigned i = 0; i < numVertices; ++i)
+    {
+        if (!i || sortedVertices[i - 1].position_ != sortedVertices[i].position_)
+            classVertices_.Resize(classVertices_.Size() + 1);
+        classVertices_.Back().Push(sortedVertices[i].index_);
+        vertexClasses_[sortedVertices[i].index_] = classVertices_.Size() - 1;
+    }
+
+    unsigned numClasses = classVertices_.Size();
+    classQuadrics_.Resize(numClasses);
+    classRemoved_.Resize(numClasses);
+    classLocked_.Resize(numClasses);
+    for (unsigned i = 0; i < numClasses; ++i)
+    {
+        classRemoved_[i] = false;
+        classLocked_[i] = false;
+    }
+
+    if (box.defined_)
+    {
+        double penalty = SKIN_PENALTY_SCALE * box.Size().Length();
+        skinPenalty_ = penalty * penalty;
+    }
+
+    // Remove triangles that are degenerate in position, and build the vertex to triangle adjacency
+    triangleRemoved_.Resize(numTriangles);
+    vertexTriangles_.Resize(numVertices);
+    numTriangles_ = 0;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        unsigned v0 = indices_[i * 3];
+        unsigned v1 = indices_[i * 3 + 1];
+        unsigned v2 = indices_[i * 3 + 2];
+        if (v0 >= numVertices || v1 >= numVertices || v2 >= numVertices || vertexClasses_[v0] == vertexClasses_[v1] ||
+            vertexClasses_[v1] == vertexClasses_[v2] || vertexClasses_[v2] == vertexClasses_[v0])
+        {
+            triangleRemoved_[i] = true;
+            continue;
+        }
+
+        triangleRemoved_[i] = false;
+        vertexTriangles_[v0].Push(i);
+        vertexTriangles_[v1].Push(i);
+        vertexTriangles_[v2].Push(i);
+        ++numTriangles_;
+    }
+
+    // Accumulate the triangle planes, and count the triangles of each edge to find the open borders
+    HashMap<unsigned long long, unsigned> edgeTriangleCounts;
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        if (triangleRemoved_[i])
+            continue;
+
+        Vector3 normal = GetTriangleNormal(i, M_MAX_UNSIGNED, Vector3::ZERO);
+        float length = normal.Length();
+        if (length > M_EPSILON)
+        {
+            normal /= length;
+            float distance = -normal.DotProduct(positions_[indices_[i * 3]]);
+            for (unsigned j = 0; j < 3; ++j)
+                classQuadrics_[vertexClasses_[indices_[i * 3 + j]]].AddPlane(normal, distance, 1.0f);
+        }
+
+        for (unsigned j = 0; j < 3; ++j)
+            ++edgeTriangleCounts[MakeEdgeKey(vertexClasses_[indices_[i * 3 + j]], vertexClasses_[indices_[i * 3 + (j + 1) % 3]])];
+    }
+
+    // Keep the open borders in place with planes perpendicular to the border triangles
+    for (unsigned i = 0; i < numTriangles; ++i)
+    {
+        if (triangleRemoved_[i])
+            continue;
+
+        Vector3 normal = GetTriangleNormal(i, M_MAX_UNSIGNED, Vector3::ZERO);
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            unsigned classA = vertexClasses_[indices_[i * 3 + j]];
+            unsigned classB = vertexClasses_[indices_[i * 3 + (j + 1) % 3]];
+            if (edgeTriangleCounts[MakeEdgeKey(classA, classB)] != 1)
+                continue;
+
+            const Vector3& positionA = positions_[indices_[i * 3 + j]];
+            const Vector3& positionB = positions_[indices_[i * 3 + (j + 1) % 3]];
+            Vector3 borderNormal = (positionB - positionA).CrossProduct(normal);
+            float length = borderNormal.Length();
+            if (length <= M_EPSILON)
+                continue;
+
+            borderNormal /= length;
+            float distance = -borderNormal.DotProduct(positionA);
+            classQuadrics_[classA].AddPlane(borderNormal, distance, BORDER_WEIGHT);
+            classQuadrics_[classB].AddPlane(borderNormal, distance, BORDER_WEIGHT);
+        }
+    }
+}
+
+bool MeshSimplifier::Collapse(unsigned fromClass, unsigned toClass)
+{
+    if (fromClass == toClass || classRemoved_[fromClass] || classRemoved_[toClass])
+        return false;
+
+    const PODVector<unsigned>& fromVertices = classVertices_[fromClass];
+    const Vector3& targetPosition = positions_[classVertices_[toClass][0]];
+
+    // Each vertex of the removed class must share an edge with exactly one vertex of the target class, which it is then
+    // merged into. Otherwise the collapse would cross an attribute seam
+    PODVector<unsigned> targetVertices(fromVertices.Size());
+    for (unsigned i = 0; i < fromVertices.Size(); ++i)
+    {
+        unsigned vertex = fromVertices[i];
+        unsigned targetVertex = M_MAX_UNSIGNED;
+        bool used = false;
+
+        const PODVector<unsigned>& triangles = vertexTriangles_[vertex];
+        for (unsigned j = 0; j < triangles.Size(); ++j)
+        {
+            unsigned triangle = triangles[j];
+            if (!UsesVertex(triangle, vertex))
+                continue;
+            used = true;
+
+            bool adjacent = false;
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                unsigned other = indices_[triangle * 3 + k];
+                if (vertexClasses_[other] != toClass)
+                    continue;
+                adjacent = true;
+                if (targetVertex != M_MAX_UNSIGNED && targetVertex != other)
+                    return false;
+                targetVertex = other;
+            }
+
+            // Reject if moving the vertex would flip the triangle
+            if (!adjacent)
+            {
+                Vector3 oldNormal = GetTriangleNormal(triangle, M_MAX_UNSIGNED, Vector3::ZERO);
+                Vector3 newNormal = GetTriangleNormal(triangle, vertex, targetPosition);
+                if (oldNormal.DotProduct(newNormal) <= 0.0f)
+                    return false;
+            }
+        }
+
+        if (used && targetVertex == M_MAX_UNSIGNED)
+            return false;
+        targetVertices[i] = targetVertex;
+    }
+
+    // Lock the neighbourhood whose costs change for the rest of the pass
+    classLocked_[fromClass] = true;
+    classLocked_[toClass] = true;
+
+    for (unsigned i = 0; i < fromVertices.Size(); ++i)
+    {
+        unsigned vertex = fromVertices[i];
+        unsigned targetVertex = targetVertices[i];
+        const PODVector<unsigned>& triangles = vertexTriangles_[vertex];
+
+        for (unsigned j = 0; j < triangles.Size(); ++j)
+        {
+            unsigned triangle = triangles[j];
+            if (!UsesVertex(triangle, vertex))
+                continue;
+
+            bool degenerate = false;
+            for (unsigned k = 0; k < 3; ++k)
+            {
+                unsigned& index = indices_[triangle * 3 + k];
+                if (index == vertex)
+                    index = targetVertex;
+                else
+                {
+                    classLocked_[vertexClasses_[index]] = true;
+                    if (vertexClasses_[index] == toClass)
+                        degenerate = true;
+                }
+            }
+
+            if (degenerate)
+            {
+                triangleRemoved_[triangle] = true;
+                --numTriangles_;
+            }
+            else
+                vertexTriangles_[targetVertex].Push(triangle);
+        }
+
+        vertexTriangles_[vertex].Clear();
+    }
+
+    classQuadrics_[toClass] += classQuadrics_[fromClass];
+    classRemoved_[fromClass] = true;
+    return true;
+}
+
+bool MeshSimplifier::UsesVertex(unsigned triangle, unsigned vertex) const
+{
+    if (triangleRemoved_[triangle])
+        return false;
+
+    return indices_[triangle * 3] == vertex || indices_[triangle * 3 + 1] == vertex || indices_[triangle * 3 + 2] == vertex;
+}
+
+Vector3 MeshSimplifier::GetTriangleNormal(unsigned triangle, unsigned movedVertex, const Vector3& movedPosition) const
+{
+    Vector3 positions[3];
+    for (unsigned i = 0; i < 3; ++i)
+    {
+        unsigned vertex = indices_[triangle * 3 + i];
+        positions[i] = vertex == movedVertex ? movedPosition : positions_[vertex];
+    }
+
+    return (positions[1] - positions[0]).CrossProduct(positions[2] - positions[0]);
+}
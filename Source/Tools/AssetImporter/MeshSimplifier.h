@@ -0,0 +1,140 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <Clockwork/Container/Vector.h>
+#include <Clockwork/Math/Vector3.h>
+
+using namespace Clockwork;
+
+/// Symmetric 4x4 error quadric of a vertex, stored as its upper triangle.
+struct Quadric
+{
+    /// Construct with zero error.
+    Quadric()
+    {
+        for (unsigned i = 0; i < 10; ++i)
+            data_[i] = 0.0;
+    }
+
+    /// Add the squared distance to a plane, scaled by weight.
+    void AddPlane(const Vector3& normal, float distance, float weight)
+    {
+        double a = normal.x_;
+        double b = normal.y_;
+        double c = normal.z_;
+        double d = distance;
+        data_[0] += weight * a * a; data_[1] += weight * a * b; data_[2] += weight * a * c; data_[3] += weight * a * d;
+        data_[4] += weight * b * b; data_[5] += weight * b * c; data_[6] += weight * b * d;
+        data_[7] += weight * c * c; data_[8] += weight * c * d;
+        data_[9] += weight * d * d;
+    }
+
+    /// Add another quadric.
+    Quadric& operator += (const Quadric& rhs)
+    {
+        for (unsigned i = 0; i < 10; ++i)
+            data_[i] += rhs.data_[i];
+        return *this;
+    }
+
+    /// Return the error of a position.
+    double Evaluate(const Vector3& position) const
+    {
+        double x = position.x_;
+        double y = position.y_;
+        double z = position.z_;
+        return data_[0] * x * x + 2.0 * data_[1] * x * y + 2.0 * data_[2] * x * z + 2.0 * data_[3] * x +
+            data_[4] * y * y + 2.0 * data_[5] * y * z + 2.0 * data_[6] * y +
+            data_[7] * z * z + 2.0 * data_[8] * z + data_[9];
+    }
+
+    /// Quadric coefficients.
+    double data_[10];
+};
+
+/// Edge collapse considered by the mesh simplifier.
+struct EdgeCollapse
+{
+    /// Test for less than with another collapse.
+    bool operator < (const EdgeCollapse& rhs) const { return cost_ < rhs.cost_; }
+
+    /// Error introduced by the collapse.
+    double cost_;
+    /// Position class to remove.
+    unsigned from_;
+    /// Position class to collapse into.
+    unsigned to_;
+};
+
+/// Quadric error edge collapse simplifier for indexed triangle lists. Vertices that share a position are collapsed together, each into the vertex of the target position it shares an edge with, so that UV seams and other attribute splits are preserved and no new vertices are created.
+class MeshSimplifier
+{
+public:
+    /// Construct from vertex positions, triangle list indices and per-vertex skinning groups (for example the most influential bone, M_MAX_UNSIGNED if none.) Collapsing between different groups is penalized.
+    MeshSimplifier(const PODVector<Vector3>& positions, const PODVector<unsigned>& indices, const PODVector<unsigned>& skinGroups);
+
+    /// Collapse edges until the triangle count is at or below the target, or no more edges can be collapsed. Return the resulting triangle count.
+    unsigned Simplify(unsigned targetTriangles);
+    /// Return the remaining triangles as indices to the original vertices.
+    void GetIndices(PODVector<unsigned>& dest) const;
+
+    /// Return number of remaining triangles.
+    unsigned GetNumTriangles() const { return numTriangles_; }
+
+private:
+    /// Build position classes, adjacency and quadrics.
+    void Initialize();
+    /// Attempt to collapse a position class into another. Return true if successful.
+    bool Collapse(unsigned fromClass, unsigned toClass);
+    /// Return whether a triangle is still in use and references the vertex.
+    bool UsesVertex(unsigned triangle, unsigned vertex) const;
+    /// Return the unnormalized normal of a triangle, optionally with one vertex moved.
+    Vector3 GetTriangleNormal(unsigned triangle, unsigned movedVertex, const Vector3& movedPosition) const;
+
+    /// Vertex positions.
+    PODVector<Vector3> positions_;
+    /// Vertex skinning groups.
+    PODVector<unsigned> skinGroups_;
+    /// Triangle list indices.
+    PODVector<unsigned> indices_;
+    /// Triangle removed flags.
+    PODVector<bool> triangleRemoved_;
+    /// Triangles referencing each vertex. May contain stale entries.
+    Vector<PODVector<unsigned> > vertexTriangles_;
+    /// Position class of each vertex.
+    PODVector<unsigned> vertexClasses_;
+    /// Vertices of each position class.
+    Vector<PODVector<unsigned> > classVertices_;
+    /// Error quadric of each position class.
+    Vector<Quadric> classQuadrics_;
+    /// Removed flags of position classes.
+    PODVector<bool> classRemoved_;
+    /// Locked flags of position classes during a collapse pass.
+    PODVector<bool> classLocked_;
+    /// Collapse penalty for crossing skinning groups.
+    double skinPenalty_;
+    /// Number of remaining triangles.
+    unsigned numTriangles_;
+};
@@ -0,0 +1,412 @@
+//
+// Copyright (c) 2008-2015 the Clockwork project.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+
+
+#include <Clockwork/Core/Context.h>
+#include <Clockwork/Core/ProcessUtils.h>
+#include <Clockwork/Core/StringUtils.h>
+#include <Clockwork/Graphics/Geometry.h>
+#include <Clockwork/Graphics/Impostor.h>
+#include <Clockwork/Graphics/Model.h>
+#include <Clockwork/Graphics/VertexBuffer.h>
+#include <Clockwork/IO/File.h>
+#include <Clockwork/IO/FileSystem.h>
+#include <Clockwork/IO/Log.h>
+#include <Clockwork/Resource/Image.h>
+#include <Clockwork/Resource/XMLFile.h>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+#include <Clockwork/DebugNew.h>
+
+using namespace Clockwork;
+
+/// Number of passes to bleed frame colors into the uncovered texels, so that filtering and mipmaps do not darken the silhouette.
+static const unsigned DILATE_PASSES = 4;
+
+/// Vertex of a triangle to capture.
+struct CaptureVertex
+{
+    /// Model space position.
+    Vector3 position_;
+    /// Model space normal.
+    Vector3 normal_;
+    /// Texture coordinate.
+    Vector2 texCoord_;
+};
+
+SharedPtr<Context> context_(new Context());
+SharedPtr<Image> diffuseTexture_;
+SharedPtr<Image> diffuseAtlas_;
+SharedPtr<Image> normalAtlas_;
+PODVector<CaptureVertex> triangles_;
+PODVector<float> depthBuffer_;
+PODVector<unsigned char> coverage_;
+Vector3 center_;
+float size_ = 1.0f;
+unsigned numFrames_ = DEFAULT_IMPOSTOR_FRAMES;
+int frameSize_ = 128;
+bool hasTexCoords_ = false;
+
+int main(int argc, char** argv);
+void Run(const Vector<String>& arguments);
+void LoadModel(const String& fileName);
+void LoadTexture(const String& fileName);
+void CaptureFrame(unsigned index);
+void DilateFrame(unsigned index);
+void WriteOutput(const String& outputFileName, const String& resourcePrefix);
+
+int main(int argc, char** argv)
+{
+    Vector<String> arguments;
+
+    #ifdef WIN32
+    arguments = ParseArguments(GetCommandLineW());
+    #else
+    arguments = ParseArguments(argc, argv);
+    #endif
+
+    Run(arguments);
+    return 0;
+}
+
+void Run(const Vector<String>& arguments)
+{
+    if (arguments.Size() < 2)
+    {
+        ErrorExit(
+            "Usage: ImpostorGenerator <input model> <output impostor file> [options]\n\n"
+            "Renders the model from octahedrally mapped directions into diffuse and normal\n"
+            "atlases using a software rasterizer, and writes the atlases, a material and\n"
+            "the impostor definition next to the output file.\n\n"
+            "Options:\n"
+            "-f <x>  Number of frames on each atlas axis, default 8\n"
+            "-r <x>  Resolution of one frame in pixels, default 128\n"
+            "-t <x>  Diffuse texture to sample with the model's first texture coordinates\n"
+            "-p <x>  Resource name prefix for the written files, for example Impostors/\n"
+        );
+    }
+
+    context_->RegisterSubsystem(new FileSystem(context_));
+    context_->RegisterSubsystem(new Log(context_));
+
+    String textureFileName;
+    String resourcePrefix;
+
+    for (unsigned i = 2; i < arguments.Size(); ++i)
+    {
+        if (arguments[i].Length() > 1 && arguments[i][0] == '-' && i < arguments.Size() - 1)
+        {
+            String argument = arguments[i].Substring(1).ToLower();
+            String value = arguments[i + 1];
+            ++i;
+
+            if (argument == "f")
+                numFrames_ = (unsigned)Clamp((int)ToUInt(value), 1, (int)MAX_IMPOSTOR_FRAMES);
+            else if (argument == "r")
+                frameSize_ = Max(ToInt(value), 1);
+            else if (argument == "t")
+                textureFileName = value;
+            else if (argument == "p")
+                resourcePrefix = AddTrailingSlash(value);
+        }
+    }
+
+    LoadModel(arguments[0]);
+    if (!textureFileName.Empty())
+        LoadTexture(textureFileName);
+
+    int atlasSize = numFrames_ * frameSize_;
+    if (atlasSize > 4096)
+        PrintLine("Warning: atlas size " + String(atlasSize) + " exceeds 4096 pixels");
+
+    diffuseAtlas_ = new Image(context_);
+    diffuseAtlas_->SetSize(atlasSize, atlasSize, 4);
+    diffuseAtlas_->Clear(Color(1.0f, 1.0f, 1.0f, 0.0f));
+    normalAtlas_ = new Image(context_);
+    normalAtlas_->SetSize(atlasSize, atlasSize, 4);
+    normalAtlas_->Clear(Color(0.5f, 0.5f, 1.0f, 1.0f));
+
+    for (unsigned i = 0; i < numFrames_ * numFrames_; ++i)
+    {
+        CaptureFrame(i);
+        DilateFrame(i);
+    }
+
+    WriteOutput(arguments[1], resourcePrefix);
+
+    PrintLine("Finished");
+}
+
+void LoadModel(const String& fileName)
+{
+    File source(context_);
+    if (!source.Open(fileName))
+        ErrorExit("Could not open input model " + fileName);
+
+    SharedPtr<Model> model(new Model(context_));
+    if (!model->Load(source))
+        ErrorExit("Could not load input model " + fileName);
+
+    const BoundingBox& box = model->GetBoundingBox();
+    center_ = box.Center();
+    size_ = Max(box.HalfSize().Length(), M_EPSILON);
+
+    // Capture the most detailed LOD level of each geometry
+    for (unsigned i = 0; i < model->GetNumGeometries(); ++i)
+    {
+        Geometry* geometry = model->GetGeometry(i, 0);
+        if (!geometry || geometry->GetPrimitiveType() != TRIANGLE_LIST)
+            continue;
+
+        const unsigned char* vertexData;
+        const unsigned char* indexData;
+        unsigned vertexSize;
+        unsigned indexSize;
+        unsigned elementMask;
+        geometry->GetRawData(vertexData, vertexSize, indexData, indexSize, elementMask);
+        if (!vertexData || !indexData)
+        {
+            PrintLine("Skipping geometry " + String(i) + " without CPU-side data");
+            continue;
+        }
+
+        bool hasNormal = (elementMask & MASK_NORMAL) != 0;
+        bool hasTexCoord = (elementMask & MASK_TEXCOORD1) != 0;
+        unsigned normalOffset = VertexBuffer::GetElementOffset(elementMask, ELEMENT_NORMAL);
+        unsigned texCoordOffset = VertexBuffer::GetElementOffset(elementMask, ELEMENT_TEXCOORD1);
+        hasTexCoords_ |= hasTexCoord;
+
+        unsigned indexStart = geometry->GetIndexStart();
+        unsigned indexEnd = indexStart + geometry->GetIndexCount() / 3 * 3;
+        for (unsigned j = indexStart; j < indexEnd; ++j)
+        {
+            unsigned index = indexSize == sizeof(unsigned) ? ((const unsigned*)indexData)[j] :
+                ((const unsigned short*)indexData)[j];
+            const unsigned char* vertex = vertexData + index * vertexSize;
+
+            CaptureVertex v;
+            v.position_ = *((const Vector3*)vertex);
+            v.normal_ = hasNormal ? *((const Vector3*)(vertex + normalOffset)) : Vector3::ZERO;
+            v.texCoord_ = hasTexCoord ? *((const Vector2*)(vertex + texCoordOffset)) : Vector2::ZERO;
+            triangles_.Push(v);
+        }
+    }
+
+    if (triangles_.Empty())
+        ErrorExit("No triangles to capture in input model " + fileName);
+
+    PrintLine("Loaded " + String(triangles_.Size() / 3) + " triangles");
+}
+
+void LoadTexture(const String& fileName)
+{
+    File source(context_);
+    diffuseTexture_ = new Image(context_);
+    if (!source.Open(fileName) || !diffuseTexture_->Load(source))
+        ErrorExit("Could not load diffuse texture " + fileName);
+    if (diffuseTexture_->IsCompressed())
+        ErrorExit("Compressed diffuse textures are not supported");
+    if (!hasTexCoords_)
+        PrintLine("Warning: model has no texture coordinates, diffuse texture is sampled at the origin");
+}
+
+static inline float EdgeFunction(const Vector2& a, const Vector2& b, const Vector2& p)
+{
+    return (b.x_ - a.x_) * (p.y_ - a.y_) - (b.y_ - a.y_) * (p.x_ - a.x_);
+}
+
+void CaptureFrame(unsigned index)
+{
+    Vector3 direction = Impostor::GetFrameDirection(index, numFrames_);
+    Vector3 right, up;
+    Impostor::GetFrameAxes(direction, right, up);
+
+    int frameX = (index % numFrames_) * frameSize_;
+    int frameY = (index / numFrames_) * frameSize_;
+    float halfFrame = 0.5f * frameSize_;
+    float pixelScale = halfFrame / size_;
+
+    depthBuffer_.Resize(frameSize_ * frameSize_);
+    coverage_.Resize(frameSize_ * frameSize_);
+    for (unsigned i = 0; i < depthBuffer_.Size(); ++i)
+        depthBuffer_[i] = -M_INFINITY;
+    memset(&coverage_[0], 0, coverage_.Size());
+
+    for (unsigned i = 0; i < triangles_.Size(); i += 3)
+    {
+        const CaptureVertex* v = &triangles_[i];
+
+        // Orthographic projection towards -direction. Screen Y grows downward, and depth grows towards the viewer
+        Vector2 screen[3];
+        float depth[3];
+        for (unsigned j = 0; j < 3; ++j)
+        {
+            Vector3 offset = v[j].position_ - center_;
+            screen[j] = Vector2(halfFrame + offset.DotProduct(right) * pixelScale, halfFrame - offset.DotProduct(up) * pixelScale);
+            depth[j] = offset.DotProduct(direction);
+        }
+
+        float area = EdgeFunction(screen[0], screen[1], screen[2]);
+        if (Abs(area) < M_EPSILON)
+            continue;
+
+        // Without vertex normals, shade with the face normal turned towards the viewer
+        Vector3 faceNormal = (v[1].position_ - v[0].position_).CrossProduct(v[2].position_ - v[0].position_).Normalized();
+        if (faceNormal.DotProduct(direction) < 0.0f)
+            faceNormal = -faceNormal;
+
+        int minX = Max((int)floorf(Min(Min(screen[0].x_, screen[1].x_), screen[2].x_)), 0);
+        int maxX = Min((int)ceilf(Max(Max(screen[0].x_, screen[1].x_), screen[2].x_)), frameSize_ - 1);
+        int minY = Max((int)floorf(Min(Min(screen[0].y_, screen[1].y_), screen[2].y_)), 0);
+        int maxY = Min((int)ceilf(Max(Max(screen[0].y_, screen[1].y_), screen[2].y_)), frameSize_ - 1);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            for (int x = minX; x <= maxX; ++x)
+            {
+                Vector2 pixel(x + 0.5f, y + 0.5f);
+                float w0 = EdgeFunction(screen[1], screen[2], pixel) / area;
+                float w1 = EdgeFunction(screen[2], screen[0], pixel) / area;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                unsigned pixelIndex = y * frameSize_ + x;
+                float pixelDepth = w0 * depth[0] + w1 * depth[1] + w2 * depth[2];
+                if (pixelDepth <= depthBuffer_[pixelIndex])
+                    continue;
+                depthBuffer_[pixelIndex] = pixelDepth;
+                coverage_[pixelIndex] = 1;
+
+                Color diffuse = Color::WHITE;
+                if (diffuseTexture_)
+                {
+                    Vector2 uv = v[0].texCoord_ * w0 + v[1].texCoord_ * w1 + v[2].texCoord_ * w2;
+                    diffuse = diffuseTexture_->GetPixelBilinear(uv.x_ - floorf(uv.x_), uv.y_ - floorf(uv.y_));
+                }
+                diffuse.a_ = 1.0f;
+
+                Vector3 normal = v[0].normal_ * w0 + v[1].normal_ * w1 + v[2].normal_ * w2;
+                normal = normal.LengthSquared() > M_EPSILON ? normal.Normalized() : faceNormal;
+                // Store in the tangent space of the frame quad: tangent = right, bitangent = up, normal = direction
+                Vector3 tangentNormal(normal.DotProduct(right), normal.DotProduct(up), normal.DotProduct(direction));
+                Color encoded(tangentNormal.x_ * 0.5f + 0.5f, tangentNormal.y_ * 0.5f + 0.5f, tangentNormal.z_ * 0.5f + 0.5f);
+
+                diffuseAtlas_->SetPixel(frameX + x, frameY + y, diffuse);
+                normalAtlas_->SetPixel(frameX + x, frameY + y, encoded);
+            }
+        }
+    }
+}
+
+void DilateFrame(unsigned index)
+{
+    int frameX = (index % numFrames_) * frameSize_;
+    int frameY = (index / numFrames_) * frameSize_;
+    PODVector<unsigned char> newCoverage;
+
+    for (unsigned pass = 0; pass < DILATE_PASSES; ++pass)
+    {
+        newCoverage = coverage_;
+
+        for (int y = 0; y < frameSize_; ++y)
+        {
+            for (int x = 0; x < frameSize_; ++x)
+            {
+                if (coverage_[y * frameSize_ + x])
+                    continue;
+
+                Color diffuseSum(0.0f, 0.0f, 0.0f, 0.0f);
+                Color normalSum(0.0f, 0.0f, 0.0f, 0.0f);
+                unsigned count = 0;
+                for (int dy = -1; dy <= 1; ++dy)
+                {
+                    for (int dx = -1; dx <= 1; ++dx)
+                    {
+                        int nx = x + dx;
+                        int ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= frameSize_ || ny >= frameSize_ || !coverage_[ny * frameSize_ + nx])
+                            continue;
+                        diffuseSum = diffuseSum + diffuseAtlas_->GetPixel(frameX + nx, frameY + ny);
+                        normalSum = normalSum + normalAtlas_->GetPixel(frameX + nx, frameY + ny);
+                        ++count;
+                    }
+                }
+
+                if (count)
+                {
+                    float invCount = 1.0f / count;
+                    // Keep alpha at zero so that the alpha mask still clips the bled texels
+                    diffuseAtlas_->SetPixel(frameX + x, frameY + y, Color(diffuseSum.r_ * invCount, diffuseSum.g_ * invCount,
+                        diffuseSum.b_ * invCount, 0.0f));
+                    normalAtlas_->SetPixel(frameX + x, frameY + y, Color(normalSum.r_ * invCount, normalSum.g_ * invCount,
+                        normalSum.b_ * invCount));
+                    newCoverage[y * frameSize_ + x] = 1;
+                }
+            }
+        }
+
+        coverage_ = newCoverage;
+    }
+}
+
+void WriteOutput(const String& outputFileName, const String& resourcePrefix)
+{
+    String basePath = GetPath(outputFileName) + GetFileName(outputFileName);
+    String diffuseFileName = basePath + "Diffuse.png";
+    String normalFileName = basePath + "Normal.png";
+    String materialFileName = basePath + "Material.xml";
+
+    if (!diffuseAtlas_->SavePNG(diffuseFileName))
+        ErrorExit("Could not write diffuse atlas " + diffuseFileName);
+    if (!normalAtlas_->SavePNG(normalFileName))
+        ErrorExit("Could not write normal atlas " + normalFileName);
+
+    SharedPtr<XMLFile> materialXml(new XMLFile(context_));
+    XMLElement materialElem = materialXml->CreateRoot("material");
+    materialElem.CreateChild("technique").SetAttribute("name", "Techniques/DiffNormalAlphaMask.xml");
+    XMLElement diffuseElem = materialElem.CreateChild("texture");
+    diffuseElem.SetAttribute("unit", "diffuse");
+    diffuseElem.SetAttribute("name", resourcePrefix + GetFileNameAndExtension(diffuseFileName));
+    XMLElement normalElem = materialElem.CreateChild("texture");
+    normalElem.SetAttribute("unit", "normal");
+    normalElem.SetAttribute("name", resourcePrefix + GetFileNameAndExtension(normalFileName));
+
+    File materialFile(context_);
+    if (!materialFile.Open(materialFileName, FILE_WRITE) || !materialXml->Save(materialFile))
+        ErrorExit("Could not write material " + materialFileName);
+
+    // Same format as Impostor::Save(), written directly so that no material resource needs to be created
+    SharedPtr<XMLFile> impostorXml(new XMLFile(context_));
+    XMLElement rootElem = impostorXml->CreateRoot("impostor");
+    rootElem.CreateChild("material").SetAttribute("name", resourcePrefix + GetFileNameAndExtension(materialFileName));
+    rootElem.CreateChild("frames").SetUInt("value", numFrames_);
+    rootElem.CreateChild("center").SetVector3("value", center_);
+    rootElem.CreateChild("size").SetFloat("value", size_);
+
+    File impostorFile(context_);
+    if (!impostorFile.Open(outputFileName, FILE_WRITE) || !impostorXml->Save(impostorFile))
+        ErrorExit("Could not write impostor " + outputFileName);
+}
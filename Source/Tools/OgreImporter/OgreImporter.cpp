@@ -24,6 +24,7 @@
 #include <Clockwork/Core/ProcessUtils.h>
 #include <Clockwork/Core/StringUtils.h>
 #include <Clockwork/Graphics/Tangent.h>
+#include <Clockwork/Graphics/VertexCache.h>
 #include <Clockwork/IO/File.h>
 #include <Clockwork/IO/FileSystem.h>
 #include <Clockwork/Resource/XMLFile.h>
@@ -36,8 +37,6 @@
 
 #include <Clockwork/DebugNew.h>
 
-static const int VERTEX_CACHE_SIZE = 32;
-
 SharedPtr<Context> context_(new Context());
 SharedPtr<XMLFile> meshFile_(new XMLFile(context_));
 SharedPtr<XMLFile> skelFile_(new XMLFile(context_));
@@ -59,7 +58,6 @@ void LoadSkeleton(const String& skeletonFileName);
 void LoadMesh(const String& inputFileName, bool generateTangents, bool splitSubMeshes, bool exportMorphs);
 void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotationsOnly, bool saveMaterialList);
 void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib);
-void CalculateScore(ModelVertex& vertex);
 String SanitateAssetName(const String& name);
 
 int main(int argc, char** argv)
@@ -1060,167 +1058,13 @@ void WriteOutput(const String& outputFileName, bool exportAnimations, bool rotat
 
 void OptimizeIndices(ModelSubGeometryLodLevel* subGeom, ModelVertexBuffer* vb, ModelIndexBuffer* ib)
 {
-    PODVector<Triangle> oldTriangles;
-    PODVector<Triangle> newTriangles;
-
     if (subGeom->indexCount_ % 3)
     {
         PrintLine("Index count is not divisible by 3, skipping index optimization");
         return;
     }
 
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-    {
-        vb->vertices_[i].useCount_ = 0;
-        vb->vertices_[i].cachePosition_ = -1;
-    }
-
-    for (unsigned i = subGeom->indexStart_; i < subGeom->indexStart_ + subGeom->indexCount_; i += 3)
-    {
-        Triangle triangle;
-        triangle.v0_ = ib->indices_[i];
-        triangle.v1_ = ib->indices_[i + 1];
-        triangle.v2_ = ib->indices_[i + 2];
-        vb->vertices_[triangle.v0_].useCount_++;
-        vb->vertices_[triangle.v1_].useCount_++;
-        vb->vertices_[triangle.v2_].useCount_++;
-        oldTriangles.Push(triangle);
-    }
-
-    for (unsigned i = 0; i < vb->vertices_.Size(); ++i)
-        CalculateScore(vb->vertices_[i]);
-
-    PODVector<unsigned> vertexCache;
-
-    while (oldTriangles.Size())
-    {
-        unsigned bestTriangle = M_MAX_UNSIGNED;
-        float bestTriangleScore = -1.0f;
-
-        // Find the best triangle at this point
-        for (unsigned i = 0; i < oldTriangles.Size(); ++i)
-        {
-            Triangle& triangle = oldTriangles[i];
-            float triangleScore =
-                vb->vertices_[triangle.v0_].score_ +
-                vb->vertices_[triangle.v1_].score_ +
-                vb->vertices_[triangle.v2_].score_;
-
-            if (triangleScore > bestTriangleScore)
-            {
-                bestTriangle = i;
-                bestTriangleScore = triangleScore;
-            }
-        }
-
-        if (bestTriangle == M_MAX_UNSIGNED)
-        {
-            PrintLine("Could not find next triangle, aborting index optimization");
-            return;
-        }
-
-        // Add the best triangle
-        Triangle triangleCopy = oldTriangles[bestTriangle];
-        newTriangles.Push(triangleCopy);
-        oldTriangles.Erase(oldTriangles.Begin() + bestTriangle);
-
-        // Reduce the use count
-        vb->vertices_[triangleCopy.v0_].useCount_--;
-        vb->vertices_[triangleCopy.v1_].useCount_--;
-        vb->vertices_[triangleCopy.v2_].useCount_--;
-
-        // Model the LRU cache behaviour
-        // Erase the triangle vertices from the middle of the cache, if they were there
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
-        {
-            if ((vertexCache[i] == triangleCopy.v0_) ||
-                (vertexCache[i] == triangleCopy.v1_) ||
-                (vertexCache[i] == triangleCopy.v2_))
-            {
-                vertexCache.Erase(vertexCache.Begin() + i);
-                --i;
-            }
-        }
-
-        // Then push them to the front
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v0_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v1_);
-        vertexCache.Insert(vertexCache.Begin(), triangleCopy.v2_);
-
-        // Update positions & scores of all vertices in the cache
-        // Give position -1 if vertex is going to be erased
-        for (unsigned i = 0; i < vertexCache.Size(); ++i)
-        {
-            ModelVertex& vertex = vb->vertices_[vertexCache[i]];
-            if (i >= VERTEX_CACHE_SIZE)
-                vertex.cachePosition_ = -1;
-            else
-                vertex.cachePosition_ = i;
-            CalculateScore(vertex);
-        }
-
-        // Finally erase the extra vertices
-        if (vertexCache.Size() > VERTEX_CACHE_SIZE)
-            vertexCache.Resize(VERTEX_CACHE_SIZE);
-    }
-
-    // Rewrite the index data now
-    unsigned i = subGeom->indexStart_;
-    for (unsigned j = 0; j < newTriangles.Size(); ++j)
-    {
-        ib->indices_[i++] = newTriangles[j].v0_;
-        ib->indices_[i++] = newTriangles[j].v1_;
-        ib->indices_[i++] = newTriangles[j].v2_;
-    }
-}
-
-void CalculateScore(ModelVertex& vertex)
-{
-    // Linear-Speed Vertex Cache Optimisation by Tom Forsyth from
-    // http://home.comcast.net/~tom_forsyth/papers/fast_vert_cache_opt.html
-    const float cacheDecayPower = 1.5f;
-    const float lastTriScore = 0.75f;
-    const float valenceBoostScale = 2.0f;
-    const float valenceBoostPower = 0.5f;
-
-    if (vertex.useCount_ == 0)
-    {
-        // No tri needs this vertex!
-        vertex.score_ = -1.0f;
-        return;
-    }
-
-    float score = 0.0f;
-    int cachePosition = vertex.cachePosition_;
-    if (cachePosition < 0)
-    {
-        // Vertex is not in FIFO cache - no score.
-    }
-    else
-    {
-        if (cachePosition < 3)
-        {
-            // This vertex was used in the last triangle,
-            // so it has a fixed score, whichever of the three
-            // it's in. Otherwise, you can get very different
-            // answers depending on whether you add
-            // the triangle 1,2,3 or 3,1,2 - which is silly.
-            score = lastTriScore;
-        }
-        else
-        {
-            // Points for being high in the cache.
-            const float scaler = 1.0f / (VERTEX_CACHE_SIZE - 3);
-            score = 1.0f - (cachePosition - 3) * scaler;
-            score = powf(score, cacheDecayPower);
-        }
-    }
-
-    // Bonus points for having a low number of tris still to
-    // use the vert, so we get rid of lone verts quickly.
-    float valenceBoost = powf((float)vertex.useCount_, -valenceBoostPower);
-    score += valenceBoostScale * valenceBoost;
-    vertex.score_ = score;
+    OptimizeVertexCache(&ib->indices_[0], sizeof(unsigned), subGeom->indexStart_, subGeom->indexCount_);
 }
 
 String SanitateAssetName(const String& name)